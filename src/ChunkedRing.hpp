@@ -0,0 +1,321 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef CHUNKEDRING_HPP_
+#define CHUNKEDRING_HPP_
+
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/* A FIFO container of values that are stored in fixed-size chunks of contiguous slots.
+ * Values are appended to the back and are erased either from the front or at arbitrary
+ * positions. It satisfies the requirements Scrobbler has to ScrobbleQueue.
+ *
+ * Erasing a value leaves a tombstone in its slot instead of shifting the values that follow it,
+ * so erasing is O(1) and does not invalidate references to other values. Appending does not
+ * invalidate references either. Tombstones are reclaimed lazily: the leading ones of a chunk
+ * are skipped once and for all, and a chunk that has no values left is unlinked and reused
+ * for the next chunk appended, so a queue that is consumed at the rate it is filled allocates
+ * no memory.
+ */
+template<typename T, std::size_t chunkCapacity = 64>
+class ChunkedRing
+{
+	static_assert(chunkCapacity > 0, "A chunk must have at least one slot.");
+
+	ChunkedRing(const ChunkedRing &) = delete;
+	ChunkedRing &operator=(const ChunkedRing &) = delete;
+
+	struct Chunk
+	{
+		Chunk() noexcept : prev(nullptr), next(nullptr), begin(0), end(0), liveCount(0) {}
+
+		T *slot(const std::size_t i) noexcept { return std::launder(reinterpret_cast<T *>(storage[i])); }
+
+		Chunk *prev;
+		Chunk *next;
+		// The slots before begin and starting with end hold no values. The slot begin always holds one.
+		std::size_t begin;
+		std::size_t end;
+		std::size_t liveCount;
+		// Indicates if a slot holds a value or a tombstone.
+		bool live[chunkCapacity];
+		alignas(T) unsigned char storage[chunkCapacity][sizeof(T)];
+	};
+
+	template<bool constant>
+	class Iterator
+	{
+		friend class ChunkedRing;
+		friend class Iterator<!constant>;
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef typename std::conditional<constant, const T *, T *>::type pointer;
+		typedef typename std::conditional<constant, const T &, T &>::type reference;
+
+		Iterator() noexcept : m_chunk(nullptr), m_slot(0) {}
+
+		// A mutable iterator is convertible to a constant one.
+		template<bool otherConstant, typename = typename std::enable_if<constant && !otherConstant>::type>
+		Iterator(const Iterator<otherConstant> &other) noexcept : m_chunk(other.m_chunk), m_slot(other.m_slot) {}
+
+		reference operator*() const noexcept { return *m_chunk->slot(m_slot); }
+		pointer operator->() const noexcept { return m_chunk->slot(m_slot); }
+
+		Iterator &operator++() noexcept
+		{
+			++m_slot;
+			skipTombstones();
+			return *this;
+		}
+
+		Iterator operator++(int) noexcept
+		{
+			const Iterator result(*this);
+			++*this;
+			return result;
+		}
+
+		Iterator &operator--() noexcept
+		{
+			do {
+				if (m_slot == m_chunk->begin) {
+					m_chunk = m_chunk->prev;
+					m_slot = m_chunk->end;
+				}
+				--m_slot;
+			} while (!m_chunk->live[m_slot]);
+			return *this;
+		}
+
+		Iterator operator--(int) noexcept
+		{
+			const Iterator result(*this);
+			--*this;
+			return result;
+		}
+
+		friend bool operator==(const Iterator &left, const Iterator &right) noexcept
+		{
+			return left.m_chunk == right.m_chunk && left.m_slot == right.m_slot;
+		}
+
+		friend bool operator!=(const Iterator &left, const Iterator &right) noexcept { return !(left == right); }
+	private:
+		Iterator(Chunk * const chunk, const std::size_t slot) noexcept : m_chunk(chunk), m_slot(slot) {}
+
+		// Moves this iterator to the first value at or after its position, or to the end.
+		void skipTombstones() noexcept
+		{
+			while (m_slot != m_chunk->end && !m_chunk->live[m_slot]) {
+				++m_slot;
+			}
+			if (m_slot == m_chunk->end && m_chunk->next != nullptr) {
+				m_chunk = m_chunk->next;
+				m_slot = m_chunk->begin;
+			}
+		}
+
+		Chunk *m_chunk;
+		std::size_t m_slot;
+	};
+public:
+	typedef T value_type;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef Iterator<false> iterator;
+	typedef Iterator<true> const_iterator;
+
+	ChunkedRing() noexcept : m_head(nullptr), m_tail(nullptr), m_spare(nullptr), m_size(0) {}
+
+	ChunkedRing(ChunkedRing &&other) noexcept
+		: m_head(other.m_head), m_tail(other.m_tail), m_spare(other.m_spare), m_size(other.m_size)
+	{
+		other.m_head = nullptr;
+		other.m_tail = nullptr;
+		other.m_spare = nullptr;
+		other.m_size = 0;
+	}
+
+	ChunkedRing &operator=(ChunkedRing &&other) noexcept
+	{
+		swap(other);
+		return *this;
+	}
+
+	~ChunkedRing()
+	{
+		clear();
+		delete m_spare;
+	}
+
+	bool empty() const noexcept { return m_size == 0; }
+	size_type size() const noexcept { return m_size; }
+
+	iterator begin() noexcept { return m_head == nullptr ? iterator() : iterator(m_head, m_head->begin); }
+	const_iterator begin() const noexcept
+	{
+		return m_head == nullptr ? const_iterator() : const_iterator(m_head, m_head->begin);
+	}
+	const_iterator cbegin() const noexcept { return begin(); }
+	iterator end() noexcept { return m_tail == nullptr ? iterator() : iterator(m_tail, m_tail->end); }
+	const_iterator end() const noexcept
+	{
+		return m_tail == nullptr ? const_iterator() : const_iterator(m_tail, m_tail->end);
+	}
+	const_iterator cend() const noexcept { return end(); }
+
+	reference front() noexcept { return *begin(); }
+	const_reference front() const noexcept { return *begin(); }
+	reference back() noexcept { return *std::prev(end()); }
+	const_reference back() const noexcept { return *std::prev(end()); }
+
+	template<typename... Args>
+	void emplace_back(Args &&...args)
+	{
+		if (m_tail == nullptr || m_tail->end == chunkCapacity) {
+			appendChunk();
+		}
+		Chunk &chunk = *m_tail;
+		new (chunk.storage[chunk.end]) T(std::forward<Args>(args)...);
+		chunk.live[chunk.end] = true;
+		++chunk.end;
+		++chunk.liveCount;
+		++m_size;
+	}
+
+	void push_back(T &&value) { emplace_back(std::move(value)); }
+	void push_back(const T &value) { emplace_back(value); }
+	void pop_back() { erase(std::prev(cend())); }
+
+	// Only appending is supported, i.e. pos must be the end of this container.
+	template<typename InputIterator>
+	void insert(const const_iterator pos, InputIterator first, const InputIterator last)
+	{
+		assert(pos == cend());
+		(void) pos;
+		for (; first != last; ++first) {
+			emplace_back(*first);
+		}
+	}
+
+	// Erases a given value, leaving a tombstone in its slot.
+	iterator erase(const const_iterator pos) noexcept
+	{
+		Chunk * const chunk = pos.m_chunk;
+		const std::size_t slot = pos.m_slot;
+		assert(chunk->live[slot]);
+
+		chunk->slot(slot)->~T();
+		chunk->live[slot] = false;
+		--chunk->liveCount;
+		--m_size;
+
+		if (chunk->liveCount == 0) {
+			Chunk * const next = chunk->next;
+			unlinkChunk(chunk);
+			return next == nullptr ? end() : iterator(next, next->begin);
+		}
+		if (slot == chunk->begin) {
+			do {
+				++chunk->begin;
+			} while (!chunk->live[chunk->begin]);
+		}
+		iterator result(chunk, slot);
+		++result;
+		return result;
+	}
+
+	iterator erase(const const_iterator first, const const_iterator last) noexcept
+	{
+		iterator it(first.m_chunk, first.m_slot);
+		for (difference_type count = std::distance(first, last); count != 0; --count) {
+			it = erase(it);
+		}
+		return it;
+	}
+
+	void clear() noexcept
+	{
+		while (m_head != nullptr) {
+			Chunk &chunk = *m_head;
+			for (std::size_t i = chunk.begin; i != chunk.end; ++i) {
+				if (chunk.live[i]) {
+					chunk.slot(i)->~T();
+				}
+			}
+			unlinkChunk(&chunk);
+		}
+		m_size = 0;
+	}
+
+	void swap(ChunkedRing &other) noexcept
+	{
+		std::swap(m_head, other.m_head);
+		std::swap(m_tail, other.m_tail);
+		std::swap(m_spare, other.m_spare);
+		std::swap(m_size, other.m_size);
+	}
+private:
+	void appendChunk()
+	{
+		Chunk *chunk;
+		if (m_spare != nullptr) {
+			chunk = m_spare;
+			m_spare = nullptr;
+			chunk->begin = 0;
+			chunk->end = 0;
+		} else {
+			chunk = new Chunk();
+		}
+		chunk->prev = m_tail;
+		chunk->next = nullptr;
+		if (m_tail == nullptr) {
+			m_head = chunk;
+		} else {
+			m_tail->next = chunk;
+		}
+		m_tail = chunk;
+	}
+
+	// Unlinks a chunk that holds no values and keeps it as the spare one if there is none.
+	void unlinkChunk(Chunk * const chunk) noexcept
+	{
+		(chunk->prev == nullptr ? m_head : chunk->prev->next) = chunk->next;
+		(chunk->next == nullptr ? m_tail : chunk->next->prev) = chunk->prev;
+		if (m_spare == nullptr) {
+			chunk->liveCount = 0;
+			m_spare = chunk;
+		} else {
+			delete chunk;
+		}
+	}
+
+	Chunk *m_head;
+	Chunk *m_tail;
+	// The chunk that is reused by appendChunk() so that a steady queue does not allocate memory.
+	Chunk *m_spare;
+	size_type m_size;
+};
+
+#endif /* CHUNKEDRING_HPP_ */
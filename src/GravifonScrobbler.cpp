@@ -16,6 +16,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 #include "GravifonScrobbler.hpp"
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <memory>
 #include <vector>
 
 #include <afc/base64.hpp>
@@ -41,6 +43,19 @@ using StatusCode = HttpClient::StatusCode;
 
 namespace
 {
+	/* The calls that exceed these limits fail, and are retried as any other failed call.
+	 * A batch of scrobbles can take a while to be processed, so the response is waited for
+	 * longer than by Last.fm. The stall detection covers waiting for the response, so it is
+	 * longer than firstByte for the latter to have effect.
+	 */
+	constexpr HttpTimeouts gravifonTimeouts = {
+		std::chrono::seconds(10), // connect
+		std::chrono::seconds(10), // tls
+		std::chrono::seconds(30), // firstByte
+		std::chrono::seconds(120), // total
+		1, std::chrono::seconds(40) // stallSpeed, stallTime
+	};
+
 	class ErrorHandler
 	{
 	public:
@@ -200,6 +215,9 @@ namespace
 		case StatusCode::OPERATION_TIMEOUT:
 			message = "sending the scrobble message has timed out";
 			break;
+		case StatusCode::STALLED:
+			message = "the connection has stalled";
+			break;
 		default:
 			message = "unknown error";
 		}
@@ -212,6 +230,193 @@ namespace
 	}
 }
 
+class GravifonScrobbler::Call final : public HttpCall
+{
+public:
+	Call(GravifonScrobbler &owner, std::vector<const ScrobbleInfo *> &&batch)
+		: batch(std::move(batch)), completedFlags(this->batch.size(), false), m_owner(owner), m_prepared(false),
+		  m_body(this->batch), m_request(), m_responseBody(), m_responseBodyAppender(m_responseBody),
+		  m_response(m_responseBodyAppender) {}
+
+	/* Builds the request that submits the batch. The body is measured by the reactor once the call
+	 * is started, and is encoded while the request is sent.
+	 *
+	 * It is executed within lock on m_mutex.
+	 */
+	void prepare(const afc::String &scrobblerUrl, const afc::String &authHeader);
+	bool prepared() const noexcept { return m_prepared; }
+
+	/* Marks the scrobbles of the batch that are completed (successfully or as non-processable)
+	 * as the response tells. The scrobbles of a batch that is not submitted are left unmarked.
+	 *
+	 * It is executed outside lock on m_mutex.
+	 */
+	void processResponse(StatusCode result);
+
+	virtual void completed(const StatusCode result) override { m_owner.callCompleted(*this, result); }
+
+	const std::vector<const ScrobbleInfo *> batch;
+	// Indicates for each scrobble of the batch if it is completed.
+	std::vector<bool> completedFlags;
+private:
+	/* Encodes the batch as a JSON array, a scrobble at a time. It is invoked by the reactor thread,
+	 * outside lock on m_mutex while the request is sent. It is safe since other threads cannot modify
+	 * or delete the scrobbles of the batch until the call is completed (see Scrobbler::collectBatch()).
+	 */
+	class Body final : public PieceBodyProducer
+	{
+	public:
+		explicit Body(const std::vector<const ScrobbleInfo *> &batch) : m_batch(batch) {}
+	protected:
+		virtual bool encodePiece(const std::size_t index, afc::FastStringBuffer<char> &dest) override
+		{
+			if (index == m_batch.size()) {
+				return false;
+			}
+			dest.reserveForOne();
+			dest.append(index == 0 ? '[' : ',');
+			appendAsJson(*m_batch[index], dest);
+			if (index + 1 == m_batch.size()) {
+				dest.reserveForOne();
+				dest.append(']');
+			}
+			return true;
+		}
+	private:
+		const std::vector<const ScrobbleInfo *> &m_batch;
+	};
+
+	GravifonScrobbler &m_owner;
+	bool m_prepared;
+	// The request body producer must live until the call is completed.
+	Body m_body;
+	HttpRequest m_request;
+	afc::FastStringBuffer<char> m_responseBody;
+	FastStringBufferAppender m_responseBodyAppender;
+	HttpResponse m_response;
+};
+
+GravifonScrobbler::GravifonScrobbler() : Scrobbler(maxScrobblesPerRequest), m_scrobblerUrl(), m_authHeader(),
+		m_dataFilePath(), m_calls(), m_callsInProgress(0)
+{ std::lock_guard<std::mutex> lock(m_mutex); // synchronising memory
+	/* This instance is partially initialised here. It will be initialised completely
+	 * when ::start() is invoked successfully.
+	 */
+}
+
+GravifonScrobbler::~GravifonScrobbler()
+{
+	// Synchronising memory before destructing the member fields of this GravifonScrobbler.
+	std::lock_guard<std::mutex> lock(m_mutex);
+}
+
+void GravifonScrobbler::Call::prepare(const afc::String &scrobblerUrl, const afc::String &authHeader)
+{
+	assert(!batch.empty());
+
+	m_request.setBody(m_body);
+	m_request.headers.reserve(4);
+	// Curl copies the headers when the call is prepared.
+	m_request.headers.push_back(authHeader.c_str());
+	// Curl expects the basic charset in headers.
+	m_request.headers.push_back("Content-Type: application/json; charset=utf-8");
+	m_request.headers.push_back("Accept: application/json");
+	m_request.headers.push_back("Accept-Charset: utf-8");
+
+	// The call is also aborted when this Scrobbler is stopped, regardless of the timeouts.
+	const StatusCode result = HttpClient().preparePost(*this, scrobblerUrl.c_str(), m_request, m_response,
+			gravifonTimeouts);
+	if (result != StatusCode::SUCCESS) {
+		reportHttpClientError(result);
+		return;
+	}
+	m_prepared = true;
+}
+
+void GravifonScrobbler::Call::processResponse(const StatusCode result)
+{
+	if (result == StatusCode::ABORTED_BY_CLIENT) {
+		logDebug("[GravifonScrobbler] An HTTP call is aborted."_s);
+		return;
+	}
+	if (result != StatusCode::SUCCESS) {
+		reportHttpClientError(result);
+		return;
+	}
+
+	logDebug("[GravifonScrobbler] Response status code: '"_s, m_response.statusCode, "#'."_s);
+
+	const afc::FastStringBuffer<char> &responseBody = m_responseBody;
+	const size_t submittedCount = batch.size();
+	ErrorHandler errorHandler;
+	if (m_response.statusCode != 200) {
+		// A global status entity is expected for a non-200 response.
+		RawResponseRecord record;
+		const char * p = parseResponseRecord(responseBody.begin(), responseBody.end(), errorHandler, record);
+		if (!errorHandler.valid() || p != responseBody.end()) {
+			logError("[GravifonScrobbler] Invalid response: "_s,
+					std::make_pair(responseBody.begin(), responseBody.end()));
+			return;
+		}
+
+		if (record.success) {
+			logError("[GravifonScrobbler] Unexpected 'ok' global status response: '"_s,
+					std::make_pair(responseBody.begin(), responseBody.end()), "'."_s);
+		} else {
+			logError("[GravifonScrobbler] Error global status response: '"_s,
+					std::make_pair(responseBody.begin(), responseBody.end()), "'. "
+					"Error: '"_s, std::make_pair(record.errorDescBegin, record.errorDescEnd), "' ("_s,
+					record.errorCode, ")."_s);
+		}
+		return;
+	}
+
+	std::vector<RawResponseRecord> records;
+	records.reserve(submittedCount);
+	const char * p = parseOKResponse(responseBody.begin(), responseBody.end(), errorHandler, records);
+	// An array of status entities is expected for a 200 response, one per scrobble submitted.
+	if (!errorHandler.valid() || p != responseBody.end()
+			|| records.size() != submittedCount) {
+		logError("[GravifonScrobbler] Invalid response: "_s,
+				std::make_pair(responseBody.begin(), responseBody.end()));
+		return;
+	}
+
+	bool allCompleted = true;
+	for (size_t i = 0; i < submittedCount; ++i) {
+		const RawResponseRecord &record = records[i];
+		if (record.success) {
+			// Successful status: if the track is scrobbled successfully then it is removed from the list.
+			completedFlags[i] = true;
+			continue;
+		}
+
+		/* Error status. If the error is unprocessable then the scrobble is removed from the list;
+		 * otherwise another attempt will be done to submit it.
+		 */
+		const unsigned long errorCode = record.errorCode;
+		afc::FastStringBuffer<char, afc::AllocMode::accurate> scrobbleAsStr = serialiseAsJson(*batch[i]);
+		if (isRecoverableError(errorCode)) {
+			logError("[GravifonScrobbler] Scrobble '"_s,
+					std::make_pair(scrobbleAsStr.begin(), scrobbleAsStr.end()), "' is not processed. "
+					"Error: '"_s, std::make_pair(record.errorDescBegin, record.errorDescEnd), "' ("_s,
+					errorCode, "). It will be re-submitted later."_s);
+			allCompleted = false;
+		} else {
+			logError("[GravifonScrobbler] Scrobble '"_s,
+					std::make_pair(scrobbleAsStr.begin(), scrobbleAsStr.end()), "' cannot be processed. "
+					"Error: '"_s, std::make_pair(record.errorDescBegin, record.errorDescEnd), "' ("_s,
+					errorCode, "). It is removed as non-processable."_s);
+			completedFlags[i] = true;
+		}
+	}
+
+	if (allCompleted) {
+		logDebug("[GravifonScrobbler] Successful response: "_s,
+				std::make_pair(responseBody.begin(), responseBody.end()));
+	}
+}
+
 void GravifonScrobbler::stopExtra()
 {
 	m_scrobblerUrl.clear();
@@ -254,7 +459,7 @@ void GravifonScrobbler::configure(const char * const serverUrl, const std::size_
 			authHeader.begin(), authHeader.size());
 
 	if (!sameScrobblerUrl || !sameAuthHeader) {
-		// The configuration has changed. Updating it as well as resetting the 'scrobbles to wait' counter.
+		// The configuration has changed. Updating it as well as re-submitting pending scrobbles at once.
 		if (!sameScrobblerUrl) {
 			const std::size_t urlSize = tmpUrl.size();
 			m_scrobblerUrl.attach(tmpUrl.detach(), urlSize);
@@ -262,20 +467,22 @@ void GravifonScrobbler::configure(const char * const serverUrl, const std::size_
 		if (!sameAuthHeader) {
 			m_authHeader.attach(authHeader.detach(), authHeaderSize);
 		}
-		m_scrobblesToWait = minScrobblesToWait();
+		resetRetryDelay();
 	}
 
 	m_configured = true;
 }
 
-size_t GravifonScrobbler::doScrobbling()
+void GravifonScrobbler::startScrobbling()
 {
 	assertLocked();
 	assert(!m_pendingScrobbles.empty());
+	assert(m_calls.empty());
 
 	if (unlikely(!m_configured)) {
 		logError("Scrobbler is not configured properly."_s);
-		return 0;
+		attemptFinished(0);
+		return;
 	}
 
 	if (m_scrobblerUrl.empty()) {
@@ -285,155 +492,83 @@ size_t GravifonScrobbler::doScrobbling()
 		 * the URL is configured to point to a scrobbling server.
 		 */
 		logError("URL to the scrobbling server is undefined."_s);
-		return 0;
-	}
-
-	afc::FastStringBuffer<char> body(127); // 127 is a reasonable starting capacity.
-	body.append('['); // Space is known to be reserved.
-
-	afc::FastStringBuffer<char> buf;
-	// Adding up to 20 scrobbles to the request.
-	// 20 is the max number of scrobbles in a single request.
-	unsigned submittedCount = 0;
-	for (auto it = m_pendingScrobbles.begin(), end = m_pendingScrobbles.end();
-			submittedCount < 20 && it != end; ++submittedCount, ++it) {
-		appendAsJson(*it, body);
-		body.reserveForOne();
-		body.append(',');
+		attemptFinished(0);
+		return;
 	}
-	*(body.end() - 1) = ']'; // Removing the redundant comma at the same time.
 
-	HttpRequest request;
-	request.setBody(body.data(), body.size());
-	request.headers.reserve(4);
-	request.headers.push_back(m_authHeader.c_str());
-	// Curl expects the basic charset in headers.
-	request.headers.push_back("Content-Type: application/json; charset=utf-8");
-	request.headers.push_back("Accept: application/json");
-	request.headers.push_back("Accept-Charset: utf-8");
-
-	// Making a copy of shared data to pass outside the critical section.
-	afc::String scrobblerUrlCopy(m_scrobblerUrl);
-
-#ifndef NDEBUG
-	const size_t pendingScrobbleCount = m_pendingScrobbles.size();
-#endif
-
-	afc::FastStringBuffer<char> responseBody;
-	FastStringBufferAppender responseBodyAppender(responseBody);
-	StatusCode result;
-	HttpResponse response(responseBodyAppender);
-
-	/* Each HTTP call is performed outside the critical section so that other threads can:
-	 * - add scrobbles without waiting for this call to finish
-	 * - stop this Scrobbler by invoking Scrobbler::stop(). In this case this HTTP call
-	 * is aborted and the scrobbles involved are left in the list of pending scrobbles
-	 * so that they can be stored to the data file and be completed later.
-	 *
-	 * It is safe to unlock the mutex because:
-	 * - no shared data is accessed outside the critical section
-	 * - other threads cannot delete scrobbles in the meantime (because the scrobbling thread
-	 * assumes that the scrobbles being submitted are the first {submittedCount} elements in
-	 * the list of pending scrobbles.
-	 *
-	 * In addition, it is safe to use m_finishScrobblingFlag outside the critical section
-	 * because it is atomic.
+	/* Up to maxScrobblesPerRequest leading scrobbles are submitted within each request. Gravifon
+	 * processes each scrobble independently of the others so the requests can be in flight at once.
 	 */
-	{ UnlockGuard unlockGuard(m_mutex);
-		logDebug("[LastfmScrobbler] Request body: "_s,
-				std::pair<const char *, const char *>(request.getBody(), request.getBody() + request.getBodySize()));
+	std::vector<std::vector<const ScrobbleInfo *>> batches;
+	collectBatches(batches);
 
-		// The timeouts are set to 'infinity' since this HTTP call is interruptible.
-		result = HttpClient().post(scrobblerUrlCopy.c_str(), request, response,
-				HttpClient::NO_TIMEOUT, HttpClient::NO_TIMEOUT, m_finishScrobblingFlag);
-	}
+	std::vector<std::unique_ptr<Call>> calls;
+	calls.reserve(batches.size());
 
-	/* Ensure that no scrobbles are deleted by other threads during the HTTP call.
-	 * Only the scrobbling thread and ::stop() can do this, and ::stop() must wait for
-	 * the scrobbling thread to finish in order to do this.
+	/* The request bodies are measured and encoded by the reactor thread outside the lock as
+	 * the requests are sent, so the memory held per request does not grow with the batch.
 	 */
-	assert(pendingScrobbleCount <= m_pendingScrobbles.size());
+	for (std::vector<const ScrobbleInfo *> &batch : batches) {
+		calls.emplace_back(new Call(*this, std::move(batch)));
+		calls.back()->prepare(m_scrobblerUrl, m_authHeader);
+	}
 
-	if (result == StatusCode::ABORTED_BY_CLIENT) {
-		logDebug("[GravifonScrobbler] An HTTP call is aborted."_s);
-		return 0;
+	/* The calls are performed by the reactor thread which invokes callCompleted() for each of them.
+	 * If this Scrobbler is stopped then the calls are aborted and the scrobbles involved are left
+	 * in the list of pending scrobbles so that they can be stored to the data file and be completed later.
+	 */
+	m_calls = std::move(calls);
+	m_callsInProgress = 0;
+	for (const std::unique_ptr<Call> &call : m_calls) {
+		if (call->prepared() && !m_finishScrobblingFlag.load(std::memory_order_relaxed) && perform(*call)) {
+			++m_callsInProgress;
+		}
 	}
-	if (result != StatusCode::SUCCESS) {
-		reportHttpClientError(result);
-		return 0;
+	if (m_callsInProgress == 0) {
+		finishScrobbling();
 	}
+}
 
-	logDebug("[GravifonScrobbler] Response status code: '"_s, response.statusCode, "#'."_s);
+void GravifonScrobbler::callCompleted(Call &call, const StatusCode result)
+{
+	// The response is processed outside the critical section. The scrobbles of the batch stay in place.
+	call.processResponse(result);
 
-	ErrorHandler errorHandler;
-	if (response.statusCode == 200) {
-		std::vector<RawResponseRecord> records;
-		records.reserve(submittedCount);
-		const char * p = parseOKResponse(responseBody.begin(), responseBody.end(), errorHandler, records);
-		// An array of status entities is expected for a 200 response, one per scrobble submitted.
-		if (!errorHandler.valid() || p != responseBody.end()
-				|| records.size() != submittedCount) {
-			logError("[GravifonScrobbler] Invalid response: "_s,
-					std::make_pair(responseBody.begin(), responseBody.end()));
-			return 0;
-		}
+	lock_guard<mutex> lock(m_mutex);
+	assert(m_callsInProgress != 0);
+	if (--m_callsInProgress == 0) {
+		finishScrobbling();
+	}
+}
+
+void GravifonScrobbler::finishScrobbling()
+{
+	assertLocked();
+	assert(m_callsInProgress == 0);
 
-		size_t completedCount = 0;
-		auto it = m_pendingScrobbles.begin();
-		for (const RawResponseRecord &record : records) {
-			if (record.success) {
-				// Successful status: if the track is scrobbled successfully then it is removed from the list.
-				it = m_pendingScrobbles.erase(it);
+	/* Ensure that no scrobbles are deleted by other threads during the HTTP calls.
+	 * Only the reactor thread and ::stop() can do this, and ::stop() must wait for
+	 * the reactor to detach this Scrobbler in order to do this.
+	 */
+	assert(&m_pendingScrobbles.front() == m_calls.front()->batch.front());
+
+	/* The scrobbles completed are removed within the critical section. The batches follow each
+	 * other in the list of pending scrobbles whatever order the responses are received in.
+	 */
+	size_t completedCount = 0;
+	auto it = m_pendingScrobbles.begin();
+	for (const std::unique_ptr<Call> &call : m_calls) {
+		for (const bool scrobbleCompleted : call->completedFlags) {
+			if (scrobbleCompleted) {
+				it = completeScrobble(it);
 				++completedCount;
 			} else {
-				/* Error status. If the error is unprocessable then the scrobble is removed from the list;
-				 * otherwise another attempt will be done to submit it.
-				 */
-				const unsigned long errorCode = record.errorCode;
-				afc::FastStringBuffer<char, afc::AllocMode::accurate> scrobbleAsStr = serialiseAsJson(*it);
-				if (isRecoverableError(errorCode)) {
-					logError("[GravifonScrobbler] Scrobble '"_s,
-							std::make_pair(scrobbleAsStr.begin(), scrobbleAsStr.end()), "' is not processed. "
-							"Error: '"_s, std::make_pair(record.errorDescBegin, record.errorDescEnd), "' ("_s,
-							errorCode, "). It will be re-submitted later."_s);
-					++it;
-				} else {
-					logError("[GravifonScrobbler] Scrobble '"_s,
-							std::make_pair(scrobbleAsStr.begin(), scrobbleAsStr.end()), "' cannot be processed. "
-							"Error: '"_s, std::make_pair(record.errorDescBegin, record.errorDescEnd), "' ("_s,
-							errorCode, "). It is removed as non-processable."_s);
-					it = m_pendingScrobbles.erase(it);
-					++completedCount;
-				}
+				++it;
 			}
 		}
-
-		if (completedCount == submittedCount) {
-			logDebug("[GravifonScrobbler] Successful response: "_s,
-					std::make_pair(responseBody.begin(), responseBody.end()));
-		}
-
-		return completedCount;
-	} else {
-		// A global status entity is expected for a non-200 response.
-		RawResponseRecord record;
-		const char * p = parseResponseRecord(responseBody.begin(), responseBody.end(), errorHandler, record);
-		if (!errorHandler.valid() || p != responseBody.end()) {
-			logError("[GravifonScrobbler] Invalid response: "_s,
-					std::make_pair(responseBody.begin(), responseBody.end()));
-			return 0;
-		}
-
-		if (record.success) {
-			logError("[GravifonScrobbler] Unexpected 'ok' global status response: '"_s,
-					std::make_pair(responseBody.begin(), responseBody.end()), "'."_s);
-		} else {
-			logError("[GravifonScrobbler] Error global status response: '"_s,
-					std::make_pair(responseBody.begin(), responseBody.end()), "'. "
-					"Error: '"_s, std::make_pair(record.errorDescBegin, record.errorDescEnd), "' ("_s,
-					record.errorCode, ")."_s);
-		}
-
-		return 0;
 	}
+
+	// None of the calls is performed by the reactor any longer so they can be destroyed.
+	m_calls.clear();
+	attemptFinished(completedCount);
 }
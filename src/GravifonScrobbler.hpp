@@ -16,31 +16,29 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 #ifndef GRAVIFONSCROBBLER_HPP_
 #define GRAVIFONSCROBBLER_HPP_
 
+#include "ChunkedRing.hpp"
 #include "ScrobbleInfo.hpp"
 #include "Scrobbler.hpp"
 #include <cstddef>
-#include <list>
+#include <memory>
 #include <mutex>
 #include <utility>
+#include <vector>
 
 #include <afc/SimpleString.hpp>
 
-// TODO think of choosing a better in-memory container for pending scrobbles (issue #16).
-class GravifonScrobbler : public Scrobbler<std::list<ScrobbleInfo>>
+/* Pending scrobbles are kept in a ChunkedRing since the scrobbles of a request that are completed
+ * are removed individually while the others are left for re-submission.
+ */
+class GravifonScrobbler : public Scrobbler<ChunkedRing<ScrobbleInfo>>
 {
 public:
-	GravifonScrobbler() : Scrobbler(), m_scrobblerUrl(), m_authHeader(), m_dataFilePath()
-	{ std::lock_guard<std::mutex> lock(m_mutex); // synchronising memory
-		/* This instance is partially initialised here. It will be initialised completely
-		 * when ::start() is invoked successfully.
-		 */
-	}
+	// The max number of scrobbles that can be submitted within a single request.
+	static constexpr std::size_t maxScrobblesPerRequest = 20;
 
-	~GravifonScrobbler()
-	{
-		// Synchronising memory before destructing the member fields of this GravifonScrobbler.
-		std::lock_guard<std::mutex> lock(m_mutex);
-	}
+	// Both are defined where Call is complete.
+	GravifonScrobbler();
+	~GravifonScrobbler();
 
 	/* - serverUrl must be a valid ASCII-compatible string
 	 * - username should conform to https://gist.github.com/bassstorm/bae655c72a1449f7e6ab
@@ -60,17 +58,37 @@ public:
 		m_dataFilePath = std::move(dataFilePath);
 	}
 protected:
-	virtual std::size_t doScrobbling() override;
+	virtual void startScrobbling() override;
 
 	virtual const afc::String &getDataFilePath() const override { return m_dataFilePath; }
 
 	virtual void stopExtra() override;
 private:
+	// An HTTP call that submits a batch of scrobbles.
+	class Call;
+
+	/* Invoked by the reactor thread when a given call of the attempt in progress is completed.
+	 *
+	 * It is executed outside lock on m_mutex.
+	 */
+	void callCompleted(Call &call, HttpClient::StatusCode result);
+	/* Removes the scrobbles completed by the calls of the attempt in progress and finishes the attempt.
+	 * It is invoked once none of the calls is in progress.
+	 *
+	 * It is executed within lock on m_mutex.
+	 */
+	void finishScrobbling();
+
 	afc::String m_scrobblerUrl;
 	// The authentication header encoded in the basic charset.
 	afc::String m_authHeader;
 
 	afc::String m_dataFilePath;
+
+	// The calls of the attempt in progress, one per batch, in the order of the batches.
+	std::vector<std::unique_ptr<Call>> m_calls;
+	// The number of the calls of the attempt in progress that are not completed yet.
+	std::size_t m_callsInProgress;
 };
 
 #endif /* GRAVIFONSCROBBLER_HPP_ */
@@ -15,7 +15,9 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 #include "HttpClient.hpp"
 #include <curl/curl.h>
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
 
 using namespace std;
 
@@ -38,22 +40,6 @@ namespace
 
 	CurlInit CurlInit::instance;
 
-	class CurlSession
-	{
-		CurlSession(const CurlSession &) = delete;
-		CurlSession(CurlSession &&) = delete;
-		CurlSession &operator=(const CurlSession &) = delete;
-		CurlSession &operator=(CurlSession &&) = delete;
-	public:
-		CURL * const handler;
-
-		CurlSession() : handler(curl_easy_init()) {}
-
-		~CurlSession() noexcept { curl_easy_cleanup(handler); };
-
-		operator CURL *() noexcept { return handler; }
-	};
-
 	class CurlHeaders
 	{
 		CurlHeaders(const CurlHeaders &) = delete;
@@ -66,6 +52,14 @@ namespace
 
 		operator curl_slist *() { return m_headers; }
 
+		// Releases the ownership of the headers.
+		curl_slist *detach() noexcept
+		{
+			curl_slist * const headers = m_headers;
+			m_headers = nullptr;
+			return headers;
+		}
+
 		bool addHeader(const char * const header)
 		{
 			curl_slist * const tmp = curl_slist_append(m_headers, header);
@@ -90,6 +84,18 @@ namespace
 		return dataSize;
 	}
 
+	size_t readBody(char * const buffer, const size_t size, const size_t nitems, void * const userdata)
+	{
+		return (*static_cast<HttpRequest::BodyProducer *>(userdata))(buffer, size * nitems);
+	}
+
+	int seekBody(void * const userdata, const curl_off_t offset, const int origin)
+	{
+		// curl seeks only to re-send the body from its beginning.
+		return offset == 0 && origin == SEEK_SET && static_cast<HttpRequest::BodyProducer *>(userdata)->rewind() ?
+				CURL_SEEKFUNC_OK : CURL_SEEKFUNC_CANTSEEK;
+	}
+
 	inline HttpClient::StatusCode toStatusCode(const CURLcode curlErrorCode)
 	{
 		switch (curlErrorCode) {
@@ -103,41 +109,35 @@ namespace
 			return HttpClient::StatusCode::UNKNOWN_ERROR;
 		}
 	}
+}
 
-	/**
-	 * Used as a CURLOPT_PROGRESSFUNCTION callback for CURL to signal CURL to terminate
-	 * the connection this callback is associated with if the abort flag (passed as clientp)
-	 * is raised. The abort flag is not modified.
-	 *
-	 * @param data a pointer to std::atomic<bool>.
-	 *
-	 * @return a non-zero value to abort the CURL connection if this is requested;
-	 *         zero is returned otherwise.
-	 */
-	int terminateConnectionCallback(void *data, double, double, double, double)
-	{
-		assert(data != nullptr);
-
-		const atomic<bool> * const abortFlag = reinterpret_cast<const atomic<bool> *>(data);
-
-		return static_cast<int>(abortFlag->load(memory_order_relaxed));
-	}
+HttpCall::~HttpCall()
+{
+	// Both are null if this call is not prepared.
+	curl_easy_cleanup(static_cast<CURL *>(m_handle));
+	curl_slist_free_all(static_cast<curl_slist *>(m_headers));
 }
 
-HttpClient::StatusCode HttpClient::send(const HttpMethod method, const char * const url,
-		const HttpRequest &request, HttpResponse &response,
-		const long connectionTimeoutMillis, const long socketTimeoutMillis,
-		const std::atomic<bool> &abortFlag)
+HttpClient::StatusCode HttpClient::prepare(HttpCall &call, const HttpMethod method, const char * const url,
+		const HttpRequest &request, HttpResponse &response, const HttpTimeouts &timeouts)
 {
+	assert(call.m_handle == nullptr);
+
 	if (!::CurlInit::instance.initialised) {
 		return StatusCode::INIT_ERROR;
 	}
 
-	CurlSession curl;
-
-	if (curl.handler == nullptr) {
+	CURL * const curl = curl_easy_init();
+	if (curl == nullptr) {
 		return StatusCode::UNKNOWN_ERROR;
 	}
+	// The call owns the handle and the headers from now on, even if it fails to be prepared.
+	call.m_handle = curl;
+	call.m_response = &response;
+	call.m_timeouts = timeouts;
+
+	HttpRequest::BodyProducer * const bodyProducer = method == HttpMethod::POST ? request.getBodyProducer() : nullptr;
+	call.m_bodyProducer = bodyProducer;
 
 	CurlHeaders headers;
 	for (const char * const header : request.headers) {
@@ -145,39 +145,88 @@ HttpClient::StatusCode HttpClient::send(const HttpMethod method, const char * co
 			return StatusCode::UNKNOWN_ERROR;
 		}
 	}
+	/* curl asks for a confirmation before sending a large body. It is not waited for since
+	 * the body is small enough, and a server that does not support it would delay the call.
+	 */
+	if (bodyProducer != nullptr && !headers.addHeader("Expect:")) {
+		return StatusCode::UNKNOWN_ERROR;
+	}
+	call.m_headers = headers.detach();
 
 	// TODO add response headers
 	curl_easy_setopt(curl, CURLOPT_URL, url);
-	if (method == HttpMethod::POST) {
+	if (bodyProducer != nullptr) {
+		// The length of the body is set by measureBody().
+		curl_easy_setopt(curl, CURLOPT_POST, 1L);
+		curl_easy_setopt(curl, CURLOPT_READFUNCTION, readBody);
+		curl_easy_setopt(curl, CURLOPT_READDATA, bodyProducer);
+		curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, seekBody);
+		curl_easy_setopt(curl, CURLOPT_SEEKDATA, bodyProducer);
+	} else if (method == HttpMethod::POST) {
 		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(request.getBodySize()));
 		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request.getBody());
 	}
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, static_cast<curl_slist *>(headers));
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, static_cast<curl_slist *>(call.m_headers));
 	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.m_bodyAppender);
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeData);
 
-	/* TODO this is a suboptimal implementation of interruptible I/O.
-	   Implement it using non-blocking socket I/O. */
-	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-	curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, terminateConnectionCallback);
-	curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, &abortFlag);
+	/* Keep-alive probes make an idle connection that is kept for reuse (see Reactor) stay open
+	 * in NATs and firewalls, and detect the one that is broken.
+	 */
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 60L);
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 60L);
 
-	// Setting timeouts.
+#if LIBCURL_VERSION_NUM >= 0x075700
+	/* The name resolver thread is not waited for if the call is aborted while the name is being
+	 * resolved, so that aborting does not take as long as the resolution (up to the DNS timeouts).
+	 */
+	curl_easy_setopt(curl, CURLOPT_QUICK_EXIT, 1L);
+#endif
+
+	/* Setting timeouts. The limits on the phases of the call are enforced by the reactor since curl
+	 * does not tell the TLS handshake from the TCP connection establishment, nor has a limit on
+	 * the time to the first octet of the response. Stalls are detected by curl.
+	 */
 	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
-	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, connectionTimeoutMillis);
-	curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, socketTimeoutMillis);
+	if (timeouts.stallTime.count() != 0) {
+		curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, std::max(timeouts.stallSpeed, 1L));
+		curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, static_cast<long>(timeouts.stallTime.count()));
+	}
+
+	return StatusCode::SUCCESS;
+}
+
+void HttpClient::measureBody(HttpCall &call)
+{
+	if (call.m_bodyProducer != nullptr) {
+		// The body is sent with its length rather than chunked, which some servers reject (411 Length Required).
+		curl_easy_setopt(static_cast<CURL *>(call.m_handle), CURLOPT_POSTFIELDSIZE_LARGE,
+				static_cast<curl_off_t>(call.m_bodyProducer->size()));
+	}
+}
 
-	const CURLcode status = curl_easy_perform(curl);
+HttpClient::StatusCode HttpClient::finish(HttpCall &call, const int curlCode)
+{
+	const CURLcode status = static_cast<CURLcode>(curlCode);
+	if (status == CURLE_OPERATION_TIMEDOUT) {
+		/* The other limits are enforced by the reactor, so curl times a call out either because
+		 * the call is stalled or, while connecting, because of its built-in connection timeout.
+		 */
+		curl_off_t requestStart = 0;
+		curl_easy_getinfo(static_cast<CURL *>(call.m_handle), CURLINFO_PRETRANSFER_TIME_T, &requestStart);
+		return requestStart != 0 ? StatusCode::STALLED : StatusCode::OPERATION_TIMEOUT;
+	}
 	if (status != 0) {
 		return toStatusCode(status);
 	}
 
 	long statusCode;
-	if (curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &statusCode) != 0) {
+	if (curl_easy_getinfo(static_cast<CURL *>(call.m_handle), CURLINFO_RESPONSE_CODE, &statusCode) != 0) {
 		return toStatusCode(status);
 	}
 
-	response.statusCode = static_cast<int>(statusCode);
+	call.m_response->statusCode = static_cast<int>(statusCode);
 
 	return StatusCode::SUCCESS;
 }
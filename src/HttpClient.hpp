@@ -16,7 +16,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 #ifndef HTTPCLIENT_HPP_
 #define HTTPCLIENT_HPP_
 
-#include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <vector>
 #include <utility>
@@ -24,15 +24,56 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 class HttpRequest
 {
 public:
+	/* Produces the body of a request piece by piece while the request is being sent, so that
+	 * the body is not kept in memory as a whole. It is invoked by the reactor thread.
+	 */
+	struct BodyProducer
+	{
+		virtual ~BodyProducer() = default;
+
+		/* Writes up to n next octets of the body to dest. Returns the number of octets written,
+		 * which is zero only if the body is over.
+		 */
+		virtual std::size_t operator()(char *dest, std::size_t n) = 0;
+
+		/* Returns the size of the body. It is invoked once, before the body is produced, so that
+		 * the body is sent with its length: some servers reject chunked requests. It is invoked
+		 * by the reactor thread right before the call is started (see Reactor::perform()).
+		 */
+		virtual std::size_t size() = 0;
+
+		/* Makes the body be produced anew from its beginning so that the request can be re-sent
+		 * (e.g. over a new connection if the one re-used is found closed). Returns false if it cannot.
+		 */
+		virtual bool rewind() = 0;
+	};
+
 	HttpRequest(void) = default; // Leaves instance non-initialised.
 
-	void setBody(const char body[], const std::size_t n) noexcept { m_body = body; m_bodySize = n; }
+	void setBody(const char body[], const std::size_t n) noexcept
+	{
+		m_body = body;
+		m_bodySize = n;
+		m_bodyProducer = nullptr;
+	}
+
+	// The body is produced while the request is sent. It is not kept in memory as a whole.
+	void setBody(BodyProducer &producer) noexcept
+	{
+		m_body = nullptr;
+		m_bodySize = 0;
+		m_bodyProducer = &producer;
+	}
+
 	const char *getBody() const noexcept { return m_body; }
 	std::size_t getBodySize() const noexcept { return m_bodySize; }
+	// Returns the producer of the body if it is set; null otherwise.
+	BodyProducer *getBodyProducer() const noexcept { return m_bodyProducer; }
 private:
 	// HttpRequestEntity does not own body.
 	const char *m_body;
 	std::size_t m_bodySize;
+	BodyProducer *m_bodyProducer;
 // TODO make it private.
 public:
 	// HttpRequestEntity does not own headers.
@@ -61,15 +102,36 @@ public:
 	int statusCode;
 };
 
+/* The limits on the duration of the phases of an HTTP call. A zero limit means no limit.
+ * A call that exceeds a limit fails with OPERATION_TIMEOUT; a call that is stalled fails
+ * with STALLED. The limits are enforced by the reactor that performs the call.
+ */
+struct HttpTimeouts
+{
+	// From the start of the call until the TCP connection is established (name resolution included).
+	std::chrono::milliseconds connect = std::chrono::milliseconds(0);
+	// From the TCP connection establishment until the TLS handshake is done.
+	std::chrono::milliseconds tls = std::chrono::milliseconds(0);
+	// From the start of sending the request until the first octet of the response is received.
+	std::chrono::milliseconds firstByte = std::chrono::milliseconds(0);
+	// From the start of the call until it is completed.
+	std::chrono::milliseconds total = std::chrono::milliseconds(0);
+	/* The call is stalled if it transfers less than stallSpeed octets per second during
+	 * stallTime once the connection is established. A zero stallTime disables the detection.
+	 */
+	long stallSpeed = 0;
+	std::chrono::seconds stallTime = std::chrono::seconds(0);
+};
+
+class HttpCall;
+
 class HttpClient
 {
 public:
 	enum class StatusCode
 	{
-		SUCCESS, INIT_ERROR, UNKNOWN_ERROR, UNABLE_TO_CONNECT, OPERATION_TIMEOUT, ABORTED_BY_CLIENT
+		SUCCESS, INIT_ERROR, UNKNOWN_ERROR, UNABLE_TO_CONNECT, OPERATION_TIMEOUT, STALLED, ABORTED_BY_CLIENT
 	};
-
-	static const long NO_TIMEOUT = 0L;
 private:
 	HttpClient(const HttpClient &) = delete;
 	HttpClient(HttpClient &&) = delete;
@@ -79,23 +141,75 @@ public:
 	HttpClient() = default;
 	~HttpClient() = default;
 
-	StatusCode get(const char * const url, const HttpRequest &request, HttpResponse &response,
-			const long connectionTimeoutMillis, const long socketTimeoutMillis, const std::atomic<bool> &abortFlag)
+	/* Prepares a given call to be performed asynchronously by Reactor::perform(). The request
+	 * (its body or body producer, and headers) and the response must stay valid until the call
+	 * is completed.
+	 * The call must not be prepared already. The call can be aborted at any time, in any phase,
+	 * by the reactor (see Reactor::detach()), regardless of the timeouts given.
+	 */
+	StatusCode prepareGet(HttpCall &call, const char * const url, const HttpRequest &request,
+			HttpResponse &response, const HttpTimeouts &timeouts)
 	{
-		return send(HttpMethod::GET, url, request, response, connectionTimeoutMillis, socketTimeoutMillis, abortFlag);
+		return prepare(call, HttpMethod::GET, url, request, response, timeouts);
 	}
 
-	StatusCode post(const char * const url, const HttpRequest &request, HttpResponse &response,
-			const long connectionTimeoutMillis, const long socketTimeoutMillis, const std::atomic<bool> &abortFlag)
+	StatusCode preparePost(HttpCall &call, const char * const url, const HttpRequest &request,
+			HttpResponse &response, const HttpTimeouts &timeouts)
 	{
-		return send(HttpMethod::POST, url, request, response, connectionTimeoutMillis, socketTimeoutMillis, abortFlag);
+		return prepare(call, HttpMethod::POST, url, request, response, timeouts);
 	}
+
+	/* Fills in the response of a given call that is performed given the curl result code.
+	 * It is used by Reactor once the call is performed.
+	 */
+	static StatusCode finish(HttpCall &call, int curlCode);
+
+	/* Sets the length of the body of a given prepared call if the body is produced (see
+	 * HttpRequest::BodyProducer). It is used by Reactor right before the call is started, outside
+	 * the critical section the call is performed within, since the body is encoded to be measured.
+	 */
+	static void measureBody(HttpCall &call);
 private:
 	enum class HttpMethod {GET, POST};
 
-	StatusCode send(const HttpMethod method, const char * const url, const HttpRequest &request,
-			HttpResponse &response, const long connectionTimeoutMillis, const long socketTimeoutMillis,
-			const std::atomic<bool> &abortFlag);
+	StatusCode prepare(HttpCall &call, HttpMethod method, const char *url, const HttpRequest &request,
+			HttpResponse &response, const HttpTimeouts &timeouts);
+};
+
+/* An HTTP call that is performed asynchronously (see HttpClient::prepareGet(), Reactor::perform()).
+ * It owns the curl handle of the call.
+ */
+class HttpCall
+{
+	friend class HttpClient;
+
+	HttpCall(const HttpCall &) = delete;
+	HttpCall(HttpCall &&) = delete;
+	HttpCall &operator=(const HttpCall &) = delete;
+	HttpCall &operator=(HttpCall &&) = delete;
+public:
+	/* Invoked by the reactor thread once the call is performed, has failed, has timed out,
+	 * or is aborted (ABORTED_BY_CLIENT). The reactor does not access the call after this function is invoked
+	 * so the call can be destroyed by it.
+	 */
+	virtual void completed(HttpClient::StatusCode status) = 0;
+
+	// The curl easy handle of the call; null if it is not prepared.
+	void *handle() const noexcept { return m_handle; }
+	// The limits of the call that are enforced by the reactor.
+	const HttpTimeouts &timeouts() const noexcept { return m_timeouts; }
+protected:
+	HttpCall() noexcept : m_handle(nullptr), m_headers(nullptr), m_response(nullptr), m_bodyProducer(nullptr),
+		m_timeouts() {}
+	// Non-virtual by design. Calls are not destroyed via pointers to HttpCall.
+	~HttpCall();
+private:
+	void *m_handle;
+	void *m_headers;
+	HttpResponse *m_response;
+	// The producer of the body which is measured once the call is started; null if the body is not produced.
+	HttpRequest::BodyProducer *m_bodyProducer;
+	HttpTimeouts m_timeouts;
 };
 
 #endif /* HTTPCLIENT_HPP_ */
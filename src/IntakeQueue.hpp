@@ -0,0 +1,102 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef INTAKEQUEUE_HPP_
+#define INTAKEQUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/* A lock-free multi-producer single-consumer queue. Producers push values without blocking
+ * each other or the consumer; the consumer takes all the values pushed so far at once,
+ * in the order they are pushed.
+ *
+ * Values are kept in a singly-linked stack that is detached as a whole and reversed by
+ * the consumer, so there is no per-value synchronisation on the consumer side and no ABA
+ * problem. Only one thread at a time may consume (e.g. the one that holds some lock).
+ */
+template<typename T>
+class IntakeQueue
+{
+	IntakeQueue(const IntakeQueue &) = delete;
+	IntakeQueue(IntakeQueue &&) = delete;
+	IntakeQueue &operator=(const IntakeQueue &) = delete;
+	IntakeQueue &operator=(IntakeQueue &&) = delete;
+public:
+	IntakeQueue() noexcept : m_head(nullptr) {}
+	~IntakeQueue() { clear(); }
+
+	/* Adds a value to the queue.
+	 *
+	 * @return true if the queue was empty before the value is added; false otherwise.
+	 */
+	bool push(T &&value)
+	{
+		Node * const node = new Node(std::move(value));
+		// The node must not be accessed once it is published since the consumer can take it at once.
+		Node *head = m_head.load(std::memory_order_relaxed);
+		do {
+			node->next = head;
+		} while (!m_head.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+		return head == nullptr;
+	}
+
+	/* Takes all the values pushed so far and passes them to consumer in the order they are pushed.
+	 *
+	 * @return the number of values taken.
+	 */
+	template<typename Consumer>
+	std::size_t consume(Consumer consumer)
+	{
+		Node *node = m_head.exchange(nullptr, std::memory_order_acquire);
+
+		// Reversing the stack to get the values in the order they are pushed.
+		Node *first = nullptr;
+		while (node != nullptr) {
+			Node * const next = node->next;
+			node->next = first;
+			first = node;
+			node = next;
+		}
+
+		std::size_t count = 0;
+		while (first != nullptr) {
+			Node * const next = first->next;
+			consumer(first->value);
+			delete first;
+			first = next;
+			++count;
+		}
+		return count;
+	}
+
+	// Drops all the values pushed so far. It is a consumer operation.
+	void clear() { consume([](T &) {}); }
+
+	bool empty() const noexcept { return m_head.load(std::memory_order_acquire) == nullptr; }
+private:
+	struct Node
+	{
+		explicit Node(T &&value) : next(nullptr), value(std::move(value)) {}
+
+		Node *next;
+		T value;
+	};
+
+	std::atomic<Node *> m_head;
+};
+
+#endif /* INTAKEQUEUE_HPP_ */
@@ -0,0 +1,478 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "JournalWriter.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include <afc/logger.hpp>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "fileutil.hpp"
+#include "ScrobbleJournal.hpp"
+
+using afc::operator"" _s;
+
+namespace
+{
+	/* Appends that are requested to be synchronised are delayed for this time
+	 * to let other appends to join the same write.
+	 */
+	constexpr std::chrono::milliseconds groupCommitWindow(5);
+
+	// The number of buffers that are written by a single writev() call at most.
+	constexpr std::size_t maxIovCount = 64;
+
+	/* Copies the octets of the file fd from begin to end to dest. Fewer octets are copied
+	 * if the file is shorter.
+	 *
+	 * @return the number of octets copied; -1 if an I/O error occurs.
+	 */
+	std::int64_t copyFileRange(const int fd, std::uint64_t begin, const std::uint64_t end, const int dest)
+	{
+		char buf[64 * 1024];
+		std::int64_t copied = 0;
+		while (begin < end) {
+			const ssize_t n = pread(fd, buf, std::min<std::uint64_t>(sizeof(buf), end - begin), begin);
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				copied = -1;
+				break;
+			}
+			if (n == 0) {
+				// The file is shorter than expected.
+				break;
+			}
+			if (!writeFully(dest, buf, n)) {
+				copied = -1;
+				break;
+			}
+			begin += n;
+			copied += n;
+		}
+		return copied;
+	}
+}
+
+void JournalWriter::start(const afc::String &dataFilePath, const std::chrono::milliseconds appendDelay)
+{
+	stop();
+
+	m_dataFilePath = dataFilePath;
+	m_fd = -1;
+	m_shiftEpoch = m_shift = 0;
+	m_failed.store(false, std::memory_order_relaxed);
+
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopFlag = false;
+		m_appendDelay = appendDelay;
+	}
+	m_thread = std::thread([this]() { this->run(); });
+}
+
+void JournalWriter::stop()
+{
+	if (!m_thread.joinable()) {
+		return;
+	}
+
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopFlag = true;
+		m_cv.notify_all();
+	}
+	m_thread.join();
+}
+
+void JournalWriter::append(afc::FastStringBuffer<char> &&records, const std::uint64_t offset, const bool sync)
+{
+	submit(Request(R_APPEND, std::move(records), offset, sync));
+}
+
+void JournalWriter::append(std::vector<afc::FastStringBuffer<char>> &&records, std::uint64_t offset,
+		const bool sync)
+{ std::lock_guard<std::mutex> lock(m_mutex);
+	assert(m_thread.joinable());
+
+	bool submitted = false;
+	for (afc::FastStringBuffer<char> &buffer : records) {
+		const std::size_t size = buffer.size();
+		if (size != 0) {
+			m_requests.emplace_back(R_APPEND, std::move(buffer), offset, false);
+			m_requests.back().epoch = m_epoch;
+			offset += size;
+			submitted = true;
+		}
+	}
+	if (submitted) {
+		// A single synchronisation after the last buffer covers all of them.
+		m_requests.back().sync = sync;
+		m_cv.notify_all();
+	}
+}
+
+void JournalWriter::rewrite(afc::FastStringBuffer<char> &&journal, const std::uint64_t copyBegin,
+		const std::uint64_t copyEnd)
+{
+	assert(copyBegin <= copyEnd);
+
+	std::vector<RewriteRange> layout;
+	layout.push_back({0, journal.size(), false});
+	if (copyBegin != copyEnd) {
+		layout.push_back({copyBegin, copyEnd, true});
+	}
+	rewrite(std::move(journal), std::move(layout));
+}
+
+void JournalWriter::rewrite(afc::FastStringBuffer<char> &&journal, std::vector<RewriteRange> &&layout)
+{
+	Request request(R_REWRITE, std::move(journal), 0, true);
+	request.layout = std::move(layout);
+	submit(std::move(request));
+}
+
+void JournalWriter::rewrite(RewritePlanner &planner, const std::uint64_t end)
+{
+	Request request(R_REWRITE, afc::FastStringBuffer<char>(), end, true);
+	request.planner = &planner;
+	submit(std::move(request));
+}
+
+void JournalWriter::rebase()
+{ std::lock_guard<std::mutex> lock(m_mutex);
+	++m_epoch;
+}
+
+void JournalWriter::storeCursor(const std::uint64_t fileId, const JournalCursors &offsets)
+{
+	afc::FastStringBuffer<char> cursor;
+	appendJournalCursor(fileId, offsets, cursor);
+	submit(Request(R_CURSOR, std::move(cursor), 0, false));
+}
+
+void JournalWriter::submit(Request &&request)
+{ std::lock_guard<std::mutex> lock(m_mutex);
+	assert(m_thread.joinable());
+
+	m_requests.emplace_back(std::move(request));
+	m_requests.back().epoch = m_epoch;
+	m_cv.notify_all();
+}
+
+void JournalWriter::flush()
+{ std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_requests.empty() && !m_busy) {
+		return;
+	}
+
+	++m_flushWaiters;
+	// Ending the group commit window, if any, since there is someone who waits for completion.
+	m_cv.notify_all();
+	while (!m_requests.empty() || m_busy) {
+		m_cv.wait(lock);
+	}
+	--m_flushWaiters;
+}
+
+void JournalWriter::run()
+{ std::unique_lock<std::mutex> lock(m_mutex);
+	afc::logger::logDebug("[JournalWriter] The journal writer thread has started."_s);
+
+	for (;;) {
+		while (m_requests.empty() && !m_stopFlag) {
+			m_cv.wait(lock);
+		}
+		if (m_requests.empty()) {
+			// All the requests are processed and this writer is stopped.
+			break;
+		}
+
+		const Request &first = m_requests.front();
+		if (first.type == R_APPEND && (first.sync || m_appendDelay.count() != 0)) {
+			const auto deadline = std::chrono::steady_clock::now() +
+					(first.sync ? std::max(groupCommitWindow, m_appendDelay) : m_appendDelay);
+			while (!m_stopFlag && m_flushWaiters == 0 &&
+					m_cv.wait_until(lock, deadline) == std::cv_status::no_timeout) {
+				// Waiting for other appends until the window ends.
+			}
+		}
+
+		std::deque<Request> batch;
+		batch.swap(m_requests);
+		m_busy = true;
+
+		lock.unlock();
+
+		for (auto it = batch.begin(), end = batch.end(); it != end;) {
+			if (it->type == R_APPEND) {
+				// Consecutive appends are written at once.
+				auto appendEnd = std::next(it);
+				while (appendEnd != end && appendEnd->type == R_APPEND) {
+					++appendEnd;
+				}
+				processAppends(it, appendEnd);
+				it = appendEnd;
+			} else {
+				if (it->type == R_REWRITE) {
+					processRewrite(*it);
+				} else {
+					processCursor(*it);
+				}
+				++it;
+			}
+		}
+
+		lock.lock();
+
+		m_busy = false;
+		m_cv.notify_all();
+	}
+
+	closeDataFile();
+
+	afc::logger::logDebug("[JournalWriter] The journal writer thread is stopped."_s);
+}
+
+void JournalWriter::processAppends(const RequestIterator begin, const RequestIterator end)
+{
+	if (!openDataFile()) {
+		afc::logger::logError("[JournalWriter] Unable to open the data file. Scrobbles are not stored."_s);
+		fail();
+		return;
+	}
+
+	struct stat fileStatus;
+	if (fstat(m_fd, &fileStatus) != 0) {
+		afc::logger::logError("[JournalWriter] Unable to access the data file. Scrobbles are not stored."_s);
+		fail();
+		return;
+	}
+
+	const std::uint64_t initialSize = fileStatus.st_size;
+	std::uint64_t position = initialSize;
+	bool sync = false;
+
+	afc::FastStringBuffer<char> header;
+	std::vector<struct iovec> iov;
+	iov.reserve(std::distance(begin, end) + 1);
+
+	for (auto it = begin; it != end; ++it) {
+		const Request &request = *it;
+		const char *data = request.data.data();
+		std::size_t size = request.data.size();
+		// The appends that follow a planned rewrite are expected at the end of the data file replaced.
+		const std::uint64_t offset = request.epoch == m_shiftEpoch ? request.offset + m_shift : request.offset;
+
+		if (offset != position) {
+			// The data file is modified by someone else so its records cannot be tracked any longer.
+			fail();
+		}
+		if (request.offset == 0 && position != 0) {
+			// The records start with the journal header which is already written.
+			assert(size >= journalHeaderSize);
+			data += journalHeaderSize;
+			size -= journalHeaderSize;
+		} else if (request.offset != 0 && position == 0) {
+			// The data file has disappeared; it is created anew.
+			appendJournalHeader(newJournalFileId(), header);
+			iov.push_back({const_cast<char *>(header.data()), header.size()});
+			position += header.size();
+		}
+
+		iov.push_back({const_cast<char *>(data), size});
+		position += size;
+		sync = sync || request.sync;
+	}
+
+	bool result = true;
+	for (std::size_t i = 0, n = iov.size(); i < n && result; i += maxIovCount) {
+		result = writeFully(m_fd, iov.data() + i, std::min(maxIovCount, n - i));
+	}
+	if (result && sync) {
+		// A new data file is durable only if its directory entry is durable.
+		result = fdatasync(m_fd) == 0 &&
+				(initialSize != 0 || syncParentDir(m_dataFilePath.c_str(), m_dataFilePath.size()));
+	}
+
+	if (result) {
+		afc::logger::logDebug("[JournalWriter] Scrobbles are stored: "_s, position - initialSize,
+				sync ? " octets (synchronised)."_s : " octets."_s);
+	} else {
+		afc::logger::logError("[JournalWriter] Unable to store scrobbles to the data file."_s);
+		fail();
+		// The state of the descriptor is unknown so the data file is re-opened for further appends.
+		closeDataFile();
+	}
+}
+
+void JournalWriter::processRewrite(const Request &request)
+{
+	if (request.planner == nullptr) {
+		if (rewriteDataFile(request.data, request.layout) < 0) {
+			fail();
+		}
+		return;
+	}
+
+	RewritePlanner &planner = *request.planner;
+	afc::FastStringBuffer<char> journal;
+	std::vector<RewriteRange> layout;
+	const std::int64_t size = planner.plan(journal, layout) ? rewriteDataFile(journal, layout) : -1;
+	if (size >= 0) {
+		m_shiftEpoch = request.epoch;
+		m_shift = std::uint64_t(size) - request.offset;
+	}
+	planner.finished(size >= 0);
+}
+
+std::int64_t JournalWriter::rewriteDataFile(const afc::FastStringBuffer<char> &journal,
+		const std::vector<RewriteRange> &layout)
+{
+	const afc::FastStringBuffer<char, afc::AllocMode::accurate> tmpPath =
+			siblingPath(m_dataFilePath.data(), m_dataFilePath.size(), ".tmp"_s);
+
+	// The descriptor refers to the data file that is to be replaced.
+	closeDataFile();
+
+	bool result = false;
+	std::int64_t size = 0;
+	if (createParentDirs(tmpPath.c_str(), tmpPath.size())) {
+		const int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		if (fd != -1) {
+			// The old data file is still in place so the records to keep are copied from it.
+			int oldFd = -1;
+			bool oldOpened = false;
+			bool shorter = false;
+			result = true;
+			for (auto it = layout.cbegin(), end = layout.cend(); it != end && result; ++it) {
+				const RewriteRange &range = *it;
+				assert(range.begin <= range.end);
+				if (!range.copied) {
+					assert(range.end <= journal.size());
+					result = writeFully(fd, journal.data() + range.begin, range.end - range.begin);
+					size += range.end - range.begin;
+					continue;
+				}
+				if (!oldOpened) {
+					oldOpened = true;
+					oldFd = open(m_dataFilePath.c_str(), O_RDONLY | O_CLOEXEC);
+					// A missing data file is treated as an empty one.
+					result = oldFd != -1 || errno == ENOENT;
+				}
+				const std::int64_t copied = oldFd == -1 ? 0 : copyFileRange(oldFd, range.begin, range.end, fd);
+				if (copied < 0) {
+					result = false;
+				} else if (std::uint64_t(copied) != range.end - range.begin) {
+					shorter = true;
+				}
+				size += copied;
+			}
+			if (oldFd != -1) {
+				close(oldFd);
+			}
+			if (result && shorter) {
+				afc::logger::logError("[JournalWriter] The data file is shorter than expected. "
+						"Some scrobbles that are not loaded into memory are lost."_s);
+			}
+			result = result && fdatasync(fd) == 0;
+			if (close(fd) != 0) {
+				result = false;
+			}
+		}
+	}
+
+	/* The new data file replaces the old one only when it is synchronised with the storage
+	 * device. This way either the old or the new data file survives an emergency.
+	 */
+	if (result && std::rename(tmpPath.c_str(), m_dataFilePath.c_str()) != 0) {
+		result = false;
+	}
+	if (!result) {
+		std::remove(tmpPath.c_str());
+		afc::logger::logError("[JournalWriter] Unable to re-write the data file."_s);
+		return -1;
+	}
+	if (!syncParentDir(m_dataFilePath.c_str(), m_dataFilePath.size())) {
+		// The data file is replaced but the replacement could be lost in case of an emergency.
+		afc::logger::logError("[JournalWriter] Unable to synchronise the data file directory."_s);
+	}
+
+	afc::logger::logDebug("[JournalWriter] The data file is re-written."_s);
+	return size;
+}
+
+void JournalWriter::processCursor(const Request &request)
+{
+	const afc::FastStringBuffer<char, afc::AllocMode::accurate> cursorPath =
+			siblingPath(m_dataFilePath.data(), m_dataFilePath.size(), ".cursor"_s);
+	const afc::FastStringBuffer<char, afc::AllocMode::accurate> tmpPath =
+			siblingPath(m_dataFilePath.data(), m_dataFilePath.size(), ".cursor.tmp"_s);
+
+	/* The cursor file is replaced by renaming so that a crash while it is written leaves the previous
+	 * cursor in place. It is not synchronised with the storage device: if it is lost or damaged anyway
+	 * (e.g. on a power loss) then it is ignored when the data file is loaded. In this case the acknowledged
+	 * scrobbles are submitted once again but no scrobble is lost.
+	 */
+	bool result = false;
+	if (createParentDirs(tmpPath.c_str(), tmpPath.size())) {
+		const int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		if (fd != -1) {
+			result = writeFully(fd, request.data.data(), request.data.size());
+			if (close(fd) != 0) {
+				result = false;
+			}
+			if (result && std::rename(tmpPath.c_str(), cursorPath.c_str()) != 0) {
+				result = false;
+			}
+			if (!result) {
+				std::remove(tmpPath.c_str());
+			}
+		}
+	}
+
+	if (!result) {
+		afc::logger::logError("[JournalWriter] Unable to store the cursor of the data file."_s);
+	}
+}
+
+bool JournalWriter::openDataFile()
+{
+	if (m_fd != -1) {
+		return true;
+	}
+	if (!createParentDirs(m_dataFilePath.c_str(), m_dataFilePath.size())) {
+		return false;
+	}
+	m_fd = open(m_dataFilePath.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+	return m_fd != -1;
+}
+
+void JournalWriter::closeDataFile()
+{
+	if (m_fd != -1) {
+		close(m_fd);
+		m_fd = -1;
+	}
+}
@@ -0,0 +1,227 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef JOURNALWRITER_HPP_
+#define JOURNALWRITER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <afc/FastStringBuffer.hpp>
+#include <afc/SimpleString.hpp>
+#include "ScrobbleJournal.hpp"
+
+/* Performs all writes to the data file and the accompanying files in the background so that
+ * the thread which requests a write does not wait for file I/O. Requests are processed
+ * in the order they are submitted.
+ *
+ * The data file is kept open for appending while this writer is started. Appends that
+ * are submitted close in time are written by a single writev() call followed by
+ * a single fdatasync() call (group commit) if any of them requests synchronisation.
+ * Appends can be delayed for a while so that they can be amended before they are written.
+ *
+ * Failures are not reported to the submitter directly. Instead, the failure flag is
+ * raised which is to be checked by takeFailure().
+ */
+class JournalWriter
+{
+	JournalWriter(const JournalWriter &) = delete;
+	JournalWriter(JournalWriter &&) = delete;
+	JournalWriter &operator=(const JournalWriter &) = delete;
+	JournalWriter &operator=(JournalWriter &&) = delete;
+public:
+	/* A part of a re-written journal: the octets of the journal given from begin to end
+	 * or, if copied is true, the octets of the data file being replaced from begin to end.
+	 */
+	struct RewriteRange
+	{
+		std::uint64_t begin;
+		std::uint64_t end;
+		bool copied;
+	};
+
+	/* Builds a re-written journal on the background thread once the requests submitted before
+	 * are processed, i.e. once the data file being replaced contains all the records to keep.
+	 */
+	class RewritePlanner
+	{
+	public:
+		/* Fills a given journal and the layout of the new data file (see rewrite()).
+		 *
+		 * @return false if the data file is to be left as is.
+		 */
+		virtual bool plan(afc::FastStringBuffer<char> &journal, std::vector<RewriteRange> &layout) = 0;
+
+		/* Invoked on the background thread once the data file is re-written or is left as is.
+		 * The planner can be destroyed by another thread as soon as this function is invoked.
+		 */
+		virtual void finished(bool rewritten) = 0;
+	protected:
+		~RewritePlanner() = default;
+	};
+
+	JournalWriter() : m_mutex(), m_cv(), m_requests(), m_busy(false), m_stopFlag(false), m_flushWaiters(0),
+			m_appendDelay(0), m_epoch(1), m_thread(), m_dataFilePath(), m_fd(-1), m_shiftEpoch(0), m_shift(0),
+			m_failed(false) {}
+
+	~JournalWriter() { stop(); }
+
+	/* @param appendDelay the time for which appends are delayed before they are written
+	 *         unless flush() is invoked. It is zero by default.
+	 */
+	void start(const afc::String &dataFilePath, std::chrono::milliseconds appendDelay = std::chrono::milliseconds(0));
+	// Processes all pending requests and stops the background thread.
+	void stop();
+
+	/* Appends a sequence of journal records to the data file. The records are expected to be
+	 * written at a given offset. If the data file is of a different size then the records are
+	 * appended anyway but the failure flag is raised. If the records start with the journal
+	 * header (i.e. the offset is zero) but the data file is not empty then the header is skipped.
+	 * Conversely, the header is written if the data file is empty but the offset is non-zero.
+	 */
+	void append(afc::FastStringBuffer<char> &&records, std::uint64_t offset, bool sync);
+
+	/* Appends the records of given buffers that follow each other starting at a given offset,
+	 * as the function above does for each of them. The buffers are submitted at once so that
+	 * they are written by the same writev() call.
+	 */
+	void append(std::vector<afc::FastStringBuffer<char>> &&records, std::uint64_t offset, bool sync);
+
+	/* Replaces the data file with a given journal atomically. The new journal is synchronised
+	 * with the storage device before the data file is replaced.
+	 *
+	 * If a non-empty range of offsets is given then the octets of the data file being replaced
+	 * that fall into this range are appended to the new journal. It is used to keep the records
+	 * that are not loaded into memory. If the data file is shorter than expected then only
+	 * the octets available are copied.
+	 */
+	void rewrite(afc::FastStringBuffer<char> &&journal, std::uint64_t copyBegin = 0, std::uint64_t copyEnd = 0);
+
+	/* Replaces the data file atomically with the journal that consists of given ranges.
+	 * The ranges of the data file being replaced must be ordered by their offsets.
+	 * If the data file is shorter than expected then only the octets available are copied.
+	 */
+	void rewrite(afc::FastStringBuffer<char> &&journal, std::vector<RewriteRange> &&layout);
+
+	/* Replaces the data file atomically with the journal that is planned by a given planner on
+	 * the background thread. The planner must be kept until it is notified that it is finished.
+	 * A failure to re-write the data file does not raise the failure flag.
+	 *
+	 * The appends submitted after this request until rebase() is invoked are expected to follow
+	 * a given offset of the data file being replaced. If the data file is re-written then they
+	 * are moved to follow the new journal instead.
+	 */
+	void rewrite(RewritePlanner &planner, std::uint64_t end);
+
+	// Makes the appends submitted from now on be written at their offsets (see rewrite() above).
+	void rebase();
+
+	// Stores the cursors of the journal. A failure to store them does not raise the failure flag.
+	void storeCursor(std::uint64_t fileId, const JournalCursors &offsets);
+
+	/* Modifies the octets of the data file from offset to offset + size if they belong to an append
+	 * that is not written yet. The octets are passed to the function patch as a pointer to the first
+	 * of them.
+	 *
+	 * @return true if the octets are modified; false if they are written already or are about
+	 *         to be written.
+	 */
+	template<typename Patch>
+	bool amend(std::uint64_t offset, std::size_t size, Patch patch);
+
+	// Blocks until all the requests submitted are processed.
+	void flush();
+
+	// Returns true if a request has failed since the last invocation of this function.
+	bool takeFailure() noexcept { return m_failed.exchange(false, std::memory_order_acq_rel); }
+private:
+	enum RequestType {R_APPEND, R_REWRITE, R_CURSOR};
+
+	struct Request
+	{
+		Request(const RequestType type, afc::FastStringBuffer<char> &&data, const std::uint64_t offset,
+				const bool sync)
+			: data(std::move(data)), offset(offset), epoch(0), type(type), sync(sync), layout(), planner(nullptr) {}
+
+		afc::FastStringBuffer<char> data;
+		// For a planned rewrite, the end of the data file being replaced.
+		std::uint64_t offset;
+		// The series of appends the request is submitted within (see rebase()).
+		std::uint64_t epoch;
+		RequestType type;
+		bool sync;
+		// Used by rewrites only: the ranges of the new data file.
+		std::vector<RewriteRange> layout;
+		// Used by planned rewrites only.
+		RewritePlanner *planner;
+	};
+
+	typedef std::deque<Request>::iterator RequestIterator;
+
+	void run();
+	void submit(Request &&request);
+	void processAppends(RequestIterator begin, RequestIterator end);
+	void processRewrite(const Request &request);
+	// Returns the size of the new data file, or -1 if the data file is not re-written.
+	std::int64_t rewriteDataFile(const afc::FastStringBuffer<char> &journal, const std::vector<RewriteRange> &layout);
+	void processCursor(const Request &request);
+	bool openDataFile();
+	void closeDataFile();
+	void fail() noexcept { m_failed.store(true, std::memory_order_release); }
+
+	std::mutex m_mutex;
+	// Used both to wake up the background thread and to notify flush() of completed requests.
+	std::condition_variable m_cv;
+	std::deque<Request> m_requests;
+	// Indicates if the background thread is processing requests that are not in m_requests.
+	bool m_busy;
+	bool m_stopFlag;
+	std::size_t m_flushWaiters;
+	std::chrono::milliseconds m_appendDelay;
+	std::uint64_t m_epoch;
+	std::thread m_thread;
+
+	// These fields are accessed by the background thread only while it is started.
+	afc::String m_dataFilePath;
+	int m_fd;
+	// The appends of this series are moved by m_shift octets since the data file is re-written as planned.
+	std::uint64_t m_shiftEpoch;
+	std::uint64_t m_shift;
+
+	std::atomic<bool> m_failed;
+};
+
+template<typename Patch>
+bool JournalWriter::amend(const std::uint64_t offset, const std::size_t size, Patch patch)
+{ std::lock_guard<std::mutex> lock(m_mutex);
+	// The requests that are taken by the background thread are not in m_requests.
+	for (Request &request : m_requests) {
+		if (request.type == R_APPEND && request.offset <= offset &&
+				offset + size <= request.offset + request.data.size()) {
+			patch(&*request.data.begin() + (offset - request.offset));
+			return true;
+		}
+	}
+	return false;
+}
+
+#endif /* JOURNALWRITER_HPP_ */
@@ -18,10 +18,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstddef>
 #include <cstdio>
 #include <limits>
+#include <memory>
 #include <utility>
+#include <vector>
 
 #include "HttpClient.hpp"
 
@@ -48,6 +51,18 @@ using namespace afc::url;
 
 namespace
 {
+	/* The calls that exceed these limits fail, and are retried as any other failed call.
+	 * The stall detection covers waiting for the response, so it is longer than firstByte
+	 * for the latter to have effect.
+	 */
+	constexpr HttpTimeouts lastfmTimeouts = {
+		std::chrono::seconds(10), // connect
+		std::chrono::seconds(10), // tls
+		std::chrono::seconds(15), // firstByte
+		std::chrono::seconds(60), // total
+		1, std::chrono::seconds(20) // stallSpeed, stallTime
+	};
+
 	inline UrlBuilder<webForm> buildAuthUrl(const afc::String &scrobblerUrl, const afc::String &username,
 			const afc::String &password)
 	{
@@ -170,7 +185,7 @@ namespace
 
 	void appendScrobbleInfo(UrlBuilder<webForm> &builder, const ScrobbleInfo &scrobbleInfo, const unsigned char index)
 	{
-		assert(index < 50); // max amount of scrobbles per request.
+		assert(index < LastfmScrobbler::maxScrobblesPerRequest);
 
 		const Track &track = scrobbleInfo.track;
 		assert(track.getTitleBegin() != track.getTitleEnd());
@@ -229,6 +244,9 @@ namespace
 		case StatusCode::OPERATION_TIMEOUT:
 			message = "sending the request has timed out";
 			break;
+		case StatusCode::STALLED:
+			message = "the connection has stalled";
+			break;
 		default:
 			message = "unknown error";
 		}
@@ -238,153 +256,261 @@ namespace
 	static constexpr auto lastfmResponseDelim = [](const char c) noexcept { return c == '\n'; };
 }
 
-void LastfmScrobbler::submitNowPlayingTrack()
+class LastfmScrobbler::Call final : public HttpCall
 {
-	assertLocked();
-
-	logDebug("[LastfmScrobbler] Trying to submit the now-playing notification to the scrobbling server."_s);
-
-	if (unlikely(!m_configured)) {
-		logError("[LastfmScrobbler] Scrobbler is not configured properly."_s);
-		return;
+public:
+	enum Type {HANDSHAKE, NOW_PLAYING, SUBMISSION};
+	enum Outcome {SUCCEEDED, BAD_SESSION, FAILED};
+
+	Call(LastfmScrobbler &owner, const Type type)
+		: type(type), submittedCount(0), firstScrobble(nullptr), sessionId(), nowPlayingUrl(), submissionUrl(),
+		  m_owner(owner), m_body(), m_submissionBody(sessionId), m_request(), m_responseBody(),
+		  m_responseBodyAppender(m_responseBody), m_response(m_responseBodyAppender)
+	{
+		m_request.setBody(nullptr, 0);
 	}
 
-	if (!m_hasNowPlayingTrack) {
-		logDebug("[LastfmScrobbler] There is no now-playing track to submit."_s);
-		return;
+	// The body is copied since it must live until the call is completed.
+	void setBody(const char * const body, const std::size_t size)
+	{
+		m_body.reserve(size);
+		m_body.append(body, size);
+		m_request.setBody(m_body.data(), m_body.size());
 	}
 
-	if (!ensureAuthenticated()) {
-		logDebug("[LastfmScrobbler] Not authenticated. The now-playing notification is not sent."_s);
-		return;
+	// The body submits given scrobbles within sessionId. It is encoded while the request is sent.
+	void setSubmissionBody(std::vector<const ScrobbleInfo *> &&batch)
+	{
+		m_submissionBody.batch = std::move(batch);
+		m_request.setBody(m_submissionBody);
 	}
 
-	// Resetting the event despite of the result of the attempt to submit it to the scrobbling server.
-	m_hasNowPlayingTrack = false;
+	// A handshake is sent by GET, the other calls are sent by POST with the body set.
+	StatusCode prepare(const char * const url)
+	{
+		// The call is also aborted when this Scrobbler is stopped, regardless of the timeouts.
+		return type == HANDSHAKE ?
+				HttpClient().prepareGet(*this, url, m_request, m_response, lastfmTimeouts) :
+				HttpClient().preparePost(*this, url, m_request, m_response, lastfmTimeouts);
+	}
 
-	const Track &track = m_nowPlayingTrack;
+	/* Parses the response. The session of a successful handshake is stored to this call.
+	 *
+	 * It is executed outside lock on m_mutex.
+	 */
+	Outcome processResponse(StatusCode result);
+
+	virtual void completed(const StatusCode result) override { m_owner.callCompleted(*this, result); }
+
+	const Type type;
+	// The scrobbles submitted are the leading pending scrobbles, starting with firstScrobble.
+	std::size_t submittedCount;
+	const ScrobbleInfo *firstScrobble;
+	// The session that a successful handshake obtains, or the one the other calls are made within.
+	afc::String sessionId;
+	afc::String nowPlayingUrl;
+	afc::String submissionUrl;
+private:
+	/* Encodes the submission form, a scrobble at a time. It is invoked by the reactor thread, outside
+	 * lock on m_mutex while the request is sent. It is safe since other threads cannot modify or delete
+	 * the scrobbles submitted until the call is completed (see Scrobbler::collectBatch()).
+	 */
+	class SubmissionBody final : public PieceBodyProducer
+	{
+	public:
+		explicit SubmissionBody(const afc::String &sessionId) : batch(), m_sessionId(sessionId) {}
 
-	// TODO re-use buffer?
-	afc::FastStringBuffer<char> artistsTagBuf;
-	writeArtists(track, artistsTagBuf);
+		std::vector<const ScrobbleInfo *> batch;
+	protected:
+		virtual bool encodePiece(const std::size_t index, afc::FastStringBuffer<char> &dest) override
+		{
+			if (index > batch.size()) {
+				return false;
+			}
+			if (index == 0) {
+				// TODO URL-encode session ID right after it is obtained during the authentication process.
+				const UrlBuilder<webForm> session(queryOnly,
+						UrlPart<raw>("s"_s), UrlPart<>(m_sessionId.data(), m_sessionId.size()));
+				dest.reserve(dest.size() + session.size());
+				dest.append(session.data(), session.size());
+				return true;
+			}
+			// Each of the other pieces is the '&'-prefixed parameters of a scrobble.
+			UrlBuilder<webForm> params(queryOnly);
+			appendScrobbleInfo(params, *batch[index - 1], static_cast<unsigned char>(index - 1));
+			dest.reserve(dest.size() + 1 + params.size());
+			dest.append(u8"&"[0]);
+			dest.append(params.data(), params.size());
+			return true;
+		}
+	private:
+		const afc::String &m_sessionId;
+	};
 
-	const char * const trackTitleBegin = track.getTitleBegin();
-	const std::size_t trackTitleSize = track.getTitleEnd() - trackTitleBegin;
+	Outcome processHandshakeResponse(const char *statusBegin, const char *statusEnd, const char *end);
+	Outcome processStatus(const char *statusBegin, const char *statusEnd);
 
-	const char * const albumTitleBegin = track.getAlbumTitleBegin();
-	const std::size_t albumTitleSize = track.getAlbumTitleEnd() - albumTitleBegin;
+	LastfmScrobbler &m_owner;
+	afc::FastStringBuffer<char> m_body;
+	SubmissionBody m_submissionBody;
+	HttpRequest m_request;
+	/* No conversion to the system encoding is used as the response body is assumed to be in
+	 * an ASCII-compatible encoding. It contains status codes, URLs (both are in ASCII),
+	 * and some reason messages that are safe to be used without conversion with hope
+	 * they are in ASCII, too.
+	 */
+	afc::FastStringBuffer<char> m_responseBody;
+	FastStringBufferAppender m_responseBodyAppender;
+	HttpResponse m_response;
+};
 
-	// TODO optimise parameter passing
-	UrlBuilder<webForm> builder(queryOnly,
-			// TODO URL-encode session ID right after it is obtained during the authentication process.
-			UrlPart<raw>("s"_s), UrlPart<>(m_sessionId.data(), m_sessionId.size()),
-			UrlPart<raw>("a"_s), UrlPart<>(artistsTagBuf.data(), artistsTagBuf.size()),
-			UrlPart<raw>("t"_s), UrlPart<>(trackTitleBegin, trackTitleSize),
-			UrlPart<raw>("b"_s), UrlPart<>(albumTitleBegin, albumTitleSize),
-			UrlPart<raw>("l"_s), NumberUrlPart<long>(track.getDurationMillis() / 1000),
-			// TODO Support track numbers.
-			// The position of the track on the album, or an empty string if not known.
-			UrlPart<raw>("n"_s), UrlPart<raw>(""_s),
-			// TODO Support MusicBrainz Track IDs.
-			// The MusicBrainz Track ID, or an empty string if not known.
-			UrlPart<raw>("m"_s), UrlPart<>(""_s));
+LastfmScrobbler::Call::Outcome LastfmScrobbler::Call::processResponse(const StatusCode result)
+{
+	if (unlikely(result == StatusCode::ABORTED_BY_CLIENT)) {
+		logDebug("[LastfmScrobbler] An HTTP call is aborted."_s);
+		return FAILED;
+	}
+	if (unlikely(result != StatusCode::SUCCESS)) {
+		reportHttpClientError(result);
+		return FAILED;
+	}
 
-	HttpRequest request;
-	request.setBody(builder.data(), builder.size());
+	static const char * const names[] = {"Authentication", "Now-playing", "Submission"};
+	logDebug("[LastfmScrobbler] "_s, names[type], " response status code: "_s, m_response.statusCode);
+	logDebug("[LastfmScrobbler] "_s, names[type], " response body:\n"_s,
+			std::make_pair(m_responseBody.begin(), m_responseBody.end()));
 
-	// Making a copy of shared data to pass outside the critical section.
-	const afc::String nowPlayingUrlCopy(m_nowPlayingUrl);
+	if (unlikely(m_response.statusCode != 200)) {
+		switch (type) {
+		case HANDSHAKE:
+			logError("[LastfmScrobbler] An error is encountered while authenticating the user to Last.fm."_s);
+			break;
+		case NOW_PLAYING:
+			logError("[LastfmScrobbler] An error is encountered while submitting the now-playing track to Last.fm."_s);
+			break;
+		default:
+			logError("[LastfmScrobbler] An error is encountered while submitting the scrobbles to Last.fm."_s);
+		}
+		return FAILED;
+	}
 
-	/* No conversion to the system encoding is used as the response body is assumed to be in
-	 * an ASCII-compatible encoding. It contains status codes (in ASCII), and some reason
-	 * messages that are safe to be used without conversion with hope they are in ASCII, too.
-	 */
-	afc::FastStringBuffer<char> responseBody;
-	FastStringBufferAppender responseBodyAppender(responseBody);
-	StatusCode result;
-	HttpResponse response(responseBodyAppender);
-
-	/* Each HTTP call is performed outside the critical section so that other threads can:
-	 * - add scrobbles without waiting for this call to finish
-	 * - stop this Scrobbler by invoking Scrobbler::stop(). In this case this HTTP call
-	 * is aborted and the scrobbles involved are left in the list of pending scrobbles
-	 * so that they can be stored to the data file and be completed later.
-	 *
-	 * It is safe to unlock the mutex because:
-	 * - no shared data is accessed outside the critical section
-	 * - other threads cannot delete scrobbles in the meantime (because the scrobbling thread
-	 * assumes that the scrobbles being submitted are the first {submittedCount} elements in
-	 * the list of pending scrobbles.
-	 *
-	 * In addition, it is safe to use m_finishScrobblingFlag outside the critical section
-	 * because it is atomic.
+	/* Using find_if to tokenise response instead of find since the former
+	 * takes parameters by value which minimises memory reads.
 	 */
-	{ UnlockGuard unlockGuard(m_mutex);
-		logDebug("[LastfmScrobbler] Now-playing URL: '"_s, nowPlayingUrlCopy, "'."_s);
-		logDebug("[LastfmScrobbler] Now-playing request body: '"_s,
-				std::make_pair(request.getBody(), request.getBody() + request.getBodySize()), "'."_s);
+	const char * const begin = m_responseBody.data(), * const end = m_responseBody.data() + m_responseBody.size();
+	// Status.
+	const char * const statusEnd = std::find_if(begin, end, lastfmResponseDelim);
+	if (unlikely(statusEnd == end)) {
+		logError("[LastfmScrobbler] Invalid response body (missing line feed): "_s,
+				std::make_pair(m_responseBody.begin(), m_responseBody.end()));
+		return FAILED;
+	}
+
+	return type == HANDSHAKE ? processHandshakeResponse(begin, statusEnd, end) : processStatus(begin, statusEnd);
+}
 
-		// The timeouts are set to 'infinity' since this HTTP call is interruptible.
-		result = HttpClient().post(nowPlayingUrlCopy.c_str(), request, response,
-				HttpClient::NO_TIMEOUT, HttpClient::NO_TIMEOUT, m_finishScrobblingFlag);
+LastfmScrobbler::Call::Outcome LastfmScrobbler::Call::processHandshakeResponse(const char * const statusBegin,
+		const char * const statusEnd, const char * const end)
+{
+	if (unlikely(statusEnd - statusBegin != 2 || *statusBegin != 'O' || *(statusBegin + 1) != 'K')) {
+		// TODO handle non-OK responses differently (e.g. if BANNED then disable the plugin).
+		logError("[LastfmScrobbler] Unable to authenticate the user to Last.fm. Reason: "_s,
+				std::make_pair(statusBegin, statusEnd));
+		return FAILED;
 	}
 
-	if (result == StatusCode::ABORTED_BY_CLIENT) {
-		logDebug("[LastfmScrobbler] An HTTP call is aborted."_s);
-		return;
+	// Session ID.
+	const char *seqBegin = statusEnd + 1;
+	const char *seqEnd = std::find_if(seqBegin, end, lastfmResponseDelim);
+	sessionId.assign(seqBegin, seqEnd);
+
+	if (unlikely(seqEnd == end)) {
+		logError("[LastfmScrobbler] Invalid response body: "_s,
+				std::make_pair(m_responseBody.begin(), m_responseBody.end()));
+		return FAILED;
 	}
-	if (result != StatusCode::SUCCESS) {
-		reportHttpClientError(result);
-		return;
+
+	// Now-playing URL.
+	seqBegin = seqEnd + 1;
+	seqEnd = std::find_if(seqBegin, end, lastfmResponseDelim);
+	nowPlayingUrl.assign(seqBegin, seqEnd);
+
+	if (unlikely(seqEnd == end)) {
+		logError("[LastfmScrobbler] Invalid response body: "_s,
+				std::make_pair(m_responseBody.begin(), m_responseBody.end()));
+		return FAILED;
 	}
 
-	logDebug("[LastfmScrobbler] Now-playing response status code: "_s, response.statusCode);
-	logDebug("[LastfmScrobbler] Now-playing response body: "_s,
-			std::make_pair(responseBody.begin(), responseBody.end()));
+	// Submission URL.
+	seqBegin = seqEnd + 1;
+	seqEnd = std::find_if(seqBegin, end, lastfmResponseDelim);
+	submissionUrl.assign(seqBegin, seqEnd);
 
-	if (response.statusCode == 200) {
-		/* Using find_if to tokenise response instead of find since the former
-		 * takes parameters by value which minimises memory reads.
-		 */
-		const char *seqBegin = responseBody.data(), *seqEnd, *end = responseBody.data() + responseBody.size();
-		seqEnd = std::find_if(seqBegin, end, lastfmResponseDelim);
-		if (unlikely(seqEnd == end)) {
-			logError("[LastfmScrobbler] Invalid response body (missing line feed): "_s,
-					std::make_pair(responseBody.begin(), responseBody.end()));
-			return;
-		}
-		const std::size_t tokenSize = seqEnd - seqBegin;
-		if (tokenSize == 2 && *seqBegin == 'O' && *(seqBegin + 1) == 'K') {
+	return SUCCEEDED;
+}
+
+LastfmScrobbler::Call::Outcome LastfmScrobbler::Call::processStatus(const char * const statusBegin,
+		const char * const statusEnd)
+{
+	const std::size_t tokenSize = statusEnd - statusBegin;
+	constexpr ConstStringRef badSession = "BADSESSION"_s;
+	if (tokenSize == 2 && *statusBegin == 'O' && *(statusBegin + 1) == 'K') {
+		if (type == NOW_PLAYING) {
 			logDebug("[LastfmScrobbler] The now-playing track is submitted successfully."_s);
-			return;
 		} else {
-			constexpr ConstStringRef badSession = "BADSESSION"_s;
-			if (tokenSize == badSession.size() && equal(badSession.begin(), badSession.end(), seqBegin)) {
-				logDebug("[LastfmScrobbler] The now-playing track is not submitted. "
-						"The user is not authenticated to Last.fm."_s);
-
-				deauthenticate();
-				return;
-			} else {
-				// TODO think of counting hard failures, as the specification suggests.
-				// A hard failure or an unknown status is reported.
-				logError("[LastfmScrobbler] Unable to submit the now-playing track to Last.fm. Reason: "_s,
-						std::make_pair(seqBegin, seqEnd));
-				return;
-			}
+			logDebug("[LastfmScrobbler] The scrobbles are submitted successfully."_s);
 		}
+		return SUCCEEDED;
+	}
+	if (tokenSize == badSession.size() && equal(badSession.begin(), badSession.end(), statusBegin)) {
+		if (type == NOW_PLAYING) {
+			logDebug("[LastfmScrobbler] The now-playing track is not submitted. "
+					"The user is not authenticated to Last.fm."_s);
+		} else {
+			logDebug("[LastfmScrobbler] The scrobbles are not submitted. "
+					"The user is not authenticated to Last.fm."_s);
+		}
+		return BAD_SESSION;
+	}
+
+	// TODO think of counting hard failures, as the specification suggests.
+	// A hard failure or an unknown status is reported.
+	if (type == NOW_PLAYING) {
+		logError("[LastfmScrobbler] Unable to submit the now-playing track to Last.fm. Reason: "_s,
+				std::make_pair(statusBegin, statusEnd));
 	} else {
-		logError("[LastfmScrobbler] An error is encountered while submitting the now-playing track to Last.fm."_s);
-		return;
+		logError("[LastfmScrobbler] Unable to submit scrobbles to Last.fm. Reason: "_s,
+				std::make_pair(statusBegin, statusEnd));
 	}
+	return FAILED;
+}
+
+LastfmScrobbler::LastfmScrobbler() : Scrobbler(maxScrobblesPerRequest), m_scrobblerUrl(), m_username(), m_password(),
+		m_dataFilePath(), m_sessionId(), m_submissionUrl(), m_nowPlayingTrack(nullptr), m_authenticated(false),
+		m_calls(), m_submissionRequested(false)
+{ std::lock_guard<std::mutex> lock(m_mutex); // synchronising memory
+	/* This instance is partially initialised here. It will be initialised completely
+	 * when ::start() is invoked successfully.
+	 */
+}
+
+LastfmScrobbler::~LastfmScrobbler()
+{
+	// Synchronising memory before destructing the member fields of this LastfmScrobbler.
+	std::lock_guard<std::mutex> lock(m_mutex);
+	delete m_nowPlayingTrack.exchange(nullptr, std::memory_order_acquire);
 }
 
 void LastfmScrobbler::stopExtra()
 {
+	// The call in progress, if any, is aborted and completed once this Scrobbler is detached from the reactor.
+	assert(m_calls[Call::HANDSHAKE] == nullptr && m_calls[Call::NOW_PLAYING] == nullptr &&
+			m_calls[Call::SUBMISSION] == nullptr);
+	m_submissionRequested = false;
 	m_sessionId.clear();
 	m_scrobblerUrl.clear();
 	m_nowPlayingUrl.clear();
-	m_hasNowPlayingTrack = false;
+	delete m_nowPlayingTrack.exchange(nullptr, std::memory_order_acquire);
 }
 
 void LastfmScrobbler::configure(const char * const serverUrl, const std::size_t serverUrlSize,
@@ -415,8 +541,8 @@ void LastfmScrobbler::configure(const char * const serverUrl, const std::size_t
 	}
 
 	if (reconfigured) {
-		// The configuration has changed. Updating it as well as resetting the 'scrobbles to wait' counter.
-		m_scrobblesToWait = minScrobblesToWait();
+		// The configuration has changed. Updating it as well as re-submitting pending scrobbles at once.
+		resetRetryDelay();
 		m_authenticated = false;
 	}
 
@@ -425,14 +551,15 @@ void LastfmScrobbler::configure(const char * const serverUrl, const std::size_t
 	logDebug("[LastfmScrobbler] Configuring completed."_s);
 }
 
-std::size_t LastfmScrobbler::doScrobbling()
+void LastfmScrobbler::startScrobbling()
 {
 	assertLocked();
 	assert(!m_pendingScrobbles.empty());
 
 	if (unlikely(!m_configured)) {
 		logError("Scrobbler is not configured properly."_s);
-		return 0;
+		attemptFinished(0);
+		return;
 	}
 
 	if (m_scrobblerUrl.empty()) {
@@ -442,245 +569,240 @@ std::size_t LastfmScrobbler::doScrobbling()
 		 * to point to a scrobbling server.
 		 */
 		logError("URL to the scrobbling server is undefined."_s);
-		return 0;
-	}
-
-	if (!ensureAuthenticated()) {
-		return 0;
+		attemptFinished(0);
+		return;
 	}
 
-	// 50 is the max number of scrobbles that can be submitted within a single request.
-	constexpr unsigned maxScrobblesPerRequest = 50;
+	// The submission is started at once unless the handshake is in progress.
+	m_submissionRequested = true;
+	startCalls();
+}
 
-	// Adding up to maxScrobblesPerRequest scrobbles to the request.
-	UrlBuilder<webForm> builder(queryOnly,
-			// TODO URL-encode session ID right after it is obtained during the authentication process.
-			UrlPart<raw>("s"_s), UrlPart<>(m_sessionId.data(), m_sessionId.size()));
+void LastfmScrobbler::startCalls()
+{
+	assertLocked();
 
-	/* Points to the position after the end of the chunk of scrobbles submitted and is used
-	 * to remove these scrobbles from the queue if they are submitted successfully.
-	 */
-	auto chunkEnd = m_pendingScrobbles.begin();
-	unsigned submittedCount = 0;
-	for (auto end = m_pendingScrobbles.end(); chunkEnd != end && submittedCount < maxScrobblesPerRequest;
-			++chunkEnd, ++submittedCount) {
-		appendScrobbleInfo(builder, *chunkEnd, submittedCount);
+	if (m_calls[Call::HANDSHAKE] != nullptr || m_finishScrobblingFlag.load(std::memory_order_relaxed)) {
+		// The calls are started once the handshake is completed, unless this Scrobbler is stopped.
+		return;
 	}
 
-	HttpRequest request;
-	request.setBody(builder.data(), builder.size());
-
-	// Making a copy of shared data to pass outside the critical section.
-	const afc::String submissionUrlCopy(m_submissionUrl);
-
-#ifndef NDEBUG
-	const size_t pendingScrobbleCount = m_pendingScrobbles.size();
-#endif
-
-	/* No conversion to the system encoding is used as the response body is assumed to be in
-	 * an ASCII-compatible encoding. It contains status codes (in ASCII), and some reason
-	 * messages that are safe to be used without conversion with hope they are in ASCII, too.
-	 */
-	afc::FastStringBuffer<char> responseBody;
-	FastStringBufferAppender responseBodyAppender(responseBody);
-	StatusCode result;
-	HttpResponse response(responseBodyAppender);
-
-	/* Each HTTP call is performed outside the critical section so that other threads can:
-	 * - add scrobbles without waiting for this call to finish
-	 * - stop this Scrobbler by invoking Scrobbler::stop(). In this case this HTTP call
-	 * is aborted and the scrobbles involved are left in the list of pending scrobbles
-	 * so that they can be stored to the data file and be completed later.
-	 *
-	 * It is safe to unlock the mutex because:
-	 * - no shared data is accessed outside the critical section
-	 * - other threads cannot delete scrobbles in the meantime (because the scrobbling thread
-	 * assumes that the scrobbles being submitted are the first {submittedCount} elements in
-	 * the list of pending scrobbles.
-	 *
-	 * In addition, it is safe to use m_finishScrobblingFlag outside the critical section
-	 * because it is atomic.
-	 */
-	{ UnlockGuard unlockGuard(m_mutex);
-		logDebug("[LastfmScrobbler] Submission URL: '"_s, submissionUrlCopy, "'."_s);
-		logDebug("[LastfmScrobbler] Submission request body: '"_s,
-				std::make_pair(request.getBody(), request.getBody() + request.getBodySize()), "'."_s);
-
-		// The timeouts are set to 'infinity' since this HTTP call is interruptible.
-		result = HttpClient().post(submissionUrlCopy.c_str(), request, response,
-				HttpClient::NO_TIMEOUT, HttpClient::NO_TIMEOUT, m_finishScrobblingFlag);
+	const bool nowPlaying = m_configured && m_calls[Call::NOW_PLAYING] == nullptr &&
+			m_nowPlayingTrack.load(std::memory_order_relaxed) != nullptr;
+	const bool submission = m_submissionRequested && m_calls[Call::SUBMISSION] == nullptr;
+	if (!nowPlaying && !submission) {
+		return;
 	}
 
-	/* Ensure that no scrobbles are deleted by other threads during the HTTP call.
-	 * Only the scrobbling thread and ::stop() can do this, and ::stop() must wait for
-	 * the scrobbling thread to finish in order to do this.
-	 */
-	assert(pendingScrobbleCount <= m_pendingScrobbles.size());
+	if (!m_authenticated) {
+		// The session is renewed once the calls that are made within the previous one are completed.
+		if (m_calls[Call::NOW_PLAYING] == nullptr && m_calls[Call::SUBMISSION] == nullptr && !startHandshake()) {
+			handshakeFailed();
+		}
+		return;
+	}
 
-	if (result == StatusCode::ABORTED_BY_CLIENT) {
-		logDebug("[LastfmScrobbler] An HTTP call is aborted."_s);
-		return 0;
+	// The now-playing notification does not wait for the submission and vice versa.
+	if (nowPlaying) {
+		startNowPlaying();
 	}
-	if (result != StatusCode::SUCCESS) {
-		reportHttpClientError(result);
-		return 0;
+	if (submission) {
+		startSubmission();
 	}
+}
 
-	logDebug("[LastfmScrobbler] Submission response status code: '"_s, response.statusCode, "'."_s);
-	logDebug("[LastfmScrobbler] Submission response body:\n"_s,
-			std::make_pair(responseBody.begin(), responseBody.end()));
+inline bool LastfmScrobbler::startHandshake()
+{
+	assertLocked();
 
-	if (response.statusCode == 200) {
-		/* Using find_if to tokenise response instead of find since the former
-		 * takes parameters by value which minimises memory reads.
-		 */
-		const char *seqBegin = responseBody.data(), *seqEnd, *end = responseBody.data() + responseBody.size();
-		seqEnd = std::find_if(seqBegin, end, lastfmResponseDelim);
-		if (unlikely(seqEnd == end)) {
-			logError("[LastfmScrobbler] Invalid response body (missing line feed): "_s,
-					std::make_pair(responseBody.begin(), responseBody.end()));
-			return 0;
-		}
-		const std::size_t tokenSize = seqEnd - seqBegin;
-		if (tokenSize == 2 && *seqBegin == 'O' && *(seqBegin + 1) == 'K') {
-			logDebug("[LastfmScrobbler] The scrobbles are submitted successfully."_s);
+	logDebug("[LastfmScrobbler] Authenticating the user..."_s);
 
-			m_pendingScrobbles.erase(m_pendingScrobbles.begin(), chunkEnd);
-			return submittedCount;
-		} else {
-			constexpr ConstStringRef badSession = "BADSESSION"_s;
-			if (tokenSize == badSession.size() && equal(badSession.begin(), badSession.end(), seqBegin)) {
-				logDebug("[LastfmScrobbler] The scrobbles are not submitted. "
-						"The user is not authenticated to Last.fm."_s);
+	// TODO set real client ID and version.
+	const UrlBuilder<webForm> url = buildAuthUrl(m_scrobblerUrl, m_username, m_password);
+	logDebug("[LastfmScrobbler] Authentication URL: "_s, url.c_str());
 
-				deauthenticate();
-				return 0;
-			} else {
-				// TODO think of counting hard failures, as the specification suggests.
-				// A hard failure or an unknown status is reported.
-				logError("[LastfmScrobbler] Unable to submit scrobbles to Last.fm. Reason: "_s,
-						std::make_pair(seqBegin, seqEnd));
-				return 0;
-			}
-		}
-	} else {
-		logError("[LastfmScrobbler] An error is encountered while submitting the scrobbles to Last.fm."_s);
-		return 0;
+	std::unique_ptr<Call> call(new Call(*this, Call::HANDSHAKE));
+	const StatusCode result = call->prepare(url.c_str());
+	if (unlikely(result != StatusCode::SUCCESS)) {
+		reportHttpClientError(result);
+		return false;
 	}
-
-	return 0;
+	return startCall(std::move(call));
 }
 
-inline bool LastfmScrobbler::ensureAuthenticated()
+inline void LastfmScrobbler::startNowPlaying()
 {
 	assertLocked();
 
-	if (m_authenticated) {
-		return true;
+	logDebug("[LastfmScrobbler] Trying to submit the now-playing notification to the scrobbling server."_s);
+
+	// Resetting the event despite of the result of the attempt to submit it to the scrobbling server.
+	const std::unique_ptr<Track> nowPlayingTrack(m_nowPlayingTrack.exchange(nullptr, std::memory_order_acquire));
+	if (nowPlayingTrack == nullptr) {
+		return;
 	}
+	const Track &track = *nowPlayingTrack;
 
-	logDebug("[LastfmScrobbler] Authenticating the user..."_s);
+	// TODO re-use buffer?
+	afc::FastStringBuffer<char> artistsTagBuf;
+	writeArtists(track, artistsTagBuf);
 
-	// TODO set real client ID and version.
-	const UrlBuilder<webForm> url = buildAuthUrl(m_scrobblerUrl, m_username, m_password);
+	const char * const trackTitleBegin = track.getTitleBegin();
+	const std::size_t trackTitleSize = track.getTitleEnd() - trackTitleBegin;
 
-	/* No conversion to the system encoding is used as the response body is assumed to be in
-	 * an ASCII-compatible encoding. It contains status codes, URLs (both are in ASCII),
-	 * and some reason messages that are safe to be used without conversion with hope
-	 * they are in ASCII, too.
-	 */
-	afc::FastStringBuffer<char> responseBody;
-	FastStringBufferAppender responseBodyAppender(responseBody);
-	StatusCode result;
-	HttpResponse response(responseBodyAppender);
-
-	/* Each HTTP call is performed outside the critical section so that other threads can:
-	 * - add scrobbles without waiting for this call to finish
-	 * - stop this Scrobbler by invoking Scrobbler::stop(). In this case this HTTP call
-	 * is aborted and the scrobbles involved are left in the list of pending scrobbles
-	 * so that they can be stored to the data file and be completed later.
-	 *
-	 * It is safe to unlock the mutex because no shared data is accessed outside the critical section.
-	 *
-	 * In addition, it is safe to use m_finishScrobblingFlag outside the critical section
-	 * because it is atomic.
-	 */
-	{ UnlockGuard unlockGuard(m_mutex);
-		logDebug("[LastfmScrobbler] Authentication URL: "_s, url.c_str());
+	const char * const albumTitleBegin = track.getAlbumTitleBegin();
+	const std::size_t albumTitleSize = track.getAlbumTitleEnd() - albumTitleBegin;
 
-		// The timeouts are set to 'infinity' since this HTTP call is interruptible.
-		result = HttpClient().get(url.c_str(), HttpRequest(), response,
-				HttpClient::NO_TIMEOUT, HttpClient::NO_TIMEOUT, m_finishScrobblingFlag);
-	}
+	// TODO optimise parameter passing
+	UrlBuilder<webForm> builder(queryOnly,
+			// TODO URL-encode session ID right after it is obtained during the authentication process.
+			UrlPart<raw>("s"_s), UrlPart<>(m_sessionId.data(), m_sessionId.size()),
+			UrlPart<raw>("a"_s), UrlPart<>(artistsTagBuf.data(), artistsTagBuf.size()),
+			UrlPart<raw>("t"_s), UrlPart<>(trackTitleBegin, trackTitleSize),
+			UrlPart<raw>("b"_s), UrlPart<>(albumTitleBegin, albumTitleSize),
+			UrlPart<raw>("l"_s), NumberUrlPart<long>(track.getDurationMillis() / 1000),
+			// TODO Support track numbers.
+			// The position of the track on the album, or an empty string if not known.
+			UrlPart<raw>("n"_s), UrlPart<raw>(""_s),
+			// TODO Support MusicBrainz Track IDs.
+			// The MusicBrainz Track ID, or an empty string if not known.
+			UrlPart<raw>("m"_s), UrlPart<>(""_s));
 
-	if (unlikely(result == StatusCode::ABORTED_BY_CLIENT)) {
-		logDebug("[LastfmScrobbler] An HTTP call is aborted."_s);
-		return false;
-	}
-	if (unlikely(result != StatusCode::SUCCESS)) {
+	std::unique_ptr<Call> call(new Call(*this, Call::NOW_PLAYING));
+	call->sessionId = m_sessionId;
+	call->setBody(builder.data(), builder.size());
+
+	logDebug("[LastfmScrobbler] Now-playing URL: '"_s, m_nowPlayingUrl, "'."_s);
+	logDebug("[LastfmScrobbler] Now-playing request body: '"_s,
+			std::make_pair(builder.data(), builder.data() + builder.size()), "'."_s);
+
+	const StatusCode result = call->prepare(m_nowPlayingUrl.c_str());
+	if (result != StatusCode::SUCCESS) {
 		reportHttpClientError(result);
-		return false;
+		return;
 	}
+	startCall(std::move(call));
+}
 
-	logDebug("[LastfmScrobbler] Authentication response status code: "_s, response.statusCode);
-	logDebug("[LastfmScrobbler] Authentication response body: "_s,
-			std::make_pair(responseBody.begin(), responseBody.end()));
+void LastfmScrobbler::startSubmission()
+{
+	assertLocked();
+	assert(m_submissionRequested);
 
-	if (unlikely(response.statusCode != 200)) {
-		logError("[LastfmScrobbler] An error is encountered while authenticating the user to Last.fm."_s);
-		return false;
-	}
+	m_submissionRequested = false;
 
-	/* Using find_if to tokenise response instead of find since the former
-	 * takes parameters by value which minimises memory reads.
+	/* Up to maxScrobblesPerRequest leading scrobbles are submitted within the request. A single
+	 * request is in flight at a time, whatever setMaxBatchesInFlight() sets, since Last.fm expects
+	 * scrobbles in chronological order and the later batches could be processed first otherwise.
+	 */
+	std::vector<const ScrobbleInfo *> batch;
+	collectBatch(batch);
+
+	std::unique_ptr<Call> call(new Call(*this, Call::SUBMISSION));
+	call->sessionId = m_sessionId;
+	call->submittedCount = batch.size();
+	call->firstScrobble = batch.front();
+	/* The request body is measured and encoded by the reactor thread outside the lock as the request
+	 * is sent, so it is not kept in memory as a whole.
 	 */
-	const char *seqBegin = responseBody.data(), *seqEnd, *end = responseBody.data() + responseBody.size();
+	call->setSubmissionBody(std::move(batch));
 
-	// Status.
-	seqEnd = std::find_if(seqBegin, end, lastfmResponseDelim);
+	logDebug("[LastfmScrobbler] Submission URL: '"_s, m_submissionUrl, "'."_s);
 
-	if (unlikely(seqEnd == end)) {
-		logError("[LastfmScrobbler] Invalid response body (missing line feed): "_s,
-				std::make_pair(responseBody.begin(), responseBody.end()));
-		return false;
+	const StatusCode result = call->prepare(m_submissionUrl.c_str());
+	if (result != StatusCode::SUCCESS) {
+		reportHttpClientError(result);
+		attemptFinished(0);
+		return;
 	}
-	if (unlikely(seqEnd - seqBegin != 2 || *seqBegin != 'O' || *(seqBegin + 1) != 'K')) {
-		// TODO handle non-OK responses differently (e.g. if BANNED then disable the plugin).
-		logError("[LastfmScrobbler] Unable to authenticate the user to Last.fm. Reason: "_s,
-				std::make_pair(seqBegin, seqEnd));
-		return false;
+	if (!startCall(std::move(call))) {
+		attemptFinished(0);
 	}
+}
 
-	// Session ID.
-	seqBegin = seqEnd + 1;
-	seqEnd = std::find_if(seqBegin, end, lastfmResponseDelim);
-	m_sessionId.assign(seqBegin, seqEnd);
+bool LastfmScrobbler::startCall(std::unique_ptr<Call> &&call)
+{
+	assertLocked();
+	assert(m_calls[call->type] == nullptr);
 
-	if (unlikely(seqEnd == end)) {
-		logError("[LastfmScrobbler] Invalid response body: "_s,
-				std::make_pair(responseBody.begin(), responseBody.end()));
+	/* The call is performed by the reactor thread which invokes callCompleted() once it is completed.
+	 * If this Scrobbler is stopped then the call is aborted. The scrobbles involved are left
+	 * in the list of pending scrobbles so that they can be stored to the data file and be completed later.
+	 */
+	if (!perform(*call)) {
 		return false;
 	}
+	m_calls[call->type] = std::move(call);
+	return true;
+}
 
-	// Now-playing URL.
-	seqBegin = seqEnd + 1;
-	seqEnd = std::find_if(seqBegin, end, lastfmResponseDelim);
-	m_nowPlayingUrl.assign(seqBegin, seqEnd);
+void LastfmScrobbler::callCompleted(Call &call, const StatusCode result)
+{
+	// The response is parsed outside the critical section.
+	const Call::Outcome outcome = call.processResponse(result);
+
+	lock_guard<mutex> lock(m_mutex);
+	// The call is destroyed once it is processed. The reactor does not access it after completion.
+	const std::unique_ptr<Call> completedCall(std::move(m_calls[call.type]));
+	assert(completedCall.get() == &call);
+	/* A call that is made within a session that is renewed already does not invalidate the current one.
+	 * Both the now-playing notification and the submission can report the same session as bad.
+	 */
+	const bool badSession = outcome == Call::BAD_SESSION &&
+			afc::equal(call.sessionId.begin(), call.sessionId.size(), m_sessionId.begin(), m_sessionId.size());
+
+	switch (call.type) {
+	case Call::HANDSHAKE:
+		if (outcome == Call::SUCCEEDED) {
+			m_sessionId = std::move(call.sessionId);
+			m_nowPlayingUrl = std::move(call.nowPlayingUrl);
+			m_submissionUrl = std::move(call.submissionUrl);
+			m_authenticated = true;
+			logDebug("[LastfmScrobbler] The user is authenticated..."_s);
+		} else {
+			handshakeFailed();
+		}
+		break;
+	case Call::NOW_PLAYING:
+		if (badSession) {
+			deauthenticate();
+		}
+		break;
+	case Call::SUBMISSION:
+		/* Ensure that no scrobbles are deleted by other threads during the HTTP call.
+		 * Only the reactor thread and ::stop() can do this, and ::stop() must wait for
+		 * the reactor to detach this Scrobbler in order to do this.
+		 */
+		assert(call.submittedCount <= m_pendingScrobbles.size());
+		assert(&m_pendingScrobbles.front() == call.firstScrobble);
 
-	if (unlikely(seqEnd == end)) {
-		logError("[LastfmScrobbler] Invalid response body: "_s,
-				std::make_pair(responseBody.begin(), responseBody.end()));
-		return false;
+		if (outcome == Call::SUCCEEDED) {
+			completeScrobbles(call.submittedCount);
+			attemptFinished(call.submittedCount);
+		} else {
+			if (badSession) {
+				deauthenticate();
+			}
+			attemptFinished(0);
+		}
+		break;
 	}
 
-	// Submission URL.
-	seqBegin = seqEnd + 1;
-	seqEnd = std::find_if(seqBegin, end, lastfmResponseDelim);
-	m_submissionUrl.assign(seqBegin, seqEnd);
+	startCalls();
+}
 
-	logDebug("[LastfmScrobbler] The user is authenticated..."_s);
-	m_authenticated = true;
-	return true;
+void LastfmScrobbler::handshakeFailed()
+{
+	assertLocked();
+
+	/* The now-playing track is dropped so that a failing handshake is not repeated at once
+	 * for its sake. The submission is retried later as the other failed attempts are.
+	 */
+	delete m_nowPlayingTrack.exchange(nullptr, std::memory_order_acquire);
+	if (m_submissionRequested) {
+		m_submissionRequested = false;
+		attemptFinished(0);
+	}
 }
 
 inline void LastfmScrobbler::deauthenticate() noexcept
@@ -18,8 +18,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 
 #include "ScrobbleInfo.hpp"
 #include "Scrobbler.hpp"
+#include <atomic>
 #include <cstddef>
 #include <deque>
+#include <memory>
 #include <mutex>
 #include <utility>
 
@@ -33,26 +35,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 class LastfmScrobbler : public Scrobbler<std::deque<ScrobbleInfo>>
 {
 public:
-	LastfmScrobbler() : Scrobbler(), m_scrobblerUrl(), m_username(), m_password(), m_dataFilePath(),
-			m_sessionId(), m_submissionUrl(), m_nowPlayingTrack(), m_authenticated(false),
-			m_hasNowPlayingTrack(false)
-	{ std::lock_guard<std::mutex> lock(m_mutex); // synchronising memory
-		/* This instance is partially initialised here. It will be initialised completely
-		 * when ::start() is invoked successfully.
-		 */
-	}
+	// The max number of scrobbles that can be submitted within a single request.
+	static constexpr std::size_t maxScrobblesPerRequest = 50;
 
-	~LastfmScrobbler()
-	{
-		// Synchronising memory before destructing the member fields of this GravifonScrobbler.
-		std::lock_guard<std::mutex> lock(m_mutex);
-	}
+	// Both are defined where Call is complete.
+	LastfmScrobbler();
+	~LastfmScrobbler();
 
+	// Replaces the now-playing track to submit. It does not acquire the lock (see Scrobbler::scrobble()).
 	void playStarted(Track &&track)
-	{ std::lock_guard<std::mutex> lock(m_mutex);
-		m_nowPlayingTrack = std::move(track);
-		m_hasNowPlayingTrack = true;
-		m_cv.notify_one();
+	{
+		delete m_nowPlayingTrack.exchange(new Track(std::move(track)), std::memory_order_acq_rel);
+		wake();
 	}
 
 	// username and password should be in UTF-8; serverUrl must be in ASCII.
@@ -68,26 +62,42 @@ public:
 		m_dataFilePath = std::move(dataFilePath);
 	}
 protected:
-	virtual std::size_t doScrobbling() override;
-	/* Since the worker thread can receive awaking events from ::scrobble() and ::playStarted()
-	 * the now-playing submission event can be submitted while the scrobbler is processing
-	 * scrobbles (outside the critical secion on m_mutex). To prevent the now-playing event lost
-	 * during this routine the scrobbler checks if there is the now-playing track reported
-	 * before and after the worker thread falls asleep.
+	virtual void startScrobbling() override;
+	/* Since this Scrobbler can be woken up by ::scrobble() and ::playStarted() the now-playing
+	 * track can be reported while calls to Last.fm are in progress. To prevent the now-playing
+	 * event lost the scrobbler checks if there is the now-playing track reported each time
+	 * it is woken up and each time it falls asleep, as well as once each call is completed.
 	 */
-	virtual void preSleep() override { submitNowPlayingTrack(); }
-	virtual void postSleep() override { submitNowPlayingTrack(); }
+	virtual void preSleep() override { startCalls(); }
+	virtual void postSleep() override { startCalls(); }
 
 	virtual const afc::String &getDataFilePath() const override { return m_dataFilePath; }
 
 	virtual void stopExtra() override;
 private:
+	// An HTTP call to Last.fm: a handshake, a now-playing notification or a submission.
+	class Call;
+
 	// All these functions must be invoked within the critical section upon Scrobbler::m_mutex.
-	bool ensureAuthenticated();
 	void deauthenticate() noexcept;
-	void notifyPlayStarted();
-
-	void submitNowPlayingTrack();
+	/* Starts the HTTP calls that are due unless the calls of the same type are in progress.
+	 * The handshake goes first if the user is not authenticated. Then the now-playing notification
+	 * and the submission requested by startScrobbling() are in flight at the same time.
+	 */
+	void startCalls();
+	bool startHandshake();
+	// Drops the now-playing track and fails the submission requested, if any.
+	void handshakeFailed();
+	void startNowPlaying();
+	void startSubmission();
+	// Makes a given prepared call the one of its type in progress. @return true if the call is started.
+	bool startCall(std::unique_ptr<Call> &&call);
+
+	/* Invoked by the reactor thread when a call in progress is completed.
+	 *
+	 * It is executed outside lock on m_mutex.
+	 */
+	void callCompleted(Call &call, HttpClient::StatusCode result);
 
 	afc::String m_scrobblerUrl;
 	afc::String m_username;
@@ -99,10 +109,15 @@ private:
 	afc::String m_submissionUrl;
 	afc::String m_nowPlayingUrl;
 
-	Track m_nowPlayingTrack;
+	// The now-playing track to submit, if any. It is replaced by producers and taken by the reactor thread.
+	std::atomic<Track *> m_nowPlayingTrack;
 
 	bool m_authenticated;
-	bool m_hasNowPlayingTrack;
+
+	// The calls in progress indexed by their types (see Call::Type). At most one call of each type is in flight.
+	std::unique_ptr<Call> m_calls[3];
+	// Indicates if the submission requested by startScrobbling() is not started yet.
+	bool m_submissionRequested;
 };
 
 #endif /* LASTFMSCROBBLER_HPP_ */
@@ -0,0 +1,146 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "NetworkMonitor.hpp"
+#include <cassert>
+#include <cerrno>
+
+#include <afc/logger.hpp>
+#include <afc/SimpleString.hpp>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using afc::operator"" _s;
+
+namespace
+{
+	// Enough for a burst of notifications; the ones that do not fit are reported by ENOBUFS.
+	constexpr std::size_t receiveBufferSize = 8192;
+}
+
+bool NetworkMonitor::open()
+{
+	close();
+
+	m_socket = ::socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+	if (m_socket == -1) {
+		afc::logger::logError("[NetworkMonitor] Unable to open a rtnetlink socket."_s);
+		return false;
+	}
+
+	sockaddr_nl address = {};
+	address.nl_family = AF_NETLINK;
+	address.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR |
+			RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+	if (::bind(m_socket, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1) {
+		afc::logger::logError("[NetworkMonitor] Unable to subscribe to network changes."_s);
+		close();
+		return false;
+	}
+	return true;
+}
+
+void NetworkMonitor::close() noexcept
+{
+	if (m_socket != -1) {
+		::close(m_socket);
+		m_socket = -1;
+	}
+}
+
+bool NetworkMonitor::receive()
+{
+	assert(opened());
+
+	alignas(nlmsghdr) char buffer[receiveBufferSize];
+
+	// All the notifications received at once are reported as a single change.
+	bool reachable = false;
+	for (;;) {
+		sockaddr_nl sender = {};
+		socklen_t senderSize = sizeof(sender);
+		const ssize_t size = ::recvfrom(m_socket, buffer, sizeof(buffer), MSG_DONTWAIT,
+				reinterpret_cast<sockaddr *>(&sender), &senderSize);
+		if (size == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			// Notifications are lost if the socket buffer overflows so the worst is assumed.
+			reachable |= errno == ENOBUFS;
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+				afc::logger::logError("[NetworkMonitor] Unable to receive network changes."_s);
+			}
+			break;
+		}
+		// Only the kernel is trusted.
+		if (sender.nl_pid == 0) {
+			reachable |= containsReachabilityEvent(buffer, static_cast<std::size_t>(size));
+		}
+	}
+
+	if (reachable) {
+		afc::logger::logDebug("[NetworkMonitor] The network may have become reachable."_s);
+	}
+	return reachable;
+}
+
+bool NetworkMonitor::isReachabilityEvent(const nlmsghdr &message) noexcept
+{
+	switch (message.nlmsg_type) {
+	case RTM_NEWLINK: {
+		if (message.nlmsg_len < NLMSG_LENGTH(sizeof(ifinfomsg))) {
+			return false;
+		}
+		const ifinfomsg &link = *static_cast<const ifinfomsg *>(NLMSG_DATA(&message));
+		// The loopback interface does not connect to anywhere.
+		return (link.ifi_flags & (IFF_UP | IFF_RUNNING | IFF_LOOPBACK)) == (IFF_UP | IFF_RUNNING);
+	}
+	case RTM_NEWADDR: {
+		if (message.nlmsg_len < NLMSG_LENGTH(sizeof(ifaddrmsg))) {
+			return false;
+		}
+		const ifaddrmsg &address = *static_cast<const ifaddrmsg *>(NLMSG_DATA(&message));
+		// Host (loopback) and link-local addresses do not make remote services reachable.
+		return address.ifa_scope == RT_SCOPE_UNIVERSE;
+	}
+	case RTM_NEWROUTE: {
+		if (message.nlmsg_len < NLMSG_LENGTH(sizeof(rtmsg))) {
+			return false;
+		}
+		const rtmsg &route = *static_cast<const rtmsg *>(NLMSG_DATA(&message));
+		return route.rtm_dst_len == 0 && route.rtm_type == RTN_UNICAST && route.rtm_table == RT_TABLE_MAIN;
+	}
+	default:
+		return false;
+	}
+}
+
+bool NetworkMonitor::containsReachabilityEvent(const void * const buffer, const std::size_t size) noexcept
+{
+	const nlmsghdr *message = static_cast<const nlmsghdr *>(buffer);
+	/* NLMSG_OK and NLMSG_NEXT use a signed remainder (int in older kernel headers)
+	 * so the size of a single receive buffer always fits it.
+	 */
+	int remaining = static_cast<int>(size);
+	for (; NLMSG_OK(message, remaining); message = NLMSG_NEXT(message, remaining)) {
+		if (isReachabilityEvent(*message)) {
+			return true;
+		}
+	}
+	return false;
+}
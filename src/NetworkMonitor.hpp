@@ -0,0 +1,68 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef NETWORKMONITOR_HPP_
+#define NETWORKMONITOR_HPP_
+
+#include <cstddef>
+
+struct nlmsghdr;
+
+/* Listens to the changes of network interfaces, addresses and routes that the Linux kernel
+ * reports via rtnetlink, and tells if the network may have become reachable, i.e. an interface
+ * gets up and running, an address is added to an interface, or a default route appears.
+ * Subscribing to these notifications needs no privileges.
+ *
+ * This monitor has no thread of its own. Its socket is to be watched for readability
+ * (e.g. by Reactor) and the notifications are to be received once it is readable.
+ */
+class NetworkMonitor
+{
+	NetworkMonitor(const NetworkMonitor &) = delete;
+	NetworkMonitor(NetworkMonitor &&) = delete;
+	NetworkMonitor &operator=(const NetworkMonitor &) = delete;
+	NetworkMonitor &operator=(NetworkMonitor &&) = delete;
+public:
+	NetworkMonitor() noexcept : m_socket(-1) {}
+
+	~NetworkMonitor() { close(); }
+
+	/* Subscribes to network changes.
+	 *
+	 * @return true if this monitor is opened; false if the kernel notifications are unavailable.
+	 */
+	bool open();
+	void close() noexcept;
+
+	bool opened() const noexcept { return m_socket != -1; }
+
+	// The socket that becomes readable when network changes are reported; -1 if this monitor is closed.
+	int fd() const noexcept { return m_socket; }
+
+	/* Receives all the notifications reported so far without blocking.
+	 *
+	 * @return true if any of them tells that the network may have become reachable.
+	 */
+	bool receive();
+
+	// Returns true if a given rtnetlink message reports that the network may have become reachable.
+	static bool isReachabilityEvent(const nlmsghdr &message) noexcept;
+	// Returns true if any of the rtnetlink messages within a given buffer is a reachability event.
+	static bool containsReachabilityEvent(const void *buffer, std::size_t size) noexcept;
+private:
+	int m_socket;
+};
+
+#endif /* NETWORKMONITOR_HPP_ */
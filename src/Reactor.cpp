@@ -0,0 +1,565 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "Reactor.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+
+#include <afc/logger.hpp>
+#include <afc/SimpleString.hpp>
+#include <curl/curl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using afc::operator"" _s;
+
+namespace
+{
+	/* The two lowest bits of the key of an epoll event tell what it is about. Watches are
+	 * identified by their addresses which are aligned so that these bits are zero.
+	 */
+	constexpr std::uint64_t keyTypeMask = 3;
+	constexpr std::uint64_t watchKey = 0;
+	constexpr std::uint64_t socketKey = 1;
+	constexpr std::uint64_t wakeKey = 2;
+
+	constexpr int maxEvents = 16;
+}
+
+void Reactor::Task::wake() noexcept
+{
+	// The reactor is signalled only once until the task is run.
+	if (m_woken.exchange(true, std::memory_order_acq_rel)) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(m_wakeMutex);
+	if (m_reactor != nullptr) {
+		m_reactor->signal();
+	}
+}
+
+bool Reactor::start()
+{
+	stop();
+
+	m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+	if (m_epoll == -1) {
+		afc::logger::logError("[Reactor] Unable to create an epoll instance."_s);
+		return false;
+	}
+
+	m_eventFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.u64 = wakeKey;
+	if (m_eventFd == -1 || ::epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_eventFd, &event) == -1) {
+		afc::logger::logError("[Reactor] Unable to create an eventfd."_s);
+		closeDescriptors();
+		return false;
+	}
+
+	m_multi = curl_multi_init();
+	if (m_multi == nullptr) {
+		afc::logger::logError("[Reactor] Unable to initialise curl."_s);
+		closeDescriptors();
+		return false;
+	}
+	curl_multi_setopt(m_multi, CURLMOPT_SOCKETFUNCTION, onSocket);
+	curl_multi_setopt(m_multi, CURLMOPT_SOCKETDATA, this);
+	curl_multi_setopt(m_multi, CURLMOPT_TIMERFUNCTION, onTimer);
+	curl_multi_setopt(m_multi, CURLMOPT_TIMERDATA, this);
+	m_curlTimerSet = false;
+
+	/* The connections are cached by the multi handle and outlive the calls. The TLS sessions are
+	 * cached per easy handle unless they are shared, so they are shared for a new connection to
+	 * a host (e.g. the one that replaces a connection closed by the server) to resume the session.
+	 * The share is used by the reactor thread only so it needs no locking.
+	 */
+	m_share = curl_share_init();
+	if (m_share == nullptr ||
+			curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS) != CURLSHE_OK ||
+			curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION) != CURLSHE_OK) {
+		afc::logger::logError("[Reactor] Unable to initialise the curl share."_s);
+		closeDescriptors();
+		return false;
+	}
+
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopFlag = false;
+	}
+	m_thread = std::thread([this]() { this->run(); });
+	return true;
+}
+
+void Reactor::stop()
+{
+	if (!m_thread.joinable()) {
+		return;
+	}
+
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopFlag = true;
+	}
+	signal();
+	m_thread.join();
+
+	assert(m_tasks.empty());
+	closeDescriptors();
+}
+
+void Reactor::closeDescriptors() noexcept
+{
+	if (m_multi != nullptr) {
+		curl_multi_cleanup(m_multi);
+		m_multi = nullptr;
+	}
+	// The share is cleaned up after the multi handle since the connections cached can refer to it.
+	if (m_share != nullptr) {
+		curl_share_cleanup(m_share);
+		m_share = nullptr;
+	}
+	if (m_eventFd != -1) {
+		::close(m_eventFd);
+		m_eventFd = -1;
+	}
+	if (m_epoll != -1) {
+		::close(m_epoll);
+		m_epoll = -1;
+	}
+}
+
+void Reactor::attach(Task &task)
+{
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		m_attachRequests.push_back(&task);
+	}
+	signal();
+}
+
+void Reactor::detach(Task &task)
+{ std::unique_lock<std::mutex> lock(m_mutex);
+	assert(started());
+	assert(std::this_thread::get_id() != m_thread.get_id());
+
+	requestDetach(task);
+	m_cv.wait(lock, [this, &task]() { return detached(task); });
+}
+
+bool Reactor::detach(Task &task, const Clock::time_point deadline)
+{ std::unique_lock<std::mutex> lock(m_mutex);
+	assert(started());
+	assert(std::this_thread::get_id() != m_thread.get_id());
+
+	requestDetach(task);
+	return m_cv.wait_until(lock, deadline, [this, &task]() { return detached(task); });
+}
+
+void Reactor::requestDetach(Task &task)
+{
+	if (detached(task)) {
+		m_detachRequests.push_back(&task);
+		signal();
+	}
+}
+
+bool Reactor::detached(const Task &task) const
+{
+	return std::find(m_detachRequests.begin(), m_detachRequests.end(), &task) == m_detachRequests.end();
+}
+
+bool Reactor::perform(Task &owner, HttpCall &call)
+{
+	assert(call.handle() != nullptr);
+
+	if (&owner == m_detaching) {
+		return false;
+	}
+	m_calls.push_back(ActiveCall{&call, &owner, Clock::now(), Clock::time_point(), false});
+	return true;
+}
+
+bool Reactor::watch(Task &owner, const int fd, Watch &watch)
+{
+	assert(watch.m_fd == -1);
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.u64 = reinterpret_cast<std::uintptr_t>(&watch);
+	assert((event.data.u64 & keyTypeMask) == watchKey);
+	if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) == -1) {
+		afc::logger::logError("[Reactor] Unable to watch a file descriptor."_s);
+		return false;
+	}
+	watch.m_fd = fd;
+	watch.m_owner = &owner;
+	m_watches.push_back(&watch);
+	return true;
+}
+
+void Reactor::unwatch(Watch &watch) noexcept
+{
+	if (watch.m_fd == -1) {
+		return;
+	}
+	::epoll_ctl(m_epoll, EPOLL_CTL_DEL, watch.m_fd, nullptr);
+	m_watches.erase(std::find(m_watches.begin(), m_watches.end(), &watch));
+	watch.m_fd = -1;
+	watch.m_owner = nullptr;
+}
+
+void Reactor::signal() noexcept
+{
+	const std::uint64_t one = 1;
+	while (::write(m_eventFd, &one, sizeof(one)) == -1 && errno == EINTR) {}
+}
+
+void Reactor::run()
+{
+	epoll_event events[maxEvents];
+
+	for (;;) {
+		int count = ::epoll_wait(m_epoll, events, maxEvents, timeoutMillis());
+		if (count == -1) {
+			if (errno != EINTR) {
+				afc::logger::logError("[Reactor] Unable to wait for events."_s);
+			}
+			count = 0;
+		}
+
+		for (int i = 0; i < count; ++i) {
+			dispatch(events[i].data.u64, events[i].events);
+		}
+		if (m_curlTimerSet && Clock::now() >= m_curlDeadline) {
+			m_curlTimerSet = false;
+			int running;
+			curl_multi_socket_action(m_multi, CURL_SOCKET_TIMEOUT, 0, &running);
+		}
+		processCompletions();
+		expireCalls();
+
+		if (!processRequests()) {
+			return;
+		}
+		runTasks();
+		addCalls();
+	}
+}
+
+void Reactor::dispatch(const std::uint64_t key, const std::uint32_t events)
+{
+	switch (key & keyTypeMask) {
+	case wakeKey: {
+		std::uint64_t value;
+		while (::read(m_eventFd, &value, sizeof(value)) == -1 && errno == EINTR) {}
+		break;
+	}
+	case socketKey: {
+		int flags = 0;
+		if (events & EPOLLIN) {
+			flags |= CURL_CSELECT_IN;
+		}
+		if (events & EPOLLOUT) {
+			flags |= CURL_CSELECT_OUT;
+		}
+		if (events & (EPOLLERR | EPOLLHUP)) {
+			flags |= CURL_CSELECT_ERR;
+		}
+		int running;
+		curl_multi_socket_action(m_multi, static_cast<curl_socket_t>(key >> 2), flags, &running);
+		break;
+	}
+	default: {
+		// The watch could be removed while the events of the same epoll_wait() call were dispatched.
+		Watch * const watch = reinterpret_cast<Watch *>(static_cast<std::uintptr_t>(key));
+		if (std::find(m_watches.begin(), m_watches.end(), watch) != m_watches.end()) {
+			watch->ready();
+		}
+	}
+	}
+}
+
+bool Reactor::processRequests()
+{
+	std::vector<Task *> attachRequests, detachRequests;
+	bool stopFlag;
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		attachRequests.swap(m_attachRequests);
+		// The detach requests are removed once they are processed since detach() waits for it.
+		detachRequests = m_detachRequests;
+		stopFlag = m_stopFlag;
+	}
+
+	for (Task * const task : attachRequests) {
+		m_tasks.push_back(task);
+		task->m_deadline = Clock::time_point();
+		{ std::lock_guard<std::mutex> lock(task->m_wakeMutex);
+			task->m_reactor = this;
+		}
+		task->m_woken.store(true, std::memory_order_release);
+	}
+
+	if (!detachRequests.empty()) {
+		for (Task * const task : detachRequests) {
+			// The calls aborted cannot start new ones.
+			m_detaching = task;
+			abortCalls(*task);
+			m_detaching = nullptr;
+
+			for (std::size_t i = m_watches.size(); i-- > 0;) {
+				if (m_watches[i]->m_owner == task) {
+					unwatch(*m_watches[i]);
+				}
+			}
+			m_tasks.erase(std::remove(m_tasks.begin(), m_tasks.end(), task), m_tasks.end());
+			{ std::lock_guard<std::mutex> lock(task->m_wakeMutex);
+				task->m_reactor = nullptr;
+			}
+		}
+
+		{ std::lock_guard<std::mutex> lock(m_mutex);
+			for (Task * const task : detachRequests) {
+				m_detachRequests.erase(std::find(m_detachRequests.begin(), m_detachRequests.end(), task));
+			}
+		}
+		m_cv.notify_all();
+	}
+
+	return !stopFlag;
+}
+
+void Reactor::processCompletions()
+{
+	int remaining;
+	while (CURLMsg * const message = curl_multi_info_read(m_multi, &remaining)) {
+		if (message->msg != CURLMSG_DONE) {
+			continue;
+		}
+		// The message is not valid once the handle is removed.
+		CURL * const handle = message->easy_handle;
+		const CURLcode result = message->data.result;
+		removeHandle(handle);
+
+		const auto it = std::find_if(m_calls.begin(), m_calls.end(),
+				[handle](const ActiveCall &call) { return call.call->handle() == handle; });
+		assert(it != m_calls.end());
+		HttpCall &call = *it->call;
+		m_calls.erase(it);
+		call.completed(HttpClient::finish(call, result));
+	}
+}
+
+void Reactor::addCalls()
+{
+	// The calls are looked up anew each time since completed() can start other calls.
+	for (;;) {
+		const auto it = std::find_if(m_calls.begin(), m_calls.end(), [](const ActiveCall &call) { return !call.added; });
+		if (it == m_calls.end()) {
+			return;
+		}
+		HttpCall &call = *it->call;
+		HttpClient::measureBody(call);
+		curl_easy_setopt(call.handle(), CURLOPT_SHARE, m_share);
+		if (curl_multi_add_handle(m_multi, call.handle()) == CURLM_OK) {
+			it->added = true;
+			continue;
+		}
+		curl_easy_setopt(call.handle(), CURLOPT_SHARE, nullptr);
+		afc::logger::logError("[Reactor] Unable to start an HTTP call."_s);
+		m_calls.erase(it);
+		call.completed(HttpClient::StatusCode::UNKNOWN_ERROR);
+	}
+}
+
+void Reactor::abortCalls(const Task &owner)
+{
+	// The calls are looked up anew each time since completed() can complete other calls.
+	for (;;) {
+		const auto it = std::find_if(m_calls.begin(), m_calls.end(),
+				[&owner](const ActiveCall &call) { return call.owner == &owner; });
+		if (it == m_calls.end()) {
+			return;
+		}
+		HttpCall &call = *it->call;
+		m_calls.erase(it);
+		removeHandle(call.handle());
+		call.completed(HttpClient::StatusCode::ABORTED_BY_CLIENT);
+	}
+}
+
+void Reactor::expireCalls()
+{
+	const Clock::time_point now = Clock::now();
+	// The calls are looked up anew each time since completed() can start other calls.
+	for (;;) {
+		const auto it = std::find_if(m_calls.begin(), m_calls.end(), [now](const ActiveCall &call)
+		{
+			const Clock::time_point callDeadline = deadline(call);
+			return callDeadline != Clock::time_point() && callDeadline <= now;
+		});
+		if (it == m_calls.end()) {
+			return;
+		}
+		HttpCall &call = *it->call;
+		m_calls.erase(it);
+		// The connection is closed by curl since the transfer is not complete.
+		removeHandle(call.handle());
+		call.completed(HttpClient::StatusCode::OPERATION_TIMEOUT);
+	}
+}
+
+Reactor::Clock::time_point Reactor::deadline(const ActiveCall &call)
+{
+	const HttpTimeouts &timeouts = call.call->timeouts();
+	CURL * const handle = call.call->handle();
+
+	Clock::time_point result;
+	const auto limit = [&result](const Clock::time_point phaseStart, const std::chrono::milliseconds timeout)
+	{
+		if (timeout.count() != 0 && (result == Clock::time_point() || phaseStart + timeout < result)) {
+			result = phaseStart + timeout;
+		}
+	};
+	limit(call.start, timeouts.total);
+
+	/* The phase the call is in is told by the times (in microseconds since the start of the call)
+	 * the request and the response have started at, as recorded by curl. They are zero until then.
+	 * curl records the connection time only once the TLS handshake is done, so the establishment
+	 * of the TCP connection is detected by the reactor (see awaitsInput()).
+	 */
+	curl_off_t responseStart = 0, requestStart = 0;
+	curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &responseStart);
+	if (responseStart != 0) {
+		return result;
+	}
+	curl_easy_getinfo(handle, CURLINFO_PRETRANSFER_TIME_T, &requestStart);
+	if (requestStart != 0) {
+		limit(call.start + std::chrono::microseconds(requestStart), timeouts.firstByte);
+	} else if (call.connected != Clock::time_point()) {
+		// The TLS handshake is in progress; a plain HTTP call passes this phase at once.
+		limit(call.connected, timeouts.tls);
+	} else {
+		limit(call.start, timeouts.connect);
+	}
+	return result;
+}
+
+void Reactor::awaitsInput(void * const handle, const int socket) noexcept
+{
+	const auto it = std::find_if(m_calls.begin(), m_calls.end(),
+			[handle](const ActiveCall &call) { return call.call->handle() == handle; });
+	if (it == m_calls.end() || it->connected != Clock::time_point()) {
+		return;
+	}
+	/* curl only waits to write to a TCP socket being connected, so the one it waits to read from
+	 * is connected. The name resolver is waited for by a UNIX socket which is skipped.
+	 */
+	int domain;
+	socklen_t size = sizeof(domain);
+	if (::getsockopt(socket, SOL_SOCKET, SO_DOMAIN, &domain, &size) == 0 && domain != AF_UNIX) {
+		it->connected = Clock::now();
+	}
+}
+
+inline void Reactor::removeHandle(void * const handle) noexcept
+{
+	curl_multi_remove_handle(m_multi, handle);
+	// The call can be destroyed by any thread once it is completed, so it must not refer to the share.
+	curl_easy_setopt(handle, CURLOPT_SHARE, nullptr);
+}
+
+void Reactor::runTasks()
+{
+	const Clock::time_point now = Clock::now();
+	// Tasks are attached and detached by this thread only so the list does not change meanwhile.
+	for (Task * const task : m_tasks) {
+		const bool due = task->m_deadline != Clock::time_point() && task->m_deadline <= now;
+		if (task->m_woken.exchange(false, std::memory_order_acq_rel) || due) {
+			task->m_deadline = Clock::time_point();
+			task->run();
+		}
+	}
+}
+
+int Reactor::timeoutMillis() const
+{
+	bool set = m_curlTimerSet;
+	Clock::time_point nearest = m_curlDeadline;
+	const auto consider = [&set, &nearest](const Clock::time_point deadline)
+	{
+		if (deadline != Clock::time_point() && (!set || deadline < nearest)) {
+			nearest = deadline;
+			set = true;
+		}
+	};
+	for (const Task * const task : m_tasks) {
+		consider(task->m_deadline);
+	}
+	for (const ActiveCall &call : m_calls) {
+		consider(deadline(call));
+	}
+	if (!set) {
+		return -1;
+	}
+
+	const Clock::time_point now = Clock::now();
+	if (nearest <= now) {
+		return 0;
+	}
+	// Rounded up so that the deadline is reached once epoll_wait() times out.
+	const std::chrono::milliseconds::rep timeout = std::chrono::ceil<std::chrono::milliseconds>(nearest - now).count();
+	return static_cast<int>(std::min<std::chrono::milliseconds::rep>(timeout, INT_MAX));
+}
+
+int Reactor::onSocket(void * const handle, const int socket, const int what, void * const reactorPtr, void *)
+{
+	Reactor &reactor = *static_cast<Reactor *>(reactorPtr);
+	const int epoll = reactor.m_epoll;
+
+	if (what == CURL_POLL_REMOVE) {
+		::epoll_ctl(epoll, EPOLL_CTL_DEL, socket, nullptr);
+		return 0;
+	}
+
+	epoll_event event = {};
+	if (what & CURL_POLL_IN) {
+		event.events |= EPOLLIN;
+		reactor.awaitsInput(handle, socket);
+	}
+	if (what & CURL_POLL_OUT) {
+		event.events |= EPOLLOUT;
+	}
+	event.data.u64 = (static_cast<std::uint64_t>(socket) << 2) | socketKey;
+	if (::epoll_ctl(epoll, EPOLL_CTL_MOD, socket, &event) == -1 && errno == ENOENT) {
+		::epoll_ctl(epoll, EPOLL_CTL_ADD, socket, &event);
+	}
+	return 0;
+}
+
+int Reactor::onTimer(void *, const long timeoutMillis, void * const reactorPtr)
+{
+	Reactor &reactor = *static_cast<Reactor *>(reactorPtr);
+	if (timeoutMillis < 0) {
+		reactor.m_curlTimerSet = false;
+	} else {
+		reactor.m_curlDeadline = Clock::now() + std::chrono::milliseconds(timeoutMillis);
+		reactor.m_curlTimerSet = true;
+	}
+	return 0;
+}
@@ -0,0 +1,234 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef REACTOR_HPP_
+#define REACTOR_HPP_
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "HttpClient.hpp"
+
+/* An event loop that hosts the background work of Scrobblers in a single thread. It invokes
+ * a task when the task is woken up or its deadline is reached, performs the HTTP calls of
+ * the tasks via the curl multi interface, and reports the file descriptors the tasks watch
+ * that become readable. All of it is waited for by a single epoll_wait() call, so an idle
+ * reactor does not wake up at all.
+ *
+ * The connections of the HTTP calls are kept alive by the reactor while it is started, so calls
+ * to the same host reuse them; a new connection resumes the TLS session of the previous one.
+ * The limits on the phases of the calls (see HttpTimeouts) are enforced by the same epoll_wait()
+ * timeout as the deadlines of the tasks.
+ *
+ * The tasks are isolated from each other as long as they do not block the reactor thread:
+ * HTTP calls are performed without blocking, and the tasks are detached one by one.
+ * A single reactor is shared by the scrobbler plugins of a process (see ScrobblerPlugin).
+ */
+class Reactor
+{
+	Reactor(const Reactor &) = delete;
+	Reactor(Reactor &&) = delete;
+	Reactor &operator=(const Reactor &) = delete;
+	Reactor &operator=(Reactor &&) = delete;
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	// A unit of background work. All its functions but wake() are invoked by the reactor thread.
+	class Task
+	{
+		friend class Reactor;
+
+		Task(const Task &) = delete;
+		Task(Task &&) = delete;
+		Task &operator=(const Task &) = delete;
+		Task &operator=(Task &&) = delete;
+	public:
+		/* Makes the reactor invoke run() soon. It can be invoked by any thread at any time.
+		 * If the task is not attached then run() is invoked once it is attached.
+		 */
+		void wake() noexcept;
+	protected:
+		Task() noexcept : m_woken(false), m_wakeMutex(), m_reactor(nullptr), m_deadline() {}
+		// Non-virtual by design. Tasks are not destroyed via pointers to Task.
+		~Task() = default;
+
+		/* Makes the reactor invoke run() at a given time unless the task is woken up before.
+		 * The deadline is cleared each time run() is invoked; the default time point clears it, too.
+		 */
+		void setDeadline(const Clock::time_point deadline) noexcept { m_deadline = deadline; }
+
+		virtual void run() = 0;
+	private:
+		std::atomic<bool> m_woken;
+		// Guards m_reactor so that wake() does not signal a reactor the task is detached from.
+		std::mutex m_wakeMutex;
+		Reactor *m_reactor;
+		Clock::time_point m_deadline;
+	};
+
+	// A file descriptor watched for readability on behalf of a task.
+	class Watch
+	{
+		friend class Reactor;
+
+		Watch(const Watch &) = delete;
+		Watch(Watch &&) = delete;
+		Watch &operator=(const Watch &) = delete;
+		Watch &operator=(Watch &&) = delete;
+	public:
+		// Invoked by the reactor thread when the file descriptor is readable.
+		virtual void ready() = 0;
+	protected:
+		Watch() noexcept : m_fd(-1), m_owner(nullptr) {}
+		// Non-virtual by design. Watches are not destroyed via pointers to Watch.
+		~Watch() = default;
+	private:
+		int m_fd;
+		Task *m_owner;
+	};
+
+	Reactor() : m_mutex(), m_cv(), m_attachRequests(), m_detachRequests(), m_stopFlag(false), m_thread(),
+			m_epoll(-1), m_eventFd(-1), m_multi(nullptr), m_share(nullptr), m_tasks(), m_calls(), m_watches(),
+			m_detaching(nullptr), m_curlDeadline(), m_curlTimerSet(false), m_refCount(0) {}
+
+	~Reactor() { stop(); }
+
+	// Starts the reactor thread. @return true if it is started; false if the reactor cannot be set up.
+	bool start();
+	// Stops the reactor thread. All the tasks must be detached before.
+	void stop();
+
+	bool started() const noexcept { return m_thread.joinable(); }
+
+	// Makes the reactor host a given task, and invoke it soon. The task must not be attached already.
+	void attach(Task &task);
+
+	/* Makes the reactor stop hosting a given task. The HTTP calls of the task are aborted and its
+	 * watches are removed. Blocks until the task is detached, so none of its functions is invoked
+	 * by the reactor once this function returns. It must not be invoked by the reactor thread.
+	 *
+	 * If the task is being detached already (see the other overload) then the same detachment is awaited.
+	 */
+	void detach(Task &task);
+	/* Makes the reactor stop hosting a given task as the other overload does, but blocks only until
+	 * a given time. If the reactor is busy and has not detached the task by then, the task is still
+	 * to be detached, so the other overload must be invoked before the task is destroyed.
+	 *
+	 * @return true if the task is detached; false if the time is over.
+	 */
+	bool detach(Task &task, Clock::time_point deadline);
+
+	/* Starts performing a given prepared call (see HttpClient::prepareGet()) on behalf of a given task.
+	 * HttpCall::completed() is invoked once the call is performed, fails, times out, or is aborted.
+	 * It must be invoked by the reactor thread.
+	 *
+	 * The call is handed over to curl once the task returns control to the reactor, so that its body
+	 * is measured (see HttpRequest::BodyProducer::size()) outside the lock the task holds meanwhile.
+	 *
+	 * @return true if the call is accepted; false otherwise, in which case completed() is not invoked.
+	 */
+	bool perform(Task &owner, HttpCall &call);
+
+	/* Starts watching a given file descriptor on behalf of a given task. The watch must not watch
+	 * another one. It must be invoked by the reactor thread.
+	 */
+	bool watch(Task &owner, int fd, Watch &watch);
+	// Stops watching the file descriptor of a given watch, if any. It must be invoked by the reactor thread.
+	void unwatch(Watch &watch) noexcept;
+
+	// The number of holders of this reactor. It is used to share the reactor across plugins.
+	void acquire() noexcept { ++m_refCount; }
+	// Returns true if the last holder has released this reactor.
+	bool release() noexcept { assert(m_refCount != 0); return --m_refCount == 0; }
+private:
+	// An HTTP call in progress.
+	struct ActiveCall
+	{
+		HttpCall *call;
+		Task *owner;
+		Clock::time_point start;
+		// The time the TCP connection of the call is established at; the default time point if it is not.
+		Clock::time_point connected;
+		// False until the call is handed over to curl (see addCalls()).
+		bool added;
+	};
+
+	void run();
+	void signal() noexcept;
+	// Submits a request to detach a given task unless it is submitted already. It is executed within lock on m_mutex.
+	void requestDetach(Task &task);
+	// Returns true if a given task is not requested to be detached. It is executed within lock on m_mutex.
+	bool detached(const Task &task) const;
+	void dispatch(std::uint64_t key, std::uint32_t events);
+	// Returns false if the reactor thread is to be stopped.
+	bool processRequests();
+	void processCompletions();
+	void runTasks();
+	/* Hands the calls accepted by perform() over to curl. The ones that curl does not accept
+	 * are completed with UNKNOWN_ERROR.
+	 */
+	void addCalls();
+	void abortCalls(const Task &owner);
+	// Fails the calls that have exceeded the limit on their current phase with OPERATION_TIMEOUT.
+	void expireCalls();
+	// Returns the time the current phase of a given call is to end by; the default time point if none.
+	static Clock::time_point deadline(const ActiveCall &call);
+	// Records that the call with a given easy handle waits to read from a given socket.
+	void awaitsInput(void *handle, int socket) noexcept;
+	// Removes the easy handle of a call that is completed or aborted from the multi handle.
+	void removeHandle(void *handle) noexcept;
+	int timeoutMillis() const;
+	void closeDescriptors() noexcept;
+
+	// The curl multi callbacks. Their signatures match the ones curl expects on Linux.
+	static int onSocket(void *handle, int socket, int what, void *reactor, void *socketData);
+	static int onTimer(void *multi, long timeoutMillis, void *reactor);
+
+	// Guards the requests to attach and detach tasks, and the stop flag.
+	std::mutex m_mutex;
+	// Notifies detach() of the tasks detached.
+	std::condition_variable m_cv;
+	std::vector<Task *> m_attachRequests;
+	std::vector<Task *> m_detachRequests;
+	bool m_stopFlag;
+	std::thread m_thread;
+
+	int m_epoll;
+	// Becomes readable when a task is woken up or a request is submitted.
+	int m_eventFd;
+	void *m_multi;
+	// Shares the DNS cache and the TLS sessions among the calls.
+	void *m_share;
+
+	// These fields are accessed by the reactor thread only while it is started.
+	std::vector<Task *> m_tasks;
+	std::vector<ActiveCall> m_calls;
+	std::vector<Watch *> m_watches;
+	// The task being detached. It cannot start HTTP calls.
+	const Task *m_detaching;
+	Clock::time_point m_curlDeadline;
+	bool m_curlTimerSet;
+
+	std::size_t m_refCount;
+};
+
+#endif /* REACTOR_HPP_ */
@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 #include <algorithm>
 #include <bitset>
 #include <cstddef>
+#include <cstdint>
 #include <utility>
 #include <afc/builtin.hpp>
 #include <afc/dateutil.hpp>
@@ -27,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 #include <afc/number.h>
 #include <afc/StringRef.hpp>
 #include <afc/utils.h>
+#include "StringDictionary.hpp"
 
 using afc::operator"" _s;
 
@@ -212,6 +214,98 @@ namespace
 		return dest;
 	}
 
+	template<typename Iterator>
+	inline Iterator writeVarUInt(std::uint64_t value, Iterator dest) noexcept
+	{
+		while (value >= 0x80) {
+			*dest++ = static_cast<char>((value & 0x7f) | 0x80);
+			value >>= 7;
+		}
+		*dest++ = static_cast<char>(value);
+		return dest;
+	}
+
+	// Returns nullptr if the value is malformed or truncated.
+	inline const char *readVarUInt(const char *p, const char * const end, std::uint64_t &dest) noexcept
+	{
+		std::uint64_t result = 0;
+		for (unsigned shift = 0; p != end && shift < 64; shift += 7) {
+			const unsigned char c = static_cast<unsigned char>(*p++);
+			result |= std::uint64_t(c & 0x7f) << shift;
+			if ((c & 0x80) == 0) {
+				dest = result;
+				return p;
+			}
+		}
+		return nullptr;
+	}
+
+	// Signed values are zigzag-encoded so that small negative values are kept short.
+	inline std::uint64_t zigZagEncode(const long value) noexcept
+	{
+		return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value < 0 ? -1 : 0);
+	}
+
+	inline long zigZagDecode(const std::uint64_t value) noexcept
+	{
+		return static_cast<long>((value >> 1) ^ (~(value & 1) + 1));
+	}
+
+	/* TimestampTZ keeps the time zone offset which is not available as a number. Timestamps are
+	 * stored as short length-prefixed ISO-8601 strings so that they are restored exactly.
+	 */
+	template<typename Iterator>
+	inline Iterator writeBinaryTimestamp(const afc::TimestampTZ &timestamp, Iterator dest) noexcept
+	{
+		Iterator sizePos = dest++;
+		const Iterator valueBegin = dest;
+		dest = afc::formatISODateTime(timestamp, dest);
+		*sizePos = static_cast<char>(dest - valueBegin);
+		return dest;
+	}
+
+	inline const char *readBinaryTimestamp(const char * const begin, const char * const end,
+			afc::TimestampTZ &dest) noexcept
+	{
+		if (unlikely(begin == end)) {
+			return nullptr;
+		}
+		const std::size_t size = static_cast<unsigned char>(*begin);
+		const char * const valueBegin = begin + 1;
+		if (unlikely(std::size_t(end - valueBegin) < size)) {
+			return nullptr;
+		}
+		const char * const valueEnd = valueBegin + size;
+		if (unlikely(!parseISODateTime(valueBegin, valueEnd, dest))) {
+			return nullptr;
+		}
+		return valueEnd;
+	}
+
+	inline std::size_t maxBinarySize(const ScrobbleInfo &scrobbleInfo) noexcept
+	{
+		constexpr std::size_t maxVarUIntSize = 10;
+
+		std::size_t maxSize = 0;
+		maxSize += 2 * (1 + afc::maxISODateTimeSize()); // Scrobble start and end timestamps.
+		maxSize += 2 * maxVarUIntSize; // Scrobble duration and track duration.
+		maxSize += 4 * maxVarUIntSize; // Three track data offsets and track data size.
+		maxSize += scrobbleInfo.track.getAlbumArtistsEnd() - scrobbleInfo.track.getTitleBegin();
+		return maxSize;
+	}
+
+	inline std::size_t maxCompactBinarySize(const ScrobbleInfo &scrobbleInfo) noexcept
+	{
+		constexpr std::size_t maxVarUIntSize = 10;
+
+		std::size_t maxSize = 0;
+		maxSize += 2 * (1 + afc::maxISODateTimeSize()); // Scrobble start and end timestamps.
+		maxSize += 2 * maxVarUIntSize; // Scrobble duration and track duration.
+		maxSize += 4 * maxVarUIntSize; // Track title size and three string identifiers.
+		maxSize += scrobbleInfo.track.getTitleEnd() - scrobbleInfo.track.getTitleBegin();
+		return maxSize;
+	}
+
 	template<typename ErrorHandler>
 	inline const char *parseText(const char * const begin, const char * const end, afc::FastStringBuffer<char> &dest, ErrorHandler &errorHandler)
 	{
@@ -668,3 +762,159 @@ void appendAsJson(const ScrobbleInfo &scrobbleInfo, afc::FastStringBuffer<char>
 
 	dest.returnTail(appendAsJsonImpl(scrobbleInfo, dest.borrowTail()));
 }
+
+void appendAsBinary(const ScrobbleInfo &scrobbleInfo, afc::FastStringBuffer<char> &dest)
+{
+	const Track &track = scrobbleInfo.track;
+	const char * const dataBegin = track.getTitleBegin();
+	const char * const dataEnd = track.getAlbumArtistsEnd();
+
+	dest.reserve(dest.size() + maxBinarySize(scrobbleInfo));
+
+	auto p = dest.borrowTail();
+	p = writeBinaryTimestamp(scrobbleInfo.scrobbleStartTimestamp, p);
+	p = writeBinaryTimestamp(scrobbleInfo.scrobbleEndTimestamp, p);
+	p = writeVarUInt(zigZagEncode(scrobbleInfo.scrobbleDuration), p);
+	p = writeVarUInt(zigZagEncode(track.getDurationMillis()), p);
+	p = writeVarUInt(track.getArtistsBegin() - dataBegin, p);
+	p = writeVarUInt(track.getAlbumTitleBegin() - dataBegin, p);
+	p = writeVarUInt(track.getAlbumArtistsBegin() - dataBegin, p);
+	p = writeVarUInt(dataEnd - dataBegin, p);
+	p = std::copy(dataBegin, dataEnd, p);
+	dest.returnTail(p);
+}
+
+void appendAsCompactBinary(const ScrobbleInfo &scrobbleInfo, const std::uint32_t artistsId,
+		const std::uint32_t albumTitleId, const std::uint32_t albumArtistsId, afc::FastStringBuffer<char> &dest)
+{
+	const Track &track = scrobbleInfo.track;
+	const char * const titleBegin = track.getTitleBegin();
+	const char * const titleEnd = track.getTitleEnd();
+
+	dest.reserve(dest.size() + maxCompactBinarySize(scrobbleInfo));
+
+	auto p = dest.borrowTail();
+	p = writeBinaryTimestamp(scrobbleInfo.scrobbleStartTimestamp, p);
+	p = writeBinaryTimestamp(scrobbleInfo.scrobbleEndTimestamp, p);
+	p = writeVarUInt(zigZagEncode(scrobbleInfo.scrobbleDuration), p);
+	p = writeVarUInt(zigZagEncode(track.getDurationMillis()), p);
+	p = writeVarUInt(titleEnd - titleBegin, p);
+	p = std::copy(titleBegin, titleEnd, p);
+	p = writeVarUInt(artistsId, p);
+	p = writeVarUInt(albumTitleId, p);
+	p = writeVarUInt(albumArtistsId, p);
+	dest.returnTail(p);
+}
+
+bool ScrobbleInfo::parseBinary(const char * const begin, const char * const end, ScrobbleInfo &dest)
+{
+	const char *p = begin;
+
+	p = readBinaryTimestamp(p, end, dest.scrobbleStartTimestamp);
+	if (unlikely(p == nullptr)) {
+		return false;
+	}
+	p = readBinaryTimestamp(p, end, dest.scrobbleEndTimestamp);
+	if (unlikely(p == nullptr)) {
+		return false;
+	}
+
+	std::uint64_t scrobbleDuration, trackDuration, artistsBegin, albumTitleBegin, albumArtistsBegin, dataSize;
+	if (unlikely((p = readVarUInt(p, end, scrobbleDuration)) == nullptr ||
+			(p = readVarUInt(p, end, trackDuration)) == nullptr ||
+			(p = readVarUInt(p, end, artistsBegin)) == nullptr ||
+			(p = readVarUInt(p, end, albumTitleBegin)) == nullptr ||
+			(p = readVarUInt(p, end, albumArtistsBegin)) == nullptr ||
+			(p = readVarUInt(p, end, dataSize)) == nullptr)) {
+		return false;
+	}
+
+	// The track title and at least a single artist are required.
+	if (unlikely(dataSize != std::uint64_t(end - p) || artistsBegin == 0 || artistsBegin >= albumTitleBegin ||
+			albumTitleBegin > albumArtistsBegin || albumArtistsBegin > dataSize)) {
+		return false;
+	}
+
+	dest.scrobbleDuration = zigZagDecode(scrobbleDuration);
+
+	Track &track = dest.track;
+	track.m_data.assign(p, dataSize);
+	track.m_artistsBegin = artistsBegin;
+	track.m_albumTitleBegin = albumTitleBegin;
+	track.m_albumArtistsBegin = albumArtistsBegin;
+	track.m_durationMillis = zigZagDecode(trackDuration);
+
+	return true;
+}
+
+bool ScrobbleInfo::parseCompactBinary(const char * const begin, const char * const end,
+		const StringDictionary &dictionary, ScrobbleInfo &dest)
+{
+	const char *p = begin;
+
+	p = readBinaryTimestamp(p, end, dest.scrobbleStartTimestamp);
+	if (unlikely(p == nullptr)) {
+		return false;
+	}
+	p = readBinaryTimestamp(p, end, dest.scrobbleEndTimestamp);
+	if (unlikely(p == nullptr)) {
+		return false;
+	}
+
+	std::uint64_t scrobbleDuration, trackDuration, titleSize;
+	if (unlikely((p = readVarUInt(p, end, scrobbleDuration)) == nullptr ||
+			(p = readVarUInt(p, end, trackDuration)) == nullptr ||
+			(p = readVarUInt(p, end, titleSize)) == nullptr)) {
+		return false;
+	}
+	// The track title is required.
+	if (unlikely(titleSize == 0 || titleSize > std::uint64_t(end - p))) {
+		return false;
+	}
+	const char * const titleBegin = p;
+	p += titleSize;
+
+	std::uint64_t ids[3];
+	for (std::uint64_t &id : ids) {
+		if (unlikely((p = readVarUInt(p, end, id)) == nullptr || id > UINT32_MAX)) {
+			return false;
+		}
+	}
+	if (unlikely(p != end)) {
+		return false;
+	}
+
+	// Artists, album title and album artists.
+	const char *stringBegins[3], *stringEnds[3];
+	std::size_t dataSize = titleSize;
+	for (int i = 0; i < 3; ++i) {
+		if (ids[i] == StringDictionary::emptyStringId) {
+			stringBegins[i] = stringEnds[i] = titleBegin;
+		} else if (unlikely(!dictionary.lookup(static_cast<std::uint32_t>(ids[i]), stringBegins[i], stringEnds[i]))) {
+			return false;
+		}
+		dataSize += stringEnds[i] - stringBegins[i];
+	}
+	// At least a single artist is required.
+	if (unlikely(stringBegins[0] == stringEnds[0])) {
+		return false;
+	}
+
+	dest.scrobbleDuration = zigZagDecode(scrobbleDuration);
+
+	// Track data are assembled within a buffer of the exact size so that a single allocation is done.
+	afc::FastStringBuffer<char, afc::AllocMode::accurate> data(dataSize);
+	data.append(titleBegin, titleSize);
+	for (int i = 0; i < 3; ++i) {
+		data.append(stringBegins[i], stringEnds[i] - stringBegins[i]);
+	}
+
+	Track &track = dest.track;
+	track.m_data.attach(data.detach(), dataSize);
+	track.m_artistsBegin = titleSize;
+	track.m_albumTitleBegin = track.m_artistsBegin + (stringEnds[0] - stringBegins[0]);
+	track.m_albumArtistsBegin = track.m_albumTitleBegin + (stringEnds[1] - stringBegins[1]);
+	track.m_durationMillis = zigZagDecode(trackDuration);
+
+	return true;
+}
@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <utility>
 #include <afc/dateutil.hpp>
@@ -25,6 +26,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 #include <afc/SimpleString.hpp>
 #include <afc/utils.h>
 
+class StringDictionary;
+
 // All strings are utf8-encoded.
 class Track
 {
@@ -92,6 +95,14 @@ public:
 
 	static bool parse(const char *begin, const char *end, ScrobbleInfo &dest);
 
+	// Parses a ScrobbleInfo written by appendAsBinary(). The whole sequence must be consumed.
+	static bool parseBinary(const char *begin, const char *end, ScrobbleInfo &dest);
+	/* Parses a ScrobbleInfo written by appendAsCompactBinary(). The strings referred to must be
+	 * defined in a given dictionary. The whole sequence must be consumed.
+	 */
+	static bool parseCompactBinary(const char *begin, const char *end, const StringDictionary &dictionary,
+			ScrobbleInfo &dest);
+
 	// Date and time when scrobble event was initiated.
 	afc::TimestampTZ scrobbleStartTimestamp;
 	// Date and time when scrobble event was finished.
@@ -201,4 +212,18 @@ private:
 afc::FastStringBuffer<char, afc::AllocMode::accurate> serialiseAsJson(const ScrobbleInfo &scrobbleInfo);
 void appendAsJson(const ScrobbleInfo &scrobbleInfo, afc::FastStringBuffer<char> &dest);
 
+/* Writes this ScrobbleInfo in the compact binary form to a buffer. Track data are written
+ * as a raw UTF-8 blob so that they are loaded with a single allocation by
+ * ScrobbleInfo::parseBinary().
+ */
+void appendAsBinary(const ScrobbleInfo &scrobbleInfo, afc::FastStringBuffer<char> &dest);
+
+/* Writes this ScrobbleInfo in the compact binary form in which the artists, the album title
+ * and the album artists are replaced with the identifiers of these strings in a dictionary
+ * (see StringDictionary). The track title is written in place. Track data are restored with
+ * a single allocation by ScrobbleInfo::parseCompactBinary().
+ */
+void appendAsCompactBinary(const ScrobbleInfo &scrobbleInfo, std::uint32_t artistsId, std::uint32_t albumTitleId,
+		std::uint32_t albumArtistsId, afc::FastStringBuffer<char> &dest);
+
 #endif /* SCROBBLER_INFO_HPP_ */
@@ -0,0 +1,428 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "ScrobbleJournal.hpp"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <afc/builtin.hpp>
+#include <afc/FastStringBuffer.hpp>
+
+namespace
+{
+	struct Crc32Table
+	{
+		Crc32Table() noexcept
+		{
+			for (std::uint32_t i = 0; i < 256; ++i) {
+				std::uint32_t c = i;
+				for (int k = 0; k < 8; ++k) {
+					c = (c & 1) != 0 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				}
+				values[i] = c;
+			}
+		}
+
+		std::uint32_t values[256];
+	};
+
+	static const Crc32Table crc32Table;
+
+	constexpr char journalMagic[4] = {'D', 'B', 'S', 'J'};
+	constexpr char cursorMagic[4] = {'D', 'B', 'S', 'C'};
+
+	template<typename Iterator>
+	inline Iterator writeUInt32(const std::uint32_t value, Iterator dest) noexcept
+	{
+		*dest++ = static_cast<char>(value & 0xff);
+		*dest++ = static_cast<char>((value >> 8) & 0xff);
+		*dest++ = static_cast<char>((value >> 16) & 0xff);
+		*dest++ = static_cast<char>((value >> 24) & 0xff);
+		return dest;
+	}
+
+	template<typename Iterator>
+	inline Iterator writeUInt64(const std::uint64_t value, Iterator dest) noexcept
+	{
+		dest = writeUInt32(static_cast<std::uint32_t>(value & 0xffffffffu), dest);
+		return writeUInt32(static_cast<std::uint32_t>(value >> 32), dest);
+	}
+
+	inline std::uint32_t readUInt32(const char * const src) noexcept
+	{
+		const unsigned char * const p = reinterpret_cast<const unsigned char *>(src);
+		return std::uint32_t(p[0]) | (std::uint32_t(p[1]) << 8) | (std::uint32_t(p[2]) << 16) |
+				(std::uint32_t(p[3]) << 24);
+	}
+
+	inline std::uint64_t readUInt64(const char * const src) noexcept
+	{
+		return std::uint64_t(readUInt32(src)) | (std::uint64_t(readUInt32(src + 4)) << 32);
+	}
+
+	// Frames the payload written by a given function as a record of a given type.
+	template<typename PayloadWriter>
+	inline void appendRecord(const JournalRecordType type, afc::FastStringBuffer<char> &dest,
+			PayloadWriter writePayload)
+	{
+		const std::size_t recordStart = dest.size();
+
+		// The payload size is written when the payload is encoded.
+		dest.reserve(recordStart + 4 + 1);
+		dest.append("\0\0\0\0", 4);
+		dest.append(static_cast<char>(type));
+
+		writePayload(dest);
+
+		const std::size_t payloadSize = dest.size() - recordStart - 4 - 1;
+		writeUInt32(static_cast<std::uint32_t>(payloadSize), dest.begin() + recordStart);
+
+		const char * const typeBegin = dest.data() + recordStart + 4;
+		const std::uint32_t crc = crc32(typeBegin, dest.data() + dest.size());
+
+		dest.reserve(dest.size() + 4);
+		dest.returnTail(writeUInt32(crc, dest.borrowTail()));
+	}
+
+	inline void appendStringRecord(const std::uint32_t id, const char * const begin, const char * const end,
+			afc::FastStringBuffer<char> &dest)
+	{
+		appendRecord(JournalRecordType::string, dest, [=](afc::FastStringBuffer<char> &payload)
+		{
+			const std::size_t size = end - begin;
+			payload.reserve(payload.size() + 4 + size);
+			payload.returnTail(writeUInt32(id, payload.borrowTail()));
+			payload.append(begin, size);
+		});
+	}
+
+	// Returns the identifier of a given string. Its string record is appended if the string is new.
+	inline std::uint32_t addString(const char * const begin, const char * const end,
+			StringDictionary &dictionary, afc::FastStringBuffer<char> &dest)
+	{
+		if (begin == end) {
+			return StringDictionary::emptyStringId;
+		}
+		bool isNew;
+		const std::uint32_t id = dictionary.add(begin, end, isNew);
+		if (isNew) {
+			appendStringRecord(id, begin, end, dest);
+		}
+		return id;
+	}
+}
+
+std::uint32_t crc32(const char * const begin, const char * const end) noexcept
+{
+	std::uint32_t c = 0xffffffffu;
+	for (const char *p = begin; p != end; ++p) {
+		c = crc32Table.values[(c ^ static_cast<unsigned char>(*p)) & 0xff] ^ (c >> 8);
+	}
+	return c ^ 0xffffffffu;
+}
+
+std::uint64_t newJournalFileId() noexcept
+{
+	std::random_device randomDevice;
+	const std::uint64_t random = (std::uint64_t(randomDevice()) << 32) | randomDevice();
+	const std::uint64_t time = std::chrono::system_clock::now().time_since_epoch().count();
+	return random ^ time;
+}
+
+void appendJournalHeader(const std::uint64_t fileId, afc::FastStringBuffer<char> &dest)
+{
+	dest.reserve(dest.size() + journalHeaderSize);
+	dest.append(journalMagic, sizeof(journalMagic));
+	dest.append(static_cast<char>(journalFormatVersion));
+	// Reserved octets.
+	dest.append('\0');
+	dest.append('\0');
+	dest.append('\0');
+	dest.returnTail(writeUInt64(fileId, dest.borrowTail()));
+}
+
+bool hasJournalMagic(const char * const begin, const char * const end) noexcept
+{
+	return std::size_t(end - begin) >= sizeof(journalMagic) &&
+			std::equal(journalMagic, journalMagic + sizeof(journalMagic), begin);
+}
+
+bool readJournalHeader(const char * const begin, const char * const end, std::uint64_t &fileId) noexcept
+{
+	if (std::size_t(end - begin) < journalHeaderSize || !hasJournalMagic(begin, end)) {
+		return false;
+	}
+	// Newer versions are not supported since they could be incompatible.
+	if (static_cast<unsigned char>(begin[4]) != journalFormatVersion) {
+		return false;
+	}
+	if (begin[5] != '\0' || begin[6] != '\0' || begin[7] != '\0') {
+		return false;
+	}
+	fileId = readUInt64(begin + 8);
+	return true;
+}
+
+void appendJournalRecord(const ScrobbleInfo &scrobbleInfo, afc::FastStringBuffer<char> &dest)
+{
+	appendRecord(JournalRecordType::scrobble, dest,
+			[&scrobbleInfo](afc::FastStringBuffer<char> &payload) { appendAsBinary(scrobbleInfo, payload); });
+}
+
+void appendJournalRecord(const ScrobbleInfo &scrobbleInfo, StringDictionary &dictionary,
+		afc::FastStringBuffer<char> &dest)
+{
+	const Track &track = scrobbleInfo.track;
+	const std::uint32_t artistsId = addString(track.getArtistsBegin(), track.getArtistsEnd(), dictionary, dest);
+	const std::uint32_t albumTitleId = addString(track.getAlbumTitleBegin(), track.getAlbumTitleEnd(),
+			dictionary, dest);
+	const std::uint32_t albumArtistsId = addString(track.getAlbumArtistsBegin(), track.getAlbumArtistsEnd(),
+			dictionary, dest);
+
+	appendRecord(JournalRecordType::compactScrobble, dest, [&](afc::FastStringBuffer<char> &payload)
+	{
+		appendAsCompactBinary(scrobbleInfo, artistsId, albumTitleId, albumArtistsId, payload);
+	});
+}
+
+void appendJournalRecord(const ScrobbleInfo &scrobbleInfo, const unsigned consumers, StringDictionary &dictionary,
+		afc::FastStringBuffer<char> &dest)
+{
+	const JournalStringIds ids = appendJournalStrings(scrobbleInfo, dictionary, dest);
+	appendJournalScrobble(scrobbleInfo, consumers, ids, dest);
+}
+
+JournalStringIds appendJournalStrings(const ScrobbleInfo &scrobbleInfo, StringDictionary &dictionary,
+		afc::FastStringBuffer<char> &dest)
+{
+	const Track &track = scrobbleInfo.track;
+	JournalStringIds ids;
+	ids.artists = addString(track.getArtistsBegin(), track.getArtistsEnd(), dictionary, dest);
+	ids.albumTitle = addString(track.getAlbumTitleBegin(), track.getAlbumTitleEnd(), dictionary, dest);
+	ids.albumArtists = addString(track.getAlbumArtistsBegin(), track.getAlbumArtistsEnd(), dictionary, dest);
+	return ids;
+}
+
+void appendJournalScrobble(const ScrobbleInfo &scrobbleInfo, const unsigned consumers, const JournalStringIds &ids,
+		afc::FastStringBuffer<char> &dest)
+{
+	assert(consumers != 0 && consumers <= allJournalConsumers);
+
+	appendRecord(JournalRecordType::sharedScrobble, dest, [&](afc::FastStringBuffer<char> &payload)
+	{
+		payload.reserve(payload.size() + 1);
+		payload.append(static_cast<char>(consumers));
+		appendAsCompactBinary(scrobbleInfo, ids.artists, ids.albumTitle, ids.albumArtists, payload);
+	});
+}
+
+void setJournalRecordConsumers(char * const record, const std::size_t size, const unsigned consumers) noexcept
+{
+	assert(size > journalRecordOverhead);
+	assert(peekJournalRecordType(record) == JournalRecordType::sharedScrobble);
+	assert(consumers != 0 && consumers <= allJournalConsumers);
+
+	char * const typeBegin = record + 4;
+	char * const crcBegin = record + size - 4;
+	typeBegin[1] = static_cast<char>(consumers);
+	writeUInt32(crc32(typeBegin, crcBegin), crcBegin);
+}
+
+void appendJournalDictionary(const StringDictionary &dictionary, afc::FastStringBuffer<char> &dest)
+{
+	dictionary.forEach([&dest](const std::uint32_t id, const char * const begin, const char * const end)
+	{
+		appendStringRecord(id, begin, end, dest);
+	});
+}
+
+bool readJournalString(const char * const payloadBegin, const char * const payloadEnd, std::uint32_t &id,
+		const char *&begin, const char *&end) noexcept
+{
+	// The empty string is never defined.
+	if (std::size_t(payloadEnd - payloadBegin) <= 4) {
+		return false;
+	}
+	id = readUInt32(payloadBegin);
+	begin = payloadBegin + 4;
+	end = payloadEnd;
+	return true;
+}
+
+void appendJournalCursorsRecord(const JournalCursors &offsets, afc::FastStringBuffer<char> &dest)
+{
+	appendRecord(JournalRecordType::cursors, dest, [&offsets](afc::FastStringBuffer<char> &payload)
+	{
+		payload.reserve(payload.size() + 8 * journalConsumerCount);
+		auto p = payload.borrowTail();
+		for (const std::uint64_t offset : offsets) {
+			p = writeUInt64(offset, p);
+		}
+		payload.returnTail(p);
+	});
+}
+
+bool readJournalCursors(const char * const payloadBegin, const char * const payloadEnd,
+		JournalCursors &offsets) noexcept
+{
+	if (std::size_t(payloadEnd - payloadBegin) != 8 * journalConsumerCount) {
+		return false;
+	}
+	for (unsigned i = 0; i < journalConsumerCount; ++i) {
+		offsets[i] = readUInt64(payloadBegin + 8 * i);
+	}
+	return true;
+}
+
+unsigned journalRecordConsumers(const JournalRecordType type, const char * const payloadBegin,
+		const char * const payloadEnd) noexcept
+{
+	switch (type) {
+	case JournalRecordType::scrobble:
+	case JournalRecordType::compactScrobble:
+		return allJournalConsumers;
+	case JournalRecordType::sharedScrobble:
+		assert(payloadBegin != payloadEnd);
+		return static_cast<unsigned char>(*payloadBegin);
+	default:
+		return 0;
+	}
+}
+
+unsigned peekJournalRecordConsumers(const char * const pos) noexcept
+{
+	switch (peekJournalRecordType(pos)) {
+	case JournalRecordType::scrobble:
+	case JournalRecordType::compactScrobble:
+		return allJournalConsumers;
+	case JournalRecordType::sharedScrobble:
+		// The mask is read only if the payload is not empty.
+		return readUInt32(pos) != 0 ? static_cast<unsigned char>(pos[5]) : 0;
+	default:
+		return 0;
+	}
+}
+
+JournalReadResult readJournalRecord(const char *&pos, const char * const end, JournalRecordType &type,
+		const char *&payloadBegin, const char *&payloadEnd) noexcept
+{
+	assert(pos <= end);
+
+	const std::size_t available = end - pos;
+	if (available == 0) {
+		return JournalReadResult::end;
+	}
+	if (unlikely(available < journalRecordOverhead)) {
+		return JournalReadResult::truncated;
+	}
+
+	const std::size_t payloadSize = readUInt32(pos);
+	if (unlikely(available - journalRecordOverhead < payloadSize)) {
+		return JournalReadResult::truncated;
+	}
+
+	const char * const typeBegin = pos + 4;
+	const char * const crcBegin = typeBegin + 1 + payloadSize;
+	const char * const next = crcBegin + 4;
+
+	if (unlikely(crc32(typeBegin, crcBegin) != readUInt32(crcBegin))) {
+		pos = next;
+		return JournalReadResult::corrupted;
+	}
+
+	const unsigned char rawType = static_cast<unsigned char>(*typeBegin);
+	if (unlikely(rawType < static_cast<unsigned char>(JournalRecordType::scrobble) ||
+			rawType > static_cast<unsigned char>(JournalRecordType::cursors))) {
+		pos = next;
+		return JournalReadResult::corrupted;
+	}
+	// A shared scrobble record starts with the consumer mask.
+	if (unlikely(rawType == static_cast<unsigned char>(JournalRecordType::sharedScrobble) && payloadSize == 0)) {
+		pos = next;
+		return JournalReadResult::corrupted;
+	}
+
+	type = static_cast<JournalRecordType>(rawType);
+	payloadBegin = typeBegin + 1;
+	payloadEnd = crcBegin;
+	pos = next;
+	return JournalReadResult::ok;
+}
+
+const char *skipJournalRecord(const char * const pos, const char * const end) noexcept
+{
+	assert(pos <= end);
+
+	const std::size_t available = end - pos;
+	if (available < journalRecordOverhead) {
+		return nullptr;
+	}
+	const std::size_t payloadSize = readUInt32(pos);
+	if (available - journalRecordOverhead < payloadSize) {
+		return nullptr;
+	}
+	return pos + journalRecordOverhead + payloadSize;
+}
+
+void appendJournalCursor(const std::uint64_t fileId, const JournalCursors &offsets, afc::FastStringBuffer<char> &dest)
+{
+	const std::size_t cursorStart = dest.size();
+
+	dest.reserve(cursorStart + journalCursorSize);
+	dest.append(cursorMagic, sizeof(cursorMagic));
+	dest.append(static_cast<char>(journalCursorVersion));
+	// Reserved octets.
+	dest.append('\0');
+	dest.append('\0');
+	dest.append('\0');
+	auto p = dest.borrowTail();
+	p = writeUInt64(fileId, p);
+	for (const std::uint64_t offset : offsets) {
+		p = writeUInt64(offset, p);
+	}
+	dest.returnTail(p);
+
+	const std::uint32_t crc = crc32(dest.data() + cursorStart, dest.data() + dest.size());
+	dest.returnTail(writeUInt32(crc, dest.borrowTail()));
+}
+
+bool readJournalCursor(const char * const begin, const char * const end, std::uint64_t &fileId,
+		JournalCursors &offsets) noexcept
+{
+	const std::size_t size = end - begin;
+	if (size < 8 || !std::equal(cursorMagic, cursorMagic + sizeof(cursorMagic), begin)) {
+		return false;
+	}
+	const unsigned char version = static_cast<unsigned char>(begin[4]);
+	if (!(version == journalCursorVersion && size == journalCursorSize) &&
+			!(version == 1 && size == legacyJournalCursorSize)) {
+		return false;
+	}
+	if (begin[5] != '\0' || begin[6] != '\0' || begin[7] != '\0') {
+		return false;
+	}
+	const char * const crcBegin = end - 4;
+	if (crc32(begin, crcBegin) != readUInt32(crcBegin)) {
+		return false;
+	}
+	fileId = readUInt64(begin + 8);
+	for (unsigned i = 0; i < journalConsumerCount; ++i) {
+		offsets[i] = readUInt64(begin + (version == 1 ? 16 : 16 + 8 * i));
+	}
+	return true;
+}
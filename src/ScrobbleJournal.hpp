@@ -0,0 +1,236 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef SCROBBLEJOURNAL_HPP_
+#define SCROBBLEJOURNAL_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <afc/FastStringBuffer.hpp>
+#include "ScrobbleInfo.hpp"
+#include "StringDictionary.hpp"
+
+/* The binary journal format of the data file.
+ *
+ * The file starts with the header:
+ *   - magic (4 octets): 'D', 'B', 'S', 'J';
+ *   - format version (1 octet);
+ *   - reserved (3 octets), must be zero;
+ *   - file identifier (8 octets, little-endian), assigned when the file is (re-)created.
+ *
+ * The header is followed by zero or more records:
+ *   - payload size (4 octets, little-endian);
+ *   - record type (1 octet);
+ *   - payload (payload size octets);
+ *   - CRC-32 (4 octets, little-endian) of the record type and the payload.
+ *
+ * Record types:
+ *   - scrobble: the payload is produced by appendAsBinary();
+ *   - string: defines a string of the dictionary (see StringDictionary) which is referred to by
+ *     the compact scrobble records that follow it. The payload is the string identifier
+ *     (4 octets, little-endian) followed by the string itself;
+ *   - compact scrobble: the payload is produced by appendAsCompactBinary();
+ *   - shared scrobble: the payload is the mask of the consumers the scrobble is pending for
+ *     (1 octet) followed by the payload of the compact scrobble record;
+ *   - cursors: the offsets of the cursors of all consumers (journalConsumerCount times
+ *     8 octets, little-endian). It is written at the beginning of a re-written journal.
+ *
+ * A journal is shared by up to journalConsumerCount consumers (i.e. scrobbling services),
+ * each of which is identified by a bit of the consumer mask. The scrobble and compact scrobble
+ * records are pending for all consumers.
+ *
+ * The string records are not subject to the cursors: all of them are read when the journal
+ * is loaded, including the ones before the cursors.
+ *
+ * The journal is accompanied by the cursor file which stores the cursor of each consumer,
+ * i.e. the offset after its last record that is acknowledged (the records of the consumer
+ * before the cursor are completed and are ignored by it):
+ *   - magic (4 octets): 'D', 'B', 'S', 'C';
+ *   - format version (1 octet), journalCursorVersion;
+ *   - reserved (3 octets), must be zero;
+ *   - journal file identifier (8 octets, little-endian);
+ *   - offsets (journalConsumerCount times 8 octets, little-endian), zero if the cursor
+ *     is unknown;
+ *   - CRC-32 (4 octets, little-endian) of the preceding octets.
+ *
+ * The cursor file of version 1 has a single offset which applies to all consumers.
+ *
+ * The cursor file applies only to the journal with the same file identifier. Otherwise
+ * the cursors record of the journal, if any, is used.
+ */
+constexpr std::size_t journalHeaderSize = 16;
+constexpr unsigned char journalFormatVersion = 1;
+// The fixed part of a record: size, type and CRC.
+constexpr std::size_t journalRecordOverhead = 4 + 1 + 4;
+constexpr unsigned journalConsumerCount = 8;
+// The consumer mask of the records that are pending for all consumers.
+constexpr unsigned allJournalConsumers = (1u << journalConsumerCount) - 1;
+constexpr unsigned char journalCursorVersion = 2;
+constexpr std::size_t journalCursorSize = 4 + 1 + 3 + 8 + 8 * journalConsumerCount + 4;
+// The size of the cursor file of version 1.
+constexpr std::size_t legacyJournalCursorSize = 4 + 1 + 3 + 8 + 8 + 4;
+
+// The cursors of the consumers of a journal indexed by the consumer identifier.
+typedef std::array<std::uint64_t, journalConsumerCount> JournalCursors;
+
+enum class JournalRecordType : unsigned char
+{
+	scrobble = 1,
+	string = 2,
+	compactScrobble = 3,
+	sharedScrobble = 4,
+	cursors = 5
+};
+
+enum class JournalReadResult
+{
+	// A valid record is read.
+	ok,
+	// The end of the journal is reached.
+	end,
+	// The record is complete but its CRC or type does not match. It can be skipped.
+	corrupted,
+	// The journal ends in the middle of the record.
+	truncated
+};
+
+std::uint32_t crc32(const char *begin, const char *end) noexcept;
+
+// Generates an identifier for a new journal file. It is not guaranteed to be unique.
+std::uint64_t newJournalFileId() noexcept;
+
+void appendJournalHeader(std::uint64_t fileId, afc::FastStringBuffer<char> &dest);
+
+// Returns true if a given sequence starts with the journal magic.
+bool hasJournalMagic(const char *begin, const char *end) noexcept;
+
+/* Validates the journal header.
+ *
+ * @return true if the header is valid and its version is supported; false otherwise.
+ *         fileId is assigned only if true is returned.
+ */
+bool readJournalHeader(const char *begin, const char *end, std::uint64_t &fileId) noexcept;
+
+// Appends a single framed scrobble record to dest.
+void appendJournalRecord(const ScrobbleInfo &scrobbleInfo, afc::FastStringBuffer<char> &dest);
+
+/* Appends a single framed compact scrobble record to dest. The strings of the scrobble that
+ * are not in the dictionary are added to it and their string records are appended before
+ * the scrobble record.
+ */
+void appendJournalRecord(const ScrobbleInfo &scrobbleInfo, StringDictionary &dictionary,
+		afc::FastStringBuffer<char> &dest);
+
+/* Appends a single framed shared scrobble record that is pending for given consumers to dest.
+ * The strings are handled as by the function above.
+ */
+void appendJournalRecord(const ScrobbleInfo &scrobbleInfo, unsigned consumers, StringDictionary &dictionary,
+		afc::FastStringBuffer<char> &dest);
+
+// The identifiers of the strings of a scrobble that are referred to by its compact record.
+struct JournalStringIds
+{
+	std::uint32_t artists;
+	std::uint32_t albumTitle;
+	std::uint32_t albumArtists;
+};
+
+/* Adds the strings of a given scrobble that are not in the dictionary to it and appends
+ * their string records to dest.
+ *
+ * @return the identifiers of the strings of the scrobble.
+ */
+JournalStringIds appendJournalStrings(const ScrobbleInfo &scrobbleInfo, StringDictionary &dictionary,
+		afc::FastStringBuffer<char> &dest);
+
+/* Appends a single framed shared scrobble record whose strings have given identifiers
+ * (see appendJournalStrings()) to dest. No dictionary is needed so that records can be
+ * encoded by several threads at once, while the dictionary is modified.
+ */
+void appendJournalScrobble(const ScrobbleInfo &scrobbleInfo, unsigned consumers, const JournalStringIds &ids,
+		afc::FastStringBuffer<char> &dest);
+
+/* Replaces the consumer mask of a given complete shared scrobble record. The CRC of the record
+ * is updated accordingly.
+ */
+void setJournalRecordConsumers(char *record, std::size_t size, unsigned consumers) noexcept;
+
+// Appends the string records of all the strings of a given dictionary to dest.
+void appendJournalDictionary(const StringDictionary &dictionary, afc::FastStringBuffer<char> &dest);
+
+/* Reads the payload of a string record.
+ *
+ * @return true if the payload is valid; false otherwise. id, begin and end are assigned
+ *         only if true is returned.
+ */
+bool readJournalString(const char *payloadBegin, const char *payloadEnd, std::uint32_t &id,
+		const char *&begin, const char *&end) noexcept;
+
+// Appends the cursors record to dest.
+void appendJournalCursorsRecord(const JournalCursors &offsets, afc::FastStringBuffer<char> &dest);
+
+/* Reads the payload of a cursors record.
+ *
+ * @return true if the payload is valid; false otherwise. offsets is assigned only if true is returned.
+ */
+bool readJournalCursors(const char *payloadBegin, const char *payloadEnd, JournalCursors &offsets) noexcept;
+
+/* Reads the record that starts at pos. If the record is complete (i.e. ok or corrupted
+ * is returned) then pos is moved to the beginning of the next record. Otherwise pos
+ * is not modified.
+ *
+ * If ok is returned then type, payloadBegin and payloadEnd are assigned.
+ */
+JournalReadResult readJournalRecord(const char *&pos, const char *end, JournalRecordType &type,
+		const char *&payloadBegin, const char *&payloadEnd) noexcept;
+
+/* Returns the beginning of the record that follows the record that starts at pos.
+ * Neither the CRC nor the type of the record is validated.
+ *
+ * @return the beginning of the next record; nullptr if the journal ends in the middle
+ *         of the record or pos is equal to end.
+ */
+const char *skipJournalRecord(const char *pos, const char *end) noexcept;
+
+/* Returns the type of the record that starts at pos as it is stored. The record must be
+ * complete (see skipJournalRecord()). The type is not validated.
+ */
+inline JournalRecordType peekJournalRecordType(const char * const pos) noexcept
+{
+	return static_cast<JournalRecordType>(pos[4]);
+}
+
+/* Returns the mask of the consumers a record read by readJournalRecord() is pending for.
+ * It is zero for the records that are not scrobbles.
+ */
+unsigned journalRecordConsumers(JournalRecordType type, const char *payloadBegin, const char *payloadEnd) noexcept;
+
+/* Returns the mask of the consumers the record that starts at pos is pending for as it is stored.
+ * The record must be complete (see skipJournalRecord()). Neither the CRC nor the type is validated.
+ */
+unsigned peekJournalRecordConsumers(const char *pos) noexcept;
+
+void appendJournalCursor(std::uint64_t fileId, const JournalCursors &offsets, afc::FastStringBuffer<char> &dest);
+
+/* Validates the cursor file.
+ *
+ * @return true if the cursor file is valid and its version is supported; false otherwise.
+ *         fileId and offsets are assigned only if true is returned.
+ */
+bool readJournalCursor(const char *begin, const char *end, std::uint64_t &fileId, JournalCursors &offsets) noexcept;
+
+#endif /* SCROBBLEJOURNAL_HPP_ */
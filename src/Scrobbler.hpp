@@ -20,25 +20,45 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 #include <atomic>
 #include <cassert>
 #include <cerrno>
+#include <chrono>
 #include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <deque>
 #include <iterator>
+#include <list>
+#include <memory>
 #include <mutex>
+#include <random>
 #include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include <afc/FastStringBuffer.hpp>
 #include <afc/logger.hpp>
 #include <afc/SimpleString.hpp>
 #include <afc/StringRef.hpp>
-#include <sys/stat.h>
+#include "fileutil.hpp"
+#include "IntakeQueue.hpp"
+#include "NetworkMonitor.hpp"
+#include "Reactor.hpp"
 #include "ScrobbleInfo.hpp"
-
-// TODO make logging tag configurable.
+#include "ScrobbleJournal.hpp"
+#include "SharedJournal.hpp"
+#include "StringDictionary.hpp"
+
+/* Submits scrobbles in the background as a task of a Reactor (see setReactor()). The file work
+ * that blocks (the load of the pending scrobbles, the reads of the spilled ones) is performed by
+ * a loader thread of this Scrobbler so that the reactor thread that is shared with other Scrobblers
+ * is not delayed by it.
+ *
+ * TODO make logging tag configurable.
+ */
 template<typename ScrobbleQueue>
-class Scrobbler
+class Scrobbler : private Reactor::Task
 {
 	static_assert(std::is_same<typename ScrobbleQueue::value_type, ScrobbleInfo>::value,
 			"ScrobbleQueue must be a container of ScrobbleInfo objects.");
@@ -48,10 +68,40 @@ class Scrobbler
 	Scrobbler &operator=(const Scrobbler &) = delete;
 	Scrobbler &operator=(Scrobbler &&) = delete;
 public:
-	Scrobbler() : m_mutex(), m_scrobblingThread(), m_cv(), m_startStopMutex(), m_finishScrobblingFlag(false)
+	/* @param maxScrobblesPerRequest the max number of scrobbles that startScrobbling() submits
+	 *         within a single request.
+	 */
+	explicit Scrobbler(const std::size_t maxScrobblesPerRequest)
+		: m_maxScrobblesPerRequest(maxScrobblesPerRequest), m_privateReactor(), m_loader(), m_intake(),
+		  m_accepting(false), m_mutex(), m_startStopMutex(), m_finishScrobblingFlag(false), m_random(),
+		  m_networkMonitor(), m_networkWatch(*this)
 	{ std::lock_guard<std::mutex> lock(m_mutex); // synchronising memory
 		m_started = false;
 		m_configured = false;
+		m_residentScrobbleLimit = defaultResidentScrobbleLimit;
+		m_maxBatchesInFlight = 1;
+		m_maxParseThreads = std::min(std::max(std::thread::hardware_concurrency(), 1u), defaultMaxParseThreads);
+		m_monitorNetwork = false;
+		m_minRetryDelay = defaultMinRetryDelay();
+		m_maxRetryDelay = defaultMaxRetryDelay();
+		m_retryDelay = m_minRetryDelay;
+		m_retryTime = std::chrono::steady_clock::time_point();
+		m_stopTimeout = defaultStopTimeout();
+		m_scrobbleCount = 0;
+		m_completedCount = 0;
+		m_loadState = L_LOADED;
+		m_loaderJob = LJ_NONE;
+		m_loaderStopFlag = false;
+		m_safeIntake = false;
+		m_sharedJournal = nullptr;
+		m_journal = nullptr;
+		m_journalConsumer = 0;
+		m_sharedReactor = nullptr;
+		m_reactor = nullptr;
+		m_submitting = false;
+		m_lastAttemptFailed = false;
+		m_prevScrobbleCount = 0;
+		m_networkMonitorOutdated = false;
 
 		/* This instance is partially initialised here. It will be initialised completely
 		 * when ::start() is invoked successfully.
@@ -70,46 +120,337 @@ public:
 		m_configured = false;
 	}
 
+	/* Sets the max number of pending scrobbles that are kept in memory. The pending scrobbles
+	 * beyond this number are kept in the data file only (spilled) and are loaded into memory
+	 * as the preceding ones are completed. The limit is raised to the number of scrobbles
+	 * needed for two requests if it is lower than that.
+	 *
+	 * The pending scrobbles that are already in memory are not spilled if the limit is lowered.
+	 */
+	void setResidentScrobbleLimit(const std::size_t limit)
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		m_residentScrobbleLimit = std::max(limit, 2 * m_maxScrobblesPerRequest);
+	}
+
+	/* Sets the max number of requests that startScrobbling() may have in flight at once, each one
+	 * with its own batch of leading pending scrobbles (see collectBatches()). It is one by default,
+	 * i.e. the next request is sent only when the response to the previous one is received.
+	 * More requests in flight drain a backlog faster when the latency of the scrobbling service
+	 * is high. It is ignored by the Scrobblers that must submit scrobbles in order.
+	 */
+	void setMaxBatchesInFlight(const std::size_t count)
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		m_maxBatchesInFlight = std::max<std::size_t>(count, 1);
+	}
+
+	/* Sets the max number of threads, the loader thread included, that parse a large data file
+	 * of an older version of this plugin when it is converted. It is the number of hardware threads
+	 * but at most four by default.
+	 *
+	 * It must be invoked while this Scrobbler is stopped.
+	 */
+	void setMaxParseThreads(const unsigned count)
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		assert(!m_started);
+		m_maxParseThreads = std::max(count, 1u);
+	}
+
+	/* Sets the bounds of the delay before pending scrobbles are re-submitted after a failed attempt.
+	 * The delay starts at minDelay and is doubled after each subsequent failure up to maxDelay.
+	 * The actual delay is picked at random between a half of it and the whole of it so that
+	 * the clients that have failed at the same time do not retry at the same time as well.
+	 * A new scrobble is submitted at once regardless of the delay.
+	 */
+	void setRetryDelay(const std::chrono::milliseconds minDelay, const std::chrono::milliseconds maxDelay)
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		// A zero delay would never grow.
+		m_minRetryDelay = std::max(minDelay, std::chrono::milliseconds(1));
+		m_maxRetryDelay = std::max(m_minRetryDelay, maxDelay);
+		m_retryDelay = m_minRetryDelay;
+	}
+
+	/* Sets the time stop() is expected to take at most. The HTTP calls in progress are aborted
+	 * at once whatever phase (e.g. name resolution, connection) they are in, so normally stop()
+	 * takes much less. If the reactor is late to detach this Scrobbler (e.g. it is busy with
+	 * a task of another Scrobbler) and the time is over then the scrobbles accepted are stored
+	 * before stop() waits for the reactor any longer, and the compaction of the data file is left
+	 * to the next start. The pending scrobbles are stored whatever time it takes since they would
+	 * be lost otherwise.
+	 */
+	void setStopTimeout(const std::chrono::milliseconds timeout)
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopTimeout = timeout;
+	}
+
+	/* Enables or disables monitoring of network changes (Linux only). If it is enabled then
+	 * pending scrobbles are re-submitted at once, without waiting for the retry delay to expire,
+	 * when an interface gets up, an address is added to an interface, or a default route appears.
+	 * The monitor is watched by the reactor while this Scrobbler is started. It is disabled by default;
+	 * no resources are used for it while it is disabled. Nothing is done if the setting is not changed.
+	 */
+	void setNetworkMonitoring(const bool enabled)
+	{
+		{ std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_monitorNetwork == enabled) {
+				return;
+			}
+			m_monitorNetwork = enabled;
+			m_networkMonitorOutdated = true;
+		}
+		// The monitor is opened or closed by the reactor thread.
+		wake();
+	}
+
+	/* Makes this Scrobbler run as a task of a given reactor that is shared with other Scrobblers.
+	 * The reactor must be started while this Scrobbler is started. If the reactor is null
+	 * (the default) then this Scrobbler starts a reactor of its own when it is started.
+	 *
+	 * It must be invoked while this Scrobbler is stopped.
+	 */
+	void setReactor(Reactor * const reactor)
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		assert(!m_started);
+		m_sharedReactor = reactor;
+	}
+
+	/* Makes this Scrobbler store its pending scrobbles to a given journal that is shared with
+	 * other Scrobblers, as a given consumer of the journal. If the journal is null (the default)
+	 * then this Scrobbler owns the journal which is stored to the data file (see getDataFilePath()).
+	 *
+	 * If the journal is shared then the data file is the one of the older versions of this plugin.
+	 * Its pending scrobbles are moved to the shared journal when this Scrobbler is started.
+	 *
+	 * It must be invoked while this Scrobbler is stopped.
+	 */
+	void setJournal(SharedJournal * const journal, const unsigned consumer)
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		assert(!m_started);
+		assert(consumer < journalConsumerCount);
+		m_sharedJournal = journal;
+		m_journalConsumer = consumer;
+	}
+
 	/*
 	 * Adds a given scrobble to the list of pending scrobbles. Optionally, it saves
 	 * the given scrobble to the data file to keep if available even if an emergency
-	 * happens. Scrobbler::stop() rewrites the data file, sweeping out all
-	 * scrobbles whose processing is completed.
+	 * happens. Scrobbles whose processing is completed are acknowledged by the cursor
+	 * of the data file; they are swept out of the data file when it is compacted.
+	 *
+	 * If the number of pending scrobbles in memory has reached the limit then the scrobble is
+	 * stored to the data file only, regardless of safeScrobbling.
+	 *
+	 * Nothing is done if this Scrobbler is not started or has failed to load its pending scrobbles.
 	 *
-	 * Nothing is done if this Scrobbler is not started.
+	 * The scrobble is pushed to the lock-free intake queue so that the caller does not wait
+	 * for the reactor thread which holds the lock while it processes responses. The scrobble
+	 * is moved to the list of pending scrobbles by the reactor thread or by the next thread
+	 * that acquires the lock. If safeScrobbling is true then the caller acquires the lock
+	 * itself to store the scrobble before this function returns. While the pending scrobbles
+	 * are being loaded the scrobble stays in the intake queue; it is added after the loaded ones
+	 * once the load is finished. A failure-safe scrobble is stored meanwhile as a spilled one
+	 * as soon as the data file is attached (see storeSafeIntake()).
 	 *
 	 * @param scrobbleInfo the track scrobble to process.
 	 * @param safeScrobble if true then the scrobble is stored to the data file
 	 *         immediately, to save this scrobble even in case of an emergency.
 	 *         It is false by default.
+	 * @param syncScrobbling if true then the data file is synchronised with the storage
+	 *         device after the scrobble is stored, to save this scrobble even in case of
+	 *         a system crash or a power failure. It is ignored if safeScrobble is false.
+	 *         It is false by default.
+	 */
+	void scrobble(ScrobbleInfo &&scrobbleInfo, const bool safeScrobbling = false, const bool syncScrobbling = false);
+
+	/* Adds given scrobbles to the list of pending scrobbles in the order they are given, as
+	 * scrobble() does for each of them. The scrobbles are moved from the range as a single entry
+	 * of the intake queue, are stored by a single append if needed and this Scrobbler
+	 * is woken up once. It is meant for bulk imports (e.g. of the listening history of another player).
+	 *
+	 * The scrobbles that do not fit into the limit of pending scrobbles in memory are not moved
+	 * but are stored to the data file directly.
 	 */
-	void scrobble(ScrobbleInfo &&scrobbleInfo, const bool safeScrobbling = false);
+	template<typename Iterator>
+	void scrobble(Iterator begin, Iterator end, bool safeScrobbling = false, bool syncScrobbling = false);
 
+	/* Attaches this Scrobbler to the reactor which submits the pending scrobbles once the loader
+	 * has loaded them from the data file. This function does not wait for the load to finish.
+	 *
+	 * @return true if this Scrobbler is started; false if it is already started, has no data file,
+	 *         or its own reactor cannot be started.
+	 */
 	bool start();
+	/* Detaches this Scrobbler from the reactor, which aborts the HTTP calls in progress, and stores
+	 * the pending scrobbles to the data file. If the pending scrobbles are not loaded yet (or their
+	 * load has failed) then they are left in the data file as they are, and only the scrobbles
+	 * accepted since start are stored after them.
+	 */
 	bool stop();
 
+	/* Blocks until the pending scrobbles are loaded after start().
+	 *
+	 * @return true if they are loaded; false if the load has failed or this Scrobbler is not started.
+	 *         A failed load is retried by the loader after the retry delay (see setRetryDelay()).
+	 */
+	bool waitForLoad()
+	{ std::unique_lock<std::mutex> lock(m_mutex);
+		m_loadCv.wait(lock, [this]() { return !m_started || m_loadState == L_LOADED || m_loadState == L_FAILED; });
+		return m_started && m_loadState == L_LOADED;
+	}
+
 	bool started() const
 	{ std::lock_guard<std::mutex> lock(m_mutex);
 		return m_started;
 	}
-private:
-	bool loadPendingScrobbles();
-	bool storePendingScrobbles();
-	void backgroundScrobbling();
 
-	// Used by openDataFile().
-	enum OpenResult {O_ERROR, O_OPENED, O_NOTEXIST};
+	// Returns the number of scrobbles completed (successful and non-processable) since this Scrobbler is started.
+	std::size_t completedCount() const
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		return m_completedCount;
+	}
 
-	static OpenResult openDataFile(const char *path, std::size_t pathSize, const char * const mode,
-			const bool storeMode, std::FILE *&dest);
-	static bool createParentDirs(const char *path, std::size_t pathSize);
+	// Returns true if the pending scrobbles are loaded and all of them are completed, including the spilled ones.
+	bool drained() const
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_started || m_loadState != L_LOADED || !m_pendingScrobbles.empty() || !m_intake.empty()) {
+			return false;
+		}
+		const std::unique_lock<std::mutex> journalLock = m_journal->lock();
+		return !m_journal->hasSpill(m_journalConsumer);
+	}
+private:
+	/* L_ATTACHED: the load in progress has attached this Scrobbler to the journal, and reads
+	 * the leading spilled scrobbles. The scrobbles can be spilled meanwhile.
+	 */
+	enum LoadState {L_LOADING, L_ATTACHED, L_LOADED, L_FAILED};
+	// The work requested from the loader thread.
+	enum LoaderJob {LJ_NONE, LJ_LOAD, LJ_SPILL};
+
+	bool loadPendingScrobbles(std::unique_lock<std::mutex> &lock);
+	bool attachJournal(const afc::String &dataFilePath);
+	bool finishLoad(bool loaded);
+	// An entry of the intake queue: the scrobbles of a single scrobble() call.
+	struct IntakeBatch
+	{
+		std::vector<ScrobbleInfo> scrobbles;
+		bool safe;
+		bool sync;
+	};
 
 	template<typename Iterator>
-	static bool storeScrobbles(Iterator begin, const Iterator end, const afc::String &dataFilePath,
-			const char * const storeMode);
+	void acceptScrobbles(Iterator begin, Iterator end, bool safeScrobbling, bool syncScrobbling);
+	void appendScrobbles(std::size_t count, bool sync);
+	bool syncJournal(bool deferCompaction);
+	void storeAccepted();
+	bool spillIntake(std::unique_lock<std::mutex> &lock, bool deferCompaction);
+	std::size_t appendIntake();
+	void storeSafeIntake();
+	void checkpointJournal();
+	void acknowledgeScrobbles(std::size_t count) noexcept;
+	void loadSpilledScrobbles(std::unique_lock<std::mutex> &lock);
+	// Makes the loader thread perform a given job unless it is busy with another one.
+	void requestLoaderJob(LoaderJob job);
+	// The body of the loader thread.
+	void runLoader();
+	// Stops the loader thread once the job in progress, if any, is finished.
+	void stopLoader(std::unique_lock<std::mutex> &lock);
+	// Invoked by the reactor thread when this Scrobbler is woken up or the retry time is reached.
+	virtual void run() override;
+	// Schedules the next attempt to submit pending scrobbles after a failed one.
+	void scheduleRetry();
+	/* Opens or closes the network monitor as configured. It is executed by the reactor thread
+	 * within lock on m_mutex.
+	 */
+	void updateNetworkMonitor();
+	// Invoked by the reactor thread when the network monitor reports network changes.
+	void networkChanged();
+
+	// Makes networkChanged() invoked when the network monitor is readable.
+	class NetworkWatch : public Reactor::Watch
+	{
+	public:
+		explicit NetworkWatch(Scrobbler &scrobbler) noexcept : m_scrobbler(scrobbler) {}
+
+		virtual void ready() override { m_scrobbler.networkChanged(); }
+	private:
+		Scrobbler &m_scrobbler;
+	};
+
+	/* The number of trailing pending scrobbles that are not stored to the journal.
+	 * It is executed within lock on the journal.
+	 */
+	std::size_t unstoredCount() const noexcept
+	{
+		return m_pendingScrobbles.size() - m_journal->storedCount(m_journalConsumer);
+	}
+
+	// Used to collect the outcome of parsing the data file.
+	struct LoadResult
+	{
+		LoadResult() : quarantine(), malformedCount(0) {}
+
+		// Moves a malformed record to the quarantine buffer.
+		void reject(const char *begin, const char *end, bool lineFeed);
+		// Appends the outcome of parsing the subsequent part of the data file.
+		void merge(const LoadResult &other);
+
+		// Malformed records in their original form.
+		afc::FastStringBuffer<char> quarantine;
+		std::size_t malformedCount;
+	};
+
+	bool loadLegacyScrobbles(const afc::String &dataFilePath, bool convertJournal, ScrobbleQueue &dest,
+			LoadResult &result, bool &found);
+	static void parseScrobbles(const char *begin, const char *end, bool journal, const StringDictionary &dictionary,
+			unsigned consumers, unsigned maxThreads, ScrobbleQueue &dest, LoadResult &result);
+	static void parseChunk(const char *begin, const char *end, bool journal, const StringDictionary &dictionary,
+			unsigned consumers, ScrobbleQueue &dest, LoadResult &result);
+	static const char *findChunkEnd(const char *begin, const char *end, std::size_t chunkSize, bool journal);
+	static void parseJournalRecords(const char *begin, const char *end, const StringDictionary &dictionary,
+			unsigned consumers, ScrobbleQueue &dest, LoadResult &result);
+	static bool parseJournalScrobble(JournalRecordType type, const char *payloadBegin, const char *payloadEnd,
+			const StringDictionary &dictionary, ScrobbleInfo &dest);
+	static void defineJournalString(const char *recordBegin, const char *recordEnd, StringDictionary &dictionary);
+	static void parseLegacyScrobbles(const char *begin, const char *end, ScrobbleQueue &dest, LoadResult &result);
+
+	// Moves all elements of src to the end of dest preserving their order.
+	template<typename T>
+	static void appendAll(std::list<T> &dest, std::list<T> &src) { dest.splice(dest.end(), src); }
+	template<typename Queue>
+	static void appendAll(Queue &dest, Queue &src);
+	static bool loadCursor(const afc::String &dataFilePath, std::uint64_t &fileId, JournalCursors &offsets);
+	static const char *findSpilledRecordsEnd(const char *begin, const char *end, std::size_t maxCount,
+			unsigned consumers);
+	static void parseSpilledScrobbles(const char *fileBegin, const char *begin, const char *end,
+			SharedJournal &journal, unsigned consumers, ScrobbleQueue &dest, std::deque<std::uint64_t> &recordEnds,
+			LoadResult &result);
 protected:
-	// Returns the number of scrobbles completed (successful and non-processable).
-	virtual std::size_t doScrobbling() = 0;
+	// Makes the reactor run this Scrobbler soon. It can be invoked by any thread.
+	using Reactor::Task::wake;
+
+	/* Starts an attempt to submit pending scrobbles. The attempt is finished by attemptFinished(),
+	 * either before this function returns or once the HTTP calls of the attempt are completed.
+	 * No other attempt is started meanwhile. The HTTP calls are performed by the reactor (see perform())
+	 * so that the reactor thread is never blocked while the scrobbles are submitted.
+	 *
+	 * It is executed by the reactor thread within lock on m_mutex.
+	 */
+	virtual void startScrobbling() = 0;
+
+	/* Finishes the attempt to submit pending scrobbles that is started by startScrobbling().
+	 * If no scrobbles are completed then the attempt is considered as failed and is retried later.
+	 *
+	 * It is executed by the reactor thread within lock on m_mutex.
+	 */
+	void attemptFinished(std::size_t completedCount);
+
+	/* Starts performing a given prepared HTTP call (see HttpClient::preparePost()) on the reactor.
+	 * The call is aborted if this Scrobbler is stopped before the call is completed.
+	 *
+	 * It is executed by the reactor thread.
+	 *
+	 * @return true if the call is started; false otherwise, in which case it is not completed.
+	 */
+	bool perform(HttpCall &call) { return m_reactor->perform(*this, call); }
 
 	/**
 	 * Returns the path to the file where to store pending scrobbles to.
@@ -129,215 +470,484 @@ protected:
 	virtual void stopExtra() { /* Nothing to do by default. */ }
 
 	/**
-	 * Invoked each time the worker thread falls asleep.
+	 * Invoked each time this Scrobbler has nothing to submit and falls asleep.
 	 *
-	 * It is executed within lock on m_mutex.
+	 * It is executed by the reactor thread within lock on m_mutex.
 	 */
 	virtual void preSleep() { /* Nothing to do by default. */ }
 	/**
-	 * Invoked each time the worker thread is awakened for some reason.
+	 * Invoked each time this Scrobbler is awakened for some reason once the pending scrobbles
+	 * are loaded, including while an attempt to submit them is in progress.
 	 *
-	 * It is executed within lock on m_mutex.
+	 * It is executed by the reactor thread within lock on m_mutex.
 	 */
 	virtual void postSleep() { /* Nothing to do by default. */ }
 
+	/* Removes the leading pending scrobbles up to a given position as completed.
+	 * Their records in the data file are acknowledged.
+	 *
+	 * It is executed within lock on m_mutex.
+	 */
+	void completeScrobbles(typename ScrobbleQueue::iterator end);
+	// Removes a given number of leading pending scrobbles as completed. It is executed within lock on m_mutex.
+	void completeScrobbles(std::size_t count) { completeScrobbles(std::next(m_pendingScrobbles.begin(), count)); }
+	/* Removes a given pending scrobble as completed. If it is not the first one and
+	 * is stored in the data file then the data file is to be re-written.
+	 *
+	 * It is executed within lock on m_mutex.
+	 *
+	 * @return the iterator that follows the scrobble removed.
+	 */
+	typename ScrobbleQueue::iterator completeScrobble(typename ScrobbleQueue::iterator it);
+	/* Moves the scrobbles of the intake queue to the list of pending scrobbles.
+	 *
+	 * It is executed within lock on m_mutex.
+	 */
+	void drainIntake();
+
+	/* Collects the pointers to up to m_maxScrobblesPerRequest leading pending scrobbles, i.e. the scrobbles
+	 * a single request submits, so that the request can be built and the response can be processed while
+	 * m_mutex is released. The lock is retaken only to complete the scrobbles.
+	 *
+	 * The scrobbles collected stay valid and in place while the lock is released since only the reactor
+	 * thread removes pending scrobbles (stop() detaches this Scrobbler first), and the other threads only
+	 * append scrobbles, which keeps the references to the elements of ScrobbleQueue valid.
+	 *
+	 * It is executed within lock on m_mutex.
+	 */
+	void collectBatch(std::vector<const ScrobbleInfo *> &dest)
+	{
+		assertLocked();
+
+		dest.clear();
+		for (auto it = m_pendingScrobbles.begin(), end = m_pendingScrobbles.end();
+				it != end && dest.size() < m_maxScrobblesPerRequest; ++it) {
+			dest.push_back(&*it);
+		}
+	}
+
+	/* Splits up to m_maxBatchesInFlight * m_maxScrobblesPerRequest leading pending scrobbles into
+	 * batches of up to m_maxScrobblesPerRequest scrobbles, one per request, as collectBatch() does.
+	 * The batches follow each other in the order of the pending scrobbles so that the outcome of
+	 * the requests can be applied by walking the pending scrobbles from the first one, whatever
+	 * order the responses are received in.
+	 *
+	 * It is executed within lock on m_mutex.
+	 */
+	void collectBatches(std::vector<std::vector<const ScrobbleInfo *>> &dest)
+	{
+		assertLocked();
+
+		dest.clear();
+		for (auto it = m_pendingScrobbles.begin(), end = m_pendingScrobbles.end();
+				it != end && (dest.size() < m_maxBatchesInFlight || dest.back().size() < m_maxScrobblesPerRequest);
+				++it) {
+			if (dest.empty() || dest.back().size() == m_maxScrobblesPerRequest) {
+				dest.emplace_back();
+				dest.back().reserve(m_maxScrobblesPerRequest);
+			}
+			dest.back().push_back(&*it);
+		}
+	}
+
 	/* Ensures that this function is executed within the critical section against m_mutex.
 	 * Even though mutex::try_lock() has side effects it is fine to acquire the lock m_mutex
 	 * since the application is terminated immediately in this case.
 	 */
 	inline void assertLocked() noexcept { assert(!m_mutex.try_lock()); }
 
-	static constexpr std::size_t minScrobblesToWait() noexcept { return 1; }
-	static constexpr std::size_t maxScrobblesToWait() noexcept { return 32; }
+	/* Makes this Scrobbler re-submit pending scrobbles at once, without waiting for the retry
+	 * delay to expire, and resets the delay. It is used when the configuration is changed.
+	 *
+	 * It is executed within lock on m_mutex.
+	 */
+	void resetRetryDelay()
+	{
+		assertLocked();
+
+		m_retryDelay = m_minRetryDelay;
+		m_retryTime = std::chrono::steady_clock::time_point();
+		wake();
+	}
 
-	ScrobbleQueue m_pendingScrobbles;
+	static constexpr std::chrono::milliseconds defaultMinRetryDelay() noexcept { return std::chrono::seconds(10); }
+	static constexpr std::chrono::milliseconds defaultMaxRetryDelay() noexcept { return std::chrono::minutes(15); }
+	static constexpr std::chrono::milliseconds defaultStopTimeout() noexcept { return std::chrono::seconds(1); }
 
-	mutable std::size_t m_scrobblesToWait;
-	mutable std::mutex m_mutex;
+	static constexpr std::size_t defaultResidentScrobbleLimit = 1000;
+	static constexpr unsigned defaultMaxParseThreads = 4;
+
+	const std::size_t m_maxScrobblesPerRequest;
+	// Contains the leading pending scrobbles. The rest of them are spilled to the data file.
+	ScrobbleQueue m_pendingScrobbles;
 private:
-	mutable std::thread m_scrobblingThread;
+	// The journal that is set by setJournal(); null if this Scrobbler owns its journal.
+	SharedJournal *m_sharedJournal;
+	// The journal that is owned by this Scrobbler while it is started, if any.
+	std::unique_ptr<SharedJournal> m_privateJournal;
+	// The journal in use while this Scrobbler is started. It is locked after m_mutex.
+	SharedJournal *m_journal;
+	unsigned m_journalConsumer;
+	std::size_t m_residentScrobbleLimit;
+	std::size_t m_maxBatchesInFlight;
+	unsigned m_maxParseThreads;
+	bool m_monitorNetwork;
+	std::chrono::milliseconds m_minRetryDelay;
+	std::chrono::milliseconds m_maxRetryDelay;
+	std::chrono::milliseconds m_stopTimeout;
+	// The reactor that is set by setReactor(); null if this Scrobbler starts its own reactor.
+	Reactor *m_sharedReactor;
+	// The reactor that is owned by this Scrobbler while it is started, if any.
+	std::unique_ptr<Reactor> m_privateReactor;
+	// The reactor this Scrobbler is attached to while it is started.
+	Reactor *m_reactor;
+	// Indicates if an attempt to submit pending scrobbles is in progress.
+	bool m_submitting;
+	bool m_lastAttemptFailed;
+	// The delay to apply (with jitter) after the next failed attempt to submit pending scrobbles.
+	std::chrono::milliseconds m_retryDelay;
+	// The time after which pending scrobbles are re-submitted after a failed attempt.
+	std::chrono::steady_clock::time_point m_retryTime;
+	/* The number of scrobbles taken from the intake queue, including the spilled ones.
+	 * Used to detect new scrobbles.
+	 */
+	std::size_t m_scrobbleCount;
+	// The value of m_scrobbleCount when the last attempt to submit pending scrobbles was started.
+	std::size_t m_prevScrobbleCount;
+	std::size_t m_completedCount;
+	LoadState m_loadState;
+	// Notified when the load of pending scrobbles is finished.
+	std::condition_variable m_loadCv;
+	/* Performs the blocking file work of this Scrobbler while it is started (see LoaderJob),
+	 * waking this Scrobbler up once each job is done.
+	 */
+	std::thread m_loader;
+	// Notifies the loader thread of a job requested or of the request to stop.
+	std::condition_variable m_loaderCv;
+	// The job that is requested from the loader thread or is in progress; LJ_NONE if the loader is idle.
+	LoaderJob m_loaderJob;
+	bool m_loaderStopFlag;
+	/* The scrobbles pushed by scrobble() that are not added to the list of pending scrobbles yet.
+	 * Any thread consumes it while holding m_mutex once the pending scrobbles are loaded, or
+	 * once the journal is attached if it holds failure-safe scrobbles.
+	 */
+	IntakeQueue<IntakeBatch> m_intake;
+	// True if the intake queue holds failure-safe scrobbles that wait for the journal to be attached.
+	bool m_safeIntake;
+	// Indicates if scrobble() accepts scrobbles, i.e. if this Scrobbler is started.
+	std::atomic<bool> m_accepting;
 protected:
-	mutable std::condition_variable m_cv;
+	mutable std::mutex m_mutex;
 
 	/* Used to prevent parallel execution of the functions start() and stop().
-	 * This is needed for stop() to know that the scrobbling thread is stopped
+	 * This is needed for stop() to know that this Scrobbler is detached from the reactor
 	 * at some time to store all pending scrobbles to the data file.
 	 */
 	mutable std::mutex m_startStopMutex;
-	/* Indicates if the background scrobbling thread should finish its work
-	 * including aborting an active connection to the scrobbling service
-	 * (e.g. Gravifon) if it is established.
+	/* Indicates if this Scrobbler is being stopped so that no new HTTP calls are to be started.
+	 * The calls in progress are aborted by the reactor.
 	 */
 	mutable std::atomic<bool> m_finishScrobblingFlag;
 	bool m_started;
 	bool m_configured;
+private:
+	// Used to spread the retries of the clients that have failed at the same time.
+	std::minstd_rand m_random;
+	// Opened while this Scrobbler is started with network monitoring enabled.
+	NetworkMonitor m_networkMonitor;
+	NetworkWatch m_networkWatch;
+	// Indicates if the network monitor is to be opened or closed as configured by the reactor thread.
+	bool m_networkMonitorOutdated;
 };
 
-// storeMode is the file access specifier valid for std::fopen().
+template<typename ScrobbleQueue>
+void Scrobbler<ScrobbleQueue>::scrobble(ScrobbleInfo &&scrobbleInfo, const bool safeScrobbling,
+		const bool syncScrobbling)
+{
+	scrobble(&scrobbleInfo, &scrobbleInfo + 1, safeScrobbling, syncScrobbling);
+}
+
 template<typename ScrobbleQueue>
 template<typename Iterator>
-inline bool Scrobbler<ScrobbleQueue>::storeScrobbles(Iterator begin, const Iterator end,
-		const afc::String &dataFilePath, const char * const storeMode)
+void Scrobbler<ScrobbleQueue>::scrobble(const Iterator begin, const Iterator end, const bool safeScrobbling,
+		const bool syncScrobbling)
 {
-	static_assert(std::is_convertible<decltype(*begin), const ScrobbleInfo &>::value,
-			"An iterator over ScrobbleInfo objects is expected.");
-	assert(storeMode != nullptr);
+	if (begin == end || !m_accepting.load(std::memory_order_acquire)) {
+		// This Scrobbler is not started or is already stopped or is disabled.
+		return;
+	}
 
-	std::FILE *dataFile; // initialised by openDataFile();
-	if (openDataFile(dataFilePath.c_str(), dataFilePath.size(), storeMode, true, dataFile) != O_OPENED) {
-		return false;
+	IntakeBatch batch;
+	batch.scrobbles.reserve(std::distance(begin, end));
+	for (Iterator it = begin; it != end; ++it) {
+		batch.scrobbles.emplace_back(std::move(*it));
 	}
+	batch.safe = safeScrobbling;
+	batch.sync = safeScrobbling && syncScrobbling;
+	const bool wasEmpty = m_intake.push(std::move(batch));
 
-	assert(dataFile != nullptr);
+	if (safeScrobbling) {
+		// The scrobbles are stored before this function returns unless the journal is not attached yet.
+		std::lock_guard<std::mutex> lock(m_mutex);
+		storeSafeIntake();
+	} else if (wasEmpty) {
+		// Otherwise this Scrobbler is woken up already and has not consumed the intake queue yet.
+		wake();
+	}
+}
 
-	bool result = true;
+/* Moves the scrobbles of the intake queue to the list of pending scrobbles in the order they are
+ * pushed, storing them as requested. Nothing is done until the pending scrobbles are loaded since
+ * the scrobbles accepted must follow them.
+ */
+template<typename ScrobbleQueue>
+void Scrobbler<ScrobbleQueue>::drainIntake()
+{
+	assertLocked();
 
-	afc::FastStringBuffer<char> buf;
-	for (auto it = begin; it != end; ++it) {
-		buf.clear();
-		appendAsJson(*it, buf);
-		const std::size_t bufSize = buf.size();
-		if (std::fwrite(buf.c_str(), sizeof(unsigned char), bufSize, dataFile) != bufSize) {
-			result = false;
-			goto finish;
-		}
-		/* ScrobbleInfo in the JSON form does not contain the character 'line feed' ('\n')
-		 * so that using the latter as a separator is safe.
-		 *
-		 * The file must end with the empty line.
-		 */
-		if (std::fwrite(u8"\n", sizeof(unsigned char), 1, dataFile) != 1) {
-			result = false;
-			goto finish;
-		}
-	}
-finish:
-	/* An assumption works that this code is compiled with exceptions disabled.
-	 * If this is not the case then unique_ptr<FILE> with a custom deleter must
-	 * be used to avoid resource leaks.
-	 */
-	if (std::fclose(dataFile) != 0) {
-		result = false;
+	if (!m_started || m_loadState != L_LOADED || m_intake.empty()) {
+		return;
 	}
 
-	return result;
+	const std::unique_lock<std::mutex> journalLock = m_journal->lock();
+	m_journal->poll();
+	m_intake.consume([this](IntakeBatch &batch)
+	{
+		m_scrobbleCount += batch.scrobbles.size();
+		acceptScrobbles(batch.scrobbles.begin(), batch.scrobbles.end(), batch.safe, batch.sync);
+	});
+	m_safeIntake = false;
 }
 
+/* Stores the failure-safe scrobbles that scrobble() has just pushed to the intake queue. Once the pending
+ * scrobbles are loaded they are accepted as usual. Until then the scrobbles of the intake queue are spilled
+ * after the pending ones once the journal is attached, so that the failure-safe ones are not kept in memory
+ * only for the duration of the load. If the load has failed then it is retried at once since the journal
+ * cannot be attached otherwise.
+ *
+ * It is executed within lock on m_mutex.
+ */
 template<typename ScrobbleQueue>
-void Scrobbler<ScrobbleQueue>::scrobble(ScrobbleInfo &&scrobbleInfo, const bool safeScrobbling)
-{ std::lock_guard<std::mutex> lock(m_mutex);
+void Scrobbler<ScrobbleQueue>::storeSafeIntake()
+{
 	using afc::operator"" _s;
 
-	if (!m_started) {
-		// This Scrobbler is not started or is already stopped or is disabled.
+	assertLocked();
+
+	if (!m_started || m_loadState == L_LOADED) {
+		drainIntake();
 		return;
 	}
 
-	m_pendingScrobbles.emplace_back(std::move(scrobbleInfo));
-
-	m_cv.notify_one();
-
-	if (safeScrobbling) {
-		/* Storing the scrobble that has just been added to the list.
-		 * The data file is appended, not re-written.
-		 */
-		auto end = m_pendingScrobbles.cend();
-		if (storeScrobbles(std::prev(end), end, getDataFilePath(), "ab")) {
-			afc::logger::logDebug("[Scrobbler] The scrobble that has just been scrobbled "
-					"is stored (failure-safe scrobbling)."_s);
-		} else {
-			afc::logger::logError("[Scrobbler] Unable to store the scrobble (failure-safe scrobbling)."_s);
-		}
+	m_safeIntake = true;
+	if (m_loadState == L_FAILED) {
+		m_retryTime = std::chrono::steady_clock::time_point();
+		wake();
+	} else if (m_loadState == L_ATTACHED) {
+		const std::unique_lock<std::mutex> journalLock = m_journal->lock();
+		m_scrobbleCount += appendIntake();
+		afc::logger::logDebug("[Scrobbler] The scrobbles that have just been scrobbled "
+				"are submitted to be stored (spilled while loading)."_s);
 	}
+	// Otherwise the loader spills them once it attaches the journal.
 }
 
 template<typename ScrobbleQueue>
-void Scrobbler<ScrobbleQueue>::backgroundScrobbling()
-{ std::unique_lock<std::mutex> lock(m_mutex);
+template<typename Iterator>
+void Scrobbler<ScrobbleQueue>::acceptScrobbles(const Iterator begin, const Iterator end, const bool safeScrobbling,
+		const bool syncScrobbling)
+{
 	using afc::operator"" _s;
 
-	afc::logger::logDebug("[Scrobbler] The background scrobbling thread has started."_s);
+	assertLocked();
+
+	/* The scrobbles are added to the list of pending scrobbles until the limit is reached.
+	 * Once there are spilled scrobbles all new scrobbles are spilled as well so that
+	 * the order of pending scrobbles is kept.
+	 */
+	Iterator spillBegin = begin;
+	if (!m_journal->hasSpill(m_journalConsumer)) {
+		for (; spillBegin != end && m_pendingScrobbles.size() < m_residentScrobbleLimit; ++spillBegin) {
+			m_pendingScrobbles.emplace_back(std::move(*spillBegin));
+		}
+	}
+
+	wake();
 
-	bool lastAttemptFailed = false;
-	std::size_t prevScrobbleCount = m_pendingScrobbles.size();
-	std::size_t idleScrobbleCount = 0;
+	if (spillBegin != end) {
+		// The pending scrobbles in memory precede the spilled ones in the journal.
+		appendScrobbles(unstoredCount(), false);
+		m_journal->append(m_journalConsumer, spillBegin, end, safeScrobbling && syncScrobbling, true);
 
-	while (!m_finishScrobblingFlag.load(std::memory_order_relaxed)) {
-		/* An attempt to submit is performed iff this Scrobbler is configured properly AND:
-		 * - the last scrobbling call did not fail and the list of pending scrobbles is not empty
-		 *     (useful when there is already a long list of pending scrobbles)
-		 * OR
-		 * - the number of scrobbles has changed
+		afc::logger::logDebug("[Scrobbler] The scrobbles that have just been scrobbled "
+				"are submitted to be stored (spilled)."_s);
+	} else if (safeScrobbling) {
+		/* Storing the scrobbles that have just been added to the list. The preceding scrobbles
+		 * that are not stored yet are stored as well so that the journal keeps the order
+		 * of pending scrobbles. The data file is appended, not re-written. The records are
+		 * written by the journal writer so that this thread does not wait for file I/O.
 		 */
-		while (!(m_configured &&
-				(m_pendingScrobbles.size() != prevScrobbleCount ||
-						(!lastAttemptFailed && !m_pendingScrobbles.empty())))) {
-			preSleep();
+		appendScrobbles(unstoredCount(), syncScrobbling);
+
+		afc::logger::logDebug("[Scrobbler] The scrobbles that have just been scrobbled "
+				"are submitted to be stored (failure-safe scrobbling)."_s);
+	}
+}
 
-			m_cv.wait(lock);
+template<typename ScrobbleQueue>
+void Scrobbler<ScrobbleQueue>::run()
+{ std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_finishScrobblingFlag.load(std::memory_order_relaxed)) {
+		// This Scrobbler is being stopped.
+		return;
+	}
 
-			if (m_finishScrobblingFlag.load(std::memory_order_relaxed)) {
-				// Finishing the background scrobbling thread since this Scrobbler is stopped.
-				return;
-			}
+	if (m_loadState == L_FAILED) {
+		if (std::chrono::steady_clock::now() < m_retryTime) {
+			// Woken up by new scrobbles. They are kept in the intake queue until the load succeeds.
+			setDeadline(m_retryTime);
+			return;
+		}
+		m_loadState = L_LOADING;
+		requestLoaderJob(LJ_LOAD);
+	}
+	// While the pending scrobbles are being loaded this Scrobbler is woken up by the loader once they are.
+	if (m_loadState != L_LOADED) {
+		return;
+	}
+	if (m_submitting) {
+		/* This Scrobbler is woken up once the attempt in progress is finished. The work that does not
+		 * wait for it (e.g. the now-playing notification) is started meanwhile.
+		 */
+		postSleep();
+		return;
+	}
+
+	if (m_networkMonitorOutdated) {
+		m_networkMonitorOutdated = false;
+		updateNetworkMonitor();
+	}
 
-			postSleep();
+	postSleep();
+	drainIntake();
+	/* The leading spilled scrobbles are loaded by the loader if the pending scrobbles in memory are
+	 * not enough for the next two rounds of requests. The ones in memory are submitted meanwhile.
+	 */
+	if (m_pendingScrobbles.size() < 2 * m_maxBatchesInFlight * m_maxScrobblesPerRequest) {
+		const std::unique_lock<std::mutex> journalLock = m_journal->lock();
+		if (m_journal->hasSpill(m_journalConsumer)) {
+			requestLoaderJob(LJ_SPILL);
 		}
+	}
 
-		if (lastAttemptFailed) {
-			// It is possible that idling mode is to be enabled in this iteration.
+	/* An attempt to submit is performed iff this Scrobbler is configured properly AND:
+	 * - new scrobbles have been scrobbled
+	 * OR
+	 * - the list of pending scrobbles is not empty, and either the last scrobbling call did
+	 *     not fail (useful when there is already a long list of pending scrobbles) or the retry
+	 *     delay after the failed call has expired
+	 */
+	if (m_configured && (m_scrobbleCount != m_prevScrobbleCount ||
+			(!m_pendingScrobbles.empty() &&
+					(!m_lastAttemptFailed || std::chrono::steady_clock::now() >= m_retryTime)))) {
+		m_submitting = true;
+		m_prevScrobbleCount = m_scrobbleCount;
+		startScrobbling();
+		return;
+	}
 
-			// Updating the number of tracks scrobbled while idling.
-			const std::size_t size = m_pendingScrobbles.size();
-			idleScrobbleCount += size - prevScrobbleCount;
+	// New scrobbles, network changes and stop() wake this Scrobbler up before the retry time if there is one.
+	if (m_lastAttemptFailed && m_configured && !m_pendingScrobbles.empty()) {
+		setDeadline(m_retryTime);
+	}
+	preSleep();
+}
 
-			/* The scrobble count must be updated even when idling because in this case
-			 * the next iteration must see the correct number of pending scrobbles to decide
-			 * whether to wait for another scrobble or not.
-			 */
-			prevScrobbleCount = size;
+template<typename ScrobbleQueue>
+void Scrobbler<ScrobbleQueue>::attemptFinished(const std::size_t completedCount)
+{
+	assertLocked();
+	assert(m_submitting);
 
-			if (idleScrobbleCount < m_scrobblesToWait) {
-				// Idling due to failed previous attempt to scrobble tracks.
-				afc::logger::logDebug("Idling is to last for "_s, m_scrobblesToWait,
-						" tracks scrobbled. Scrobbles passed: "_s, idleScrobbleCount);
+	m_submitting = false;
+	m_lastAttemptFailed = completedCount == 0;
 
-				/* Idling is forced due to some last scrobble requests failed.
-				 * No scrobble request is submitted.
-				 */
-				continue;
-			}
-		}
+	if (m_lastAttemptFailed) {
+		scheduleRetry();
+	} else {
+		// If the attempt is (partially) successful then the retry delay is reset.
+		m_retryDelay = m_minRetryDelay;
 
-		// Idling has finished so resetting the counter of tracks scrobbled while idling.
-		idleScrobbleCount = 0;
+		checkpointJournal();
+	}
 
-		// Scrobbling tracks.
-		const std::size_t scrobbledCount = doScrobbling();
-		lastAttemptFailed = scrobbledCount == 0;
+	// The next attempt is started or scheduled by run().
+	wake();
+}
 
-		if (lastAttemptFailed) {
-			/* If this attempt has failed then increasing the timeout by two times
-			 * up to max allowed limit.
-			 */
-			m_scrobblesToWait = std::min(m_scrobblesToWait * 2, maxScrobblesToWait());
+template<typename ScrobbleQueue>
+void Scrobbler<ScrobbleQueue>::updateNetworkMonitor()
+{
+	using afc::operator"" _s;
 
-			afc::logger::logDebug("Idling is to last now for "_s, m_scrobblesToWait, " tracks scrobbled."_s);
-		} else {
-			// If the attempt is (partially) successful then the timeout is reset.
-			m_scrobblesToWait = minScrobblesToWait();
+	assertLocked();
+
+	if (!m_monitorNetwork) {
+		if (m_networkMonitor.opened()) {
+			m_reactor->unwatch(m_networkWatch);
+			m_networkMonitor.close();
 		}
+		return;
+	}
+	if (m_networkMonitor.opened()) {
+		return;
+	}
+
+	if (!m_networkMonitor.open() || !m_reactor->watch(*this, m_networkMonitor.fd(), m_networkWatch)) {
+		m_networkMonitor.close();
+		afc::logger::logError("[Scrobbler] Network changes are not monitored."_s);
+	}
+}
 
-		prevScrobbleCount = m_pendingScrobbles.size();
+template<typename ScrobbleQueue>
+void Scrobbler<ScrobbleQueue>::networkChanged()
+{
+	using afc::operator"" _s;
+
+	if (!m_networkMonitor.receive()) {
+		return;
 	}
 
-	afc::logger::logDebug("[Scrobbler] The background scrobbling thread is going to be stopped..."_s);
+	// The network is back so the pending scrobbles are likely to be submitted successfully.
+	std::lock_guard<std::mutex> lock(m_mutex);
+	afc::logger::logDebug("[Scrobbler] The network has changed. The retry delay is reset."_s);
+	resetRetryDelay();
+}
+
+template<typename ScrobbleQueue>
+inline void Scrobbler<ScrobbleQueue>::scheduleRetry()
+{
+	using afc::operator"" _s;
+
+	assertLocked();
+
+	// The delay is picked at random from the upper half of the current delay ("equal jitter").
+	const std::chrono::milliseconds::rep delay = m_retryDelay.count();
+	std::uniform_int_distribution<std::chrono::milliseconds::rep> jitter(delay / 2, delay);
+	const std::chrono::milliseconds retryDelay(jitter(m_random));
+	m_retryTime = std::chrono::steady_clock::now() + retryDelay;
+
+	// The delay is doubled after each failed attempt up to the max allowed delay.
+	m_retryDelay = std::min(2 * m_retryDelay, m_maxRetryDelay);
+
+	afc::logger::logDebug("[Scrobbler] Pending scrobbles are to be re-submitted in "_s, retryDelay.count(),
+			" ms unless new scrobbles are scrobbled."_s);
 }
 
 template<typename ScrobbleQueue>
 bool Scrobbler<ScrobbleQueue>::start()
 // m_startStopMutex must be locked first to co-operate with ::stop() properly.
-{ std::lock_guard<std::mutex> startStopLock(m_startStopMutex); std::lock_guard<std::mutex> lock(m_mutex);
+{ std::lock_guard<std::mutex> startStopLock(m_startStopMutex); std::unique_lock<std::mutex> lock(m_mutex);
 	using afc::operator"" _s;
 
 	if (m_started) {
@@ -345,19 +955,54 @@ bool Scrobbler<ScrobbleQueue>::start()
 		return false;
 	}
 
-	if (!loadPendingScrobbles()) {
-		return false;
+	if (m_sharedJournal != nullptr) {
+		m_journal = m_sharedJournal;
+	} else {
+		const afc::String &dataFilePath = getDataFilePath();
+		if (dataFilePath.size() == 0) {
+			return false;
+		}
+		m_privateJournal.reset(new SharedJournal(dataFilePath));
+		m_journal = m_privateJournal.get();
 	}
 
-	m_finishScrobblingFlag.store(false, std::memory_order_relaxed);
+	if (m_sharedReactor != nullptr) {
+		assert(m_sharedReactor->started());
+		m_reactor = m_sharedReactor;
+	} else {
+		m_privateReactor.reset(new Reactor());
+		if (!m_privateReactor->start()) {
+			m_privateReactor.reset();
+			m_journal = nullptr;
+			m_privateJournal.reset();
+			return false;
+		}
+		m_reactor = m_privateReactor.get();
+	}
 
-	afc::logger::logDebug("[Scrobbler] Starting the background scrobbling thread..."_s);
+	// The pending scrobbles are loaded by the loader thread.
+	m_loadState = L_LOADING;
+	m_loaderJob = LJ_LOAD;
+	m_completedCount = 0;
+	// The scrobbles pushed after the previous stop() has drained the intake queue are dropped.
+	m_intake.clear();
+	m_safeIntake = false;
+	m_accepting.store(true, std::memory_order_release);
+	m_finishScrobblingFlag.store(false, std::memory_order_relaxed);
 
-	m_scrobblingThread = std::thread([this]() { this->backgroundScrobbling(); });
+	m_submitting = false;
+	m_lastAttemptFailed = false;
+	m_retryDelay = m_minRetryDelay;
+	m_retryTime = std::chrono::steady_clock::time_point();
+	m_random.seed(static_cast<std::minstd_rand::result_type>(
+			std::chrono::steady_clock::now().time_since_epoch().count()));
+	m_networkMonitorOutdated = true;
 
-	m_scrobblesToWait = minScrobblesToWait();
+	afc::logger::logDebug("[Scrobbler] Starting the background scrobbling..."_s);
 
 	m_started = true;
+	m_loader = std::thread(&Scrobbler::runLoader, this);
+	m_reactor->attach(*this);
 	return true;
 }
 
@@ -367,41 +1012,71 @@ bool Scrobbler<ScrobbleQueue>::stop()
 { std::lock_guard<std::mutex> startStopLock(m_startStopMutex);
 	using afc::operator"" _s;
 
-	std::thread threadToStop;
-
+	std::chrono::steady_clock::time_point deadline;
 	{ std::lock_guard<std::mutex> lock(m_mutex);
 		if (!m_started) {
 			// This Scrobbler is not started or is already stopped.
 			return true;
 		}
 
-		/* The scrobbling thread is disassociated with this Scrobbler so that
-		 * after this critical section is exited this Scrobbler could be used safely.
-		 */
-		threadToStop.swap(m_scrobblingThread);
-
+		m_accepting.store(false, std::memory_order_release);
 		m_finishScrobblingFlag.store(true, std::memory_order_relaxed);
+		deadline = std::chrono::steady_clock::now() + m_stopTimeout;
 
-		afc::logger::logDebug("[Scrobbler] The scrobbling thread is being stopped..."_s);
-
-		// Waking up the scrobbing thread to let it finish quickly.
-		m_cv.notify_one();
+		afc::logger::logDebug("[Scrobbler] The background scrobbling is being stopped..."_s);
 	}
 
-	/* Waiting for the old scrobbling thread to finish. This is used to ensure that
-	 * there are no scrobbles that are being submitted so that the list of pending
-	 * scrobbles could be serialised safely.
+	/* Waiting for the reactor to detach this Scrobbler, aborting the HTTP calls in progress.
+	 * This is used to ensure that there are no scrobbles that are being submitted so that
+	 * the list of pending scrobbles could be serialised safely. m_mutex is not held since
+	 * the calls aborted acquire it. m_reactor is modified only while m_startStopMutex is locked.
 	 */
-	threadToStop.join();
-	afc::logger::logDebug("[Scrobbler] The scrobbling thread is stopped."_s);
-
-	{ std::lock_guard<std::mutex> lock(m_mutex);
-		/* Invocation of stopExtra() must go after thread join and
-		 * before storing the pending scrobbles as per documentation.
+	if (!m_reactor->detach(*this, deadline)) {
+		/* The reactor is busy (e.g. with a task of another Scrobbler). The scrobbles accepted are stored
+		 * meanwhile so that they are kept even if the process is terminated before the reactor is free.
+		 */
+		afc::logger::logDebug("[Scrobbler] The reactor is late to detach this Scrobbler. "
+				"The scrobbles accepted are stored meanwhile."_s);
+		storeAccepted();
+		m_reactor->detach(*this);
+	}
+	if (m_privateReactor != nullptr) {
+		m_privateReactor->stop();
+	}
+	afc::logger::logDebug("[Scrobbler] The background scrobbling is stopped."_s);
+
+	{ std::unique_lock<std::mutex> lock(m_mutex);
+		// The watch of the monitor is removed by the reactor already.
+		m_networkMonitor.close();
+
+		// The loader finishes the job in progress so that the pending scrobbles are not changed by it any longer.
+		stopLoader(lock);
+
+		const bool late = std::chrono::steady_clock::now() >= deadline;
+		if (late) {
+			afc::logger::logDebug("[Scrobbler] Stopping is late. The data file is not compacted."_s);
+		}
+
+		/* The pending scrobbles that the loader has not loaded (or has failed to) are not loaded here
+		 * since they are to be stored back as they are. Only the scrobbles accepted are stored after them.
+		 */
+		if (m_loadState != L_LOADED && !m_intake.empty() && !spillIntake(lock, late)) {
+			afc::logger::logError("[Scrobbler] Unable to store the scrobbles accepted since start. "
+					"These scrobbles are lost."_s);
+		}
+
+		/* Invocation of stopExtra() must go after the detachment and
+		 * before storing the pending scrobbles as per documentation.
 		 */
 		stopExtra();
 
-		if (!storePendingScrobbles()) {
+		// The scrobbles that are still in the intake queue are stored along with the other pending ones.
+		drainIntake();
+		m_intake.clear();
+		m_safeIntake = false;
+
+		// If the load has failed then the journal is not attached and the data file is left untouched.
+		if (m_loadState == L_LOADED && !syncJournal(late)) {
 			afc::logger::logError("[Scrobbler] Unable to store pending scrobbles. These scrobbles are lost."_s);
 		}
 
@@ -411,6 +1086,10 @@ bool Scrobbler<ScrobbleQueue>::stop()
 		 * invocation after stop() returns.
 		 */
 		m_pendingScrobbles.clear();
+		m_journal = nullptr;
+		m_privateJournal.reset();
+		m_reactor = nullptr;
+		m_privateReactor.reset();
 
 		/* Clearing configuration so that this Scrobbler is to be re-configured
 		 * if it is re-used later.
@@ -418,157 +1097,850 @@ bool Scrobbler<ScrobbleQueue>::stop()
 		m_configured = false;
 
 		m_started = false;
+		m_loadCv.notify_all();
 	}
 
 	return true;
 }
 
 template<typename ScrobbleQueue>
-// The last path element is considered as a file and therefore is not created.
-inline bool Scrobbler<ScrobbleQueue>::createParentDirs(const char * const path, const std::size_t pathSize)
+void Scrobbler<ScrobbleQueue>::requestLoaderJob(const LoaderJob job)
 {
-	if (pathSize == 0) {
-		return true;
-	}
+	assertLocked();
 
-	const char *start = path;
-	afc::FastStringBuffer<char> pathElementBuf(pathSize);
-	if (*path == '/') {
-		++start;
-		pathElementBuf.append('/');
+	if (m_loaderJob == LJ_NONE) {
+		m_loaderJob = job;
+		m_loaderCv.notify_one();
 	}
+}
+
+/* Performs the jobs requested until this Scrobbler is stopped. The jobs are performed within lock
+ * on m_mutex which they release while they read files.
+ */
+template<typename ScrobbleQueue>
+void Scrobbler<ScrobbleQueue>::runLoader()
+{ std::unique_lock<std::mutex> lock(m_mutex);
+	using afc::operator"" _s;
 
 	for (;;) {
-		const char * const end = std::strchr(start, '/');
-		if (end == nullptr) {
-			return true;
+		m_loaderCv.wait(lock, [this]() { return m_loaderStopFlag || m_loaderJob != LJ_NONE; });
+		if (m_loaderStopFlag) {
+			return;
 		}
-		pathElementBuf.append(start, end);
-		if (mkdir(pathElementBuf.c_str(), 0775) != 0 && errno != EEXIST) {
-			return false;
+
+		if (m_loaderJob == LJ_LOAD) {
+			afc::logger::logDebug("[Scrobbler] The background scrobbling has started."_s);
+
+			if (finishLoad(loadPendingScrobbles(lock))) {
+				m_prevScrobbleCount = m_scrobbleCount;
+			} else {
+				// The scrobbles accepted meanwhile are kept in the intake queue until the load succeeds.
+				scheduleRetry();
+			}
+		} else {
+			loadSpilledScrobbles(lock);
 		}
-		start = end + 1;
-		pathElementBuf.append('/');
+		m_loaderJob = LJ_NONE;
+
+		// The next attempt (or the retry of the load) is started or scheduled by run().
+		wake();
 	}
 }
 
 template<typename ScrobbleQueue>
-inline typename Scrobbler<ScrobbleQueue>::OpenResult
-Scrobbler<ScrobbleQueue>::openDataFile(const char *path, std::size_t pathSize, const char * const mode,
-		const bool storeMode, std::FILE *&dest)
+void Scrobbler<ScrobbleQueue>::stopLoader(std::unique_lock<std::mutex> &lock)
 {
-	if (pathSize == 0) {
-		return O_ERROR;
-	}
+	assertLocked();
+
+	m_loaderStopFlag = true;
+	m_loaderCv.notify_one();
+	lock.unlock();
+	m_loader.join();
+	lock.lock();
+	m_loaderStopFlag = false;
+	m_loaderJob = LJ_NONE;
+}
+
+template<typename ScrobbleQueue>
+inline bool Scrobbler<ScrobbleQueue>::loadPendingScrobbles(std::unique_lock<std::mutex> &lock)
+{
+	using afc::operator"" _s;
+
+	assertLocked();
+
+	afc::logger::logDebug("[Scrobbler] Loading pending scrobbles..."_s);
 
-	/* - if the file or some parent directories do not exist then create missing parts if
-	 *   the store mode is enabled.
-	 * - if the file exists but it is not a regular file or a symbolic link then return failure
-	 *   because such a file cannot be used to load/store pending scrobbles
-	 * - if the file exists and it a regular file or a symbolic link then proceed with
-	 *   loading/storing pending scrobbles from/into it
+	/* The data file is read while m_mutex is released so that scrobble() is not blocked
+	 * for the duration of the load; new scrobbles are queued in m_intake meanwhile.
 	 */
-	struct stat fileStatus;
-	if (stat(path, &fileStatus) != 0) {
-		if (errno == ENOTDIR || errno == ENOENT) {
-			if (!storeMode) {
-				return O_NOTEXIST;
+	const afc::String dataFilePath = getDataFilePath();
+	lock.unlock();
+	const bool attached = attachJournal(dataFilePath);
+	lock.lock();
+	if (!attached) {
+		return false;
+	}
+
+	m_loadState = L_ATTACHED;
+	if (m_safeIntake) {
+		// The failure-safe scrobbles accepted so far are stored after the pending ones.
+		const std::unique_lock<std::mutex> journalLock = m_journal->lock();
+		m_scrobbleCount += appendIntake();
+	}
+	loadSpilledScrobbles(lock);
+
+	afc::logger::logDebug("[Scrobbler] Pending scrobbles loaded: "_s, m_pendingScrobbles.size());
+	return true;
+}
+
+/* Attaches this Scrobbler to the journal. The pending scrobbles of a data file of an older version
+ * are moved to the journal. If the journal is owned by this Scrobbler then the data file is
+ * the journal itself so only the data file that is not a journal is converted.
+ *
+ * It is executed by the loader thread (or by stop()) while m_mutex is not locked, so it uses only
+ * the fields that are not modified while this Scrobbler is started.
+ */
+template<typename ScrobbleQueue>
+bool Scrobbler<ScrobbleQueue>::attachJournal(const afc::String &dataFilePath)
+{
+	using afc::operator"" _s;
+
+	const bool shared = m_sharedJournal != nullptr;
+	ScrobbleQueue scrobbles;
+	LoadResult loadResult;
+	bool legacyFound = false;
+	if (dataFilePath.size() != 0 && !loadLegacyScrobbles(dataFilePath, shared, scrobbles, loadResult, legacyFound)) {
+		return false;
+	}
+
+	{ const std::unique_lock<std::mutex> journalLock = m_journal->lock();
+		if (!m_journal->attach(m_journalConsumer)) {
+			return false;
+		}
+
+		if (loadResult.malformedCount != 0) {
+			afc::logger::logError("[Scrobbler] Malformed records are found in the data file: "_s,
+					loadResult.malformedCount, ". They are moved to the quarantine file."_s);
+			if (!m_journal->storeQuarantine(loadResult.quarantine)) {
+				afc::logger::logError("[Scrobbler] Unable to write the quarantine file. "
+						"The malformed records are lost."_s);
 			}
-			if (!createParentDirs(path, pathSize)) {
-				return O_ERROR;
+		}
+
+		if (legacyFound) {
+			// The scrobbles converted are spilled; the leading ones are loaded back as the others.
+			afc::logger::logDebug("[Scrobbler] Converting the data file..."_s);
+			m_journal->append(m_journalConsumer, scrobbles.cbegin(), scrobbles.cend(), true, true);
+			if (!m_journal->sync()) {
+				afc::logger::logError("[Scrobbler] Unable to store the pending scrobbles of the data file."_s);
+				m_journal->detach(m_journalConsumer);
+				return false;
 			}
-		} else {
-			return O_ERROR;
 		}
-	} else if (!(S_ISREG(fileStatus.st_mode) || S_ISLNK(fileStatus.st_mode))) {
-		return O_ERROR;
 	}
 
-	// If we are here then the file either exists or the store mode is enabled.
-	dest = fopen(path, mode);
-	// If the file is not opened here then reporting an error for both cases.
-	return dest != nullptr ? O_OPENED : O_ERROR;
+	if (legacyFound && shared) {
+		// The data file is superseded by the shared journal.
+		const afc::FastStringBuffer<char, afc::AllocMode::accurate> cursorPath =
+				siblingPath(dataFilePath.data(), dataFilePath.size(), ".cursor"_s);
+		if (std::remove(dataFilePath.c_str()) != 0) {
+			afc::logger::logError("[Scrobbler] Unable to remove the data file that is converted."_s);
+		}
+		std::remove(cursorPath.c_str());
+	}
+	return true;
 }
 
+/* Adds the scrobbles accepted during the load after the loaded ones, and notifies waitForLoad().
+ * If the load has failed then the scrobbles accepted are kept in the intake queue so that they
+ * follow the loaded ones once the load is retried successfully.
+ *
+ * @return loaded.
+ */
 template<typename ScrobbleQueue>
-inline bool Scrobbler<ScrobbleQueue>::loadPendingScrobbles()
+bool Scrobbler<ScrobbleQueue>::finishLoad(const bool loaded)
 {
 	using afc::operator"" _s;
 
 	assertLocked();
 
-	afc::logger::logDebug("[Scrobbler] Loading pending scrobbles..."_s);
+	if (loaded) {
+		m_loadState = L_LOADED;
+		m_retryDelay = m_minRetryDelay;
+		drainIntake();
+	} else {
+		afc::logger::logError("[Scrobbler] Unable to load pending scrobbles. The load is retried later."_s);
+		m_loadState = L_FAILED;
+		m_pendingScrobbles.clear();
+	}
+	m_loadCv.notify_all();
+	return loaded;
+}
 
-	std::FILE *dataFile; // initialised by openDataFile();
-	const afc::String &dataFilePath = getDataFilePath();
-	const OpenResult openResult = openDataFile(dataFilePath.c_str(), dataFilePath.size(), "rb", false, dataFile);
-	if (openResult == O_ERROR) {
+/* Loads all the pending scrobbles of the data file of an older version of this plugin.
+ * The data file is either in the JSON form or a journal of a single Scrobbler; the latter
+ * is converted only if convertJournal is true.
+ *
+ * @param found is set to true if the data file is to be converted.
+ */
+template<typename ScrobbleQueue>
+bool Scrobbler<ScrobbleQueue>::loadLegacyScrobbles(const afc::String &dataFilePath, const bool convertJournal,
+		ScrobbleQueue &dest, LoadResult &result, bool &found)
+{
+	using afc::operator"" _s;
+
+	/* The data file is mapped into memory as a whole so that scrobbles are parsed in place,
+	 * without copying them to an intermediate buffer.
+	 */
+	MappedFile dataFile;
+	const MappedFile::MapResult mapResult = dataFile.map(dataFilePath.c_str());
+	if (mapResult == MappedFile::M_ERROR) {
 		return false;
-	} else if (openResult == O_NOTEXIST) {
+	}
+	const char * const begin = dataFile.begin();
+	const char * const end = dataFile.end();
+	if (mapResult == MappedFile::M_NOTEXIST || begin == end) {
 		// There are no pending scrobbles.
 		return true;
 	}
 
-	assert(openResult == O_OPENED);
-	assert(dataFile != nullptr);
+	if (!hasJournalMagic(begin, end)) {
+		// The data file written by an older version of this plugin.
+		parseScrobbles(begin, end, false, StringDictionary(), 0, m_maxParseThreads, dest, result);
+		found = true;
+		return true;
+	}
+
+	if (!convertJournal) {
+		return true;
+	}
+
+	std::uint64_t fileId;
+	if (!readJournalHeader(begin, end, fileId)) {
+		/* The data file is either damaged or written by a newer version of this plugin.
+		 * In both cases it is left untouched.
+		 */
+		afc::logger::logError("[Scrobbler] The data file has an invalid or unsupported header."_s);
+		return false;
+	}
+
+	// The records before the cursor are acknowledged already so they are skipped.
+	const unsigned consumers = 1u << m_journalConsumer;
+	const char *recordsBegin = begin + journalHeaderSize;
+	std::uint64_t cursorFileId;
+	JournalCursors cursors;
+	if (loadCursor(dataFilePath, cursorFileId, cursors) && cursorFileId == fileId &&
+			cursors[m_journalConsumer] >= journalHeaderSize && cursors[m_journalConsumer] <= dataFile.size()) {
+		recordsBegin = begin + cursors[m_journalConsumer];
+	}
+
+	// All the string records are read before the scrobbles are parsed.
+	StringDictionary dictionary;
+	for (const char *p = begin + journalHeaderSize; p != end;) {
+		const char * const next = skipJournalRecord(p, end);
+		if (next == nullptr) {
+			// The truncated record is handled by parseJournalRecords().
+			break;
+		}
+		if (peekJournalRecordType(p) == JournalRecordType::string) {
+			defineJournalString(p, next, dictionary);
+		}
+		p = next;
+	}
+
+	parseScrobbles(recordsBegin, end, true, dictionary, consumers, m_maxParseThreads, dest, result);
+	found = true;
+	return true;
+}
+
+template<typename ScrobbleQueue>
+inline void Scrobbler<ScrobbleQueue>::LoadResult::reject(const char * const begin, const char * const end,
+		const bool lineFeed)
+{
+	const std::size_t size = end - begin;
+	quarantine.reserve(quarantine.size() + size + 1);
+	quarantine.append(begin, size);
+	if (lineFeed) {
+		quarantine.append(u8"\n"[0]);
+	}
+	++malformedCount;
+}
+
+template<typename ScrobbleQueue>
+inline void Scrobbler<ScrobbleQueue>::LoadResult::merge(const LoadResult &other)
+{
+	quarantine.reserve(quarantine.size() + other.quarantine.size());
+	quarantine.append(other.quarantine.data(), other.quarantine.size());
+	malformedCount += other.malformedCount;
+}
+
+template<typename ScrobbleQueue>
+inline void Scrobbler<ScrobbleQueue>::parseScrobbles(const char * const begin, const char * const end,
+		const bool journal, const StringDictionary &dictionary, const unsigned consumers, const unsigned maxThreads,
+		ScrobbleQueue &dest, LoadResult &result)
+{
+	using afc::operator"" _s;
+
+	/* A large backlog is split into chunks at record boundaries which are parsed in parallel.
+	 * Small data files are parsed by the calling thread since starting threads is not free.
+	 */
+	constexpr std::size_t minChunkSize = 1024 * 1024;
+
+	const std::size_t size = end - begin;
+	const std::size_t chunkCount = std::min<std::size_t>(size / minChunkSize, maxThreads);
+	if (chunkCount <= 1) {
+		parseChunk(begin, end, journal, dictionary, consumers, dest, result);
+		return;
+	}
 
-	bool result = true;
-	afc::FastStringBuffer<char> buf;
+	// A part of the data file that is parsed independently of the others.
+	struct Chunk
+	{
+		const char *begin;
+		const char *end;
+		ScrobbleQueue scrobbles;
+		LoadResult result;
+	};
+
+	std::vector<Chunk> chunks(chunkCount);
+	const std::size_t chunkSize = size / chunkCount;
+	const char *chunkBegin = begin;
+	for (std::size_t i = 0; i < chunkCount; ++i) {
+		Chunk &chunk = chunks[i];
+		chunk.begin = chunkBegin;
+		chunk.end = i == chunkCount - 1 ? end : findChunkEnd(chunkBegin, end, chunkSize, journal);
+		chunkBegin = chunk.end;
+	}
+
+	afc::logger::logDebug("[Scrobbler] Parsing the data file in parallel..."_s);
+
+	// The first chunk is parsed by the calling thread. The dictionary is not modified while parsing.
+	std::vector<std::thread> workers;
+	workers.reserve(chunkCount - 1);
+	for (std::size_t i = 1; i < chunkCount; ++i) {
+		Chunk &chunk = chunks[i];
+		if (chunk.begin != chunk.end) {
+			workers.emplace_back([&chunk, journal, &dictionary, consumers]()
+			{
+				parseChunk(chunk.begin, chunk.end, journal, dictionary, consumers, chunk.scrobbles, chunk.result);
+			});
+		}
+	}
+	parseChunk(chunks[0].begin, chunks[0].end, journal, dictionary, consumers, chunks[0].scrobbles,
+			chunks[0].result);
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+
+	// Scrobbles are added to the queue in the order they are stored in the data file.
+	for (Chunk &chunk : chunks) {
+		appendAll(dest, chunk.scrobbles);
+		result.merge(chunk.result);
+	}
+}
+
+template<typename ScrobbleQueue>
+inline void Scrobbler<ScrobbleQueue>::parseChunk(const char * const begin, const char * const end,
+		const bool journal, const StringDictionary &dictionary, const unsigned consumers, ScrobbleQueue &dest,
+		LoadResult &result)
+{
+	if (journal) {
+		parseJournalRecords(begin, end, dictionary, consumers, dest, result);
+	} else {
+		parseLegacyScrobbles(begin, end, dest, result);
+	}
+}
+
+template<typename ScrobbleQueue>
+inline const char *Scrobbler<ScrobbleQueue>::findChunkEnd(const char * const begin, const char * const end,
+		const std::size_t chunkSize, const bool journal)
+{
+	if (std::size_t(end - begin) <= chunkSize) {
+		return end;
+	}
+
+	if (journal) {
+		/* Records are skipped by their size only. A truncated record is left to the chunk
+		 * so that it is handled by parseJournalRecords().
+		 */
+		const char *p = begin;
+		while (std::size_t(p - begin) < chunkSize) {
+			const char * const next = skipJournalRecord(p, end);
+			if (next == nullptr) {
+				return end;
+			}
+			p = next;
+		}
+		return p;
+	} else {
+		const void * const lineFeed = std::memchr(begin + chunkSize, u8"\n"[0], end - begin - chunkSize);
+		return lineFeed != nullptr ? static_cast<const char *>(lineFeed) + 1 : end;
+	}
+}
+
+template<typename ScrobbleQueue>
+template<typename Queue>
+inline void Scrobbler<ScrobbleQueue>::appendAll(Queue &dest, Queue &src)
+{
+	if (dest.empty()) {
+		dest.swap(src);
+	} else {
+		dest.insert(dest.end(), std::make_move_iterator(src.begin()), std::make_move_iterator(src.end()));
+		src.clear();
+	}
+}
+
+template<typename ScrobbleQueue>
+inline void Scrobbler<ScrobbleQueue>::parseJournalRecords(const char * const begin, const char * const end,
+		const StringDictionary &dictionary, const unsigned consumers, ScrobbleQueue &dest, LoadResult &result)
+{
+	const char *p = begin;
 	for (;;) {
-		const int c = std::fgetc(dataFile);
-		if (c == EOF) {
+		const char * const recordBegin = p;
+		JournalRecordType type;
+		const char *payloadBegin, *payloadEnd;
+
+		switch (readJournalRecord(p, end, type, payloadBegin, payloadEnd)) {
+		case JournalReadResult::ok:
+			if ((journalRecordConsumers(type, payloadBegin, payloadEnd) & consumers) == 0) {
+				/* String records are read before scrobble records are parsed. The cursors records
+				 * and the records of other consumers are skipped.
+				 */
+				break;
+			}
+
+			/* Instantiating the destination scrobble within the queue to minimise copying/moving.
+			 * If parsing fails then it is ejected. It is assumed that exceptions are disabled.
+			 */
+			dest.emplace_back();
+			if (!parseJournalScrobble(type, payloadBegin, payloadEnd, dictionary, dest.back())) {
+				dest.pop_back();
+				result.reject(recordBegin, p, false);
+			}
+			break;
+		case JournalReadResult::corrupted:
+			result.reject(recordBegin, p, false);
 			break;
+		case JournalReadResult::truncated:
+			// The last record was not written completely (e.g. an emergency happened).
+			result.reject(recordBegin, end, false);
+			return;
+		case JournalReadResult::end:
+			return;
 		}
-		if (c == 0x0a) { // c == u8'\n'
+	}
+}
+
+template<typename ScrobbleQueue>
+inline bool Scrobbler<ScrobbleQueue>::parseJournalScrobble(const JournalRecordType type,
+		const char * const payloadBegin, const char * const payloadEnd, const StringDictionary &dictionary,
+		ScrobbleInfo &dest)
+{
+	if (type == JournalRecordType::compactScrobble) {
+		return ScrobbleInfo::parseCompactBinary(payloadBegin, payloadEnd, dictionary, dest);
+	}
+	if (type == JournalRecordType::sharedScrobble) {
+		// The payload starts with the consumer mask.
+		return ScrobbleInfo::parseCompactBinary(payloadBegin + 1, payloadEnd, dictionary, dest);
+	}
+	assert(type == JournalRecordType::scrobble);
+	return ScrobbleInfo::parseBinary(payloadBegin, payloadEnd, dest);
+}
+
+/* Adds the string defined by a given string record to the dictionary. A malformed string record
+ * is ignored here; the scrobbles that refer to the string are rejected when they are parsed.
+ */
+template<typename ScrobbleQueue>
+inline void Scrobbler<ScrobbleQueue>::defineJournalString(const char * const recordBegin,
+		const char * const recordEnd, StringDictionary &dictionary)
+{
+	const char *p = recordBegin;
+	JournalRecordType type;
+	const char *payloadBegin, *payloadEnd;
+	std::uint32_t id;
+	const char *stringBegin, *stringEnd;
+	if (readJournalRecord(p, recordEnd, type, payloadBegin, payloadEnd) == JournalReadResult::ok &&
+			type == JournalRecordType::string &&
+			readJournalString(payloadBegin, payloadEnd, id, stringBegin, stringEnd)) {
+		dictionary.define(id, stringBegin, stringEnd);
+	}
+}
+
+template<typename ScrobbleQueue>
+inline void Scrobbler<ScrobbleQueue>::parseLegacyScrobbles(const char * const begin, const char * const end,
+		ScrobbleQueue &dest, LoadResult &result)
+{
+	/* Each scrobble is stored in the JSON form on a separate line. ScrobbleInfo in the JSON form
+	 * does not contain the character 'line feed' ('\n'). memchr() is used to find line ends
+	 * since it is vectorised by the C library.
+	 */
+	const char *lineBegin = begin;
+	while (lineBegin != end) {
+		const void * const lineFeed = std::memchr(lineBegin, u8"\n"[0], end - lineBegin);
+		const char * const lineEnd = lineFeed != nullptr ? static_cast<const char *>(lineFeed) : end;
+
+		if (lineBegin != lineEnd) {
 			/* Instantiating the destination scrobble within the queue to minimise copying/moving.
-			 * It parsing fails then it is ejected. It is assumed that exceptions are disabled.
+			 * If parsing fails then it is ejected. It is assumed that exceptions are disabled.
 			 */
-			m_pendingScrobbles.emplace_back();
-			if (ScrobbleInfo::parse(buf.data(), buf.data() + buf.size(), m_pendingScrobbles.back())) {
-				buf.clear();
+			dest.emplace_back();
+			if (!ScrobbleInfo::parse(lineBegin, lineEnd, dest.back())) {
+				dest.pop_back();
+				result.reject(lineBegin, lineEnd, true);
+			}
+		}
+
+		lineBegin = lineEnd == end ? end : lineEnd + 1;
+	}
+}
+
+template<typename ScrobbleQueue>
+inline bool Scrobbler<ScrobbleQueue>::loadCursor(const afc::String &dataFilePath, std::uint64_t &fileId,
+		JournalCursors &offsets)
+{
+	using afc::operator"" _s;
+
+	const afc::FastStringBuffer<char, afc::AllocMode::accurate> path =
+			siblingPath(dataFilePath.data(), dataFilePath.size(), ".cursor"_s);
+
+	std::FILE * const cursorFile = std::fopen(path.c_str(), "rb");
+	if (cursorFile == nullptr) {
+		return false;
+	}
+
+	// An extra octet is requested to reject a cursor file of an unexpected size.
+	char buf[journalCursorSize + 1];
+	const std::size_t size = std::fread(buf, sizeof(char), sizeof(buf), cursorFile);
+	std::fclose(cursorFile);
+
+	return readJournalCursor(buf, buf + size, fileId, offsets);
+}
+
+/* Returns the end of the leading spilled records between begin and end that contain up to
+ * maxCount scrobble records pending for given consumers. Only the framing of the records
+ * is checked. If a truncated record is met then end is returned since the rest of the records are lost.
+ */
+template<typename ScrobbleQueue>
+const char *Scrobbler<ScrobbleQueue>::findSpilledRecordsEnd(const char * const begin, const char * const end,
+		const std::size_t maxCount, const unsigned consumers)
+{
+	const char *p = begin;
+	for (std::size_t count = 0; count < maxCount && p != end;) {
+		const char * const next = skipJournalRecord(p, end);
+		if (next == nullptr) {
+			return end;
+		}
+		if ((peekJournalRecordConsumers(p) & consumers) != 0) {
+			++count;
+		}
+		p = next;
+	}
+	return p;
+}
+
+/* Parses the spilled records between begin and end that are pending for given consumers.
+ * The offset of the end of each scrobble record parsed is added to recordEnds. The malformed
+ * records are moved to the quarantine buffer unless they are quarantined already (e.g. by another
+ * consumer of the journal). The journal must be locked.
+ */
+template<typename ScrobbleQueue>
+void Scrobbler<ScrobbleQueue>::parseSpilledScrobbles(const char * const fileBegin, const char * const begin,
+		const char * const end, SharedJournal &journal, const unsigned consumers, ScrobbleQueue &dest,
+		std::deque<std::uint64_t> &recordEnds, LoadResult &result)
+{
+	const char *p = begin;
+	for (;;) {
+		const char * const recordBegin = p;
+		JournalRecordType type;
+		const char *payloadBegin, *payloadEnd;
+
+		switch (readJournalRecord(p, end, type, payloadBegin, payloadEnd)) {
+		case JournalReadResult::ok:
+			if ((journalRecordConsumers(type, payloadBegin, payloadEnd) & consumers) == 0) {
+				// The strings are defined when the journal is loaded or the records are appended.
+				break;
+			}
+
+			dest.emplace_back();
+			if (parseJournalScrobble(type, payloadBegin, payloadEnd, journal.dictionary(), dest.back())) {
+				recordEnds.push_back(p - fileBegin);
 			} else {
-				m_pendingScrobbles.pop_back();
-				result = false;
-				goto finish;
+				dest.pop_back();
+				if (journal.markQuarantined(recordBegin - fileBegin)) {
+					result.reject(recordBegin, p, false);
+				}
 			}
+			break;
+		case JournalReadResult::corrupted:
+			if (journal.markQuarantined(recordBegin - fileBegin)) {
+				result.reject(recordBegin, p, false);
+			}
+			break;
+		case JournalReadResult::truncated:
+			// The framing of the spilled records is checked when the journal is loaded.
+			if (journal.markQuarantined(recordBegin - fileBegin)) {
+				result.reject(recordBegin, end, false);
+			}
+			return;
+		case JournalReadResult::end:
+			return;
+		}
+	}
+}
+
+template<typename ScrobbleQueue>
+inline void Scrobbler<ScrobbleQueue>::appendScrobbles(const std::size_t count, const bool sync)
+{
+	assertLocked();
+
+	if (count == 0) {
+		return;
+	}
+
+	auto end = m_pendingScrobbles.cend();
+	m_journal->append(m_journalConsumer, std::prev(end, count), end, sync, false);
+}
+
+template<typename ScrobbleQueue>
+inline void Scrobbler<ScrobbleQueue>::acknowledgeScrobbles(const std::size_t count) noexcept
+{
+	// The scrobbles that are not stored to the journal do not move the cursor.
+	m_journal->acknowledge(m_journalConsumer, std::min(count, m_journal->storedCount(m_journalConsumer)));
+}
+
+/* Loads the leading spilled scrobbles if the pending scrobbles in memory are not enough
+ * for the next two rounds of requests. The records to load are found with m_mutex and the journal
+ * released; they are parsed within the locks since the dictionary of the journal is used.
+ * It is executed by the loader thread (or by stop()).
+ */
+template<typename ScrobbleQueue>
+void Scrobbler<ScrobbleQueue>::loadSpilledScrobbles(std::unique_lock<std::mutex> &lock)
+{
+	using afc::operator"" _s;
+
+	assertLocked();
+
+	const std::size_t residentCount = m_pendingScrobbles.size();
+	if (residentCount >= 2 * m_maxBatchesInFlight * m_maxScrobblesPerRequest) {
+		return;
+	}
+
+	const std::size_t maxCount = m_residentScrobbleLimit > residentCount ?
+			m_residentScrobbleLimit - residentCount : 0;
+	const unsigned consumers = 1u << m_journalConsumer;
+	SharedJournal &journal = *m_journal;
+
+	for (;;) {
+		SharedJournal::SpillRange range;
+		{ const std::unique_lock<std::mutex> journalLock = journal.lock();
+			if (!journal.spillRange(m_journalConsumer, range)) {
+				return;
+			}
+		}
+
+		/* New scrobbles are spilled while there are spilled scrobbles so the pending scrobbles
+		 * in memory are only completed by the reactor thread while m_mutex is released. New records
+		 * are appended after the range that is read.
+		 */
+		lock.unlock();
+
+		// The spilled records could still be queued to the journal writer.
+		journal.flush();
+		// Only the pages of the records read are loaded into memory.
+		MappedFile dataFile;
+		const bool mapped = dataFile.map(journal.dataFilePath().c_str()) == MappedFile::M_MAPPED &&
+				dataFile.size() >= range.end;
+		const char * const rangeBegin = mapped ? dataFile.begin() + range.begin : nullptr;
+		const char * const rangeEnd = mapped ?
+				findSpilledRecordsEnd(rangeBegin, dataFile.begin() + range.end, maxCount, consumers) : nullptr;
+
+		lock.lock();
+		std::unique_lock<std::mutex> journalLock = journal.lock();
+
+		if (!journal.isCurrent(range)) {
+			// The data file is re-written by another consumer in the meantime.
+			continue;
+		}
+
+		ScrobbleQueue scrobbles;
+		std::deque<std::uint64_t> recordEnds;
+		LoadResult loadResult;
+		std::uint64_t readEnd = range.end;
+		if (mapped) {
+			parseSpilledScrobbles(dataFile.begin(), rangeBegin, rangeEnd, journal, consumers, scrobbles, recordEnds,
+					loadResult);
+			readEnd = rangeEnd - dataFile.begin();
 		} else {
-			buf.reserveForOne();
-			buf.append(static_cast<char>(c));
+			afc::logger::logError("[Scrobbler] The data file is shorter than expected. "
+					"The spilled scrobbles are lost."_s);
 		}
+		journal.loadSpill(m_journalConsumer, range, readEnd, recordEnds);
+		journalLock.unlock();
+
+		if (loadResult.malformedCount != 0) {
+			afc::logger::logError("[Scrobbler] Malformed spilled records are found in the data file: "_s,
+					loadResult.malformedCount, ". They are moved to the quarantine file."_s);
+			lock.unlock();
+			const bool quarantined = journal.storeQuarantine(loadResult.quarantine);
+			lock.lock();
+			if (!quarantined) {
+				afc::logger::logError("[Scrobbler] Unable to write the quarantine file. "
+						"The malformed records are lost."_s);
+			}
+		}
+
+		afc::logger::logDebug("[Scrobbler] Spilled scrobbles loaded: "_s, scrobbles.size());
+
+		appendAll(m_pendingScrobbles, scrobbles);
+		return;
 	}
-	if (feof(dataFile) == 0) {
-		result = false;
+}
+
+template<typename ScrobbleQueue>
+void Scrobbler<ScrobbleQueue>::completeScrobbles(const typename ScrobbleQueue::iterator end)
+{
+	assertLocked();
+
+	const std::size_t count = std::distance(m_pendingScrobbles.begin(), end);
+	const std::unique_lock<std::mutex> journalLock = m_journal->lock();
+	acknowledgeScrobbles(count);
+	m_pendingScrobbles.erase(m_pendingScrobbles.begin(), end);
+	m_completedCount += count;
+}
+
+template<typename ScrobbleQueue>
+typename ScrobbleQueue::iterator Scrobbler<ScrobbleQueue>::completeScrobble(const typename ScrobbleQueue::iterator it)
+{
+	assertLocked();
+
+	const std::unique_lock<std::mutex> journalLock = m_journal->lock();
+	if (it == m_pendingScrobbles.begin()) {
+		acknowledgeScrobbles(1);
 	} else {
-		/* The last byte of the data file must be either 0x0a or just the end
-		 * of the last scrobble. In either case buf is empty.
-		 */
-		result &= (buf.size() == 0);
+		// Checking if the scrobble is stored in the journal, i.e. it is among the leading ones.
+		const std::size_t storedCount = m_journal->storedCount(m_journalConsumer);
+		std::size_t index = 0;
+		for (auto p = m_pendingScrobbles.begin(); index != storedCount; ++p, ++index) {
+			if (p == it) {
+				m_journal->acknowledgeAt(m_journalConsumer, index);
+				break;
+			}
+		}
 	}
-finish:
-	if (std::fclose(dataFile) != 0) {
+	++m_completedCount;
+	return m_pendingScrobbles.erase(it);
+}
+
+template<typename ScrobbleQueue>
+inline void Scrobbler<ScrobbleQueue>::checkpointJournal()
+{
+	assertLocked();
+
+	const std::unique_lock<std::mutex> journalLock = m_journal->lock();
+	m_journal->checkpoint();
+}
+
+/* Stores the scrobbles of the intake queue along with the other pending scrobbles that are not stored yet
+ * while the reactor is late to detach this Scrobbler. The pending scrobbles in memory stay in place since
+ * they could still be being submitted. Nothing is done unless the pending scrobbles are loaded.
+ *
+ * It is executed by stop() while m_mutex is not locked.
+ */
+template<typename ScrobbleQueue>
+void Scrobbler<ScrobbleQueue>::storeAccepted()
+{
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_loadState != L_LOADED) {
+			return;
+		}
+		drainIntake();
+		const std::unique_lock<std::mutex> journalLock = m_journal->lock();
+		appendScrobbles(unstoredCount(), false);
+	}
+	// The failures are taken into account once the pending scrobbles are stored by syncJournal().
+	m_journal->flush();
+}
+
+/* Attaches this Scrobbler to the journal to store the scrobbles of the intake queue as spilled ones
+ * while the pending scrobbles are not loaded, so that the scrobbles accepted follow them.
+ *
+ * It is executed by stop() within lock on m_mutex.
+ */
+template<typename ScrobbleQueue>
+bool Scrobbler<ScrobbleQueue>::spillIntake(std::unique_lock<std::mutex> &lock, const bool deferCompaction)
+{
+	using afc::operator"" _s;
+
+	assertLocked();
+
+	const afc::String dataFilePath = getDataFilePath();
+	lock.unlock();
+	const bool attached = attachJournal(dataFilePath);
+	lock.lock();
+	if (!attached) {
+		return false;
+	}
+
+	const std::unique_lock<std::mutex> journalLock = m_journal->lock();
+	const std::size_t count = appendIntake();
+	bool result = m_journal->sync();
+	if (!m_journal->detach(m_journalConsumer, deferCompaction)) {
 		result = false;
 	}
 
-	afc::logger::logDebug("[Scrobbler] Pending scrobbles loaded: "_s, m_pendingScrobbles.size());
+	if (result) {
+		afc::logger::logDebug("[Scrobbler] Scrobbles accepted stored: "_s, count);
+	}
 	return result;
 }
 
+/* Appends the scrobbles of the intake queue to the journal as spilled ones, in the order they are pushed.
+ *
+ * It is executed within lock on m_mutex and on the journal while this Scrobbler is attached to the journal.
+ *
+ * @return the number of scrobbles appended.
+ */
+template<typename ScrobbleQueue>
+std::size_t Scrobbler<ScrobbleQueue>::appendIntake()
+{
+	assertLocked();
+
+	std::size_t count = 0;
+	m_intake.consume([this, &count](IntakeBatch &batch)
+	{
+		count += batch.scrobbles.size();
+		m_journal->append(m_journalConsumer, batch.scrobbles.cbegin(), batch.scrobbles.cend(), batch.sync, true);
+	});
+	m_safeIntake = false;
+	return count;
+}
+
 template<typename ScrobbleQueue>
-inline bool Scrobbler<ScrobbleQueue>::storePendingScrobbles()
+inline bool Scrobbler<ScrobbleQueue>::syncJournal(const bool deferCompaction)
 {
 	using afc::operator"" _s;
 
 	assertLocked();
 
-	afc::logger::logDebug("[Scrobbler] Storing pending scrobbles..."_s);
-
-	/* The assumption is that all tracks are loaded into the list of pending scrobbles
-	 * so that the file could be overwritten with the remaining pending scrobbles.
+	/* The acknowledged records are not removed from the data file unless they occupy
+	 * too much space. Only the scrobbles that are not stored yet are appended and
+	 * the cursor is updated.
 	 */
-	const bool result = storeScrobbles(m_pendingScrobbles.cbegin(), m_pendingScrobbles.cend(), getDataFilePath(), "wb");
-
-	afc::logger::logDebug("[Scrobbler] Pending scrobbles stored: "_s, m_pendingScrobbles.size());
+	const std::unique_lock<std::mutex> journalLock = m_journal->lock();
+	appendScrobbles(unstoredCount(), true);
+	bool result = m_journal->sync();
+	if (!result) {
+		// The records that are lost are not stored any longer so they are appended once again.
+		appendScrobbles(unstoredCount(), true);
+		result = m_journal->sync();
+	}
+	if (!m_journal->detach(m_journalConsumer, deferCompaction)) {
+		result = false;
+	}
 
+	if (result) {
+		afc::logger::logDebug("[Scrobbler] Pending scrobbles stored: "_s, m_pendingScrobbles.size());
+	}
 	return result;
 }
 
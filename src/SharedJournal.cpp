@@ -0,0 +1,994 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "SharedJournal.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iterator>
+#include <limits>
+#include <thread>
+#include <utility>
+
+#include <afc/logger.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include "fileutil.hpp"
+
+using afc::operator"" _s;
+
+namespace
+{
+	/* The data file is compacted if dead records occupy at least this space and at least
+	 * as much space as the rest of the records.
+	 */
+	constexpr std::uint64_t compactionThreshold = 1024 * 1024;
+
+	// Marks an offset that does not refer to a record boundary of the data file being compacted.
+	constexpr std::uint64_t lostOffset = std::numeric_limits<std::uint64_t>::max();
+
+	/* Adds the string defined by a given string record to the dictionary. A malformed string record
+	 * is ignored here; the scrobbles that refer to the string are rejected when they are parsed.
+	 */
+	void defineJournalString(const char * const recordBegin, const char * const recordEnd,
+			StringDictionary &dictionary)
+	{
+		const char *p = recordBegin;
+		JournalRecordType type;
+		const char *payloadBegin, *payloadEnd;
+		std::uint32_t id;
+		const char *stringBegin, *stringEnd;
+		if (readJournalRecord(p, recordEnd, type, payloadBegin, payloadEnd) == JournalReadResult::ok &&
+				type == JournalRecordType::string &&
+				readJournalString(payloadBegin, payloadEnd, id, stringBegin, stringEnd)) {
+			dictionary.define(id, stringBegin, stringEnd);
+		}
+	}
+
+	void readJournalCursorsRecord(const char * const recordBegin, const char * const recordEnd,
+			JournalCursors &dest)
+	{
+		const char *p = recordBegin;
+		JournalRecordType type;
+		const char *payloadBegin, *payloadEnd;
+		JournalCursors offsets;
+		if (readJournalRecord(p, recordEnd, type, payloadBegin, payloadEnd) == JournalReadResult::ok &&
+				type == JournalRecordType::cursors && readJournalCursors(payloadBegin, payloadEnd, offsets)) {
+			dest = offsets;
+		}
+	}
+
+	bool loadCursor(const afc::String &dataFilePath, std::uint64_t &fileId, JournalCursors &offsets)
+	{
+		const afc::FastStringBuffer<char, afc::AllocMode::accurate> path =
+				siblingPath(dataFilePath.data(), dataFilePath.size(), ".cursor"_s);
+
+		std::FILE * const cursorFile = std::fopen(path.c_str(), "rb");
+		if (cursorFile == nullptr) {
+			return false;
+		}
+
+		// An extra octet is requested to reject a cursor file of an unexpected size.
+		char buf[journalCursorSize + 1];
+		const std::size_t size = std::fread(buf, sizeof(char), sizeof(buf), cursorFile);
+		std::fclose(cursorFile);
+
+		return readJournalCursor(buf, buf + size, fileId, offsets);
+	}
+}
+
+SharedJournal::SharedJournal(const afc::String &dataFilePath, const std::chrono::milliseconds appendDelay)
+	: m_mutex(), m_dataFilePath(dataFilePath), m_appendDelay(appendDelay), m_writer(),
+	  m_encoders(std::min<std::size_t>(std::max(std::thread::hardware_concurrency(), 1u), maxEncoderCount) - 1),
+	  m_refCount(0),
+	  m_attached(0), m_consumers(), m_dictionary(), m_fileId(0), m_size(0), m_preambleEnd(0), m_compactedSize(0),
+	  m_liveBase(0), m_generation(0), m_compaction(), m_repairNeeded(false), m_lastRecord(), m_quarantined(),
+	  m_legacyConsumers(0), m_foreign(false)
+{
+}
+
+SharedJournal::~SharedJournal()
+{
+	// Synchronising memory before destructing the member fields of this journal.
+	std::lock_guard<std::mutex> lock(m_mutex);
+	assert(m_attached == 0);
+}
+
+bool SharedJournal::attach(const unsigned consumer)
+{
+	assert(consumer < journalConsumerCount);
+	assert((m_attached & (1u << consumer)) == 0);
+
+	if (m_attached == 0) {
+		if (!open(consumer)) {
+			return false;
+		}
+	} else {
+		pollCompaction();
+	}
+	m_attached |= 1u << consumer;
+
+	Consumer &state = m_consumers[consumer];
+	state.recordEnds.clear();
+	state.completed.clear();
+	const std::uint64_t recordsBegin = std::max<std::uint64_t>(state.cursor, journalHeaderSize);
+	state.spillBegin = state.pending && recordsBegin < m_size ? recordsBegin : 0;
+	return true;
+}
+
+bool SharedJournal::detach(const unsigned consumer, const bool deferCompaction)
+{
+	assert(consumer < journalConsumerCount);
+	assert((m_attached & (1u << consumer)) != 0);
+
+	poll();
+	// The cursors are stored and the records are swept out for the current state of the consumer.
+	awaitCompaction();
+
+	Consumer &state = m_consumers[consumer];
+	if (!state.completed.empty() || m_foreign || (!deferCompaction && needsCompaction())) {
+		afc::logger::logDebug("[SharedJournal] Compacting the data file..."_s);
+		compact();
+	} else {
+		storeCursors();
+	}
+
+	state.pending = !state.recordEnds.empty() || state.spillBegin != 0;
+	state.recordEnds.clear();
+	state.completed.clear();
+	state.spillBegin = 0;
+	m_attached &= ~(1u << consumer);
+
+	m_writer.flush();
+	const bool result = !m_writer.takeFailure();
+
+	if (m_attached == 0) {
+		close();
+	} else if (!result) {
+		// The records of the other consumers could be lost as well.
+		m_repairNeeded = true;
+		pollCompaction();
+	}
+	return result;
+}
+
+bool SharedJournal::open(const unsigned consumer)
+{
+	m_writer.start(m_dataFilePath, m_appendDelay);
+	m_legacyConsumers = 1u << consumer;
+
+	/* The data file is walked through to read the string records (all of them are needed
+	 * regardless of the cursors) and the cursors record, and to check the framing of the records
+	 * so that new records could be appended. The scrobble records are parsed by the consumers.
+	 */
+	MappedFile dataFile;
+	const MappedFile::MapResult mapResult = dataFile.map(m_dataFilePath.c_str());
+	if (mapResult == MappedFile::M_ERROR) {
+		afc::logger::logError("[SharedJournal] Unable to read the data file."_s);
+		m_writer.stop();
+		return false;
+	}
+	if (mapResult == MappedFile::M_NOTEXIST || dataFile.size() == 0) {
+		// There are no pending scrobbles.
+		return true;
+	}
+
+	const char * const begin = dataFile.begin();
+	const char * const end = dataFile.end();
+	if (!hasJournalMagic(begin, end)) {
+		// The data file written by an older version of the plugin. It is converted by the consumer.
+		m_foreign = true;
+		return true;
+	}
+	std::uint64_t fileId;
+	if (!readJournalHeader(begin, end, fileId)) {
+		/* The data file is either damaged or written by a newer version of this plugin.
+		 * In both cases it is left untouched.
+		 */
+		afc::logger::logError("[SharedJournal] The data file has an invalid or unsupported header."_s);
+		m_writer.stop();
+		return false;
+	}
+
+	JournalCursors cursors = {};
+	// The end of the last record that is pending for each consumer.
+	JournalCursors lastRecordEnds = {};
+	const char *preambleEnd = begin + journalHeaderSize;
+	const char *p = begin + journalHeaderSize;
+	while (p != end) {
+		const char * const next = skipJournalRecord(p, end);
+		if (next == nullptr) {
+			break;
+		}
+		const JournalRecordType type = peekJournalRecordType(p);
+		if (type == JournalRecordType::string) {
+			defineJournalString(p, next, m_dictionary);
+		} else if (type == JournalRecordType::cursors) {
+			readJournalCursorsRecord(p, next, cursors);
+		} else {
+			// The records are validated when they are loaded by the consumers.
+			const unsigned consumers = type == JournalRecordType::sharedScrobble ?
+					peekJournalRecordConsumers(p) : m_legacyConsumers;
+			for (unsigned i = 0; i < journalConsumerCount; ++i) {
+				if ((consumers & (1u << i)) != 0) {
+					lastRecordEnds[i] = next - begin;
+				}
+			}
+		}
+		if (preambleEnd == p && (type == JournalRecordType::string || type == JournalRecordType::cursors)) {
+			preambleEnd = next;
+		}
+		p = next;
+	}
+
+	// The cursor file is more recent than the cursors record unless it refers to another data file.
+	std::uint64_t cursorFileId;
+	JournalCursors storedCursors;
+	if (loadCursor(m_dataFilePath, cursorFileId, storedCursors) && cursorFileId == fileId) {
+		cursors = storedCursors;
+	}
+
+	m_fileId = fileId;
+	m_size = m_compactedSize = dataFile.size();
+	m_liveBase = m_preambleEnd = preambleEnd - begin;
+	for (unsigned i = 0; i < journalConsumerCount; ++i) {
+		Consumer &state = m_consumers[i];
+		state.cursor = state.checkpoint = cursors[i] <= std::uint64_t(p - begin) ? cursors[i] : 0;
+		state.pending = lastRecordEnds[i] > state.cursor;
+	}
+	++m_generation;
+
+	const bool truncated = p != end;
+	dataFile.unmap();
+
+	if (truncated) {
+		// New records cannot be appended after a truncated one so the data file is re-written.
+		afc::logger::logError("[SharedJournal] The data file ends with an incomplete record. "
+				"It is moved to the quarantine file."_s);
+		compact();
+	}
+	return true;
+}
+
+void SharedJournal::close()
+{
+	m_writer.stop();
+	m_writer.takeFailure();
+	// The compaction in progress, if any, is finished by the journal writer; the data file is not used any longer.
+	m_compaction.reset();
+	m_repairNeeded = false;
+
+	for (Consumer &state : m_consumers) {
+		state = Consumer();
+	}
+	m_dictionary.clear();
+	m_fileId = m_size = m_preambleEnd = m_compactedSize = m_liveBase = 0;
+	++m_generation;
+	m_lastRecord.consumers = 0;
+	m_quarantined.clear();
+	m_legacyConsumers = 0;
+	m_foreign = false;
+}
+
+void SharedJournal::startJournal(afc::FastStringBuffer<char> &dest)
+{
+	m_fileId = newJournalFileId();
+	m_preambleEnd = m_liveBase = journalHeaderSize;
+	m_dictionary.clear();
+	appendJournalHeader(m_fileId, dest);
+}
+
+std::size_t SharedJournal::encoderCount(const std::size_t recordCount) const noexcept
+{
+	// The thread that appends the records encodes them along with the threads of m_encoders.
+	return std::max<std::size_t>(std::min(m_encoders.threadCount() + 1, recordCount / minEncoderChunkSize), 1);
+}
+
+void SharedJournal::appendChunks(const unsigned consumer, std::vector<afc::FastStringBuffer<char>> &&chunks,
+		const bool sync, const bool spill)
+{
+	// The first chunk contains no scrobble records; each of the others contains some.
+	assert(chunks.size() > 1);
+
+	Consumer &state = m_consumers[consumer];
+	const std::uint64_t offset = m_size;
+
+	std::uint64_t chunkOffset = offset + chunks[0].size();
+	if (spill && state.spillBegin == 0) {
+		state.spillBegin = chunkOffset;
+	}
+	for (std::size_t i = 1, n = chunks.size(); i < n; ++i) {
+		const afc::FastStringBuffer<char> &chunk = chunks[i];
+		assert(chunk.size() != 0);
+		if (!spill) {
+			const char * const begin = chunk.data();
+			const char * const end = begin + chunk.size();
+			for (const char *p = begin; p != end;) {
+				p = skipJournalRecord(p, end);
+				assert(p != nullptr);
+				state.recordEnds.push_back(chunkOffset + (p - begin));
+			}
+		}
+		chunkOffset += chunk.size();
+	}
+
+	// The last scrobble record is remembered so that it can be amended by other consumers.
+	const afc::FastStringBuffer<char> &lastChunk = chunks.back();
+	const char * const lastChunkEnd = lastChunk.data() + lastChunk.size();
+	const char *lastRecord = lastChunk.data();
+	for (const char *p = lastRecord; p != lastChunkEnd; p = skipJournalRecord(p, lastChunkEnd)) {
+		lastRecord = p;
+	}
+	rememberLastRecord(lastChunk, lastRecord - lastChunk.data(), chunkOffset - lastChunk.size(), consumer);
+
+	m_size = chunkOffset;
+	m_writer.append(std::move(chunks), offset, sync);
+}
+
+bool SharedJournal::amendLastRecord(const char * const record, const std::size_t size, const unsigned consumer)
+{
+	const unsigned mask = 1u << consumer;
+	if (m_lastRecord.consumers == 0 || (m_lastRecord.consumers & mask) != 0 ||
+			size != m_lastRecord.record.size()) {
+		return false;
+	}
+
+	// The records are equal except for the consumer masks and the CRCs.
+	const char * const last = m_lastRecord.record.data();
+	constexpr std::size_t maskPos = 4 + 1;
+	if (!std::equal(record, record + maskPos, last) ||
+			!std::equal(record + maskPos + 1, record + size - 4, last + maskPos + 1)) {
+		return false;
+	}
+
+	const unsigned consumers = m_lastRecord.consumers | mask;
+	if (!m_writer.amend(m_lastRecord.offset, size,
+			[size, consumers](char * const p) { setJournalRecordConsumers(p, size, consumers); })) {
+		return false;
+	}
+	m_lastRecord.consumers = consumers;
+
+	afc::logger::logDebug("[SharedJournal] The scrobble is stored by the record of another consumer."_s);
+	return true;
+}
+
+void SharedJournal::rememberLastRecord(const afc::FastStringBuffer<char> &records, const std::size_t recordStart,
+		const std::uint64_t offset, const unsigned consumer)
+{
+	if (m_appendDelay.count() == 0) {
+		// The records are written right away so they cannot be amended.
+		return;
+	}
+
+	// The string records, if any, precede the scrobble record.
+	const char *p = records.data() + recordStart;
+	const char * const end = records.data() + records.size();
+	while (peekJournalRecordType(p) == JournalRecordType::string) {
+		p = skipJournalRecord(p, end);
+	}
+
+	const std::size_t size = end - p;
+	m_lastRecord.record.clear();
+	m_lastRecord.record.reserve(size);
+	m_lastRecord.record.append(p, size);
+	m_lastRecord.offset = offset + (p - records.data());
+	m_lastRecord.consumers = 1u << consumer;
+}
+
+void SharedJournal::acknowledge(const unsigned consumer, const std::size_t count)
+{
+	assert(consumer < journalConsumerCount);
+
+	Consumer &state = m_consumers[consumer];
+	assert(count <= state.recordEnds.size());
+	if (count == 0) {
+		return;
+	}
+
+	const std::uint64_t cursor = state.recordEnds[count - 1];
+	state.cursor = cursor;
+	state.recordEnds.erase(state.recordEnds.begin(), state.recordEnds.begin() + count);
+	state.completed.erase(std::remove_if(state.completed.begin(), state.completed.end(),
+			[cursor](const std::uint64_t end) { return end <= cursor; }), state.completed.end());
+}
+
+void SharedJournal::acknowledgeAt(const unsigned consumer, const std::size_t index)
+{
+	assert(consumer < journalConsumerCount);
+
+	Consumer &state = m_consumers[consumer];
+	assert(index < state.recordEnds.size());
+	if (index == 0) {
+		acknowledge(consumer, 1);
+		return;
+	}
+
+	const auto it = state.recordEnds.begin() + index;
+	state.completed.push_back(*it);
+	state.recordEnds.erase(it);
+}
+
+void SharedJournal::checkpoint()
+{
+	poll();
+
+	if (m_compaction != nullptr) {
+		// The cursors and the dead records are taken into account by the next checkpoint.
+		return;
+	}
+	if (needsCompaction()) {
+		afc::logger::logDebug("[SharedJournal] Compacting the data file..."_s);
+		startCompaction();
+	} else {
+		storeCursors();
+	}
+}
+
+void SharedJournal::poll()
+{
+	if (m_writer.takeFailure()) {
+		afc::logger::logError("[SharedJournal] Some records are not written. The data file is being repaired..."_s);
+		m_repairNeeded = true;
+	}
+	pollCompaction();
+}
+
+bool SharedJournal::sync()
+{
+	m_writer.flush();
+	if (m_writer.takeFailure()) {
+		afc::logger::logError("[SharedJournal] Some records are not written. The data file is being repaired..."_s);
+		compact();
+		return false;
+	}
+	pollCompaction();
+	return true;
+}
+
+bool SharedJournal::spillRange(const unsigned consumer, SpillRange &dest)
+{
+	assert(consumer < journalConsumerCount);
+
+	pollCompaction();
+
+	const Consumer &state = m_consumers[consumer];
+	if (state.spillBegin == 0) {
+		return false;
+	}
+	dest.generation = m_generation;
+	dest.begin = state.spillBegin;
+	dest.end = m_size;
+	return true;
+}
+
+void SharedJournal::loadSpill(const unsigned consumer, const SpillRange &range, const std::uint64_t readEnd,
+		const std::deque<std::uint64_t> &recordEnds)
+{
+	assert(consumer < journalConsumerCount);
+	assert(isCurrent(range));
+
+	Consumer &state = m_consumers[consumer];
+	assert(state.spillBegin == range.begin);
+	assert(range.begin <= readEnd && readEnd <= range.end && range.end <= m_size);
+
+	if (recordEnds.empty() && state.recordEnds.empty()) {
+		// All the records of the consumer before the end of the range read are malformed ones.
+		state.cursor = std::max(state.cursor, readEnd);
+	}
+	state.recordEnds.insert(state.recordEnds.end(), recordEnds.begin(), recordEnds.end());
+	// New spilled records could be appended while the range is read.
+	state.spillBegin = readEnd < m_size ? readEnd : 0;
+}
+
+bool SharedJournal::markQuarantined(const std::uint64_t offset)
+{
+	if (std::find(m_quarantined.begin(), m_quarantined.end(), offset) != m_quarantined.end()) {
+		return false;
+	}
+	m_quarantined.push_back(offset);
+	return true;
+}
+
+bool SharedJournal::storeQuarantine(const afc::FastStringBuffer<char> &records) const
+{
+	const afc::FastStringBuffer<char, afc::AllocMode::accurate> path =
+			siblingPath(m_dataFilePath.data(), m_dataFilePath.size(), ".quarantine"_s);
+
+	if (!createParentDirs(path.c_str(), path.size())) {
+		return false;
+	}
+	const int fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+	if (fd == -1) {
+		return false;
+	}
+	bool result = writeFully(fd, records.data(), records.size());
+	if (::close(fd) != 0) {
+		result = false;
+	}
+	return result;
+}
+
+bool SharedJournal::needsCompaction() const noexcept
+{
+	if (m_size == 0) {
+		return false;
+	}
+
+	// The records that all the consumers with pending records have passed since the last compaction are dead.
+	std::uint64_t passed = m_size;
+	unsigned pendingCount = 0;
+	for (unsigned i = 0; i < journalConsumerCount; ++i) {
+		const Consumer &state = m_consumers[i];
+		const bool pending = (m_attached & (1u << i)) != 0 ?
+				!state.recordEnds.empty() || state.spillBegin != 0 : state.pending;
+		if (pending) {
+			passed = std::min(passed, std::max(state.cursor, m_liveBase));
+			++pendingCount;
+		}
+	}
+
+	const std::uint64_t deadSize = passed - m_liveBase;
+	const std::uint64_t otherSize = m_size - m_preambleEnd - deadSize;
+	/* If there are no other records then compaction consists of writing the header only
+	 * so it is done regardless of the threshold.
+	 */
+	if (deadSize != 0 && (otherSize == 0 || (deadSize >= compactionThreshold && deadSize >= otherSize))) {
+		return true;
+	}
+
+	/* The dead records that follow the records of a consumer that lags behind the others are not
+	 * accounted above so the data file is compacted as well each time it doubles in size.
+	 */
+	const std::uint64_t growth = m_size - m_compactedSize;
+	return pendingCount > 1 && growth >= compactionThreshold && growth >= m_compactedSize;
+}
+
+/* A compaction of the data file that is planned and performed by the journal writer (see compact()).
+ * The state that tells which records to keep is captured within the lock when the compaction is started.
+ * The outcome is used within the lock once the compaction is finished.
+ */
+class SharedJournal::Compaction final : public JournalWriter::RewritePlanner
+{
+public:
+	// A run of records of the data file being replaced that are either all kept or all dropped.
+	struct Run
+	{
+		std::uint64_t begin;
+		// The position of the run in the new data file, counted from the end of its preamble.
+		std::uint64_t newBegin;
+		bool kept;
+	};
+
+	explicit Compaction(const SharedJournal &journal);
+
+	bool plan(afc::FastStringBuffer<char> &journal, std::vector<JournalWriter::RewriteRange> &layout) override;
+	void finished(bool rewritten) override;
+
+	bool isFinished() const noexcept { return m_finished.load(std::memory_order_acquire); }
+
+	/* Returns the offset of the new data file that a given offset of the data file being replaced
+	 * is moved to. The offsets beyond the end of the data file when the compaction is started belong
+	 * to the records appended meanwhile which follow the new journal. If exact is false then an offset
+	 * beyond the last complete record is moved back to its end; otherwise lostOffset is returned.
+	 *
+	 * @param recordBegin true if the offset refers to the beginning of a record rather than to its end.
+	 */
+	std::uint64_t move(std::uint64_t offset, bool exact, bool recordBegin) const noexcept;
+
+	const SharedJournal &owner;
+	// The state of the journal when the compaction is started.
+	const std::uint64_t end;
+	const unsigned attached;
+	const unsigned legacyConsumers;
+	JournalCursors cursors;
+	// The ends of the records acknowledged out of order along with the consumers, in order.
+	std::vector<std::pair<std::uint64_t, unsigned>> completed;
+	std::vector<std::uint64_t> quarantined;
+	// The string records of the dictionary.
+	afc::FastStringBuffer<char> strings;
+
+	// The outcome, which is valid once the compaction is finished.
+	bool rewritten;
+	std::uint64_t fileId;
+	std::uint64_t preambleSize;
+	std::uint64_t size;
+	// The end of the last complete record of the data file being replaced.
+	std::uint64_t validEnd;
+	std::vector<Run> runs;
+	unsigned pendingConsumers;
+	afc::FastStringBuffer<char> quarantine;
+	std::size_t malformedCount;
+private:
+	std::atomic<bool> m_finished;
+};
+
+SharedJournal::Compaction::Compaction(const SharedJournal &journal)
+	: owner(journal), end(journal.m_size), attached(journal.m_attached), legacyConsumers(journal.m_legacyConsumers),
+	  cursors(), completed(), quarantined(journal.m_quarantined), strings(), rewritten(false), fileId(0),
+	  preambleSize(0), size(0), validEnd(0), runs(), pendingConsumers(0), quarantine(), malformedCount(0),
+	  m_finished(false)
+{
+	for (unsigned i = 0; i < journalConsumerCount; ++i) {
+		const Consumer &state = journal.m_consumers[i];
+		cursors[i] = state.cursor;
+		for (const std::uint64_t recordEnd : state.completed) {
+			completed.emplace_back(recordEnd, i);
+		}
+	}
+	std::sort(completed.begin(), completed.end());
+	appendJournalDictionary(journal.m_dictionary, strings);
+}
+
+/* Walks through the records of the data file, which is not modified meanwhile since it is done
+ * by the journal writer. The string records and the cursors record are replaced with the strings
+ * and the cursors captured; the modified records follow them in the journal buffer.
+ */
+bool SharedJournal::Compaction::plan(afc::FastStringBuffer<char> &journal,
+		std::vector<JournalWriter::RewriteRange> &layout)
+{
+	MappedFile dataFile;
+	const MappedFile::MapResult mapResult = dataFile.map(owner.m_dataFilePath.c_str());
+	if (mapResult == MappedFile::M_ERROR) {
+		afc::logger::logError("[SharedJournal] Unable to read the data file. It is not compacted."_s);
+		return false;
+	}
+
+	const char *begin = nullptr, *end = nullptr;
+	if (mapResult == MappedFile::M_MAPPED) {
+		std::uint64_t fileId;
+		if (readJournalHeader(dataFile.begin(), dataFile.end(), fileId)) {
+			begin = dataFile.begin();
+			end = dataFile.end();
+		}
+	}
+	if (begin == nullptr && this->end > journalHeaderSize) {
+		afc::logger::logError("[SharedJournal] The data file is missing or damaged. "
+				"The pending scrobbles that are not in memory are lost."_s);
+	}
+
+	// Modified records are copied to this buffer.
+	afc::FastStringBuffer<char> records;
+	std::size_t nextCompleted = 0;
+	std::uint64_t newPos = 0;
+	auto quarantineRecord = [&](const char * const recordBegin, const char * const recordEnd)
+	{
+		const std::uint64_t offset = recordBegin - begin;
+		if (std::find(quarantined.begin(), quarantined.end(), offset) == quarantined.end()) {
+			quarantined.push_back(offset);
+			quarantine.reserve(quarantine.size() + (recordEnd - recordBegin));
+			quarantine.append(recordBegin, recordEnd - recordBegin);
+			++malformedCount;
+		}
+	};
+	auto passRecord = [&](const std::uint64_t recordBegin, const bool kept)
+	{
+		if (kept != runs.back().kept) {
+			runs.push_back({recordBegin, newPos, kept});
+		}
+	};
+
+	runs.push_back({journalHeaderSize, 0, false});
+	validEnd = journalHeaderSize;
+	const char *p = begin == nullptr ? nullptr : begin + journalHeaderSize;
+	while (p != end) {
+		const char * const recordBegin = p;
+		JournalRecordType type;
+		const char *payloadBegin, *payloadEnd;
+		const JournalReadResult readResult = readJournalRecord(p, end, type, payloadBegin, payloadEnd);
+		if (readResult == JournalReadResult::truncated) {
+			quarantineRecord(recordBegin, end);
+			break;
+		}
+
+		const std::uint64_t recordEnd = p - begin;
+		validEnd = recordEnd;
+		if (readResult == JournalReadResult::corrupted) {
+			quarantineRecord(recordBegin, p);
+			passRecord(recordBegin - begin, false);
+			continue;
+		}
+
+		// The string records and the cursors record are written anew.
+		const unsigned consumers = type == JournalRecordType::string || type == JournalRecordType::cursors ? 0 :
+				type == JournalRecordType::sharedScrobble ? journalRecordConsumers(type, payloadBegin, payloadEnd) :
+				legacyConsumers;
+		unsigned completedBy = 0, live = 0;
+		for (; nextCompleted < completed.size() && completed[nextCompleted].first <= recordEnd; ++nextCompleted) {
+			if (completed[nextCompleted].first == recordEnd) {
+				completedBy |= 1u << completed[nextCompleted].second;
+			}
+		}
+		for (unsigned i = 0; i < journalConsumerCount; ++i) {
+			const unsigned mask = 1u << i;
+			if ((consumers & mask) != 0 && (completedBy & mask) == 0 && recordEnd > cursors[i]) {
+				live |= mask;
+			}
+		}
+
+		pendingConsumers |= live;
+		passRecord(recordBegin - begin, live != 0);
+		if (live != 0) {
+			const std::size_t size = p - recordBegin;
+			const std::uint64_t copyBegin = recordBegin - begin;
+			if ((consumers & completedBy) != 0 && type == JournalRecordType::sharedScrobble) {
+				// The consumers that have acknowledged the record out of order are excluded.
+				const std::size_t recordStart = records.size();
+				records.reserve(recordStart + size);
+				records.append(recordBegin, size);
+				setJournalRecordConsumers(&*records.begin() + recordStart, size, consumers & ~completedBy);
+				layout.push_back({recordStart, records.size(), false});
+			} else if (!layout.empty() && layout.back().copied && layout.back().end == copyBegin) {
+				layout.back().end = recordEnd;
+			} else {
+				layout.push_back({copyBegin, recordEnd, true});
+			}
+			newPos += size;
+		}
+	}
+
+	fileId = newJournalFileId();
+	appendJournalHeader(fileId, journal);
+	preambleSize = journal.size();
+	if (newPos != 0) {
+		preambleSize += journalRecordOverhead + 8 * journalConsumerCount + strings.size();
+	}
+	size = preambleSize + newPos;
+
+	if (newPos != 0) {
+		JournalCursors newCursors = {};
+		for (unsigned i = 0; i < journalConsumerCount; ++i) {
+			newCursors[i] = cursors[i] == 0 ? 0 : move(cursors[i], false, false);
+		}
+		appendJournalCursorsRecord(newCursors, journal);
+		journal.reserve(journal.size() + strings.size() + records.size());
+		journal.append(strings.data(), strings.size());
+		assert(journal.size() == preambleSize);
+
+		// The modified records follow the preamble in the journal buffer.
+		for (JournalWriter::RewriteRange &range : layout) {
+			if (!range.copied) {
+				range.begin += preambleSize;
+				range.end += preambleSize;
+			}
+		}
+		journal.append(records.data(), records.size());
+	}
+	layout.insert(layout.begin(), {0, preambleSize, false});
+	return true;
+}
+
+void SharedJournal::Compaction::finished(const bool rewritten)
+{
+	if (rewritten && malformedCount != 0) {
+		afc::logger::logError("[SharedJournal] Malformed records are found in the data file: "_s,
+				malformedCount, ". They are moved to the quarantine file."_s);
+		if (!owner.storeQuarantine(quarantine)) {
+			afc::logger::logError("[SharedJournal] Unable to write the quarantine file. "
+					"The malformed records are lost."_s);
+		}
+	}
+	this->rewritten = rewritten;
+	m_finished.store(true, std::memory_order_release);
+}
+
+std::uint64_t SharedJournal::Compaction::move(const std::uint64_t offset, const bool exact,
+		const bool recordBegin) const noexcept
+{
+	if (offset > end || (recordBegin && offset == end)) {
+		return offset - end + size;
+	}
+	if (offset > validEnd) {
+		return exact ? lostOffset : move(validEnd, false, false);
+	}
+	if (offset < journalHeaderSize) {
+		return exact ? lostOffset : preambleSize;
+	}
+	// The offsets within the runs of the records dropped are moved to the end of the previous run kept.
+	const auto run = std::prev(std::upper_bound(runs.begin(), runs.end(), offset,
+			[](const std::uint64_t value, const Run &run) { return value < run.begin; }));
+	return preambleSize + run->newBegin + (run->kept ? offset - run->begin : 0);
+}
+
+/* Re-writes the data file without the records that are acknowledged by all the consumers they are
+ * pending for, and blocks until it is done. The lock is released meanwhile unless the data file
+ * is being opened.
+ *
+ * The records are copied from the data file by the journal writer; the string records
+ * are replaced with the dictionary and the cursors are written to the cursors record. The records
+ * are validated so the data file is repaired this way as well: the malformed records are moved
+ * to the quarantine file and the data file is truncated at the first incomplete record.
+ * The offsets held by the consumers are moved accordingly; the ones that do not refer to
+ * the boundaries of the records kept are lost. The state of the journal is changed only if
+ * the data file is re-written.
+ */
+void SharedJournal::compact()
+{
+	awaitCompaction();
+	startCompaction();
+	awaitCompaction();
+}
+
+/* Starts compacting the data file (see compact()) unless it is being compacted already.
+ * The records appended while the data file is being compacted are moved by the journal writer
+ * to follow the new journal, and their offsets are moved once the compaction is finished.
+ */
+void SharedJournal::startCompaction()
+{
+	if (m_compaction != nullptr) {
+		return;
+	}
+	m_repairNeeded = false;
+
+	if (m_foreign) {
+		// The data file that is not a journal is replaced with an empty journal.
+		afc::FastStringBuffer<char> header;
+		startJournal(header);
+		m_size = m_compactedSize = header.size();
+		m_foreign = false;
+		++m_generation;
+		m_writer.rewrite(std::move(header));
+		return;
+	}
+	if (m_size == 0) {
+		return;
+	}
+
+	m_compaction.reset(new Compaction(*this));
+	m_writer.rewrite(*m_compaction, m_size);
+}
+
+void SharedJournal::awaitCompaction()
+{
+	while (m_compaction != nullptr) {
+		if (!m_compaction->isFinished()) {
+			if (m_attached != 0) {
+				// The data file is not opened or closed while there are consumers attached.
+				afc::UnlockGuard unlockGuard(m_mutex);
+				m_writer.flush();
+			} else {
+				m_writer.flush();
+			}
+		}
+		pollCompaction();
+	}
+}
+
+void SharedJournal::pollCompaction()
+{
+	if (m_compaction != nullptr && m_compaction->isFinished()) {
+		finishCompaction();
+	}
+	if (m_repairNeeded && m_compaction == nullptr) {
+		startCompaction();
+	}
+}
+
+// Moves the offsets held by the consumers to the new data file.
+void SharedJournal::finishCompaction()
+{
+	const std::unique_ptr<Compaction> compaction = std::move(m_compaction);
+	// The appends submitted from now on refer to the new data file if it is re-written.
+	m_writer.rebase();
+	if (!compaction->rewritten) {
+		return;
+	}
+
+	for (unsigned i = 0; i < journalConsumerCount; ++i) {
+		Consumer &state = m_consumers[i];
+		const std::uint64_t cursor = compaction->cursors[i];
+		if (state.cursor != 0) {
+			state.cursor = compaction->move(state.cursor, false, false);
+		}
+		state.checkpoint = cursor == 0 ? 0 : compaction->move(cursor, false, false);
+		if (state.spillBegin != 0) {
+			state.spillBegin = compaction->move(state.spillBegin, true, true);
+		}
+		for (std::uint64_t &recordEnd : state.recordEnds) {
+			recordEnd = compaction->move(recordEnd, true, false);
+		}
+		// The records acknowledged out of order before the compaction is started are swept out.
+		auto completedEnd = std::remove_if(state.completed.begin(), state.completed.end(),
+				[&compaction, i](const std::uint64_t recordEnd)
+				{
+					return std::binary_search(compaction->completed.begin(), compaction->completed.end(),
+							std::make_pair(recordEnd, i));
+				});
+		for (auto it = state.completed.begin(); it != completedEnd;) {
+			*it = compaction->move(*it, true, false);
+			if (*it == lostOffset) {
+				*it = *--completedEnd;
+			} else {
+				++it;
+			}
+		}
+		state.completed.erase(completedEnd, state.completed.end());
+		if ((compaction->attached & (1u << i)) == 0) {
+			state.pending = (compaction->pendingConsumers & (1u << i)) != 0;
+		}
+
+		const auto lost = std::find(state.recordEnds.begin(), state.recordEnds.end(), lostOffset);
+		if (lost != state.recordEnds.end()) {
+			// The scrobbles are kept in memory so they are to be stored once again.
+			afc::logger::logError("[SharedJournal] Some records of pending scrobbles are lost. "
+					"They are to be stored once again."_s);
+			state.recordEnds.erase(lost, state.recordEnds.end());
+			if (state.spillBegin != 0) {
+				state.spillBegin = lostOffset;
+			}
+		}
+		if (state.spillBegin == lostOffset) {
+			afc::logger::logError("[SharedJournal] The records of spilled scrobbles are lost."_s);
+			state.spillBegin = 0;
+		}
+	}
+
+	const std::uint64_t appendedSize = m_size - compaction->end;
+	m_fileId = compaction->fileId;
+	m_size = compaction->size + appendedSize;
+	m_compactedSize = compaction->size;
+	m_preambleEnd = compaction->preambleSize;
+	++m_generation;
+	m_lastRecord.consumers = 0;
+	m_quarantined.clear();
+	if (compaction->size == journalHeaderSize) {
+		if (appendedSize == 0) {
+			m_dictionary.clear();
+		} else if (compaction->strings.size() != 0) {
+			// The records appended meanwhile could refer to the strings that the new journal lacks.
+			const std::uint64_t offset = m_size;
+			m_size += compaction->strings.size();
+			m_writer.append(std::move(compaction->strings), offset, false);
+		}
+	}
+
+	/* The records are kept as of the cursors the compaction is started with so the ones
+	 * acknowledged meanwhile are dead already.
+	 */
+	std::uint64_t liveBase = m_size;
+	for (unsigned i = 0; i < journalConsumerCount; ++i) {
+		const Consumer &state = m_consumers[i];
+		const bool pending = (m_attached & (1u << i)) != 0 ?
+				!state.recordEnds.empty() || state.spillBegin != 0 : state.pending;
+		if (pending) {
+			liveBase = std::min(liveBase, state.cursor);
+		}
+		if ((compaction->pendingConsumers & (1u << i)) != 0) {
+			liveBase = std::min(liveBase, state.checkpoint);
+		}
+	}
+	m_liveBase = std::max(liveBase, m_preambleEnd);
+
+	afc::logger::logDebug("[SharedJournal] The data file is re-written: "_s, m_size, " octets."_s);
+}
+
+void SharedJournal::storeCursors()
+{
+	// The cursor file would refer to the data file that is being replaced.
+	if (m_size == 0 || m_compaction != nullptr) {
+		return;
+	}
+
+	bool changed = false;
+	JournalCursors cursors;
+	for (unsigned i = 0; i < journalConsumerCount; ++i) {
+		Consumer &state = m_consumers[i];
+		cursors[i] = state.cursor;
+		changed = changed || state.cursor != state.checkpoint;
+		state.checkpoint = state.cursor;
+	}
+	if (changed) {
+		m_writer.storeCursor(m_fileId, cursors);
+	}
+}
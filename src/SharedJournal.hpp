@@ -0,0 +1,430 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef SHAREDJOURNAL_HPP_
+#define SHAREDJOURNAL_HPP_
+
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include <afc/FastStringBuffer.hpp>
+#include <afc/SimpleString.hpp>
+#include <afc/utils.h>
+#include "JournalWriter.hpp"
+#include "ScrobbleInfo.hpp"
+#include "ScrobbleJournal.hpp"
+#include "StringDictionary.hpp"
+#include "WorkerPool.hpp"
+
+/* The journal of pending scrobbles that is shared by a number of consumers (e.g. the Scrobblers
+ * of different scrobbling services) so that each scrobble is stored once. Each consumer is
+ * identified by a number from zero to journalConsumerCount - 1 and has its own cursor.
+ * A record is swept out of the data file when it is compacted if all the consumers
+ * the record is pending for have acknowledged it.
+ *
+ * For each consumer attached, the leading recordEnds.size() pending scrobbles in memory
+ * are stored in the journal in the same order; the rest of them are not stored yet. If the
+ * consumer has spilled scrobbles then all its records starting at spillBegin are the records
+ * of the pending scrobbles that follow the ones in memory, and all the pending scrobbles in memory
+ * are stored.
+ *
+ * If a consumer appends a scrobble that is equal to the last record appended by another consumer
+ * (e.g. the same track is scrobbled to two services) and that record is not written yet then
+ * the record is amended to be pending for both of them instead of storing the scrobble twice.
+ * Appends to a shared journal are delayed for a while to let this happen.
+ *
+ * The scrobble records of the older versions of the journal format are pending for the consumer
+ * that loads the journal since such a journal has been written for a single consumer.
+ *
+ * The data file is compacted by the journal writer while the journal is used as if the data file
+ * were not re-written; the offsets held by the consumers are moved once the compaction is finished.
+ *
+ * A data file that is not a journal (i.e. written by an older version of the plugin) is treated
+ * as an empty journal; it is replaced once the first records are appended or the last consumer
+ * is detached. The consumer is expected to convert its contents before that.
+ *
+ * All the functions except for the constructor, the destructor, lock() and flush() must be invoked
+ * within lock(). The journal never invokes its consumers so it can be locked while the lock of
+ * a consumer is held.
+ */
+class SharedJournal
+{
+	SharedJournal(const SharedJournal &) = delete;
+	SharedJournal(SharedJournal &&) = delete;
+	SharedJournal &operator=(const SharedJournal &) = delete;
+	SharedJournal &operator=(SharedJournal &&) = delete;
+public:
+	/* The leading spilled records of a consumer. They are read while the journal is unlocked
+	 * so the generation is used to detect that the data file is re-written in the meantime.
+	 */
+	struct SpillRange
+	{
+		std::uint64_t generation;
+		std::uint64_t begin;
+		std::uint64_t end;
+	};
+
+	/* @param appendDelay the time for which appends are delayed before they are written
+	 *         (see JournalWriter). It is zero by default.
+	 */
+	explicit SharedJournal(const afc::String &dataFilePath,
+			std::chrono::milliseconds appendDelay = std::chrono::milliseconds(0));
+
+	~SharedJournal();
+
+	const afc::String &dataFilePath() const noexcept { return m_dataFilePath; }
+
+	std::unique_lock<std::mutex> lock() { return std::unique_lock<std::mutex>(m_mutex); }
+
+	// The number of holders of this journal. It is used to share the journal across plugins.
+	void acquire() noexcept { ++m_refCount; }
+	// Returns true if the last holder has released this journal.
+	bool release() noexcept { assert(m_refCount != 0); return --m_refCount == 0; }
+
+	/* Attaches a given consumer to this journal. The data file is loaded when the first consumer
+	 * is attached. All the pending records of the consumer are spilled ones once it is attached.
+	 *
+	 * @return true if the consumer is attached; false if the data file cannot be loaded.
+	 */
+	bool attach(unsigned consumer);
+
+	/* Detaches a given consumer from this journal. The cursors are stored or the data file
+	 * is compacted if needed. The data file is closed when the last consumer is detached.
+	 *
+	 * If deferCompaction is true then the data file is compacted only if the cursors cannot
+	 * represent the state of the consumer (e.g. some records are completed out of order).
+	 * The dead records are left to the next compaction then.
+	 *
+	 * @return true if all the records are written; false otherwise.
+	 */
+	bool detach(unsigned consumer, bool deferCompaction = false);
+
+	/* Appends the records of given scrobbles of a consumer. They become stored pending scrobbles
+	 * of the consumer unless spill is true in which case they become its spilled scrobbles.
+	 *
+	 * The lock is released while the records of a large number of scrobbles are encoded so that
+	 * the other consumers are not blocked meanwhile. The state of the consumer is not changed
+	 * by the other consumers so the consumer must not append scrobbles from several threads at once.
+	 */
+	template<typename Iterator>
+	void append(unsigned consumer, Iterator begin, Iterator end, bool sync, bool spill);
+
+	// Returns the number of leading pending scrobbles of a given consumer that are stored.
+	std::size_t storedCount(const unsigned consumer) const noexcept
+	{
+		assert(consumer < journalConsumerCount);
+		return m_consumers[consumer].recordEnds.size();
+	}
+
+	bool hasSpill(const unsigned consumer) const noexcept
+	{
+		assert(consumer < journalConsumerCount);
+		return m_consumers[consumer].spillBegin != 0;
+	}
+
+	// Moves the cursor of a given consumer past a given number of its leading stored scrobbles.
+	void acknowledge(unsigned consumer, std::size_t count);
+
+	/* Acknowledges the stored scrobble of a given consumer at a given position. The cursor
+	 * cannot acknowledge a record in the middle so the record is left out when the data file
+	 * is compacted; it is compacted when the consumer is detached at the latest.
+	 */
+	void acknowledgeAt(unsigned consumer, std::size_t index);
+
+	/* Starts compacting the data file if it is worth it; stores the cursors otherwise.
+	 * The data file is compacted in the background.
+	 */
+	void checkpoint();
+
+	/* Checks if some records have failed to be written. If so then the data file is repaired
+	 * in the background: once it is, the stored scrobbles whose records are lost become not stored
+	 * so that the consumers could append them once again. The offsets are moved if the compaction
+	 * in progress is finished.
+	 */
+	void poll();
+
+	/* Blocks until all the records are written and then does the same as poll() except that
+	 * the data file is repaired before it returns.
+	 *
+	 * @return true if all the records are written; false otherwise.
+	 */
+	bool sync();
+
+	// Returns false if a given consumer has no spilled scrobbles.
+	bool spillRange(unsigned consumer, SpillRange &dest);
+
+	/* Returns false if the data file is re-written since a given range is obtained or is being
+	 * re-written, in which case the records are to be read once again.
+	 */
+	bool isCurrent(const SpillRange &range) const noexcept
+	{
+		return range.generation == m_generation && m_compaction == nullptr;
+	}
+
+	/* Accepts the spilled records of a given consumer that are read from range.begin to readEnd.
+	 * The ends of the records of the scrobbles loaded are given in order. The range must be current.
+	 */
+	void loadSpill(unsigned consumer, const SpillRange &range, std::uint64_t readEnd,
+			const std::deque<std::uint64_t> &recordEnds);
+
+	/* Marks the malformed record that starts at a given offset as quarantined.
+	 *
+	 * @return false if the record is already quarantined (e.g. by another consumer).
+	 */
+	bool markQuarantined(std::uint64_t offset);
+
+	// Appends malformed records to the quarantine file.
+	bool storeQuarantine(const afc::FastStringBuffer<char> &records) const;
+
+	// The strings that are referred to by the records of the journal.
+	const StringDictionary &dictionary() const noexcept { return m_dictionary; }
+
+	// Blocks until all the records are written. It does not need the lock.
+	void flush() { m_writer.flush(); }
+private:
+	/* Large appends are encoded outside the lock by up to this number of threads, each of them
+	 * encoding this number of records at least.
+	 */
+	static constexpr std::size_t maxEncoderCount = 8;
+	static constexpr std::size_t minEncoderChunkSize = 4096;
+
+	class Compaction;
+
+	struct Consumer
+	{
+		Consumer() : recordEnds(), completed(), cursor(0), checkpoint(0), spillBegin(0), pending(false) {}
+
+		std::deque<std::uint64_t> recordEnds;
+		// The ends of the records that are acknowledged out of order.
+		std::vector<std::uint64_t> completed;
+		// Zero if unknown, i.e. none of the records of the consumer are acknowledged.
+		std::uint64_t cursor;
+		// The cursor that is stored in the data file or the cursor file.
+		std::uint64_t checkpoint;
+		// Zero if there are no spilled scrobbles.
+		std::uint64_t spillBegin;
+		/* Indicates if there are records after the cursor that are pending for the consumer.
+		 * It is used while the consumer is detached.
+		 */
+		bool pending;
+	};
+
+	// The last scrobble record appended. It can be amended until it is written.
+	struct LastRecord
+	{
+		LastRecord() : record(), offset(0), consumers(0) {}
+
+		afc::FastStringBuffer<char> record;
+		std::uint64_t offset;
+		// Zero if there is no record to amend.
+		unsigned consumers;
+	};
+
+	bool open(unsigned consumer);
+	void close();
+	void startJournal(afc::FastStringBuffer<char> &dest);
+	// Returns the number of threads to encode a given number of records by; 1 if they are not worth splitting.
+	std::size_t encoderCount(std::size_t recordCount) const noexcept;
+	template<typename Iterator>
+	bool appendUnlocked(unsigned consumer, Iterator begin, Iterator end, std::size_t recordCount, bool sync,
+			bool spill);
+	void appendChunks(unsigned consumer, std::vector<afc::FastStringBuffer<char>> &&chunks, bool sync, bool spill);
+	bool amendLastRecord(const char *record, std::size_t size, unsigned consumer);
+	void rememberLastRecord(const afc::FastStringBuffer<char> &records, std::size_t recordStart,
+			std::uint64_t offset, unsigned consumer);
+	bool needsCompaction() const noexcept;
+	void compact();
+	void startCompaction();
+	void awaitCompaction();
+	// Moves the offsets if the compaction in progress is finished; starts the repair that is requested.
+	void pollCompaction();
+	void finishCompaction();
+	void storeCursors();
+	// Returns the mask of the consumers a given valid scrobble record is pending for.
+	unsigned recordConsumers(JournalRecordType type, const char *payloadBegin, const char *payloadEnd) const noexcept
+	{
+		return type == JournalRecordType::sharedScrobble ?
+				journalRecordConsumers(type, payloadBegin, payloadEnd) : m_legacyConsumers;
+	}
+
+	mutable std::mutex m_mutex;
+	const afc::String m_dataFilePath;
+	const std::chrono::milliseconds m_appendDelay;
+	// Performs all writes to the data file, compaction included, so that no file I/O is done within the lock.
+	JournalWriter m_writer;
+	// Encodes the records of large appends.
+	WorkerPool m_encoders;
+	std::size_t m_refCount;
+	// The bit mask of the consumers attached.
+	unsigned m_attached;
+	Consumer m_consumers[journalConsumerCount];
+	StringDictionary m_dictionary;
+	std::uint64_t m_fileId;
+	// Zero if there is no data file.
+	std::uint64_t m_size;
+	// The end of the header and the string and cursors records that follow it.
+	std::uint64_t m_preambleEnd;
+	// The size of the data file after it is loaded or compacted.
+	std::uint64_t m_compactedSize;
+	/* The records from m_preambleEnd to m_liveBase are kept by the last compaction. The ones after it
+	 * are considered dead once all the consumers attached pass them.
+	 */
+	std::uint64_t m_liveBase;
+	// Changed each time the data file is re-written.
+	std::uint64_t m_generation;
+	// The compaction in progress, if any.
+	std::unique_ptr<Compaction> m_compaction;
+	// Indicates if the data file is to be repaired once the compaction in progress is finished.
+	bool m_repairNeeded;
+	LastRecord m_lastRecord;
+	std::vector<std::uint64_t> m_quarantined;
+	// The consumers the scrobble records of the older versions of the journal format are pending for.
+	unsigned m_legacyConsumers;
+	// Indicates if the data file is not a journal.
+	bool m_foreign;
+};
+
+template<typename Iterator>
+void SharedJournal::append(const unsigned consumer, Iterator begin, const Iterator end, const bool sync,
+		const bool spill)
+{
+	static_assert(std::is_convertible<decltype(*begin), const ScrobbleInfo &>::value,
+			"An iterator over ScrobbleInfo objects is expected.");
+	assert(consumer < journalConsumerCount);
+	assert((m_attached & (1u << consumer)) != 0);
+
+	if (begin == end) {
+		return;
+	}
+
+	pollCompaction();
+
+	Consumer &state = m_consumers[consumer];
+	const bool single = std::next(begin) == end;
+
+	if (!single && !m_foreign) {
+		// A large number of records (e.g. the ones stored when a consumer is detached) is encoded outside the lock.
+		const std::size_t recordCount = std::distance(begin, end);
+		if (recordCount >= 2 * minEncoderChunkSize && appendUnlocked(consumer, begin, end, recordCount, sync, spill)) {
+			return;
+		}
+	}
+
+	const std::uint64_t offset = m_size;
+	afc::FastStringBuffer<char> records;
+	if (offset == 0) {
+		startJournal(records);
+	}
+
+	std::size_t lastStart = 0;
+	for (auto it = begin; it != end; ++it) {
+		const std::size_t start = records.size();
+		appendJournalRecord(*it, 1u << consumer, m_dictionary, records);
+
+		if (single && amendLastRecord(records.data() + start, records.size() - start, consumer)) {
+			// The scrobble is stored by the last record which is not written yet.
+			if (spill) {
+				if (state.spillBegin == 0) {
+					state.spillBegin = m_lastRecord.offset;
+				}
+			} else {
+				state.recordEnds.push_back(m_lastRecord.offset + m_lastRecord.record.size());
+			}
+			return;
+		}
+
+		lastStart = start;
+		if (spill) {
+			if (state.spillBegin == 0) {
+				state.spillBegin = offset + start;
+			}
+		} else {
+			state.recordEnds.push_back(offset + records.size());
+		}
+	}
+
+	rememberLastRecord(records, lastStart, offset, consumer);
+	m_size = offset + records.size();
+	if (m_foreign) {
+		// The data file that is not a journal is replaced with the new journal.
+		m_foreign = false;
+		m_writer.rewrite(std::move(records));
+	} else {
+		m_writer.append(std::move(records), offset, sync);
+	}
+}
+
+/* Appends the records of a large number of scrobbles in three steps. First, the strings of the scrobbles
+ * are added to the dictionary and their records are submitted to be written within the lock so that
+ * the records of the other consumers can refer to them. Then the scrobble records are encoded by
+ * m_encoders while the lock is released, given the identifiers of their strings. At last, the scrobble
+ * records are appended within the lock.
+ *
+ * @return false if a compaction is finished while the lock is released, in which case the identifiers
+ *         can be outdated and nothing but the string records is appended.
+ */
+template<typename Iterator>
+bool SharedJournal::appendUnlocked(const unsigned consumer, const Iterator begin, const Iterator end,
+		const std::size_t recordCount, const bool sync, const bool spill)
+{
+	afc::FastStringBuffer<char> strings;
+	if (m_size == 0) {
+		startJournal(strings);
+	}
+	std::vector<JournalStringIds> ids;
+	ids.reserve(recordCount);
+	for (auto it = begin; it != end; ++it) {
+		ids.push_back(appendJournalStrings(*it, m_dictionary, strings));
+	}
+	if (strings.size() != 0) {
+		const std::uint64_t offset = m_size;
+		m_size += strings.size();
+		m_writer.append(std::move(strings), offset, false);
+	}
+	const std::uint64_t generation = m_generation;
+
+	// The first chunk is left empty since the string records are appended already.
+	const std::size_t encoders = encoderCount(recordCount);
+	std::vector<afc::FastStringBuffer<char>> chunks(encoders + 1);
+	const unsigned consumers = 1u << consumer;
+	{ afc::UnlockGuard unlockGuard(m_mutex);
+		m_encoders.run(encoders, [begin, recordCount, encoders, consumers, &ids, &chunks](const std::size_t i)
+		{
+			const std::size_t chunkBegin = recordCount * i / encoders;
+			const std::size_t chunkEnd = recordCount * (i + 1) / encoders;
+			afc::FastStringBuffer<char> &dest = chunks[i + 1];
+			auto it = std::next(begin, chunkBegin);
+			for (std::size_t j = chunkBegin; j < chunkEnd; ++j, ++it) {
+				appendJournalScrobble(*it, consumers, ids[j], dest);
+			}
+		});
+	}
+
+	if (m_generation != generation) {
+		return false;
+	}
+	appendChunks(consumer, std::move(chunks), sync, spill);
+	return true;
+}
+
+#endif /* SHAREDJOURNAL_HPP_ */
@@ -0,0 +1,83 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "StringDictionary.hpp"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+std::uint32_t StringDictionary::add(const char * const begin, const char * const end, bool &isNew)
+{
+	assert(begin != end);
+
+	const std::string_view value(begin, end - begin);
+	const auto it = m_ids.find(value);
+	if (it != m_ids.end()) {
+		isNew = false;
+		return it->second;
+	}
+
+	const std::uint32_t id = m_nextId++;
+	const std::string &stored = m_strings.emplace(id, std::string(begin, end)).first->second;
+	m_ids.emplace(std::string_view(stored), id);
+	isNew = true;
+	return id;
+}
+
+bool StringDictionary::define(const std::uint32_t id, const char * const begin, const char * const end)
+{
+	// The greatest identifier is not accepted so that there is always an identifier for a new string.
+	if (id == emptyStringId || id == std::numeric_limits<std::uint32_t>::max()) {
+		return false;
+	}
+
+	const std::string_view value(begin, end - begin);
+	const auto it = m_strings.find(id);
+	if (it != m_strings.end()) {
+		return std::string_view(it->second) == value;
+	}
+
+	const std::string &stored = m_strings.emplace(id, std::string(begin, end)).first->second;
+	// If the same string is defined with several identifiers then the first one is used for new scrobbles.
+	m_ids.emplace(std::string_view(stored), id);
+	m_nextId = std::max(m_nextId, id + 1);
+	return true;
+}
+
+bool StringDictionary::lookup(const std::uint32_t id, const char *&begin, const char *&end) const noexcept
+{
+	const auto it = m_strings.find(id);
+	if (it == m_strings.end()) {
+		return false;
+	}
+	begin = it->second.data();
+	end = begin + it->second.size();
+	return true;
+}
+
+std::uint32_t StringDictionary::find(const char * const begin, const char * const end) const noexcept
+{
+	assert(begin != end);
+
+	const auto it = m_ids.find(std::string_view(begin, end - begin));
+	return it == m_ids.end() ? emptyStringId : it->second;
+}
+
+void StringDictionary::clear() noexcept
+{
+	m_ids.clear();
+	m_strings.clear();
+	m_nextId = emptyStringId + 1;
+}
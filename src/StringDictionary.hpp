@@ -0,0 +1,86 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef STRINGDICTIONARY_HPP_
+#define STRINGDICTIONARY_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/* Maps strings that are repeated across scrobbles (e.g. artists and album titles) to
+ * numeric identifiers so that each string is stored in the data file once.
+ *
+ * The identifier 0 stands for the empty string which is never added to the dictionary.
+ */
+class StringDictionary
+{
+public:
+	static constexpr std::uint32_t emptyStringId = 0;
+
+	StringDictionary() : m_strings(), m_ids(), m_nextId(emptyStringId + 1) {}
+
+	StringDictionary(const StringDictionary &) = delete;
+	StringDictionary(StringDictionary &&) = default;
+	StringDictionary &operator=(const StringDictionary &) = delete;
+	StringDictionary &operator=(StringDictionary &&) = default;
+
+	/* Returns the identifier of a given string. If the string is not in this dictionary yet
+	 * then it is added and isNew is assigned to true.
+	 */
+	std::uint32_t add(const char *begin, const char *end, bool &isNew);
+
+	/* Adds a string with a given identifier, as it is read from the data file. Re-defining
+	 * a string with the same value is allowed.
+	 *
+	 * @return false if the identifier is reserved or it is defined with a different value;
+	 *         true otherwise.
+	 */
+	bool define(std::uint32_t id, const char *begin, const char *end);
+
+	/* Assigns the string with a given identifier to begin and end.
+	 *
+	 * @return false if the identifier is not defined; true otherwise.
+	 */
+	bool lookup(std::uint32_t id, const char *&begin, const char *&end) const noexcept;
+
+	/* Returns the identifier of a given non-empty string; emptyStringId if it is not in this dictionary.
+	 * Unlike add(), it can be invoked concurrently.
+	 */
+	std::uint32_t find(const char *begin, const char *end) const noexcept;
+
+	// Invokes f(id, begin, end) for each string in this dictionary, in no particular order.
+	template<typename Function>
+	void forEach(Function f) const
+	{
+		for (const auto &entry : m_strings) {
+			f(entry.first, entry.second.data(), entry.second.data() + entry.second.size());
+		}
+	}
+
+	std::size_t size() const noexcept { return m_strings.size(); }
+	void clear() noexcept;
+private:
+	/* Node-based containers are used so that the keys of m_ids can refer to the values of
+	 * m_strings: they are not relocated when the containers grow.
+	 */
+	std::unordered_map<std::uint32_t, std::string> m_strings;
+	std::unordered_map<std::string_view, std::uint32_t> m_ids;
+	std::uint32_t m_nextId;
+};
+
+#endif /* STRINGDICTIONARY_HPP_ */
@@ -0,0 +1,97 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "WorkerPool.hpp"
+#include <cassert>
+
+WorkerPool::WorkerPool(const std::size_t threadCount)
+	: m_threadCount(threadCount), m_jobMutex(), m_mutex(), m_cv(), m_doneCv(), m_threads(), m_invoke(nullptr),
+	  m_part(nullptr), m_partCount(0), m_nextPart(0), m_donePartCount(0), m_stopFlag(false) {}
+
+WorkerPool::~WorkerPool()
+{
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopFlag = true;
+		m_cv.notify_all();
+	}
+	for (std::thread &thread : m_threads) {
+		thread.join();
+	}
+}
+
+void WorkerPool::run(const std::size_t partCount, void (* const invoke)(void *, std::size_t), void * const part)
+{
+	std::unique_lock<std::mutex> jobLock(m_jobMutex, std::try_to_lock);
+	if (!jobLock.owns_lock() || m_threadCount == 0 || partCount < 2) {
+		// Another job is in progress, or there is nothing to share.
+		for (std::size_t i = 0; i < partCount; ++i) {
+			invoke(part, i);
+		}
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_threads.empty()) {
+		m_threads.reserve(m_threadCount);
+		for (std::size_t i = 0; i < m_threadCount; ++i) {
+			m_threads.emplace_back([this]() { work(); });
+		}
+	}
+
+	m_invoke = invoke;
+	m_part = part;
+	m_partCount = partCount;
+	m_nextPart = 0;
+	m_donePartCount = 0;
+	m_cv.notify_all();
+
+	runParts(lock);
+	m_doneCv.wait(lock, [this]() { return m_donePartCount == m_partCount; });
+
+	// The threads of this pool wait for the next job.
+	m_partCount = m_nextPart = m_donePartCount = 0;
+	m_invoke = nullptr;
+	m_part = nullptr;
+}
+
+void WorkerPool::runParts(std::unique_lock<std::mutex> &lock)
+{
+	assert(lock.owns_lock());
+
+	while (m_nextPart < m_partCount) {
+		const std::size_t i = m_nextPart++;
+		void (* const invoke)(void *, std::size_t) = m_invoke;
+		void * const part = m_part;
+
+		lock.unlock();
+		invoke(part, i);
+		lock.lock();
+
+		if (++m_donePartCount == m_partCount) {
+			m_doneCv.notify_all();
+		}
+	}
+}
+
+void WorkerPool::work()
+{ std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		m_cv.wait(lock, [this]() { return m_stopFlag || m_nextPart < m_partCount; });
+		if (m_stopFlag) {
+			return;
+		}
+		runParts(lock);
+	}
+}
@@ -0,0 +1,78 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef WORKERPOOL_HPP_
+#define WORKERPOOL_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A fixed set of threads that run the parts of a job along with the thread that submits the job
+ * so that CPU-bound work (e.g. encoding a large number of journal records) is spread across cores
+ * without starting threads for each job. The threads are started when the first job is run.
+ *
+ * A single job is run at a time. A job that is submitted while another one is in progress
+ * is run by the submitting thread alone rather than waiting for it.
+ */
+class WorkerPool
+{
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool(WorkerPool &&) = delete;
+	WorkerPool &operator=(const WorkerPool &) = delete;
+	WorkerPool &operator=(WorkerPool &&) = delete;
+public:
+	explicit WorkerPool(std::size_t threadCount);
+	~WorkerPool();
+
+	// The number of threads of this pool, not counting the threads that submit jobs.
+	std::size_t threadCount() const noexcept { return m_threadCount; }
+
+	/* Invokes part(i) for each i from zero to partCount - 1 and returns once all of them return.
+	 * The parts are run concurrently by the threads of this pool and the calling thread.
+	 */
+	template<typename Part>
+	void run(const std::size_t partCount, Part part)
+	{
+		run(partCount, [](void * const p, const std::size_t i) { (*static_cast<Part *>(p))(i); }, &part);
+	}
+private:
+	void run(std::size_t partCount, void (*invoke)(void *, std::size_t), void *part);
+	// Runs the parts of the current job that are not taken yet. It is executed within lock on m_mutex.
+	void runParts(std::unique_lock<std::mutex> &lock);
+	// The body of each thread of this pool.
+	void work();
+
+	const std::size_t m_threadCount;
+	// Held by the thread that submits a job while the job is in progress.
+	std::mutex m_jobMutex;
+	std::mutex m_mutex;
+	// Notified when a job is submitted or this pool is being destroyed.
+	std::condition_variable m_cv;
+	// Notified when the last part of the job is done.
+	std::condition_variable m_doneCv;
+	std::vector<std::thread> m_threads;
+	void (*m_invoke)(void *, std::size_t);
+	void *m_part;
+	std::size_t m_partCount;
+	// The index of the next part to run.
+	std::size_t m_nextPart;
+	std::size_t m_donePartCount;
+	bool m_stopFlag;
+};
+
+#endif /* WORKERPOOL_HPP_ */
@@ -23,6 +23,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 #include <cstring>
 #include <utility>
 
+#include <afc/FastStringBuffer.hpp>
 #include <afc/logger.hpp>
 #include <afc/StringRef.hpp>
 #include <afc/utils.h>
@@ -263,4 +264,72 @@ private:
 	afc::FastStringBuffer<char> &m_dest;
 };
 
+/* Produces a request body that consists of pieces (e.g. the scrobbles of a batch) which are
+ * encoded one at a time as the request is sent. Only the piece being sent is kept in memory,
+ * so the memory used does not depend on the number of the pieces. The size of the body is
+ * measured by encoding the pieces once more before the body is sent.
+ */
+class PieceBodyProducer : public HttpRequest::BodyProducer
+{
+	PieceBodyProducer(const PieceBodyProducer &) = delete;
+	PieceBodyProducer(PieceBodyProducer &&) = delete;
+	PieceBodyProducer &operator=(const PieceBodyProducer &) = delete;
+	PieceBodyProducer &operator=(PieceBodyProducer &&) = delete;
+public:
+	PieceBodyProducer() : m_piece(), m_offset(0), m_nextPiece(0) {}
+
+	std::size_t operator()(char * const dest, const std::size_t n) override
+	{
+		std::size_t written = 0;
+		while (written < n) {
+			if (m_offset == m_piece.size()) {
+				m_piece.clear();
+				m_offset = 0;
+				if (!encodePiece(m_nextPiece, m_piece)) {
+					break;
+				}
+				++m_nextPiece;
+				continue;
+			}
+			const std::size_t count = std::min(n - written, m_piece.size() - m_offset);
+			std::memcpy(dest + written, m_piece.data() + m_offset, count);
+			m_offset += count;
+			written += count;
+		}
+		return written;
+	}
+
+	std::size_t size() override
+	{
+		std::size_t result = 0;
+		for (std::size_t i = 0;; ++i) {
+			m_piece.clear();
+			if (!encodePiece(i, m_piece)) {
+				break;
+			}
+			result += m_piece.size();
+		}
+		rewind();
+		return result;
+	}
+
+	bool rewind() override
+	{
+		m_piece.clear();
+		m_offset = 0;
+		m_nextPiece = 0;
+		return true;
+	}
+protected:
+	/* Appends the piece with a given index to dest. The pieces are encoded in order, starting
+	 * with the first one each time the body is rewound. Returns false if there is no such piece.
+	 */
+	virtual bool encodePiece(std::size_t index, afc::FastStringBuffer<char> &dest) = 0;
+private:
+	afc::FastStringBuffer<char> m_piece;
+	// The number of the octets of the current piece that are produced.
+	std::size_t m_offset;
+	std::size_t m_nextPiece;
+};
+
 #endif /* DEADBEEF_UTIL_HPP_ */
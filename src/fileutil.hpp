@@ -0,0 +1,207 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef FILEUTIL_HPP_
+#define FILEUTIL_HPP_
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include <afc/FastStringBuffer.hpp>
+#include <afc/StringRef.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// A read-only memory mapping of a whole regular file.
+class MappedFile
+{
+	MappedFile(const MappedFile &) = delete;
+	MappedFile(MappedFile &&) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+	MappedFile &operator=(MappedFile &&) = delete;
+public:
+	enum MapResult {M_ERROR, M_MAPPED, M_NOTEXIST};
+
+	MappedFile() noexcept : m_data(nullptr), m_size(0) {}
+
+	~MappedFile() noexcept { unmap(); }
+
+	/* Maps the file the path points to. An empty file is mapped successfully
+	 * to an empty sequence.
+	 *
+	 * @return M_MAPPED if the file is mapped; M_NOTEXIST if the file does not exist;
+	 *         M_ERROR if the file is not a regular file or cannot be mapped.
+	 */
+	MapResult map(const char * const path) noexcept
+	{
+		unmap();
+
+		const int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd == -1) {
+			return errno == ENOENT || errno == ENOTDIR ? M_NOTEXIST : M_ERROR;
+		}
+
+		MapResult result = M_MAPPED;
+		struct stat fileStatus;
+		if (fstat(fd, &fileStatus) != 0 || !S_ISREG(fileStatus.st_mode)) {
+			result = M_ERROR;
+		} else if (fileStatus.st_size > 0) {
+			void * const data = mmap(nullptr, fileStatus.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data == MAP_FAILED) {
+				result = M_ERROR;
+			} else {
+				m_data = static_cast<const char *>(data);
+				m_size = fileStatus.st_size;
+				// The file is expected to be read from the beginning to the end.
+				madvise(data, m_size, MADV_SEQUENTIAL);
+			}
+		}
+
+		// The mapping stays valid after the file descriptor is closed.
+		if (close(fd) != 0) {
+			unmap();
+			result = M_ERROR;
+		}
+		return result;
+	}
+
+	void unmap() noexcept
+	{
+		if (m_data != nullptr) {
+			munmap(const_cast<char *>(m_data), m_size);
+			m_data = nullptr;
+			m_size = 0;
+		}
+	}
+
+	const char *begin() const noexcept { return m_data; }
+	const char *end() const noexcept { return m_data + m_size; }
+	std::size_t size() const noexcept { return m_size; }
+private:
+	const char *m_data;
+	std::size_t m_size;
+};
+
+// The last path element is considered as a file and therefore is not created.
+inline bool createParentDirs(const char * const path, const std::size_t pathSize)
+{
+	if (pathSize == 0) {
+		return true;
+	}
+
+	const char *start = path;
+	afc::FastStringBuffer<char> pathElementBuf(pathSize);
+	if (*path == '/') {
+		++start;
+		pathElementBuf.append('/');
+	}
+
+	for (;;) {
+		const char * const end = std::strchr(start, '/');
+		if (end == nullptr) {
+			return true;
+		}
+		pathElementBuf.append(start, end);
+		if (mkdir(pathElementBuf.c_str(), 0775) != 0 && errno != EEXIST) {
+			return false;
+		}
+		start = end + 1;
+		pathElementBuf.append('/');
+	}
+}
+
+// Returns the path of a file that resides next to a given one and has a given suffix.
+inline afc::FastStringBuffer<char, afc::AllocMode::accurate> siblingPath(const char * const path,
+		const std::size_t pathSize, const afc::ConstStringRef suffix)
+{
+	afc::FastStringBuffer<char, afc::AllocMode::accurate> result(pathSize + suffix.size());
+	result.append(path, pathSize);
+	result.append(suffix);
+	return result;
+}
+
+/* Writes all the buffers given to a file descriptor, retrying partial writes.
+ * The buffer descriptors are modified.
+ *
+ * @return true if all the data is written; false otherwise.
+ */
+inline bool writeFully(const int fd, struct iovec *iov, int iovCount) noexcept
+{
+	while (iovCount > 0) {
+		const ssize_t written = writev(fd, iov, iovCount);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		std::size_t rest = written;
+		while (iovCount > 0 && rest >= iov->iov_len) {
+			rest -= iov->iov_len;
+			++iov;
+			--iovCount;
+		}
+		if (iovCount > 0) {
+			iov->iov_base = static_cast<char *>(iov->iov_base) + rest;
+			iov->iov_len -= rest;
+		}
+	}
+	return true;
+}
+
+inline bool writeFully(const int fd, const char * const data, const std::size_t size) noexcept
+{
+	struct iovec iov = {const_cast<char *>(data), size};
+	return writeFully(fd, &iov, 1);
+}
+
+/* Forces the directory that contains a given file to be written to the storage device
+ * so that the file that is created or renamed survives an emergency.
+ *
+ * @return true if the directory is written; false otherwise.
+ */
+inline bool syncParentDir(const char * const path, const std::size_t pathSize)
+{
+	afc::FastStringBuffer<char, afc::AllocMode::accurate> dirPath(pathSize + 1);
+	const char *lastSlash = path + pathSize;
+	while (lastSlash != path && *(lastSlash - 1) != '/') {
+		--lastSlash;
+	}
+	if (lastSlash == path) {
+		// The path contains no directory.
+		dirPath.append('.');
+	} else if (--lastSlash == path) {
+		// The file resides in the root directory.
+		dirPath.append('/');
+	} else {
+		dirPath.append(path, lastSlash);
+	}
+
+	const int fd = open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1) {
+		return false;
+	}
+	bool result = fsync(fd) == 0;
+	if (close(fd) != 0) {
+		result = false;
+	}
+	return result;
+}
+
+#endif /* FILEUTIL_HPP_ */
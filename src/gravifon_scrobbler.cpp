@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 #include "pathutil.hpp"
 #include "ScrobbleInfo.hpp"
 #include "Scrobbler.hpp"
+#include "scrobbler_plugin.hpp"
 
 using namespace std;
 
@@ -40,12 +41,81 @@ namespace
 	static GravifonScrobbler gravifonClient;
 
 	// These variables must be accessed within the critical section against pluginMutex.
-	static DB_misc_t plugin = {};
+	static ScrobblerPlugin plugin = {};
 	static DB_functions_t *deadbeef;
 	static double scrobbleThreshold = 0.d;
 
 	static mutex pluginMutex;
 
+	/* The settings applied to the client last; -1 if none is applied yet. They are applied on each
+	 * message, so the client is not locked (nor woken up) unless they are changed.
+	 */
+	static int appliedResidentScrobbleLimit = -1;
+	static int appliedMaxRequestsInFlight = -1;
+	static int appliedNetworkMonitoring = -1;
+
+	// Applies the max number of pending scrobbles that are kept in memory.
+	inline void applyResidentScrobbleLimit()
+	{
+		int limit = deadbeef->conf_get_int("gravifonScrobbler.residentScrobbleLimit", 1000);
+		limit = limit > 0 ? limit : 0;
+		if (limit != appliedResidentScrobbleLimit) {
+			gravifonClient.setResidentScrobbleLimit(limit);
+			appliedResidentScrobbleLimit = limit;
+		}
+	}
+
+	// Applies the max number of requests to Gravifon that are in flight at once.
+	inline void applyMaxRequestsInFlight()
+	{
+		int count = deadbeef->conf_get_int("gravifonScrobbler.maxRequestsInFlight", 1);
+		count = count > 0 ? count : 1;
+		if (count != appliedMaxRequestsInFlight) {
+			gravifonClient.setMaxBatchesInFlight(count);
+			appliedMaxRequestsInFlight = count;
+		}
+	}
+
+	// Applies whether pending scrobbles are re-submitted at once when the network comes back.
+	inline void applyNetworkMonitoring()
+	{
+		const int enabled = deadbeef->conf_get_int("gravifonScrobbler.monitorNetwork", 0) != 0;
+		if (enabled != appliedNetworkMonitoring) {
+			gravifonClient.setNetworkMonitoring(enabled);
+			appliedNetworkMonitoring = enabled;
+		}
+	}
+
+	/* Starts the client with the journal and the reactor shared with the peer scrobbler plugin.
+	 * They are held only while the client is started, so a disabled plugin holds no threads.
+	 * DeaDBeeF starts and stops plugins and delivers messages to them in its main thread one by one,
+	 * so the peer plugin does not acquire or release them concurrently.
+	 */
+	inline bool startClient()
+	{
+		/* The journal is shared with the peer scrobbler plugin if it is loaded. The data file
+		 * is the one of the older versions of this plugin; its scrobbles are moved to the shared journal.
+		 */
+		gravifonClient.setJournal(acquireSharedJournal(*deadbeef, plugin, "lastfm_scrobbler"), gravifonJournalConsumer);
+		// The reactor thread is shared with the peer scrobbler plugin, too.
+		gravifonClient.setReactor(acquireReactor(*deadbeef, plugin, "lastfm_scrobbler"));
+		if (!gravifonClient.start()) {
+			releaseSharedJournal(plugin);
+			releaseReactor(plugin);
+			return false;
+		}
+		return true;
+	}
+
+	// Stops the client and releases the journal and the reactor acquired by startClient().
+	inline bool stopClient()
+	{
+		const bool stopped = gravifonClient.stop();
+		releaseSharedJournal(plugin);
+		releaseReactor(plugin);
+		return stopped;
+	}
+
 	/**
 	 * Starts (if needed) the Gravifon client and configures it according to the
 	 * Gravifon scrobbler plugin settings. If the settings are updated then the
@@ -54,29 +124,43 @@ namespace
 	 *
 	 * @param safeScrobbling assigned to true if failure-safe scrobbling is enabled;
 	 *         assigned to false otherwise.
+	 * @param syncScrobbling assigned to true if failure-safe scrobbles are to be synchronised
+	 *         with the storage device; assigned to false otherwise.
+	 * @param startStop if false then the client is neither started nor stopped; it is used by the threads
+	 *         other than the main one of DeaDBeeF (see startClient()).
 	 *
 	 * @return true if the Gravifon client is started and able to accept scrobbles;
 	 *         false is returned otherwise.
 	 */
-	inline bool initClient(bool &safeScrobbling)
+	inline bool initClient(bool &safeScrobbling, bool &syncScrobbling, const bool startStop = true)
 	{ ConfLock lock(*deadbeef);
+		// The limit is applied before the client is started since it affects loading of pending scrobbles.
+		applyResidentScrobbleLimit();
+		applyMaxRequestsInFlight();
+		applyNetworkMonitoring();
+
 		const bool enabled = deadbeef->conf_get_int("gravifonScrobbler.enabled", 0);
 		const bool clientStarted = gravifonClient.started();
-		if (!enabled) {
+		if (!startStop) {
+			if (!enabled || !clientStarted) {
+				return false;
+			}
+		} else if (!enabled) {
 			if (clientStarted) {
-				if (!gravifonClient.stop()) {
+				if (!stopClient()) {
 					logError("[gravifon_scrobbler] unable to stop Gravifon client."_s);
 				}
 			}
 			return false;
 		} else if (!clientStarted) {
-			if (!gravifonClient.start()) {
+			if (!startClient()) {
 				logError("[gravifon_scrobbler] unable to start Gravifon client."_s);
 				return false;
 			}
 		}
 
 		safeScrobbling = deadbeef->conf_get_int("gravifonScrobbler.safeScrobbling", 0);
+		syncScrobbling = deadbeef->conf_get_int("gravifonScrobbler.syncScrobbling", 0);
 
 		// DeaDBeeF configuration records are returned in UTF-8.
 		const char * const gravifonUrl = deadbeef->conf_get_str_fast(
@@ -138,7 +222,10 @@ namespace
 		gravifonClient.setDataFilePath(afc::String::move(dataFilePath));
 
 		const bool enabled = deadbeef->conf_get_int("gravifonScrobbler.enabled", 0);
-		if (enabled && !gravifonClient.start()) {
+		applyResidentScrobbleLimit();
+		applyMaxRequestsInFlight();
+		applyNetworkMonitoring();
+		if (enabled && !startClient()) {
 			return 1;
 		}
 
@@ -148,7 +235,18 @@ namespace
 	int gravifonScrobblerStop()
 	{
 		logDebug("[gravifon_scrobbler] Stopping...");
-		return gravifonClient.stop() ? 0 : 1;
+		return stopClient() ? 0 : 1;
+	}
+
+	void gravifonScrobblerScrobble(ScrobbleInfo * const begin, ScrobbleInfo * const end)
+	{ lock_guard<mutex> lock(pluginMutex);
+		bool safeScrobbling, syncScrobbling;
+
+		// It can be invoked by any thread so the client is left as the main thread has set it up.
+		if (!initClient(safeScrobbling, syncScrobbling, false)) {
+			return;
+		}
+		gravifonClient.scrobble(begin, end, safeScrobbling, syncScrobbling);
 	}
 
 	int gravifonScrobblerMessage(const uint32_t id, const uintptr_t ctx, const uint32_t p1, const uint32_t p2)
@@ -158,10 +256,10 @@ namespace
 		}
 
 		{ lock_guard<mutex> lock(pluginMutex);
-			bool safeScrobbling;
+			bool safeScrobbling, syncScrobbling;
 
 			// TODO distinguish disabled scrobbling and gravifon client init errors
-			if (!initClient(safeScrobbling)) {
+			if (!initClient(safeScrobbling, syncScrobbling)) {
 				return 0;
 			}
 
@@ -169,7 +267,7 @@ namespace
 			afc::Optional<ScrobbleInfo> scrobbleInfo = getScrobbleInfo(event, *deadbeef, scrobbleThreshold);
 
 			if (scrobbleInfo.hasValue()) {
-				gravifonClient.scrobble(std::move(scrobbleInfo.value()), safeScrobbling);
+				gravifonClient.scrobble(std::move(scrobbleInfo.value()), safeScrobbling, syncScrobbling);
 			}
 			return 0;
 		}
@@ -180,14 +278,15 @@ extern "C" DB_plugin_t *gravifon_scrobbler_load(DB_functions_t * const api)
 { lock_guard<mutex> lock(pluginMutex);
 	deadbeef = api;
 
-	plugin.plugin.api_vmajor = 1;
-	plugin.plugin.api_vminor = 4;
-	plugin.plugin.version_major = 1;
-	plugin.plugin.version_minor = 0;
-	plugin.plugin.type = DB_PLUGIN_MISC;
-	plugin.plugin.name = u8"gravifon scrobbler";
-	plugin.plugin.descr = u8"An audio track scrobbler to Gravifon.";
-	plugin.plugin.copyright =
+	plugin.misc.plugin.api_vmajor = 1;
+	plugin.misc.plugin.api_vminor = 4;
+	plugin.misc.plugin.version_major = 1;
+	plugin.misc.plugin.version_minor = 0;
+	plugin.misc.plugin.type = DB_PLUGIN_MISC;
+	plugin.misc.plugin.id = "gravifon_scrobbler";
+	plugin.misc.plugin.name = u8"gravifon scrobbler";
+	plugin.misc.plugin.descr = u8"An audio track scrobbler to Gravifon.";
+	plugin.misc.plugin.copyright =
 		u8"Copyright (C) 2013-2023 Dźmitry Laŭčuk\n"
 		"\n"
 		"This program is free software: you can redistribute it and/or modify\n"
@@ -204,11 +303,11 @@ extern "C" DB_plugin_t *gravifon_scrobbler_load(DB_functions_t * const api)
 		"along with this program.  If not, see <http://www.gnu.org/licenses/>."
 		"\n";
 
-	plugin.plugin.website =
+	plugin.misc.plugin.website =
 			u8"https://github.com/dzlia/deadbeef_scrobbler_plugins";
-	plugin.plugin.start = gravifonScrobblerStart;
-	plugin.plugin.stop = gravifonScrobblerStop;
-	plugin.plugin.configdialog =
+	plugin.misc.plugin.start = gravifonScrobblerStart;
+	plugin.misc.plugin.stop = gravifonScrobblerStop;
+	plugin.misc.plugin.configdialog =
 			u8"property \"Enable scrobbler\" "
 				u8"checkbox gravifonScrobbler.enabled 0;"
 			u8"property \"Username\" entry gravifonScrobbler.username \"\";"
@@ -219,9 +318,18 @@ extern "C" DB_plugin_t *gravifon_scrobbler_load(DB_functions_t * const api)
 			u8"property \"Scrobble threshold (%)\" "
 				u8"entry gravifonScrobbler.threshold \"0.0\";"
 			u8"property \"Failure-safe scrobbling\" "
-				u8"checkbox gravifonScrobbler.safeScrobbling 0;";
+				u8"checkbox gravifonScrobbler.safeScrobbling 0;"
+			u8"property \"Sync failure-safe scrobbles to disk\" "
+				u8"checkbox gravifonScrobbler.syncScrobbling 0;"
+			u8"property \"Max pending scrobbles kept in memory\" "
+				u8"entry gravifonScrobbler.residentScrobbleLimit \"1000\";"
+			u8"property \"Max requests in flight\" "
+				u8"entry gravifonScrobbler.maxRequestsInFlight \"1\";"
+			u8"property \"Retry at once when the network comes back\" "
+				u8"checkbox gravifonScrobbler.monitorNetwork 0;";
 
-	plugin.plugin.message = gravifonScrobblerMessage;
+	plugin.misc.plugin.message = gravifonScrobblerMessage;
+	plugin.scrobble = gravifonScrobblerScrobble;
 
 	return DB_PLUGIN(&plugin);
 }
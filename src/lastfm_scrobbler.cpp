@@ -29,6 +29,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 #include "Scrobbler.hpp"
 #include "LastfmScrobbler.hpp"
 #include "pathutil.hpp"
+#include "scrobbler_plugin.hpp"
 #include "deadbeef_util.hpp"
 
 using namespace std;
@@ -42,12 +43,69 @@ namespace
 	static LastfmScrobbler lastfmClient;
 
 	// These variables must be accessed within the critical section against pluginMutex.
-	static DB_misc_t plugin = {};
+	static ScrobblerPlugin plugin = {};
 	static DB_functions_t *deadbeef;
 	static double scrobbleThreshold = 0.d;
 
 	static mutex pluginMutex;
 
+	/* The settings applied to the client last; -1 if none is applied yet. They are applied on each
+	 * message, so the client is not locked (nor woken up) unless they are changed.
+	 */
+	static int appliedResidentScrobbleLimit = -1;
+	static int appliedNetworkMonitoring = -1;
+
+	// Applies the max number of pending scrobbles that are kept in memory.
+	inline void applyResidentScrobbleLimit()
+	{
+		int limit = deadbeef->conf_get_int("lastfmScrobbler.residentScrobbleLimit", 1000);
+		limit = limit > 0 ? limit : 0;
+		if (limit != appliedResidentScrobbleLimit) {
+			lastfmClient.setResidentScrobbleLimit(limit);
+			appliedResidentScrobbleLimit = limit;
+		}
+	}
+
+	// Applies whether pending scrobbles are re-submitted at once when the network comes back.
+	inline void applyNetworkMonitoring()
+	{
+		const int enabled = deadbeef->conf_get_int("lastfmScrobbler.monitorNetwork", 0) != 0;
+		if (enabled != appliedNetworkMonitoring) {
+			lastfmClient.setNetworkMonitoring(enabled);
+			appliedNetworkMonitoring = enabled;
+		}
+	}
+
+	/* Starts the client with the journal and the reactor shared with the peer scrobbler plugin.
+	 * They are held only while the client is started, so a disabled plugin holds no threads.
+	 * DeaDBeeF starts and stops plugins and delivers messages to them in its main thread one by one,
+	 * so the peer plugin does not acquire or release them concurrently.
+	 */
+	inline bool startClient()
+	{
+		/* The journal is shared with the peer scrobbler plugin if it is loaded. The data file
+		 * is the one of the older versions of this plugin; its scrobbles are moved to the shared journal.
+		 */
+		lastfmClient.setJournal(acquireSharedJournal(*deadbeef, plugin, "gravifon_scrobbler"), lastfmJournalConsumer);
+		// The reactor thread is shared with the peer scrobbler plugin, too.
+		lastfmClient.setReactor(acquireReactor(*deadbeef, plugin, "gravifon_scrobbler"));
+		if (!lastfmClient.start()) {
+			releaseSharedJournal(plugin);
+			releaseReactor(plugin);
+			return false;
+		}
+		return true;
+	}
+
+	// Stops the client and releases the journal and the reactor acquired by startClient().
+	inline bool stopClient()
+	{
+		const bool stopped = lastfmClient.stop();
+		releaseSharedJournal(plugin);
+		releaseReactor(plugin);
+		return stopped;
+	}
+
 	/**
 	 * Starts (if needed) the Lastfm client and configures it according to the
 	 * Lastfm scrobbler plugin settings. If the settings are updated then the
@@ -56,29 +114,42 @@ namespace
 	 *
 	 * @param safeScrobbling assigned to true if failure-safe scrobbling is enabled;
 	 *         assigned to false otherwise.
+	 * @param syncScrobbling assigned to true if failure-safe scrobbles are to be synchronised
+	 *         with the storage device; assigned to false otherwise.
+	 * @param startStop if false then the client is neither started nor stopped; it is used by the threads
+	 *         other than the main one of DeaDBeeF (see startClient()).
 	 *
 	 * @return true if the Lastfm client is started and able to accept scrobbles;
 	 *         false is returned otherwise.
 	 */
-	inline bool initClient(bool &safeScrobbling)
+	inline bool initClient(bool &safeScrobbling, bool &syncScrobbling, const bool startStop = true)
 	{ ConfLock lock(*deadbeef);
+		// The limit is applied before the client is started since it affects loading of pending scrobbles.
+		applyResidentScrobbleLimit();
+		applyNetworkMonitoring();
+
 		const bool enabled = deadbeef->conf_get_int("lastfmScrobbler.enabled", 0);
 		const bool clientStarted = lastfmClient.started();
-		if (!enabled) {
+		if (!startStop) {
+			if (!enabled || !clientStarted) {
+				return false;
+			}
+		} else if (!enabled) {
 			if (clientStarted) {
-				if (!lastfmClient.stop()) {
+				if (!stopClient()) {
 					logError("[lastfm_scrobbler] unable to stop Last.fm client."_s);
 				}
 			}
 			return false;
 		} else if (!clientStarted) {
-			if (!lastfmClient.start()) {
+			if (!startClient()) {
 				logError("[lastfm_scrobbler] unable to start Last.fm client."_s);
 				return false;
 			}
 		}
 
 		safeScrobbling = deadbeef->conf_get_int("lastfmScrobbler.safeScrobbling", 0);
+		syncScrobbling = deadbeef->conf_get_int("lastfmScrobbler.syncScrobbling", 0);
 
 		// DeaDBeeF configuration records are returned in UTF-8.
 		const char * const lastfmUrl = deadbeef->conf_get_str_fast(
@@ -125,7 +196,9 @@ namespace
 		lastfmClient.setDataFilePath(afc::String::move(dataFilePath));
 
 		const bool enabled = deadbeef->conf_get_int("lastfmScrobbler.enabled", 0);
-		if (enabled && !lastfmClient.start()) {
+		applyResidentScrobbleLimit();
+		applyNetworkMonitoring();
+		if (enabled && !startClient()) {
 			return 1;
 		}
 
@@ -135,7 +208,18 @@ namespace
 	int lastfmScrobblerStop()
 	{
 		logDebug("[lastfm_scrobbler] Stopping..."_s);
-		return lastfmClient.stop() ? 0 : 1;
+		return stopClient() ? 0 : 1;
+	}
+
+	void lastfmScrobblerScrobble(ScrobbleInfo * const begin, ScrobbleInfo * const end)
+	{ lock_guard<mutex> lock(pluginMutex);
+		bool safeScrobbling, syncScrobbling;
+
+		// It can be invoked by any thread so the client is left as the main thread has set it up.
+		if (!initClient(safeScrobbling, syncScrobbling, false)) {
+			return;
+		}
+		lastfmClient.scrobble(begin, end, safeScrobbling, syncScrobbling);
 	}
 
 	int lastfmScrobblerMessage(const uint32_t id, const uintptr_t ctx, const uint32_t p1, const uint32_t p2)
@@ -145,10 +229,10 @@ namespace
 		}
 
 		{ lock_guard<mutex> lock(pluginMutex);
-			bool safeScrobbling;
+			bool safeScrobbling, syncScrobbling;
 
 			// TODO distinguish disabled scrobbling and Lastfm client init errors
-			if (!initClient(safeScrobbling)) {
+			if (!initClient(safeScrobbling, syncScrobbling)) {
 				return 0;
 			}
 
@@ -156,7 +240,7 @@ namespace
 
 			afc::Optional<ScrobbleInfo> scrobbleInfo = getScrobbleInfo(event, *deadbeef, scrobbleThreshold);
 			if (scrobbleInfo.hasValue()) {
-				lastfmClient.scrobble(std::move(scrobbleInfo.value()), safeScrobbling);
+				lastfmClient.scrobble(std::move(scrobbleInfo.value()), safeScrobbling, syncScrobbling);
 			}
 
 			afc::Optional<Track> nowPlayingTrack = getTrackInfo(event->to, *deadbeef);
@@ -173,14 +257,15 @@ extern "C" DB_plugin_t *lastfm_scrobbler_load(DB_functions_t * const api)
 { lock_guard<mutex> lock(pluginMutex);
 	deadbeef = api;
 
-	plugin.plugin.api_vmajor = 1;
-	plugin.plugin.api_vminor = 4;
-	plugin.plugin.version_major = 1;
-	plugin.plugin.version_minor = 0;
-	plugin.plugin.type = DB_PLUGIN_MISC;
-	plugin.plugin.name = u8"lastfm scrobbler";
-	plugin.plugin.descr = u8"An audio track scrobbler to Last.fm.";
-	plugin.plugin.copyright =
+	plugin.misc.plugin.api_vmajor = 1;
+	plugin.misc.plugin.api_vminor = 4;
+	plugin.misc.plugin.version_major = 1;
+	plugin.misc.plugin.version_minor = 0;
+	plugin.misc.plugin.type = DB_PLUGIN_MISC;
+	plugin.misc.plugin.id = "lastfm_scrobbler";
+	plugin.misc.plugin.name = u8"lastfm scrobbler";
+	plugin.misc.plugin.descr = u8"An audio track scrobbler to Last.fm.";
+	plugin.misc.plugin.copyright =
 		u8"Copyright (C) 2013-2023 Dźmitry Laŭčuk\n"
 		"\n"
 		"This program is free software: you can redistribute it and/or modify\n"
@@ -196,11 +281,11 @@ extern "C" DB_plugin_t *lastfm_scrobbler_load(DB_functions_t * const api)
 		"You should have received a copy of the GNU General Public License\n"
 		"along with this program.  If not, see <http://www.gnu.org/licenses/>.\n";
 
-	plugin.plugin.website =
+	plugin.misc.plugin.website =
 			u8"https://github.com/dzlia/deadbeef_scrobbler_plugins";
-	plugin.plugin.start = lastfmScrobblerStart;
-	plugin.plugin.stop = lastfmScrobblerStop;
-	plugin.plugin.configdialog =
+	plugin.misc.plugin.start = lastfmScrobblerStart;
+	plugin.misc.plugin.stop = lastfmScrobblerStop;
+	plugin.misc.plugin.configdialog =
 			u8"property \"Enable scrobbler\" "
 				u8"checkbox lastfmScrobbler.enabled 0;"
 			u8"property \"Username\" entry lastfmScrobbler.username \"\";"
@@ -210,9 +295,16 @@ extern "C" DB_plugin_t *lastfm_scrobbler_load(DB_functions_t * const api)
 			u8"property \"Scrobble threshold (%)\" "
 				u8"entry lastfmScrobbler.threshold \"0.0\";"
 			u8"property \"Failure-safe scrobbling\" "
-				u8"checkbox lastfmScrobbler.safeScrobbling 0;";
-
-	plugin.plugin.message = lastfmScrobblerMessage;
+				u8"checkbox lastfmScrobbler.safeScrobbling 0;"
+			u8"property \"Sync failure-safe scrobbles to disk\" "
+				u8"checkbox lastfmScrobbler.syncScrobbling 0;"
+			u8"property \"Max pending scrobbles kept in memory\" "
+				u8"entry lastfmScrobbler.residentScrobbleLimit \"1000\";"
+			u8"property \"Retry at once when the network comes back\" "
+				u8"checkbox lastfmScrobbler.monitorNetwork 0;";
+
+	plugin.misc.plugin.message = lastfmScrobblerMessage;
+	plugin.scrobble = lastfmScrobblerScrobble;
 
 	return DB_PLUGIN(&plugin);
 }
@@ -0,0 +1,657 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+/* scrobblectl - an offline tool to inspect and maintain the data files of the scrobbler plugins
+ * while DeaDBeeF is not running. See usage below.
+ */
+#include <chrono>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <afc/FastStringBuffer.hpp>
+#include <afc/SimpleString.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "fileutil.hpp"
+#include "GravifonScrobbler.hpp"
+#include "JournalWriter.hpp"
+#include "LastfmScrobbler.hpp"
+#include "ScrobbleInfo.hpp"
+#include "ScrobbleJournal.hpp"
+#include "scrobbler_plugin.hpp"
+#include "SharedJournal.hpp"
+#include "StringDictionary.hpp"
+
+using namespace std;
+
+namespace
+{
+	const char usage[] =
+		"Usage: scrobblectl [options] <command> [<arguments>]\n"
+		"\n"
+		"Commands:\n"
+		"  stat [<data file>]                   prints the summary of the data file\n"
+		"  validate [<data file>]               checks the records of the data file\n"
+		"  compact [--dedupe] [<data file>]     re-writes the data file with the pending records only\n"
+		"  convert --to json|journal <in> <out> converts the pending scrobbles of a data file\n"
+		"  submit --backend gravifon|lastfm --url <url> --user <name> --password <password>\n"
+		"         [--timeout <seconds>] [<data file>]\n"
+		"                                       submits the pending scrobbles of a consumer\n"
+		"\n"
+		"Options:\n"
+		"  --consumer <n>  the consumer the records of the older formats (and the JSON output)\n"
+		"                  belong to; 0 is Gravifon, 1 is Last.fm. By default it is 0, or the one\n"
+		"                  of the backend for submit.\n"
+		"  --dedupe        merges the equal scrobbles pending for different consumers\n"
+		"\n"
+		"The data file is the one shared by the plugins by default. DeaDBeeF must not be running.\n";
+
+	struct Options
+	{
+		vector<const char *> arguments;
+		const char *to = nullptr;
+		const char *backend = nullptr;
+		const char *url = nullptr;
+		const char *user = nullptr;
+		const char *password = nullptr;
+		long consumer = -1;
+		long timeout = 30;
+		bool dedupe = false;
+	};
+
+	// A scrobble record of a data file. The lines of a data file in the JSON form are records, too.
+	struct Record
+	{
+		const char *begin;
+		const char *end;
+		JournalRecordType type;
+		const char *payloadBegin;
+		const char *payloadEnd;
+		// The consumers the record is stored for and the ones it is still pending for.
+		unsigned consumers;
+		unsigned pending;
+	};
+
+	struct DataFile
+	{
+		MappedFile file;
+		// False if the data file is in the JSON form of the older versions of the plugins.
+		bool journal = true;
+		std::uint64_t fileId = 0;
+		JournalCursors cursors = {};
+		// Where the cursors are taken from: the cursor file, the cursors record or neither of them.
+		const char *cursorSource = "none, all records are pending";
+		StringDictionary dictionary;
+		vector<Record> records;
+		size_t stringCount = 0;
+		std::uint64_t stringSize = 0;
+		size_t malformedCount = 0;
+		bool truncated = false;
+	};
+
+	bool parseArguments(const int argc, char ** const argv, Options &dest)
+	{
+		for (int i = 1; i < argc; ++i) {
+			const char * const arg = argv[i];
+			if (std::strncmp(arg, "--", 2) != 0) {
+				dest.arguments.push_back(arg);
+				continue;
+			}
+			if (std::strcmp(arg, "--dedupe") == 0) {
+				dest.dedupe = true;
+				continue;
+			}
+			if (i + 1 == argc) {
+				return false;
+			}
+			const char * const value = argv[++i];
+			if (std::strcmp(arg, "--to") == 0) {
+				dest.to = value;
+			} else if (std::strcmp(arg, "--backend") == 0) {
+				dest.backend = value;
+			} else if (std::strcmp(arg, "--url") == 0) {
+				dest.url = value;
+			} else if (std::strcmp(arg, "--user") == 0) {
+				dest.user = value;
+			} else if (std::strcmp(arg, "--password") == 0) {
+				dest.password = value;
+			} else if (std::strcmp(arg, "--consumer") == 0) {
+				dest.consumer = std::strtol(value, nullptr, 10);
+				if (dest.consumer < 0 || dest.consumer >= long(journalConsumerCount)) {
+					return false;
+				}
+			} else if (std::strcmp(arg, "--timeout") == 0) {
+				dest.timeout = std::strtol(value, nullptr, 10);
+				if (dest.timeout <= 0) {
+					return false;
+				}
+			} else {
+				return false;
+			}
+		}
+		return !dest.arguments.empty();
+	}
+
+	afc::String toString(const char * const s)
+	{
+		afc::String result;
+		result.assign(s, std::strlen(s));
+		return result;
+	}
+
+	// Returns the data file given by the argument at a given position or the shared data file.
+	bool dataFilePath(const Options &options, const size_t pos, afc::String &dest)
+	{
+		if (options.arguments.size() > pos) {
+			dest = toString(options.arguments[pos]);
+			return true;
+		}
+		afc::FastStringBuffer<char, afc::AllocMode::accurate> path;
+		if (!getSharedDataFilePath(path)) {
+			std::fprintf(stderr, "Unable to build the path to the data file; neither XDG_DATA_HOME nor HOME is set.\n");
+			return false;
+		}
+		dest = afc::String::move(path);
+		return true;
+	}
+
+	bool loadCursorFile(const afc::String &path, const std::uint64_t fileId, JournalCursors &dest)
+	{
+		const afc::FastStringBuffer<char, afc::AllocMode::accurate> cursorPath =
+				siblingPath(path.data(), path.size(), afc::ConstStringRef(".cursor", 7));
+		MappedFile cursorFile;
+		std::uint64_t cursorFileId;
+		JournalCursors cursors;
+		if (cursorFile.map(cursorPath.c_str()) != MappedFile::M_MAPPED ||
+				!readJournalCursor(cursorFile.begin(), cursorFile.end(), cursorFileId, cursors) ||
+				cursorFileId != fileId) {
+			return false;
+		}
+		dest = cursors;
+		return true;
+	}
+
+	void loadJsonLines(const unsigned legacyConsumers, DataFile &dest)
+	{
+		dest.journal = false;
+		const char *p = dest.file.begin();
+		const char * const end = dest.file.end();
+		while (p != end) {
+			const void * const lineFeed = std::memchr(p, '\n', end - p);
+			const char * const lineEnd = lineFeed == nullptr ? end : static_cast<const char *>(lineFeed);
+			if (lineEnd != p) {
+				dest.records.push_back({p, lineEnd, JournalRecordType::scrobble, p, lineEnd,
+						legacyConsumers, legacyConsumers});
+			}
+			p = lineFeed == nullptr ? end : lineEnd + 1;
+		}
+	}
+
+	/* Loads the records of a data file. The scrobble records that are not of the shared record type
+	 * are pending for legacyConsumers.
+	 */
+	bool loadDataFile(const afc::String &path, const unsigned legacyConsumers, DataFile &dest)
+	{
+		if (dest.file.map(path.c_str()) != MappedFile::M_MAPPED) {
+			std::fprintf(stderr, "Unable to read the data file %s.\n", path.c_str());
+			return false;
+		}
+		const char * const begin = dest.file.begin();
+		const char * const end = dest.file.end();
+		if (begin == end) {
+			return true;
+		}
+		if (!hasJournalMagic(begin, end)) {
+			loadJsonLines(legacyConsumers, dest);
+			return true;
+		}
+		if (!readJournalHeader(begin, end, dest.fileId)) {
+			std::fprintf(stderr, "The data file %s has an invalid or unsupported header.\n", path.c_str());
+			return false;
+		}
+
+		bool cursorsFound = loadCursorFile(path, dest.fileId, dest.cursors);
+		if (cursorsFound) {
+			dest.cursorSource = "the cursor file";
+		}
+
+		for (const char *p = begin + journalHeaderSize;;) {
+			const char * const recordBegin = p;
+			JournalRecordType type;
+			const char *payloadBegin, *payloadEnd;
+			const JournalReadResult result = readJournalRecord(p, end, type, payloadBegin, payloadEnd);
+			if (result == JournalReadResult::end) {
+				break;
+			}
+			if (result == JournalReadResult::truncated) {
+				dest.truncated = true;
+				break;
+			}
+			if (result == JournalReadResult::corrupted) {
+				++dest.malformedCount;
+				continue;
+			}
+
+			if (type == JournalRecordType::string) {
+				std::uint32_t id;
+				const char *stringBegin, *stringEnd;
+				if (readJournalString(payloadBegin, payloadEnd, id, stringBegin, stringEnd) &&
+						dest.dictionary.define(id, stringBegin, stringEnd)) {
+					++dest.stringCount;
+					dest.stringSize += p - recordBegin;
+				} else {
+					++dest.malformedCount;
+				}
+			} else if (type == JournalRecordType::cursors) {
+				// The cursor file supersedes the cursors record; the first cursors record is used otherwise.
+				JournalCursors cursors;
+				if (!readJournalCursors(payloadBegin, payloadEnd, cursors)) {
+					++dest.malformedCount;
+				} else if (!cursorsFound) {
+					dest.cursors = cursors;
+					dest.cursorSource = "the cursors record";
+					cursorsFound = true;
+				}
+			} else {
+				const unsigned consumers = type == JournalRecordType::sharedScrobble ?
+						journalRecordConsumers(type, payloadBegin, payloadEnd) : legacyConsumers;
+				dest.records.push_back({recordBegin, p, type, payloadBegin, payloadEnd, consumers, 0});
+			}
+		}
+
+		// A record is pending for a consumer unless it precedes the cursor of the consumer.
+		for (Record &record : dest.records) {
+			const std::uint64_t offset = record.begin - begin;
+			for (unsigned i = 0; i < journalConsumerCount; ++i) {
+				const unsigned mask = 1u << i;
+				if ((record.consumers & mask) != 0 && offset >= dest.cursors[i]) {
+					record.pending |= mask;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool parseRecord(const DataFile &dataFile, const Record &record, ScrobbleInfo &dest)
+	{
+		if (!dataFile.journal) {
+			return ScrobbleInfo::parse(record.payloadBegin, record.payloadEnd, dest);
+		}
+		switch (record.type) {
+		case JournalRecordType::scrobble:
+			return ScrobbleInfo::parseBinary(record.payloadBegin, record.payloadEnd, dest);
+		case JournalRecordType::compactScrobble:
+			return ScrobbleInfo::parseCompactBinary(record.payloadBegin, record.payloadEnd, dataFile.dictionary, dest);
+		case JournalRecordType::sharedScrobble:
+			return ScrobbleInfo::parseCompactBinary(record.payloadBegin + 1, record.payloadEnd,
+					dataFile.dictionary, dest);
+		default:
+			return false;
+		}
+	}
+
+	unsigned legacyConsumers(const Options &options)
+	{
+		return 1u << (options.consumer < 0 ? 0 : options.consumer);
+	}
+
+	int statCommand(const Options &options)
+	{
+		afc::String path;
+		DataFile dataFile;
+		if (!dataFilePath(options, 1, path) || !loadDataFile(path, legacyConsumers(options), dataFile)) {
+			return 1;
+		}
+
+		size_t pendingCount = 0;
+		size_t pendingCounts[journalConsumerCount] = {};
+		std::uint64_t liveSize = dataFile.journal && dataFile.file.size() != 0 ?
+				journalHeaderSize + dataFile.stringSize : 0;
+		for (const Record &record : dataFile.records) {
+			if (record.pending != 0) {
+				++pendingCount;
+				liveSize += record.end - record.begin;
+			}
+			for (unsigned i = 0; i < journalConsumerCount; ++i) {
+				if ((record.pending & (1u << i)) != 0) {
+					++pendingCounts[i];
+				}
+			}
+		}
+
+		std::printf("data file: %s\n", path.c_str());
+		if (dataFile.journal) {
+			std::printf("format: journal (file id %016" PRIx64 ")\n", dataFile.fileId);
+		} else {
+			std::printf("format: JSON lines (older versions)\n");
+		}
+		std::printf("size: %zu octets\n", dataFile.file.size());
+		std::printf("scrobbles: %zu (%zu pending, %zu acknowledged)\n", dataFile.records.size(),
+				pendingCount, dataFile.records.size() - pendingCount);
+		std::printf("strings: %zu\n", dataFile.stringCount);
+		std::printf("malformed records: %zu%s\n", dataFile.malformedCount, dataFile.truncated ? " (truncated)" : "");
+		if (dataFile.journal) {
+			std::printf("cursors: %s\n", dataFile.cursorSource);
+		}
+		for (unsigned i = 0; i < journalConsumerCount; ++i) {
+			if (pendingCounts[i] != 0 || dataFile.cursors[i] != 0) {
+				std::printf("consumer %u: %zu pending, cursor %" PRIu64 "\n", i, pendingCounts[i], dataFile.cursors[i]);
+			}
+		}
+		// The acknowledged and malformed records; the dictionary is rebuilt by compaction but is kept as a whole.
+		std::printf("reclaimable: %" PRIu64 " octets\n", std::uint64_t(dataFile.file.size()) - liveSize);
+		return 0;
+	}
+
+	int validateCommand(const Options &options)
+	{
+		afc::String path;
+		DataFile dataFile;
+		if (!dataFilePath(options, 1, path) || !loadDataFile(path, legacyConsumers(options), dataFile)) {
+			return 1;
+		}
+
+		size_t invalidCount = 0;
+		for (const Record &record : dataFile.records) {
+			ScrobbleInfo scrobbleInfo;
+			if (!parseRecord(dataFile, record, scrobbleInfo)) {
+				++invalidCount;
+			}
+		}
+
+		const size_t errorCount = dataFile.malformedCount + invalidCount + (dataFile.truncated ? 1 : 0);
+		std::printf("%zu scrobbles checked: %zu malformed records, %zu scrobbles that cannot be parsed%s\n",
+				dataFile.records.size(), dataFile.malformedCount, invalidCount,
+				dataFile.truncated ? ", the last record is truncated" : "");
+		return errorCount == 0 ? 0 : 1;
+	}
+
+	/* Builds the journal of the pending scrobbles of a data file. If dedupe is true then a scrobble
+	 * that is equal to a preceding one is merged into it unless this changes the order of the
+	 * scrobbles of some consumer.
+	 *
+	 * @return the number of scrobbles merged.
+	 */
+	size_t buildJournal(const DataFile &dataFile, const bool dedupe, afc::FastStringBuffer<char> &dest,
+			size_t &keptCount, size_t &invalidCount)
+	{
+		appendJournalHeader(newJournalFileId(), dest);
+
+		StringDictionary dictionary;
+		vector<size_t> recordStarts;
+		vector<unsigned> recordConsumers;
+		// The number of records up to the last one of each consumer.
+		size_t consumerEnds[journalConsumerCount] = {};
+		unordered_map<string, size_t> emitted;
+		afc::FastStringBuffer<char> key;
+		size_t mergedCount = 0;
+		invalidCount = 0;
+
+		for (const Record &record : dataFile.records) {
+			if (record.pending == 0) {
+				continue;
+			}
+			ScrobbleInfo scrobbleInfo;
+			if (!parseRecord(dataFile, record, scrobbleInfo)) {
+				++invalidCount;
+				continue;
+			}
+
+			if (dedupe) {
+				key.clear();
+				appendAsBinary(scrobbleInfo, key);
+				auto it = emitted.emplace(string(key.data(), key.size()), recordConsumers.size()).first;
+				const size_t index = it->second;
+				if (index != recordConsumers.size()) {
+					// The record is merged only if no record of the consumers added follows the merged one.
+					const unsigned added = record.pending & ~recordConsumers[index];
+					bool merged = true;
+					for (unsigned i = 0; i < journalConsumerCount; ++i) {
+						if ((added & (1u << i)) != 0 && consumerEnds[i] > index) {
+							merged = false;
+						}
+					}
+					if (merged) {
+						recordConsumers[index] |= added;
+						const size_t recordSize = (index + 1 == recordStarts.size() ? dest.size() :
+								recordStarts[index + 1]) - recordStarts[index];
+						setJournalRecordConsumers(&*dest.begin() + recordStarts[index], recordSize,
+								recordConsumers[index]);
+						++mergedCount;
+						continue;
+					}
+				}
+				it->second = recordConsumers.size();
+			}
+
+			const JournalStringIds ids = appendJournalStrings(scrobbleInfo, dictionary, dest);
+			recordStarts.push_back(dest.size());
+			appendJournalScrobble(scrobbleInfo, record.pending, ids, dest);
+			recordConsumers.push_back(record.pending);
+			for (unsigned i = 0; i < journalConsumerCount; ++i) {
+				if ((record.pending & (1u << i)) != 0) {
+					consumerEnds[i] = recordConsumers.size();
+				}
+			}
+		}
+		keptCount = recordConsumers.size();
+		return mergedCount;
+	}
+
+	// Replaces the file the path points to with a given journal atomically.
+	bool writeJournal(const afc::String &path, afc::FastStringBuffer<char> &&journal)
+	{
+		JournalWriter writer;
+		writer.start(path);
+		writer.rewrite(std::move(journal));
+		writer.stop();
+		if (writer.takeFailure()) {
+			std::fprintf(stderr, "Unable to write the data file %s.\n", path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	int compactCommand(const Options &options)
+	{
+		afc::String path;
+		DataFile dataFile;
+		if (!dataFilePath(options, 1, path) || !loadDataFile(path, legacyConsumers(options), dataFile)) {
+			return 1;
+		}
+
+		afc::FastStringBuffer<char> journal;
+		size_t keptCount, invalidCount;
+		const size_t mergedCount = buildJournal(dataFile, options.dedupe, journal, keptCount, invalidCount);
+		const size_t oldSize = dataFile.file.size(), newSize = journal.size();
+		dataFile.file.unmap();
+		if (!writeJournal(path, std::move(journal))) {
+			return 1;
+		}
+		// The cursors of the new journal are all zero; the cursor file of the old one is stale.
+		const afc::FastStringBuffer<char, afc::AllocMode::accurate> cursorPath =
+				siblingPath(path.data(), path.size(), afc::ConstStringRef(".cursor", 7));
+		unlink(cursorPath.c_str());
+
+		std::printf("%zu scrobbles kept, %zu merged, %zu dropped as invalid; %zu octets -> %zu octets\n",
+				keptCount, mergedCount, invalidCount, oldSize, newSize);
+		return 0;
+	}
+
+	int convertCommand(const Options &options)
+	{
+		const bool toJson = options.to != nullptr && std::strcmp(options.to, "json") == 0;
+		const bool toJournal = options.to != nullptr && std::strcmp(options.to, "journal") == 0;
+		if (!(toJson || toJournal) || options.arguments.size() != 3) {
+			std::fputs(usage, stderr);
+			return 2;
+		}
+		const afc::String inPath = toString(options.arguments[1]), outPath = toString(options.arguments[2]);
+		DataFile dataFile;
+		if (!loadDataFile(inPath, legacyConsumers(options), dataFile)) {
+			return 1;
+		}
+
+		if (toJournal) {
+			afc::FastStringBuffer<char> journal;
+			size_t keptCount, invalidCount;
+			buildJournal(dataFile, options.dedupe, journal, keptCount, invalidCount);
+			if (!writeJournal(outPath, std::move(journal))) {
+				return 1;
+			}
+			std::printf("%zu scrobbles converted, %zu dropped as invalid\n", keptCount, invalidCount);
+			return 0;
+		}
+
+		// The JSON form has no consumers so only the scrobbles pending for the consumer given are converted.
+		const unsigned consumer = legacyConsumers(options);
+		afc::FastStringBuffer<char> out;
+		size_t convertedCount = 0, invalidCount = 0;
+		for (const Record &record : dataFile.records) {
+			if ((record.pending & consumer) == 0) {
+				continue;
+			}
+			ScrobbleInfo scrobbleInfo;
+			if (!parseRecord(dataFile, record, scrobbleInfo)) {
+				++invalidCount;
+				continue;
+			}
+			appendAsJson(scrobbleInfo, out);
+			out.reserve(out.size() + 1);
+			out.append('\n');
+			++convertedCount;
+		}
+
+		const int fd = open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0664);
+		if (fd == -1) {
+			std::fprintf(stderr, "Unable to open the file %s.\n", outPath.c_str());
+			return 1;
+		}
+		const bool written = writeFully(fd, out.data(), out.size()) && fsync(fd) == 0;
+		if (close(fd) != 0 || !written) {
+			std::fprintf(stderr, "Unable to write the file %s.\n", outPath.c_str());
+			return 1;
+		}
+		std::printf("%zu scrobbles converted, %zu dropped as invalid\n", convertedCount, invalidCount);
+		return 0;
+	}
+
+	/* Submits the scrobbles pending for a consumer until there are none left or no progress is made
+	 * for the timeout given.
+	 */
+	template<typename Client>
+	int submit(Client &client, const afc::String &path, const unsigned consumer, const long timeout)
+	{
+		SharedJournal journal(path);
+		client.setJournal(&journal, consumer);
+		if (!client.start() || !client.waitForLoad()) {
+			std::fprintf(stderr, "Unable to load the scrobbles of the data file %s.\n", path.c_str());
+			client.stop();
+			return 1;
+		}
+
+		typedef std::chrono::steady_clock clock;
+		const clock::time_point startTime = clock::now();
+		clock::time_point progressTime = startTime;
+		size_t completedCount = 0;
+		while (!client.drained() && clock::now() - progressTime < std::chrono::seconds(timeout)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			const size_t count = client.completedCount();
+			if (count != completedCount) {
+				completedCount = count;
+				progressTime = clock::now();
+			}
+		}
+		const bool drained = client.drained();
+		completedCount = client.completedCount();
+		const double seconds = std::chrono::duration<double>(clock::now() - startTime).count();
+		client.stop();
+
+		std::printf("%zu scrobbles completed in %.3f s (%.1f records/s)\n", completedCount, seconds,
+				seconds > 0 ? completedCount / seconds : 0.0);
+		if (!drained) {
+			std::fprintf(stderr, "Some scrobbles are still pending: no progress is made for %ld s.\n", timeout);
+			return 1;
+		}
+		return 0;
+	}
+
+	int submitCommand(const Options &options)
+	{
+		if (options.backend == nullptr || options.url == nullptr || options.user == nullptr ||
+				options.password == nullptr || options.arguments.size() > 2) {
+			std::fputs(usage, stderr);
+			return 2;
+		}
+		afc::String path;
+		if (!dataFilePath(options, 1, path)) {
+			return 1;
+		}
+
+		if (std::strcmp(options.backend, "gravifon") == 0) {
+			GravifonScrobbler client;
+			client.configure(options.url, std::strlen(options.url), options.user, std::strlen(options.user),
+					options.password, std::strlen(options.password));
+			return submit(client, path, options.consumer < 0 ? gravifonJournalConsumer : options.consumer,
+					options.timeout);
+		}
+		if (std::strcmp(options.backend, "lastfm") == 0) {
+			LastfmScrobbler client;
+			client.configure(options.url, std::strlen(options.url), options.user, options.password);
+			return submit(client, path, options.consumer < 0 ? lastfmJournalConsumer : options.consumer,
+					options.timeout);
+		}
+		std::fputs(usage, stderr);
+		return 2;
+	}
+}
+
+int main(const int argc, char ** const argv)
+{
+	Options options;
+	if (!parseArguments(argc, argv, options)) {
+		std::fputs(usage, stderr);
+		return 2;
+	}
+
+	const char * const command = options.arguments[0];
+	if (std::strcmp(command, "stat") == 0 && options.arguments.size() <= 2) {
+		return statCommand(options);
+	}
+	if (std::strcmp(command, "validate") == 0 && options.arguments.size() <= 2) {
+		return validateCommand(options);
+	}
+	if (std::strcmp(command, "compact") == 0 && options.arguments.size() <= 2) {
+		return compactCommand(options);
+	}
+	if (std::strcmp(command, "convert") == 0) {
+		return convertCommand(options);
+	}
+	if (std::strcmp(command, "submit") == 0) {
+		return submitCommand(options);
+	}
+	std::fputs(usage, stderr);
+	return 2;
+}
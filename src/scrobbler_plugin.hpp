@@ -0,0 +1,196 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef SCROBBLER_PLUGIN_HPP_
+#define SCROBBLER_PLUGIN_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <deadbeef.h>
+
+#include <afc/FastStringBuffer.hpp>
+#include <afc/logger.hpp>
+#include <afc/SimpleString.hpp>
+#include <afc/StringRef.hpp>
+
+#include "pathutil.hpp"
+#include "Reactor.hpp"
+#include "ScrobbleInfo.hpp"
+#include "SharedJournal.hpp"
+
+// The journal consumers of the scrobbler plugins.
+static constexpr unsigned gravifonJournalConsumer = 0;
+static constexpr unsigned lastfmJournalConsumer = 1;
+
+// The version of ScrobblerPlugin and of the SharedJournal and Reactor it refers to.
+static constexpr std::uint32_t scrobblerPluginVersion = 3;
+
+// The time for which appends to the shared journal are delayed to let the same scrobble be deduplicated.
+static constexpr std::chrono::milliseconds sharedJournalAppendDelay(20);
+
+/* The plugin structure of the scrobbler plugins. The plugins find each other by their ids and
+ * share the SharedJournal and the Reactor one of them creates. Each plugin links its own copy of
+ * SharedJournal and Reactor so they are shared only if the peer plugin declares the same version
+ * and layout.
+ *
+ * The journal and the reactor are acquired when the client of a plugin is started and released
+ * when it is stopped. DeaDBeeF starts and stops plugins and delivers messages to them one by one
+ * in its main thread, and the clients are started and stopped only there, so the journal and reactor
+ * pointers are not guarded. Plugins are unloaded only after all of them are stopped, so neither
+ * the journal writer thread nor the reactor thread started by the code of one plugin outlives that code.
+ */
+struct ScrobblerPlugin
+{
+	DB_misc_t misc;
+	std::uint32_t version;
+	std::uint32_t sharedJournalSize;
+	std::uint32_t reactorSize;
+	// The journal this plugin holds while its client is started; null otherwise.
+	SharedJournal *journal;
+	// The reactor this plugin holds while its client is started; null otherwise.
+	Reactor *reactor;
+	/* Scrobbles given tracks in bulk with the failure-safe settings of the plugin (see Scrobbler::scrobble()).
+	 * The scrobbles are moved from. Nothing is done if scrobbling is disabled. Other plugins (e.g. importers
+	 * of the listening history of other players) find the scrobbler plugin by its id to use it.
+	 */
+	void (*scrobble)(ScrobbleInfo *begin, ScrobbleInfo *end);
+};
+
+// Builds the path to the data file of the journal shared by the scrobbler plugins (see ::getDataFilePath()).
+inline bool getSharedDataFilePath(afc::FastStringBuffer<char, afc::AllocMode::accurate> &dest)
+{
+	using afc::operator"" _s;
+
+	return ::getDataFilePath("deadbeef/scrobbler_data"_s, dest);
+}
+
+/* Finds the peer scrobbler plugin by its id and declares the version and layout of a given plugin.
+ *
+ * @return the peer plugin; null if it is not loaded; the given plugin if the peer is incompatible.
+ */
+inline const ScrobblerPlugin *findPeerPlugin(DB_functions_t &deadbeef, ScrobblerPlugin &self,
+		const char * const peerId)
+{
+	self.version = scrobblerPluginVersion;
+	self.sharedJournalSize = sizeof(SharedJournal);
+	self.reactorSize = sizeof(Reactor);
+
+	DB_plugin_t * const peer = deadbeef.plug_get_for_id(peerId);
+	if (peer == nullptr) {
+		return nullptr;
+	}
+	const ScrobblerPlugin &peerPlugin = *reinterpret_cast<const ScrobblerPlugin *>(peer);
+	if (peer->type != DB_PLUGIN_MISC || peerPlugin.version != scrobblerPluginVersion ||
+			peerPlugin.sharedJournalSize != sizeof(SharedJournal) || peerPlugin.reactorSize != sizeof(Reactor)) {
+		return &self;
+	}
+	return &peerPlugin;
+}
+
+/* Acquires the journal shared with the peer scrobbler plugin or, if the peer does not hold one,
+ * creates it at the shared data file path.
+ *
+ * @return the journal acquired; null if the peer is incompatible or the path cannot be built.
+ *         In this case the plugin is expected to use its own journal.
+ */
+inline SharedJournal *acquireSharedJournal(DB_functions_t &deadbeef, ScrobblerPlugin &self, const char * const peerId)
+{
+	using afc::operator"" _s;
+
+	const ScrobblerPlugin * const peerPlugin = findPeerPlugin(deadbeef, self, peerId);
+	if (peerPlugin == &self) {
+		afc::logger::logError("[scrobbler] the peer plugin is incompatible; the data file is not shared."_s);
+		return nullptr;
+	}
+	if (peerPlugin != nullptr && peerPlugin->journal != nullptr) {
+		SharedJournal &journal = *peerPlugin->journal;
+		{ std::unique_lock<std::mutex> lock(journal.lock());
+			journal.acquire();
+		}
+		return self.journal = &journal;
+	}
+
+	afc::FastStringBuffer<char, afc::AllocMode::accurate> dataFilePath;
+	if (!getSharedDataFilePath(dataFilePath)) {
+		return nullptr;
+	}
+	SharedJournal * const journal = new SharedJournal(afc::String::move(dataFilePath), sharedJournalAppendDelay);
+	journal->acquire();
+	return self.journal = journal;
+}
+
+// Releases the journal acquired by acquireSharedJournal(). The last holder deletes it.
+inline void releaseSharedJournal(ScrobblerPlugin &self)
+{
+	SharedJournal * const journal = self.journal;
+	if (journal == nullptr) {
+		return;
+	}
+	self.journal = nullptr;
+	bool last;
+	{ std::unique_lock<std::mutex> lock(journal->lock());
+		last = journal->release();
+	}
+	if (last) {
+		delete journal;
+	}
+}
+
+/* Acquires the reactor shared with the peer scrobbler plugin or, if the peer does not hold one,
+ * creates and starts it. A single reactor thread hosts both plugins then.
+ *
+ * @return the reactor acquired; null if the peer is incompatible or the reactor cannot be started.
+ *         In this case the plugin is expected to let its Scrobbler start its own reactor.
+ */
+inline Reactor *acquireReactor(DB_functions_t &deadbeef, ScrobblerPlugin &self, const char * const peerId)
+{
+	using afc::operator"" _s;
+
+	const ScrobblerPlugin * const peerPlugin = findPeerPlugin(deadbeef, self, peerId);
+	if (peerPlugin == &self) {
+		afc::logger::logError("[scrobbler] the peer plugin is incompatible; the reactor is not shared."_s);
+		return nullptr;
+	}
+	if (peerPlugin != nullptr && peerPlugin->reactor != nullptr) {
+		Reactor &reactor = *peerPlugin->reactor;
+		reactor.acquire();
+		return self.reactor = &reactor;
+	}
+
+	Reactor * const reactor = new Reactor();
+	if (!reactor->start()) {
+		delete reactor;
+		return nullptr;
+	}
+	reactor->acquire();
+	return self.reactor = reactor;
+}
+
+/* Releases the reactor acquired by acquireReactor(). The last holder stops and deletes it.
+ * The Scrobbler of the plugin must be stopped before.
+ */
+inline void releaseReactor(ScrobblerPlugin &self)
+{
+	Reactor * const reactor = self.reactor;
+	if (reactor == nullptr) {
+		return;
+	}
+	self.reactor = nullptr;
+	if (reactor->release()) {
+		delete reactor;
+	}
+}
+
+#endif /* SCROBBLER_PLUGIN_HPP_ */
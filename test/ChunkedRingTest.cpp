@@ -0,0 +1,199 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "ChunkedRingTest.hpp"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ChunkedRingTest);
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include <ChunkedRing.hpp>
+
+using namespace std;
+
+namespace
+{
+	// Small chunks so that the values of each test span several of them.
+	typedef ChunkedRing<int, 4> Ring;
+
+	vector<int> values(const Ring &ring)
+	{
+		return vector<int>(ring.begin(), ring.end());
+	}
+
+	vector<int> sequence(const int begin, const int end)
+	{
+		vector<int> result;
+		for (int i = begin; i < end; ++i) {
+			result.push_back(i);
+		}
+		return result;
+	}
+}
+
+void ChunkedRingTest::testEmplaceBack_Order()
+{
+	Ring ring;
+	CPPUNIT_ASSERT(ring.empty());
+	CPPUNIT_ASSERT(ring.begin() == ring.end());
+
+	for (int i = 0; i < 10; ++i) {
+		ring.emplace_back(i);
+	}
+
+	CPPUNIT_ASSERT(!ring.empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(10), ring.size());
+	CPPUNIT_ASSERT_EQUAL(0, ring.front());
+	CPPUNIT_ASSERT_EQUAL(9, ring.back());
+	CPPUNIT_ASSERT(values(ring) == sequence(0, 10));
+	CPPUNIT_ASSERT_EQUAL(ptrdiff_t(10), distance(ring.cbegin(), ring.cend()));
+
+	// Iterating backwards.
+	int expected = 10;
+	for (auto it = ring.end(); it != ring.begin();) {
+		--it;
+		CPPUNIT_ASSERT_EQUAL(--expected, *it);
+	}
+	CPPUNIT_ASSERT_EQUAL(0, expected);
+}
+
+void ChunkedRingTest::testErase_Arbitrary()
+{
+	Ring ring;
+	for (int i = 0; i < 10; ++i) {
+		ring.emplace_back(i);
+	}
+	const int * const sixth = &*next(ring.begin(), 6);
+
+	// Erasing a value in the middle of a chunk.
+	auto it = ring.erase(next(ring.begin(), 1));
+	CPPUNIT_ASSERT_EQUAL(2, *it);
+
+	// Erasing the remaining values of the first chunk.
+	it = ring.erase(it);
+	CPPUNIT_ASSERT_EQUAL(3, *it);
+	it = ring.erase(it);
+	CPPUNIT_ASSERT_EQUAL(4, *it);
+	it = ring.erase(ring.begin());
+	CPPUNIT_ASSERT_EQUAL(4, *it);
+	CPPUNIT_ASSERT(it == ring.begin());
+
+	// Erasing the whole second chunk.
+	for (int i = 4; i < 8; ++i) {
+		if (i == 6) {
+			// The other values are not moved.
+			CPPUNIT_ASSERT_EQUAL(static_cast<const int *>(&*it), sixth);
+			++it;
+		} else {
+			it = ring.erase(it);
+		}
+	}
+	CPPUNIT_ASSERT_EQUAL(8, *it);
+
+	// Erasing the last value.
+	it = ring.erase(prev(ring.end()));
+	CPPUNIT_ASSERT(it == ring.end());
+
+	CPPUNIT_ASSERT_EQUAL(size_t(2), ring.size());
+	CPPUNIT_ASSERT((values(ring) == vector<int>{6, 8}));
+	CPPUNIT_ASSERT_EQUAL(8, ring.back());
+	CPPUNIT_ASSERT_EQUAL(6, *prev(ring.end(), 2));
+
+	ring.emplace_back(10);
+	CPPUNIT_ASSERT((values(ring) == vector<int>{6, 8, 10}));
+
+	it = ring.erase(ring.begin());
+	it = ring.erase(it);
+	it = ring.erase(it);
+	CPPUNIT_ASSERT(ring.empty());
+	CPPUNIT_ASSERT(it == ring.end());
+	CPPUNIT_ASSERT(ring.begin() == ring.end());
+}
+
+void ChunkedRingTest::testErase_Range()
+{
+	Ring ring;
+	for (int i = 0; i < 10; ++i) {
+		ring.emplace_back(i);
+	}
+
+	auto it = ring.erase(ring.begin(), next(ring.begin(), 6));
+	CPPUNIT_ASSERT(it == ring.begin());
+	CPPUNIT_ASSERT_EQUAL(6, *it);
+	CPPUNIT_ASSERT(values(ring) == sequence(6, 10));
+
+	// The chunks released are reused.
+	for (int i = 10; i < 20; ++i) {
+		ring.emplace_back(i);
+	}
+	CPPUNIT_ASSERT(values(ring) == sequence(6, 20));
+
+	it = ring.erase(next(ring.begin(), 2), ring.end());
+	CPPUNIT_ASSERT(it == ring.end());
+	CPPUNIT_ASSERT(values(ring) == sequence(6, 8));
+
+	it = ring.erase(ring.begin(), ring.end());
+	CPPUNIT_ASSERT(it == ring.end());
+	CPPUNIT_ASSERT(ring.empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(0), ring.size());
+
+	ring.emplace_back(1);
+	CPPUNIT_ASSERT((values(ring) == vector<int>{1}));
+}
+
+void ChunkedRingTest::testPopBack()
+{
+	Ring ring;
+	for (int i = 0; i < 5; ++i) {
+		ring.emplace_back(i);
+	}
+
+	ring.pop_back();
+	CPPUNIT_ASSERT_EQUAL(3, ring.back());
+	ring.pop_back();
+	CPPUNIT_ASSERT_EQUAL(2, ring.back());
+	ring.emplace_back(5);
+	CPPUNIT_ASSERT((values(ring) == vector<int>{0, 1, 2, 5}));
+	CPPUNIT_ASSERT_EQUAL(size_t(4), ring.size());
+}
+
+void ChunkedRingTest::testInsert_MoveOnly()
+{
+	ChunkedRing<unique_ptr<int>, 4> src;
+	for (int i = 0; i < 6; ++i) {
+		src.emplace_back(new int(i));
+	}
+
+	ChunkedRing<unique_ptr<int>, 4> dest;
+	dest.emplace_back(new int(-1));
+	dest.insert(dest.end(), make_move_iterator(src.begin()), make_move_iterator(src.end()));
+	src.clear();
+	CPPUNIT_ASSERT(src.empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(7), dest.size());
+
+	int expected = -1;
+	for (const unique_ptr<int> &value : dest) {
+		CPPUNIT_ASSERT_EQUAL(expected++, *value);
+	}
+
+	// The values are released by the destructor of the container they are swapped to.
+	src.swap(dest);
+	CPPUNIT_ASSERT(dest.empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(7), src.size());
+	CPPUNIT_ASSERT_EQUAL(5, *src.back());
+}
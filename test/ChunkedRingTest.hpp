@@ -0,0 +1,39 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef CHUNKEDRINGTEST_HPP_
+#define CHUNKEDRINGTEST_HPP_
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class ChunkedRingTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(ChunkedRingTest);
+	CPPUNIT_TEST(testEmplaceBack_Order);
+	CPPUNIT_TEST(testErase_Arbitrary);
+	CPPUNIT_TEST(testErase_Range);
+	CPPUNIT_TEST(testPopBack);
+	CPPUNIT_TEST(testInsert_MoveOnly);
+	CPPUNIT_TEST_SUITE_END();
+public:
+	void testEmplaceBack_Order();
+	void testErase_Arbitrary();
+	void testErase_Range();
+	void testPopBack();
+	void testInsert_MoveOnly();
+};
+
+#endif /* CHUNKEDRINGTEST_HPP_ */
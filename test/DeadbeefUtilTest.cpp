@@ -23,6 +23,44 @@ CPPUNIT_TEST_SUITE_REGISTRATION(DeadbeefUtilTest);
 #include <deadbeef_util.hpp>
 #include <afc/FastStringBuffer.hpp>
 
+namespace
+{
+	// Produces the pieces '0', '11', '222', ... up to a given number of them.
+	class TestBodyProducer : public PieceBodyProducer
+	{
+	public:
+		explicit TestBodyProducer(const std::size_t pieceCount) : encodedCount(0), m_pieceCount(pieceCount) {}
+
+		std::size_t encodedCount;
+	protected:
+		virtual bool encodePiece(const std::size_t index, afc::FastStringBuffer<char> &dest) override
+		{
+			if (index == m_pieceCount) {
+				return false;
+			}
+			++encodedCount;
+			const std::string piece(index + 1, char('0' + index % 10));
+			dest.reserve(dest.size() + piece.size());
+			dest.append(piece.data(), piece.size());
+			return true;
+		}
+	private:
+		const std::size_t m_pieceCount;
+	};
+
+	// Reads the body produced by a given producer by a given number of octets at a time.
+	std::string readBody(HttpRequest::BodyProducer &producer, const std::size_t bufSize)
+	{
+		std::string result;
+		std::string buf(bufSize, '\0');
+		for (std::size_t n; (n = producer(&buf[0], bufSize)) != 0;) {
+			CPPUNIT_ASSERT(n <= bufSize);
+			result.append(buf, 0, n);
+		}
+		return result;
+	}
+}
+
 void DeadbeefUtilTest::testConvertMultiTag_EmptyString()
 {
 	afc::FastStringBuffer<char> result;
@@ -67,3 +105,42 @@ void DeadbeefUtilTest::testConvertMultiTag_TwoValues_NonEmptyBuffer()
 	CPPUNIT_ASSERT_EQUAL(std::string(result.begin(), result.end()),
 			(std::string("Elton JohnPerry Como") += u8"\0"[0]).append("Tom Jones"));
 }
+
+void DeadbeefUtilTest::testPieceBodyProducer()
+{
+	const std::string expected = "0" "11" "222" "3333" "44444";
+
+	for (const std::size_t bufSize : {std::size_t(1), std::size_t(2), std::size_t(4), std::size_t(64)}) {
+		TestBodyProducer producer(5);
+		CPPUNIT_ASSERT_EQUAL(expected, readBody(producer, bufSize));
+		// Each piece is encoded once, whatever the pieces are split into.
+		CPPUNIT_ASSERT_EQUAL(std::size_t(5), producer.encodedCount);
+	}
+
+	TestBodyProducer empty(0);
+	CPPUNIT_ASSERT_EQUAL(std::string(), readBody(empty, 16));
+}
+
+void DeadbeefUtilTest::testPieceBodyProducer_Size()
+{
+	TestBodyProducer producer(5);
+	CPPUNIT_ASSERT_EQUAL(std::size_t(15), producer.size());
+	// The body is produced from its beginning after it is measured.
+	CPPUNIT_ASSERT_EQUAL(std::string("0" "11" "222" "3333" "44444"), readBody(producer, 4));
+
+	TestBodyProducer empty(0);
+	CPPUNIT_ASSERT_EQUAL(std::size_t(0), empty.size());
+}
+
+void DeadbeefUtilTest::testPieceBodyProducer_Rewind()
+{
+	TestBodyProducer producer(4);
+	char buf[4];
+	// The body is rewound in the middle of the second piece.
+	CPPUNIT_ASSERT_EQUAL(std::size_t(2), producer(buf, 2));
+	CPPUNIT_ASSERT(producer.rewind());
+
+	CPPUNIT_ASSERT_EQUAL(std::string("0" "11" "222" "3333"), readBody(producer, 3));
+	CPPUNIT_ASSERT(producer.rewind());
+	CPPUNIT_ASSERT_EQUAL(std::string("0" "11" "222" "3333"), readBody(producer, 5));
+}
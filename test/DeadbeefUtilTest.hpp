@@ -27,6 +27,9 @@ class DeadbeefUtilTest : public CppUnit::TestFixture
 	CPPUNIT_TEST(testConvertMultiTag_TwoValues);
 	CPPUNIT_TEST(testConvertMultiTag_ThreeValues);
 	CPPUNIT_TEST(testConvertMultiTag_TwoValues_NonEmptyBuffer);
+	CPPUNIT_TEST(testPieceBodyProducer);
+	CPPUNIT_TEST(testPieceBodyProducer_Rewind);
+	CPPUNIT_TEST(testPieceBodyProducer_Size);
 	CPPUNIT_TEST_SUITE_END();
 public:
 	void testConvertMultiTag_EmptyString();
@@ -34,6 +37,9 @@ public:
 	void testConvertMultiTag_TwoValues();
 	void testConvertMultiTag_ThreeValues();
 	void testConvertMultiTag_TwoValues_NonEmptyBuffer();
+	void testPieceBodyProducer();
+	void testPieceBodyProducer_Rewind();
+	void testPieceBodyProducer_Size();
 };
 
 #endif /* DEADBEEFUTILTEST_HPP_ */
@@ -0,0 +1,100 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "IntakeQueueTest.hpp"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(IntakeQueueTest);
+
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <IntakeQueue.hpp>
+
+using namespace std;
+
+void IntakeQueueTest::testConsume_Order()
+{
+	IntakeQueue<unique_ptr<int>> queue;
+	for (int i = 0; i < 5; ++i) {
+		queue.push(unique_ptr<int>(new int(i)));
+	}
+
+	vector<int> result;
+	CPPUNIT_ASSERT_EQUAL(size_t(5), queue.consume([&result](unique_ptr<int> &value) { result.push_back(*value); }));
+	CPPUNIT_ASSERT_EQUAL(size_t(5), result.size());
+	for (int i = 0; i < 5; ++i) {
+		CPPUNIT_ASSERT_EQUAL(i, result[i]);
+	}
+
+	CPPUNIT_ASSERT(queue.empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(0), queue.consume([&result](unique_ptr<int> &value) { result.push_back(*value); }));
+	CPPUNIT_ASSERT_EQUAL(size_t(5), result.size());
+}
+
+void IntakeQueueTest::testPush_Empty()
+{
+	IntakeQueue<int> queue;
+	CPPUNIT_ASSERT(queue.empty());
+	CPPUNIT_ASSERT(queue.push(1));
+	CPPUNIT_ASSERT(!queue.empty());
+	CPPUNIT_ASSERT(!queue.push(2));
+
+	queue.clear();
+	CPPUNIT_ASSERT(queue.empty());
+	CPPUNIT_ASSERT(queue.push(3));
+	// The values left are released by the destructor.
+}
+
+void IntakeQueueTest::testPush_ConcurrentProducers()
+{
+	constexpr int producerCount = 4;
+	constexpr int valueCount = 100 * 1000;
+
+	// The values are pairs of the producer and the sequence number.
+	IntakeQueue<pair<int, int>> queue;
+	vector<thread> producers;
+	for (int producer = 0; producer < producerCount; ++producer) {
+		producers.emplace_back([&queue, producer]()
+		{
+			for (int i = 0; i < valueCount; ++i) {
+				queue.push(make_pair(producer, i));
+			}
+		});
+	}
+
+	// The values of each producer are consumed in the order they are pushed while the producers are running.
+	vector<int> next(producerCount, 0);
+	bool inOrder = true;
+	const auto consumer = [&next, &inOrder](const pair<int, int> &value)
+	{
+		inOrder = inOrder && value.second == next[value.first];
+		++next[value.first];
+	};
+	size_t total = 0;
+	while (total < size_t(producerCount) * valueCount) {
+		total += queue.consume(consumer);
+	}
+	for (thread &producer : producers) {
+		producer.join();
+	}
+
+	CPPUNIT_ASSERT(inOrder);
+	CPPUNIT_ASSERT(queue.empty());
+	for (int producer = 0; producer < producerCount; ++producer) {
+		CPPUNIT_ASSERT_EQUAL(valueCount, next[producer]);
+	}
+}
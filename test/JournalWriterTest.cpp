@@ -0,0 +1,321 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "JournalWriterTest.hpp"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(JournalWriterTest);
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <JournalWriter.hpp>
+#include <ScrobbleJournal.hpp>
+#include <afc/FastStringBuffer.hpp>
+#include <afc/SimpleString.hpp>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+	afc::FastStringBuffer<char> buffer(const char * const data, const size_t size)
+	{
+		afc::FastStringBuffer<char> result(size);
+		result.append(data, size);
+		return result;
+	}
+
+	string readFile(const string &path)
+	{
+		ifstream in(path, ios::binary);
+		return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	}
+
+	afc::String toString(const string &s)
+	{
+		afc::String result;
+		result.assign(s.data(), s.size());
+		return result;
+	}
+}
+
+void JournalWriterTest::setUp()
+{
+	char dirTemplate[] = "/tmp/journal_writer_test_XXXXXX";
+	CPPUNIT_ASSERT(mkdtemp(dirTemplate) != nullptr);
+	m_dir = dirTemplate;
+	// The parent directory of the data file is to be created by the writer.
+	m_dataFilePath = m_dir + "/data/journal";
+}
+
+void JournalWriterTest::tearDown()
+{
+	remove(m_dataFilePath.c_str());
+	remove((m_dataFilePath + ".tmp").c_str());
+	remove((m_dataFilePath + ".cursor").c_str());
+	remove((m_dataFilePath + ".cursor.tmp").c_str());
+	rmdir((m_dir + "/data").c_str());
+	rmdir(m_dir.c_str());
+}
+
+void JournalWriterTest::testAppend_NewFile()
+{
+	afc::FastStringBuffer<char> header;
+	appendJournalHeader(1, header);
+	const string headerStr(header.data(), header.size());
+
+	JournalWriter writer;
+	writer.start(toString(m_dataFilePath));
+	writer.append(std::move(header), 0, true);
+	writer.append(buffer("abc", 3), journalHeaderSize, false);
+	writer.append(buffer("de", 2), journalHeaderSize + 3, true);
+	writer.flush();
+
+	CPPUNIT_ASSERT(!writer.takeFailure());
+	CPPUNIT_ASSERT_EQUAL(headerStr + "abcde", readFile(m_dataFilePath));
+
+	writer.stop();
+}
+
+void JournalWriterTest::testAppend_HeaderSkipped()
+{
+	afc::FastStringBuffer<char> header1, header2;
+	appendJournalHeader(1, header1);
+	appendJournalHeader(2, header2);
+	const string headerStr(header1.data(), header1.size());
+	header2.reserve(header2.size() + 2);
+	header2.append("fg", 2);
+
+	JournalWriter writer;
+	writer.start(toString(m_dataFilePath));
+	writer.append(std::move(header1), 0, false);
+	writer.flush();
+	// The journal header is not written twice.
+	writer.append(std::move(header2), 0, false);
+	writer.stop();
+
+	CPPUNIT_ASSERT(writer.takeFailure());
+	CPPUNIT_ASSERT_EQUAL(headerStr + "fg", readFile(m_dataFilePath));
+}
+
+void JournalWriterTest::testAppend_UnexpectedOffset()
+{
+	JournalWriter writer;
+	writer.start(toString(m_dataFilePath));
+	/* The data file does not exist so the journal header is written before the records.
+	 * The records written before are lost so the failure is reported.
+	 */
+	writer.append(buffer("abc", 3), journalHeaderSize + 10, false);
+	writer.flush();
+
+	CPPUNIT_ASSERT(writer.takeFailure());
+	CPPUNIT_ASSERT(!writer.takeFailure());
+
+	writer.append(buffer("de", 2), journalHeaderSize + 3, false);
+	writer.flush();
+
+	CPPUNIT_ASSERT(!writer.takeFailure());
+
+	writer.append(buffer("f", 1), journalHeaderSize, false);
+	writer.stop();
+
+	CPPUNIT_ASSERT(writer.takeFailure());
+
+	// The records are appended anyway.
+	const string content = readFile(m_dataFilePath);
+	uint64_t fileId;
+	CPPUNIT_ASSERT_EQUAL(journalHeaderSize + 6, content.size());
+	CPPUNIT_ASSERT(readJournalHeader(content.data(), content.data() + content.size(), fileId));
+	CPPUNIT_ASSERT_EQUAL(string("abcdef"), content.substr(journalHeaderSize));
+}
+
+void JournalWriterTest::testAppend_Buffers()
+{
+	afc::FastStringBuffer<char> header;
+	appendJournalHeader(1, header);
+	const string headerStr(header.data(), header.size());
+
+	vector<afc::FastStringBuffer<char>> records;
+	records.emplace_back(std::move(header));
+	records.emplace_back(buffer("abc", 3));
+	// Empty buffers are skipped.
+	records.emplace_back();
+	records.emplace_back(buffer("de", 2));
+
+	JournalWriter writer;
+	writer.start(toString(m_dataFilePath));
+	writer.append(std::move(records), 0, true);
+	writer.flush();
+
+	CPPUNIT_ASSERT(!writer.takeFailure());
+	CPPUNIT_ASSERT_EQUAL(headerStr + "abcde", readFile(m_dataFilePath));
+
+	writer.stop();
+}
+
+void JournalWriterTest::testRewrite()
+{
+	afc::FastStringBuffer<char> journal;
+	appendJournalHeader(3, journal);
+	journal.reserve(journal.size() + 2);
+	journal.append("xy", 2);
+	const string journalStr(journal.data(), journal.size());
+
+	afc::FastStringBuffer<char> oldJournal;
+	appendJournalHeader(2, oldJournal);
+	oldJournal.reserve(oldJournal.size() + 3);
+	oldJournal.append("abc", 3);
+
+	JournalWriter writer;
+	writer.start(toString(m_dataFilePath));
+	writer.append(std::move(oldJournal), 0, false);
+	writer.rewrite(std::move(journal));
+	// The data file is re-opened after it is replaced.
+	writer.append(buffer("z", 1), journalHeaderSize + 2, false);
+	JournalCursors offsets = {};
+	offsets[1] = journalHeaderSize + 1;
+	writer.storeCursor(3, offsets);
+	writer.stop();
+
+	CPPUNIT_ASSERT(!writer.takeFailure());
+	CPPUNIT_ASSERT_EQUAL(journalStr + "z", readFile(m_dataFilePath));
+
+	const string cursor = readFile(m_dataFilePath + ".cursor");
+	uint64_t fileId;
+	JournalCursors storedOffsets;
+	CPPUNIT_ASSERT(readJournalCursor(cursor.data(), cursor.data() + cursor.size(), fileId, storedOffsets));
+	CPPUNIT_ASSERT_EQUAL(uint64_t(3), fileId);
+	CPPUNIT_ASSERT(offsets == storedOffsets);
+	CPPUNIT_ASSERT(readFile(m_dataFilePath + ".tmp").empty());
+}
+
+void JournalWriterTest::testRewrite_CopyRange()
+{
+	afc::FastStringBuffer<char> oldJournal;
+	appendJournalHeader(2, oldJournal);
+	oldJournal.reserve(oldJournal.size() + 6);
+	oldJournal.append("abcdef", 6);
+
+	afc::FastStringBuffer<char> journal1;
+	appendJournalHeader(3, journal1);
+	journal1.reserve(journal1.size() + 2);
+	journal1.append("xy", 2);
+	const string journal1Str(journal1.data(), journal1.size());
+
+	afc::FastStringBuffer<char> journal2;
+	appendJournalHeader(4, journal2);
+	const string journal2Str(journal2.data(), journal2.size());
+
+	JournalWriter writer;
+	writer.start(toString(m_dataFilePath));
+	writer.append(std::move(oldJournal), 0, false);
+	// The octets "cde" of the old journal are kept.
+	writer.rewrite(std::move(journal1), journalHeaderSize + 2, journalHeaderSize + 5);
+	writer.flush();
+
+	CPPUNIT_ASSERT(!writer.takeFailure());
+	CPPUNIT_ASSERT_EQUAL(journal1Str + "cde", readFile(m_dataFilePath));
+
+	// Only the octets available are copied if the data file is shorter than expected.
+	writer.rewrite(std::move(journal2), journalHeaderSize + 3, journalHeaderSize + 100);
+	writer.stop();
+
+	CPPUNIT_ASSERT(!writer.takeFailure());
+	CPPUNIT_ASSERT_EQUAL(journal2Str + "de", readFile(m_dataFilePath));
+}
+
+void JournalWriterTest::testRewrite_Layout()
+{
+	afc::FastStringBuffer<char> oldJournal;
+	appendJournalHeader(2, oldJournal);
+	oldJournal.reserve(oldJournal.size() + 6);
+	oldJournal.append("abcdef", 6);
+
+	afc::FastStringBuffer<char> journal;
+	appendJournalHeader(3, journal);
+	journal.reserve(journal.size() + 2);
+	journal.append("xy", 2);
+	const string headerStr(journal.data(), journalHeaderSize);
+
+	vector<JournalWriter::RewriteRange> layout;
+	layout.push_back({0, journalHeaderSize, false});
+	layout.push_back({journalHeaderSize, journalHeaderSize + 2, true});
+	layout.push_back({journalHeaderSize, journalHeaderSize + 2, false});
+	layout.push_back({journalHeaderSize + 4, journalHeaderSize + 6, true});
+
+	JournalWriter writer;
+	writer.start(toString(m_dataFilePath));
+	writer.append(std::move(oldJournal), 0, false);
+	// The octets "ab" and "ef" of the old journal are interleaved with the octets "xy" of the new one.
+	writer.rewrite(std::move(journal), std::move(layout));
+	writer.stop();
+
+	CPPUNIT_ASSERT(!writer.takeFailure());
+	CPPUNIT_ASSERT_EQUAL(headerStr + "abxyef", readFile(m_dataFilePath));
+}
+
+void JournalWriterTest::testAmend()
+{
+	afc::FastStringBuffer<char> header;
+	appendJournalHeader(1, header);
+	const string headerStr(header.data(), header.size());
+
+	JournalWriter writer;
+	// The appends are delayed long enough to be amended.
+	writer.start(toString(m_dataFilePath), chrono::milliseconds(10000));
+	writer.append(std::move(header), 0, false);
+	writer.append(buffer("abc", 3), journalHeaderSize, false);
+
+	CPPUNIT_ASSERT(writer.amend(journalHeaderSize + 1, 1, [](char * const p) { *p = 'x'; }));
+	// The octets that span two appends cannot be amended.
+	CPPUNIT_ASSERT(!writer.amend(journalHeaderSize - 1, 2, [](char * const p) { *p = 'y'; }));
+
+	writer.flush();
+	// The appends are written so they cannot be amended any longer.
+	CPPUNIT_ASSERT(!writer.amend(journalHeaderSize + 1, 1, [](char * const p) { *p = 'z'; }));
+	writer.stop();
+
+	CPPUNIT_ASSERT(!writer.takeFailure());
+	CPPUNIT_ASSERT_EQUAL(headerStr + "axc", readFile(m_dataFilePath));
+}
+
+void JournalWriterTest::testStoreCursor_Replaced()
+{
+	JournalCursors offsets = {};
+	offsets[0] = journalHeaderSize + 10;
+
+	JournalWriter writer;
+	writer.start(toString(m_dataFilePath));
+	writer.storeCursor(3, offsets);
+	offsets[0] = journalHeaderSize + 20;
+	offsets[1] = journalHeaderSize + 5;
+	writer.storeCursor(3, offsets);
+	writer.stop();
+
+	// The cursor file is replaced as a whole with the last cursor; the temporary file is not left.
+	const string cursor = readFile(m_dataFilePath + ".cursor");
+	uint64_t fileId;
+	JournalCursors storedOffsets;
+	CPPUNIT_ASSERT(readJournalCursor(cursor.data(), cursor.data() + cursor.size(), fileId, storedOffsets));
+	CPPUNIT_ASSERT_EQUAL(uint64_t(3), fileId);
+	CPPUNIT_ASSERT(offsets == storedOffsets);
+	CPPUNIT_ASSERT_EQUAL(-1, access((m_dataFilePath + ".cursor.tmp").c_str(), F_OK));
+}
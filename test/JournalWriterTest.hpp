@@ -0,0 +1,54 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef JOURNALWRITERTEST_HPP_
+#define JOURNALWRITERTEST_HPP_
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+
+class JournalWriterTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(JournalWriterTest);
+	CPPUNIT_TEST(testAppend_NewFile);
+	CPPUNIT_TEST(testAppend_HeaderSkipped);
+	CPPUNIT_TEST(testAppend_UnexpectedOffset);
+	CPPUNIT_TEST(testAppend_Buffers);
+	CPPUNIT_TEST(testRewrite);
+	CPPUNIT_TEST(testRewrite_CopyRange);
+	CPPUNIT_TEST(testRewrite_Layout);
+	CPPUNIT_TEST(testAmend);
+	CPPUNIT_TEST(testStoreCursor_Replaced);
+	CPPUNIT_TEST_SUITE_END();
+public:
+	void setUp();
+	void tearDown();
+
+	void testAppend_NewFile();
+	void testAppend_HeaderSkipped();
+	void testAppend_UnexpectedOffset();
+	void testAppend_Buffers();
+	void testRewrite();
+	void testRewrite_CopyRange();
+	void testRewrite_Layout();
+	void testAmend();
+	void testStoreCursor_Replaced();
+private:
+	std::string m_dir;
+	std::string m_dataFilePath;
+};
+
+#endif /* JOURNALWRITERTEST_HPP_ */
@@ -0,0 +1,145 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "NetworkMonitorTest.hpp"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(NetworkMonitorTest);
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include <NetworkMonitor.hpp>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+
+using namespace std;
+
+namespace
+{
+	// Builds a rtnetlink message of a given type with a given payload.
+	template<typename Payload>
+	vector<char> message(const unsigned short type, const Payload &payload)
+	{
+		vector<char> result(NLMSG_SPACE(sizeof(Payload)));
+		nlmsghdr header = {};
+		header.nlmsg_len = NLMSG_LENGTH(sizeof(Payload));
+		header.nlmsg_type = type;
+		memcpy(result.data(), &header, sizeof(header));
+		memcpy(result.data() + NLMSG_HDRLEN, &payload, sizeof(payload));
+		return result;
+	}
+
+	bool isReachabilityEvent(const vector<char> &message)
+	{
+		return NetworkMonitor::isReachabilityEvent(*reinterpret_cast<const nlmsghdr *>(message.data()));
+	}
+
+	ifinfomsg link(const unsigned flags)
+	{
+		ifinfomsg result = {};
+		result.ifi_family = AF_UNSPEC;
+		result.ifi_flags = flags;
+		return result;
+	}
+
+	ifaddrmsg address(const unsigned char scope)
+	{
+		ifaddrmsg result = {};
+		result.ifa_family = AF_INET;
+		result.ifa_scope = scope;
+		return result;
+	}
+
+	rtmsg route(const unsigned char dstLength, const unsigned char table, const unsigned char type)
+	{
+		rtmsg result = {};
+		result.rtm_family = AF_INET;
+		result.rtm_dst_len = dstLength;
+		result.rtm_table = table;
+		result.rtm_type = type;
+		return result;
+	}
+}
+
+void NetworkMonitorTest::testReachabilityEvent_Link()
+{
+	CPPUNIT_ASSERT(isReachabilityEvent(message(RTM_NEWLINK, link(IFF_UP | IFF_RUNNING))));
+	CPPUNIT_ASSERT(isReachabilityEvent(message(RTM_NEWLINK, link(IFF_UP | IFF_RUNNING | IFF_MULTICAST))));
+	// An interface that is up but has no carrier.
+	CPPUNIT_ASSERT(!isReachabilityEvent(message(RTM_NEWLINK, link(IFF_UP))));
+	CPPUNIT_ASSERT(!isReachabilityEvent(message(RTM_NEWLINK, link(IFF_UP | IFF_RUNNING | IFF_LOOPBACK))));
+	CPPUNIT_ASSERT(!isReachabilityEvent(message(RTM_DELLINK, link(IFF_UP | IFF_RUNNING))));
+}
+
+void NetworkMonitorTest::testReachabilityEvent_Address()
+{
+	CPPUNIT_ASSERT(isReachabilityEvent(message(RTM_NEWADDR, address(RT_SCOPE_UNIVERSE))));
+	CPPUNIT_ASSERT(!isReachabilityEvent(message(RTM_NEWADDR, address(RT_SCOPE_LINK))));
+	CPPUNIT_ASSERT(!isReachabilityEvent(message(RTM_NEWADDR, address(RT_SCOPE_HOST))));
+	CPPUNIT_ASSERT(!isReachabilityEvent(message(RTM_DELADDR, address(RT_SCOPE_UNIVERSE))));
+
+	// A message that is too short to contain its payload.
+	vector<char> truncated = message(RTM_NEWADDR, address(RT_SCOPE_UNIVERSE));
+	reinterpret_cast<nlmsghdr *>(truncated.data())->nlmsg_len = NLMSG_HDRLEN;
+	CPPUNIT_ASSERT(!isReachabilityEvent(truncated));
+}
+
+void NetworkMonitorTest::testReachabilityEvent_Route()
+{
+	CPPUNIT_ASSERT(isReachabilityEvent(message(RTM_NEWROUTE, route(0, RT_TABLE_MAIN, RTN_UNICAST))));
+	CPPUNIT_ASSERT(!isReachabilityEvent(message(RTM_NEWROUTE, route(24, RT_TABLE_MAIN, RTN_UNICAST))));
+	CPPUNIT_ASSERT(!isReachabilityEvent(message(RTM_NEWROUTE, route(0, RT_TABLE_LOCAL, RTN_UNICAST))));
+	CPPUNIT_ASSERT(!isReachabilityEvent(message(RTM_NEWROUTE, route(0, RT_TABLE_MAIN, RTN_UNREACHABLE))));
+	CPPUNIT_ASSERT(!isReachabilityEvent(message(RTM_DELROUTE, route(0, RT_TABLE_MAIN, RTN_UNICAST))));
+}
+
+void NetworkMonitorTest::testContainsReachabilityEvent()
+{
+	const vector<char> hostAddress = message(RTM_NEWADDR, address(RT_SCOPE_HOST));
+	const vector<char> defaultRoute = message(RTM_NEWROUTE, route(0, RT_TABLE_MAIN, RTN_UNICAST));
+
+	vector<char> buffer(hostAddress);
+	CPPUNIT_ASSERT(!NetworkMonitor::containsReachabilityEvent(buffer.data(), buffer.size()));
+
+	// The event follows another message within the same buffer.
+	buffer.insert(buffer.end(), defaultRoute.begin(), defaultRoute.end());
+	CPPUNIT_ASSERT(NetworkMonitor::containsReachabilityEvent(buffer.data(), buffer.size()));
+
+	// The event is cut off.
+	CPPUNIT_ASSERT(!NetworkMonitor::containsReachabilityEvent(buffer.data(), buffer.size() - 1));
+	CPPUNIT_ASSERT(!NetworkMonitor::containsReachabilityEvent(buffer.data(), 0));
+}
+
+void NetworkMonitorTest::testOpenClose()
+{
+	NetworkMonitor monitor;
+	CPPUNIT_ASSERT(!monitor.opened());
+	CPPUNIT_ASSERT_EQUAL(-1, monitor.fd());
+	CPPUNIT_ASSERT(monitor.open());
+	CPPUNIT_ASSERT(monitor.opened());
+	CPPUNIT_ASSERT(monitor.fd() != -1);
+
+	// Re-opening re-subscribes.
+	CPPUNIT_ASSERT(monitor.open());
+	CPPUNIT_ASSERT(monitor.opened());
+
+	monitor.close();
+	CPPUNIT_ASSERT(!monitor.opened());
+	CPPUNIT_ASSERT_EQUAL(-1, monitor.fd());
+	monitor.close();
+	CPPUNIT_ASSERT(!monitor.opened());
+}
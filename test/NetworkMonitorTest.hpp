@@ -0,0 +1,39 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef NETWORKMONITORTEST_HPP_
+#define NETWORKMONITORTEST_HPP_
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class NetworkMonitorTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(NetworkMonitorTest);
+	CPPUNIT_TEST(testReachabilityEvent_Link);
+	CPPUNIT_TEST(testReachabilityEvent_Address);
+	CPPUNIT_TEST(testReachabilityEvent_Route);
+	CPPUNIT_TEST(testContainsReachabilityEvent);
+	CPPUNIT_TEST(testOpenClose);
+	CPPUNIT_TEST_SUITE_END();
+public:
+	void testReachabilityEvent_Link();
+	void testReachabilityEvent_Address();
+	void testReachabilityEvent_Route();
+	void testContainsReachabilityEvent();
+	void testOpenClose();
+};
+
+#endif /* NETWORKMONITORTEST_HPP_ */
@@ -0,0 +1,879 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "ReactorTest.hpp"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ReactorTest);
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <Reactor.hpp>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+	class TestTask : public Reactor::Task
+	{
+	public:
+		explicit TestTask(function<void (TestTask &)> &&action) : m_action(move(action)), m_runCount(0) {}
+
+		using Reactor::Task::setDeadline;
+
+		size_t runCount() const
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_runCount;
+		}
+
+		// Returns true if the task is run a given number of times within a second.
+		bool awaitRunCount(const size_t count)
+		{ unique_lock<mutex> lock(m_mutex);
+			return m_cv.wait_for(lock, chrono::seconds(1), [&]() { return m_runCount >= count; });
+		}
+	protected:
+		virtual void run() override
+		{
+			m_action(*this);
+			{ lock_guard<mutex> lock(m_mutex);
+				++m_runCount;
+			}
+			m_cv.notify_all();
+		}
+	private:
+		function<void (TestTask &)> m_action;
+		mutable mutex m_mutex;
+		condition_variable m_cv;
+		size_t m_runCount;
+	};
+
+	class TestCall : public HttpCall, public HttpResponse::BodyAppender
+	{
+	public:
+		TestCall() : request(), response(*this), body(), m_completed(false), m_status() {}
+
+		virtual void operator()(const char * const dataChunk, const size_t n) override { body.append(dataChunk, n); }
+
+		virtual void completed(const HttpClient::StatusCode status) override
+		{
+			{ lock_guard<mutex> lock(m_mutex);
+				m_status = status;
+				m_completed = true;
+			}
+			m_cv.notify_all();
+		}
+
+		// Returns true if the call is completed within a given time.
+		bool awaitCompletion(const chrono::milliseconds timeout = chrono::seconds(1))
+		{ unique_lock<mutex> lock(m_mutex);
+			return m_cv.wait_for(lock, timeout, [&]() { return m_completed; });
+		}
+
+		bool isCompleted()
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_completed;
+		}
+
+		HttpClient::StatusCode status()
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_status;
+		}
+
+		HttpRequest request;
+		HttpResponse response;
+		string body;
+	private:
+		mutex m_mutex;
+		condition_variable m_cv;
+		bool m_completed;
+		HttpClient::StatusCode m_status;
+	};
+
+	// Produces a given body a few octets at a time.
+	class TestBodyProducer : public HttpRequest::BodyProducer
+	{
+	public:
+		explicit TestBodyProducer(const string &body) : rewindCount(0), m_body(body), m_offset(0) {}
+
+		virtual size_t operator()(char * const dest, const size_t n) override
+		{
+			const size_t count = min(min(n, size_t(3)), m_body.size() - m_offset);
+			m_body.copy(dest, count, m_offset);
+			m_offset += count;
+			return count;
+		}
+
+		virtual size_t size() override { return m_body.size(); }
+
+		virtual bool rewind() override
+		{
+			m_offset = 0;
+			++rewindCount;
+			return true;
+		}
+
+		size_t rewindCount;
+	private:
+		const string m_body;
+		size_t m_offset;
+	};
+
+	const char okResponse[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nOK";
+	// The body is cut short so the call stalls once the response is started.
+	const char truncatedResponse[] = "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\nOK";
+	// Sent instead of the response to a chunked request, as the servers that do not accept them do.
+	const char lengthRequiredResponse[] = "HTTP/1.1 411 Length Required\r\nContent-Length: 0\r\n\r\n";
+
+	/* Decodes a chunked request body that starts at a given position of given data, and moves
+	 * the position to the end of the body. Returns false if the body is not received completely.
+	 */
+	bool decodeChunked(const string &data, size_t &pos, string &body)
+	{
+		for (size_t chunkStart = pos;;) {
+			const size_t sizeEnd = data.find("\r\n", chunkStart);
+			if (sizeEnd == string::npos) {
+				return false;
+			}
+			const size_t chunkSize = strtoul(data.c_str() + chunkStart, nullptr, 16);
+			const size_t chunkEnd = sizeEnd + 2 + chunkSize + 2;
+			if (data.size() < chunkEnd) {
+				return false;
+			}
+			if (chunkSize == 0) {
+				pos = chunkEnd;
+				return true;
+			}
+			body.append(data, sizeEnd + 2, chunkSize);
+			chunkStart = chunkEnd;
+		}
+	}
+
+	/* An HTTP server on the loopback interface that sends a given response to each request and keeps
+	 * connections alive. Each connection is served by its own thread. The responses are held back until
+	 * a given number of requests are received in total (SIZE_MAX makes the server never respond).
+	 * A connection that has served a given number of requests is closed once the next request is
+	 * received, as if it were closed by the server before the request was sent. Chunked requests
+	 * are rejected.
+	 */
+	class TestServer
+	{
+	public:
+		explicit TestServer(const size_t heldResponseCount = 0, const char * const response = okResponse,
+				const size_t requestsPerConnection = SIZE_MAX)
+			: m_heldResponseCount(heldResponseCount), m_response(response),
+			  m_requestsPerConnection(requestsPerConnection), m_socket(-1), m_port(0), m_thread(), m_mutex(), m_cv(),
+			  m_connections(), m_connectionThreads(), m_requestCount(0), m_bodies(), m_stopped(false) {}
+
+		~TestServer()
+		{
+			if (m_thread.joinable()) {
+				// Makes accept(), recv() and the responses held back return.
+				{ lock_guard<mutex> lock(m_mutex);
+					m_stopped = true;
+					::shutdown(m_socket, SHUT_RDWR);
+					for (const int connection : m_connections) {
+						::shutdown(connection, SHUT_RDWR);
+					}
+				}
+				m_cv.notify_all();
+				m_thread.join();
+				for (thread &connectionThread : m_connectionThreads) {
+					connectionThread.join();
+				}
+				for (const int connection : m_connections) {
+					::close(connection);
+				}
+			}
+			if (m_socket != -1) {
+				::close(m_socket);
+			}
+		}
+
+		bool start()
+		{
+			m_socket = ::socket(AF_INET, SOCK_STREAM, 0);
+			sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			socklen_t addressSize = sizeof(address);
+			if (m_socket == -1 || ::bind(m_socket, reinterpret_cast<sockaddr *>(&address), addressSize) != 0 ||
+					::listen(m_socket, 16) != 0 ||
+					::getsockname(m_socket, reinterpret_cast<sockaddr *>(&address), &addressSize) != 0) {
+				return false;
+			}
+			m_port = ntohs(address.sin_port);
+			m_thread = thread([this]() { serve(); });
+			return true;
+		}
+
+		string url() const { return "http://127.0.0.1:" + to_string(m_port) + "/"; }
+		// The TLS handshake is never responded to by this server.
+		string httpsUrl() const { return "https://127.0.0.1:" + to_string(m_port) + "/"; }
+
+		size_t connectionCount()
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_connections.size();
+		}
+
+		// The bodies of the requests responded to, in the order they are received.
+		vector<string> bodies()
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_bodies;
+		}
+	private:
+		void serve()
+		{
+			for (;;) {
+				const int connection = ::accept(m_socket, nullptr, nullptr);
+				if (connection == -1) {
+					return;
+				}
+				lock_guard<mutex> lock(m_mutex);
+				m_connections.push_back(connection);
+				m_connectionThreads.emplace_back([this, connection]() { serveConnection(connection); });
+			}
+		}
+
+		void serveConnection(const int connection)
+		{
+			string request;
+			size_t servedCount = 0;
+			char buf[512];
+			ssize_t n;
+			while ((n = ::recv(connection, buf, sizeof(buf), 0)) > 0) {
+				request.append(buf, static_cast<size_t>(n));
+				for (size_t headersEnd; (headersEnd = request.find("\r\n\r\n")) != string::npos;) {
+					size_t end = headersEnd + 4;
+					string body;
+					const bool chunked = request.find("Transfer-Encoding: chunked") < headersEnd;
+					const size_t lengthPos = request.find("Content-Length: ");
+					if (chunked) {
+						if (!decodeChunked(request, end, body)) {
+							break;
+						}
+					} else if (lengthPos < headersEnd) {
+						const size_t length = strtoul(request.c_str() + lengthPos + strlen("Content-Length: "),
+								nullptr, 10);
+						if (request.size() < end + length) {
+							break;
+						}
+						body.assign(request, end, length);
+						end += length;
+					}
+					request.erase(0, end);
+					if (servedCount++ == m_requestsPerConnection) {
+						::shutdown(connection, SHUT_RDWR);
+						return;
+					}
+					{ unique_lock<mutex> lock(m_mutex);
+						++m_requestCount;
+						m_bodies.push_back(move(body));
+						m_cv.notify_all();
+						m_cv.wait(lock, [this]() { return m_requestCount >= m_heldResponseCount || m_stopped; });
+					}
+					const char * const response = chunked ? lengthRequiredResponse : m_response;
+					::send(connection, response, strlen(response), MSG_NOSIGNAL);
+				}
+			}
+			// The connection is closed once the server is stopped so that its descriptor is not re-used meanwhile.
+		}
+
+		const size_t m_heldResponseCount;
+		const char * const m_response;
+		const size_t m_requestsPerConnection;
+		int m_socket;
+		unsigned m_port;
+		thread m_thread;
+		mutex m_mutex;
+		condition_variable m_cv;
+		vector<int> m_connections;
+		vector<thread> m_connectionThreads;
+		size_t m_requestCount;
+		vector<string> m_bodies;
+		bool m_stopped;
+	};
+
+	class TestWatch : public Reactor::Watch
+	{
+	public:
+		explicit TestWatch(const int fd) : m_fd(fd), m_data() {}
+
+		virtual void ready() override
+		{
+			char buf[16];
+			const ssize_t n = ::read(m_fd, buf, sizeof(buf));
+			{ lock_guard<mutex> lock(m_mutex);
+				if (n > 0) {
+					m_data.append(buf, static_cast<size_t>(n));
+				}
+			}
+			m_cv.notify_all();
+		}
+
+		// Returns the data read if it is as long as expected within a second.
+		string awaitData(const size_t size)
+		{ unique_lock<mutex> lock(m_mutex);
+			m_cv.wait_for(lock, chrono::seconds(1), [&]() { return m_data.size() >= size; });
+			return m_data;
+		}
+	private:
+		const int m_fd;
+		mutex m_mutex;
+		condition_variable m_cv;
+		string m_data;
+	};
+
+	HttpTimeouts totalTimeout(const chrono::milliseconds total)
+	{
+		HttpTimeouts timeouts;
+		timeouts.total = total;
+		return timeouts;
+	}
+
+	/* Performs a GET call to a given URL with given timeouts on a reactor of its own.
+	 * Returns the time it has taken to complete the call, or a minute if it is not completed.
+	 */
+	chrono::steady_clock::duration performCall(const string &url, const HttpTimeouts &timeouts, TestCall &call)
+	{
+		Reactor reactor;
+		CPPUNIT_ASSERT(reactor.start());
+
+		HttpClient client;
+		call.request.setBody(nullptr, 0);
+		bool performed = false;
+		const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		TestTask task([&](TestTask &self)
+		{
+			performed = client.prepareGet(call, url.c_str(), call.request, call.response, timeouts) ==
+					HttpClient::StatusCode::SUCCESS && reactor.perform(self, call);
+		});
+		reactor.attach(task);
+		const bool completed = call.awaitCompletion(chrono::minutes(1));
+		const chrono::steady_clock::duration elapsed = chrono::steady_clock::now() - start;
+		reactor.detach(task);
+		reactor.stop();
+
+		CPPUNIT_ASSERT(performed);
+		return completed ? elapsed : chrono::minutes(1);
+	}
+}
+
+void ReactorTest::testWake()
+{
+	Reactor reactor;
+	CPPUNIT_ASSERT(reactor.start());
+	CPPUNIT_ASSERT(reactor.started());
+
+	TestTask task([](TestTask &) {});
+	// A task is run once it is attached.
+	reactor.attach(task);
+	CPPUNIT_ASSERT(task.awaitRunCount(1));
+
+	task.wake();
+	CPPUNIT_ASSERT(task.awaitRunCount(2));
+	task.wake();
+	CPPUNIT_ASSERT(task.awaitRunCount(3));
+
+	reactor.detach(task);
+	const size_t runCount = task.runCount();
+	// A task that is detached is not run.
+	task.wake();
+	this_thread::sleep_for(chrono::milliseconds(20));
+	CPPUNIT_ASSERT_EQUAL(runCount, task.runCount());
+
+	reactor.stop();
+	CPPUNIT_ASSERT(!reactor.started());
+}
+
+void ReactorTest::testDeadline()
+{
+	Reactor reactor;
+	CPPUNIT_ASSERT(reactor.start());
+
+	const chrono::milliseconds delay(50);
+	Reactor::Clock::time_point deadline;
+	Reactor::Clock::time_point secondRun;
+	TestTask task([&](TestTask &self)
+	{
+		if (self.runCount() == 0) {
+			deadline = Reactor::Clock::now() + delay;
+			self.setDeadline(deadline);
+		} else {
+			secondRun = Reactor::Clock::now();
+		}
+	});
+	reactor.attach(task);
+	CPPUNIT_ASSERT(task.awaitRunCount(2));
+	reactor.detach(task);
+
+	CPPUNIT_ASSERT(secondRun >= deadline);
+	// The task is run only once its deadline is reached.
+	CPPUNIT_ASSERT_EQUAL(size_t(2), task.runCount());
+}
+
+void ReactorTest::testPerform()
+{
+	char path[] = "/tmp/reactorTest_XXXXXX";
+	const int fd = ::mkstemp(path);
+	CPPUNIT_ASSERT(fd != -1);
+	CPPUNIT_ASSERT(::write(fd, "Hello", 5) == 5);
+	::close(fd);
+	const string url = string("file://") + path;
+
+	Reactor reactor;
+	CPPUNIT_ASSERT(reactor.start());
+
+	HttpClient client;
+	TestCall call;
+	call.request.setBody(nullptr, 0);
+	bool performed = false;
+	TestTask task([&](TestTask &self)
+	{
+		performed = client.prepareGet(call, url.c_str(), call.request, call.response, totalTimeout(chrono::seconds(1))) ==
+				HttpClient::StatusCode::SUCCESS && reactor.perform(self, call);
+	});
+	reactor.attach(task);
+
+	CPPUNIT_ASSERT(call.awaitCompletion());
+	reactor.detach(task);
+	::unlink(path);
+
+	CPPUNIT_ASSERT(performed);
+	CPPUNIT_ASSERT(call.status() == HttpClient::StatusCode::SUCCESS);
+	CPPUNIT_ASSERT_EQUAL(string("Hello"), call.body);
+}
+
+void ReactorTest::testPerform_ReusesConnection()
+{
+	TestServer server;
+	CPPUNIT_ASSERT(server.start());
+	const string url = server.url();
+
+	Reactor reactor;
+	CPPUNIT_ASSERT(reactor.start());
+
+	HttpClient client;
+	TestCall calls[2];
+	bool performed[2] = {false, false};
+	TestTask task([&](TestTask &self)
+	{
+		const size_t i = self.runCount();
+		if (i < 2) {
+			calls[i].request.setBody(nullptr, 0);
+			performed[i] = client.prepareGet(calls[i], url.c_str(), calls[i].request, calls[i].response,
+					totalTimeout(chrono::seconds(1))) == HttpClient::StatusCode::SUCCESS && reactor.perform(self, calls[i]);
+		}
+	});
+	reactor.attach(task);
+	CPPUNIT_ASSERT(calls[0].awaitCompletion());
+	// The second call is started once the first one is completed.
+	task.wake();
+	CPPUNIT_ASSERT(calls[1].awaitCompletion());
+	reactor.detach(task);
+
+	for (size_t i = 0; i < 2; ++i) {
+		CPPUNIT_ASSERT(performed[i]);
+		CPPUNIT_ASSERT(calls[i].status() == HttpClient::StatusCode::SUCCESS);
+		CPPUNIT_ASSERT_EQUAL(200, calls[i].response.statusCode);
+		CPPUNIT_ASSERT_EQUAL(string("OK"), calls[i].body);
+	}
+	// The connection of the first call is kept alive and reused by the second one.
+	CPPUNIT_ASSERT_EQUAL(size_t(1), server.connectionCount());
+
+	reactor.stop();
+}
+
+void ReactorTest::testPerform_StreamedBody()
+{
+	// The connection is dropped once the second request is sent so that it is re-sent by a new connection.
+	TestServer server(0, okResponse, 1);
+	CPPUNIT_ASSERT(server.start());
+	const string url = server.url();
+
+	Reactor reactor;
+	CPPUNIT_ASSERT(reactor.start());
+
+	HttpClient client;
+	TestCall calls[2];
+	TestBodyProducer producers[2] = {TestBodyProducer("first=body"), TestBodyProducer("second&streamed=body")};
+	bool performed[2] = {false, false};
+	TestTask task([&](TestTask &self)
+	{
+		const size_t i = self.runCount();
+		if (i < 2) {
+			calls[i].request.setBody(producers[i]);
+			performed[i] = client.preparePost(calls[i], url.c_str(), calls[i].request, calls[i].response,
+					totalTimeout(chrono::seconds(1))) == HttpClient::StatusCode::SUCCESS && reactor.perform(self, calls[i]);
+		}
+	});
+	reactor.attach(task);
+	CPPUNIT_ASSERT(calls[0].awaitCompletion());
+	task.wake();
+	CPPUNIT_ASSERT(calls[1].awaitCompletion());
+	reactor.detach(task);
+
+	for (size_t i = 0; i < 2; ++i) {
+		CPPUNIT_ASSERT(performed[i]);
+		CPPUNIT_ASSERT(calls[i].status() == HttpClient::StatusCode::SUCCESS);
+		// The bodies are sent with their lengths; the server rejects chunked ones.
+		CPPUNIT_ASSERT_EQUAL(200, calls[i].response.statusCode);
+	}
+	const vector<string> bodies = server.bodies();
+	CPPUNIT_ASSERT_EQUAL(size_t(2), bodies.size());
+	CPPUNIT_ASSERT_EQUAL(string("first=body"), bodies[0]);
+	CPPUNIT_ASSERT_EQUAL(string("second&streamed=body"), bodies[1]);
+	// The body of the second call is produced again for the new connection.
+	CPPUNIT_ASSERT_EQUAL(size_t(1), producers[1].rewindCount);
+	CPPUNIT_ASSERT_EQUAL(size_t(2), server.connectionCount());
+
+	reactor.stop();
+}
+
+void ReactorTest::testPerform_BodyMeasuredOutsideTask()
+{
+	// Records whether a given mutex is free when the body is measured.
+	class LockCheckingBodyProducer : public TestBodyProducer
+	{
+	public:
+		LockCheckingBodyProducer(const string &body, mutex &lock)
+			: TestBodyProducer(body), measuredUnlocked(false), m_lock(lock) {}
+
+		virtual size_t size() override
+		{
+			measuredUnlocked = m_lock.try_lock();
+			if (measuredUnlocked) {
+				m_lock.unlock();
+			}
+			return TestBodyProducer::size();
+		}
+
+		bool measuredUnlocked;
+	private:
+		mutex &m_lock;
+	};
+
+	TestServer server(0, okResponse);
+	CPPUNIT_ASSERT(server.start());
+	const string url = server.url();
+
+	Reactor reactor;
+	CPPUNIT_ASSERT(reactor.start());
+
+	HttpClient client;
+	TestCall call;
+	mutex taskMutex;
+	LockCheckingBodyProducer producer("measured=outside", taskMutex);
+	bool performed = false;
+	// The task starts the call within its critical section, as the scrobblers do.
+	TestTask task([&](TestTask &self)
+	{ lock_guard<mutex> lock(taskMutex);
+		call.request.setBody(producer);
+		performed = client.preparePost(call, url.c_str(), call.request, call.response,
+				totalTimeout(chrono::seconds(1))) == HttpClient::StatusCode::SUCCESS && reactor.perform(self, call);
+	});
+	reactor.attach(task);
+	CPPUNIT_ASSERT(call.awaitCompletion());
+	reactor.detach(task);
+
+	CPPUNIT_ASSERT(performed);
+	CPPUNIT_ASSERT(call.status() == HttpClient::StatusCode::SUCCESS);
+	CPPUNIT_ASSERT_EQUAL(200, call.response.statusCode);
+	CPPUNIT_ASSERT(producer.measuredUnlocked);
+	const vector<string> bodies = server.bodies();
+	CPPUNIT_ASSERT_EQUAL(size_t(1), bodies.size());
+	CPPUNIT_ASSERT_EQUAL(string("measured=outside"), bodies[0]);
+
+	reactor.stop();
+}
+
+void ReactorTest::testPerform_Concurrent()
+{
+	constexpr size_t callCount = 4;
+	// The server responds only once all the requests are received, so the calls must be in flight at once.
+	TestServer server(callCount);
+	CPPUNIT_ASSERT(server.start());
+	const string url = server.url();
+
+	Reactor reactor;
+	CPPUNIT_ASSERT(reactor.start());
+
+	HttpClient client;
+	TestCall calls[callCount];
+	size_t performedCount = 0;
+	TestTask task([&](TestTask &self)
+	{
+		for (TestCall &call : calls) {
+			call.request.setBody(nullptr, 0);
+			if (client.prepareGet(call, url.c_str(), call.request, call.response, totalTimeout(chrono::seconds(1))) ==
+					HttpClient::StatusCode::SUCCESS && reactor.perform(self, call)) {
+				++performedCount;
+			}
+		}
+	});
+	reactor.attach(task);
+	for (TestCall &call : calls) {
+		CPPUNIT_ASSERT(call.awaitCompletion());
+	}
+	reactor.detach(task);
+
+	CPPUNIT_ASSERT_EQUAL(callCount, performedCount);
+	for (TestCall &call : calls) {
+		CPPUNIT_ASSERT(call.status() == HttpClient::StatusCode::SUCCESS);
+		CPPUNIT_ASSERT_EQUAL(string("OK"), call.body);
+	}
+	CPPUNIT_ASSERT_EQUAL(callCount, server.connectionCount());
+
+	reactor.stop();
+}
+
+void ReactorTest::testDetach_AbortsCalls()
+{
+	// A server that accepts connections (by the kernel) but never responds.
+	const int server = ::socket(AF_INET, SOCK_STREAM, 0);
+	CPPUNIT_ASSERT(server != -1);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressSize = sizeof(address);
+	CPPUNIT_ASSERT(::bind(server, reinterpret_cast<sockaddr *>(&address), addressSize) == 0);
+	CPPUNIT_ASSERT(::listen(server, 4) == 0);
+	CPPUNIT_ASSERT(::getsockname(server, reinterpret_cast<sockaddr *>(&address), &addressSize) == 0);
+	char url[64];
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/", unsigned(ntohs(address.sin_port)));
+
+	Reactor reactor;
+	CPPUNIT_ASSERT(reactor.start());
+
+	HttpClient client;
+	TestCall call;
+	call.request.setBody(nullptr, 0);
+	bool performed = false;
+	TestTask task([&](TestTask &self)
+	{
+		performed = client.prepareGet(call, url, call.request, call.response, totalTimeout(chrono::minutes(1))) ==
+				HttpClient::StatusCode::SUCCESS && reactor.perform(self, call);
+	});
+	reactor.attach(task);
+	CPPUNIT_ASSERT(task.awaitRunCount(1));
+	CPPUNIT_ASSERT(performed);
+	CPPUNIT_ASSERT(!call.isCompleted());
+
+	const Reactor::Clock::time_point start = Reactor::Clock::now();
+	reactor.detach(task);
+	CPPUNIT_ASSERT(Reactor::Clock::now() - start < chrono::seconds(1));
+	// The call is completed by the time the task is detached.
+	CPPUNIT_ASSERT(call.isCompleted());
+	CPPUNIT_ASSERT(call.status() == HttpClient::StatusCode::ABORTED_BY_CLIENT);
+
+	reactor.stop();
+	::close(server);
+}
+
+void ReactorTest::testDetach_Deadline()
+{
+	Reactor reactor;
+	CPPUNIT_ASSERT(reactor.start());
+
+	// A task that keeps the reactor busy until it is released.
+	mutex releaseMutex;
+	condition_variable releaseCv;
+	bool released = false;
+	TestTask blocker([&](TestTask &)
+	{ unique_lock<mutex> lock(releaseMutex);
+		releaseCv.wait(lock, [&]() { return released; });
+	});
+	TestTask task([](TestTask &) {});
+	reactor.attach(task);
+	CPPUNIT_ASSERT(task.awaitRunCount(1));
+	reactor.attach(blocker);
+	this_thread::sleep_for(chrono::milliseconds(20));
+
+	const Reactor::Clock::time_point start = Reactor::Clock::now();
+	// The reactor is busy, so the task is not detached in time.
+	CPPUNIT_ASSERT(!reactor.detach(task, start + chrono::milliseconds(50)));
+	CPPUNIT_ASSERT(Reactor::Clock::now() - start >= chrono::milliseconds(50));
+	CPPUNIT_ASSERT(Reactor::Clock::now() - start < chrono::seconds(1));
+
+	{ lock_guard<mutex> lock(releaseMutex);
+		released = true;
+	}
+	releaseCv.notify_all();
+	// The detachment requested is still carried out.
+	CPPUNIT_ASSERT(reactor.detach(task, Reactor::Clock::now() + chrono::seconds(1)));
+	const size_t runCount = task.runCount();
+	task.wake();
+	this_thread::sleep_for(chrono::milliseconds(20));
+	CPPUNIT_ASSERT_EQUAL(runCount, task.runCount());
+
+	reactor.detach(blocker);
+	reactor.stop();
+}
+
+void ReactorTest::testPerform_ConnectTimeout()
+{
+	// The backlog of a server that never accepts connections is filled so that connecting hangs.
+	const int server = ::socket(AF_INET, SOCK_STREAM, 0);
+	CPPUNIT_ASSERT(server != -1);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressSize = sizeof(address);
+	CPPUNIT_ASSERT(::bind(server, reinterpret_cast<sockaddr *>(&address), addressSize) == 0);
+	CPPUNIT_ASSERT(::listen(server, 0) == 0);
+	CPPUNIT_ASSERT(::getsockname(server, reinterpret_cast<sockaddr *>(&address), &addressSize) == 0);
+	vector<int> clients;
+	for (int i = 0; i < 2; ++i) {
+		const int client = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		CPPUNIT_ASSERT(client != -1);
+		::connect(client, reinterpret_cast<sockaddr *>(&address), addressSize);
+		clients.push_back(client);
+	}
+	char url[64];
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/", unsigned(ntohs(address.sin_port)));
+
+	HttpTimeouts timeouts = totalTimeout(chrono::seconds(30));
+	timeouts.connect = chrono::milliseconds(200);
+	TestCall call;
+	const chrono::steady_clock::duration elapsed = performCall(url, timeouts, call);
+
+	CPPUNIT_ASSERT(call.status() == HttpClient::StatusCode::OPERATION_TIMEOUT);
+	CPPUNIT_ASSERT(elapsed >= chrono::milliseconds(200));
+	CPPUNIT_ASSERT(elapsed < chrono::seconds(2));
+
+	for (const int client : clients) {
+		::close(client);
+	}
+	::close(server);
+}
+
+void ReactorTest::testPerform_TlsTimeout()
+{
+	// The server waits for an HTTP request so the TLS handshake is never responded to.
+	TestServer server(SIZE_MAX);
+	CPPUNIT_ASSERT(server.start());
+
+	HttpTimeouts timeouts = totalTimeout(chrono::seconds(30));
+	timeouts.connect = chrono::milliseconds(200);
+	timeouts.tls = chrono::milliseconds(300);
+	TestCall call;
+	const chrono::steady_clock::duration elapsed = performCall(server.httpsUrl(), timeouts, call);
+
+	CPPUNIT_ASSERT(call.status() == HttpClient::StatusCode::OPERATION_TIMEOUT);
+	// The TLS phase is limited on its own, after the connection is established.
+	CPPUNIT_ASSERT(elapsed >= chrono::milliseconds(300));
+	CPPUNIT_ASSERT(elapsed < chrono::seconds(2));
+}
+
+void ReactorTest::testPerform_FirstByteTimeout()
+{
+	TestServer server(SIZE_MAX);
+	CPPUNIT_ASSERT(server.start());
+
+	HttpTimeouts timeouts = totalTimeout(chrono::seconds(30));
+	timeouts.firstByte = chrono::milliseconds(300);
+	// The response is waited for shorter than the call would be considered stalled.
+	timeouts.stallSpeed = 1;
+	timeouts.stallTime = chrono::seconds(10);
+	TestCall call;
+	const chrono::steady_clock::duration elapsed = performCall(server.url(), timeouts, call);
+
+	CPPUNIT_ASSERT(call.status() == HttpClient::StatusCode::OPERATION_TIMEOUT);
+	CPPUNIT_ASSERT(elapsed >= chrono::milliseconds(300));
+	CPPUNIT_ASSERT(elapsed < chrono::seconds(2));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), server.connectionCount());
+}
+
+void ReactorTest::testPerform_TotalTimeout()
+{
+	TestServer server(0, truncatedResponse);
+	CPPUNIT_ASSERT(server.start());
+
+	HttpTimeouts timeouts = totalTimeout(chrono::milliseconds(300));
+	timeouts.firstByte = chrono::seconds(10);
+	TestCall call;
+	const chrono::steady_clock::duration elapsed = performCall(server.url(), timeouts, call);
+
+	// The response is started in time but is not completed in time.
+	CPPUNIT_ASSERT(call.status() == HttpClient::StatusCode::OPERATION_TIMEOUT);
+	CPPUNIT_ASSERT(elapsed >= chrono::milliseconds(300));
+	CPPUNIT_ASSERT(elapsed < chrono::seconds(2));
+}
+
+void ReactorTest::testPerform_Stalled()
+{
+	TestServer server(0, truncatedResponse);
+	CPPUNIT_ASSERT(server.start());
+
+	HttpTimeouts timeouts = totalTimeout(chrono::seconds(30));
+	timeouts.stallSpeed = 1;
+	timeouts.stallTime = chrono::seconds(1);
+	TestCall call;
+	const chrono::steady_clock::duration elapsed = performCall(server.url(), timeouts, call);
+
+	// A stall is told from a timeout.
+	CPPUNIT_ASSERT(call.status() == HttpClient::StatusCode::STALLED);
+	CPPUNIT_ASSERT(elapsed >= chrono::seconds(1));
+	CPPUNIT_ASSERT(elapsed < chrono::seconds(10));
+}
+
+void ReactorTest::testWatch()
+{
+	int fds[2];
+	CPPUNIT_ASSERT(::pipe(fds) == 0);
+
+	Reactor reactor;
+	CPPUNIT_ASSERT(reactor.start());
+
+	TestWatch watch(fds[0]);
+	bool watched = false;
+	TestTask task([&](TestTask &self)
+	{
+		if (self.runCount() == 0) {
+			watched = reactor.watch(self, fds[0], watch);
+		}
+	});
+	reactor.attach(task);
+	CPPUNIT_ASSERT(task.awaitRunCount(1));
+	CPPUNIT_ASSERT(watched);
+
+	CPPUNIT_ASSERT(::write(fds[1], "ab", 2) == 2);
+	CPPUNIT_ASSERT_EQUAL(string("ab"), watch.awaitData(2));
+	CPPUNIT_ASSERT(::write(fds[1], "c", 1) == 1);
+	CPPUNIT_ASSERT_EQUAL(string("abc"), watch.awaitData(3));
+
+	// The watch is removed once the task is detached.
+	reactor.detach(task);
+	CPPUNIT_ASSERT(::write(fds[1], "d", 1) == 1);
+	this_thread::sleep_for(chrono::milliseconds(20));
+	CPPUNIT_ASSERT_EQUAL(string("abc"), watch.awaitData(3));
+
+	reactor.stop();
+	::close(fds[0]);
+	::close(fds[1]);
+}
@@ -0,0 +1,59 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef REACTORTEST_HPP_
+#define REACTORTEST_HPP_
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class ReactorTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(ReactorTest);
+	CPPUNIT_TEST(testWake);
+	CPPUNIT_TEST(testDeadline);
+	CPPUNIT_TEST(testPerform);
+	CPPUNIT_TEST(testPerform_ReusesConnection);
+	CPPUNIT_TEST(testPerform_StreamedBody);
+	CPPUNIT_TEST(testPerform_BodyMeasuredOutsideTask);
+	CPPUNIT_TEST(testPerform_Concurrent);
+	CPPUNIT_TEST(testPerform_ConnectTimeout);
+	CPPUNIT_TEST(testPerform_TlsTimeout);
+	CPPUNIT_TEST(testPerform_FirstByteTimeout);
+	CPPUNIT_TEST(testPerform_TotalTimeout);
+	CPPUNIT_TEST(testPerform_Stalled);
+	CPPUNIT_TEST(testDetach_AbortsCalls);
+	CPPUNIT_TEST(testDetach_Deadline);
+	CPPUNIT_TEST(testWatch);
+	CPPUNIT_TEST_SUITE_END();
+public:
+	void testWake();
+	void testDeadline();
+	void testPerform();
+	void testPerform_ReusesConnection();
+	void testPerform_StreamedBody();
+	void testPerform_BodyMeasuredOutsideTask();
+	void testPerform_Concurrent();
+	void testPerform_ConnectTimeout();
+	void testPerform_TlsTimeout();
+	void testPerform_FirstByteTimeout();
+	void testPerform_TotalTimeout();
+	void testPerform_Stalled();
+	void testDetach_AbortsCalls();
+	void testDetach_Deadline();
+	void testWatch();
+};
+
+#endif /* REACTORTEST_HPP_ */
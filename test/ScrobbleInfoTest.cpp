@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 CPPUNIT_TEST_SUITE_REGISTRATION(ScrobbleInfoTest);
 
 #include <ScrobbleInfo.hpp>
+#include <StringDictionary.hpp>
 #include <ctime>
 #include <afc/FastStringBuffer.hpp>
 #include <afc/StringRef.hpp>
@@ -44,6 +45,26 @@ namespace
 
 		return timegm(dateTime);
 	}
+
+	std::uint32_t addString(const char * const begin, const char * const end, StringDictionary &dictionary)
+	{
+		if (begin == end) {
+			return StringDictionary::emptyStringId;
+		}
+		bool isNew;
+		return dictionary.add(begin, end, isNew);
+	}
+
+	void appendAsCompactBinary(const ScrobbleInfo &scrobbleInfo, StringDictionary &dictionary,
+			afc::FastStringBuffer<char> &dest)
+	{
+		const Track &track = scrobbleInfo.track;
+		::appendAsCompactBinary(scrobbleInfo,
+				addString(track.getArtistsBegin(), track.getArtistsEnd(), dictionary),
+				addString(track.getAlbumTitleBegin(), track.getAlbumTitleEnd(), dictionary),
+				addString(track.getAlbumArtistsBegin(), track.getAlbumArtistsEnd(), dictionary),
+				dest);
+	}
 }
 
 void ScrobbleInfoTest::setUp()
@@ -215,3 +236,140 @@ void ScrobbleInfoTest::testSerialiseAsJson_ScrobbleInfoWithAllFields()
 			u8R"("album":{"title":"A Night at the Opera","artists":[{"name":"Scorpions"}]},)"
 			u8R"("length":{"amount":12,"unit":"ms"}}})"), string(result.c_str()));
 }
+
+void ScrobbleInfoTest::testSerialiseAsBinary_RoundTrip_WithAllFields()
+{
+	afc::ConstStringRef input = u8R"({"scrobble_start_datetime":"2002-01-01T23:12:33+0000",)"
+			u8R"("scrobble_end_datetime":"2003-02-03T13:40:04+0130",)"
+			u8R"("scrobble_duration":{"amount":1207,"unit":"ms"},)"
+			u8R"("track":{"title":"'39","artists":[{"name":"Queen"},{"name":"Scorpions"}],)"
+			u8R"("album":{"title":"A Night at the Opera","artists":[{"name":"ABBA"},{"name":"Scorpions"}]},)"
+			u8R"("length":{"amount":207026,"unit":"ms"}}})"_s;
+
+	afc::Optional<ScrobbleInfo> scrobbleInfo = ScrobbleInfo::parse(input.begin(), input.end());
+	CPPUNIT_ASSERT(scrobbleInfo.hasValue());
+
+	afc::FastStringBuffer<char> buf;
+	appendAsBinary(scrobbleInfo.value(), buf);
+
+	ScrobbleInfo result;
+	CPPUNIT_ASSERT(ScrobbleInfo::parseBinary(buf.data(), buf.data() + buf.size(), result));
+
+	afc::FastStringBuffer<char, afc::AllocMode::accurate> serialisedScrobble = serialiseAsJson(result);
+
+	CPPUNIT_ASSERT_EQUAL(string(input.begin(), input.end()), string(serialisedScrobble.c_str()));
+}
+
+void ScrobbleInfoTest::testSerialiseAsBinary_RoundTrip_NoAlbum()
+{
+	afc::ConstStringRef input = u8R"({"scrobble_start_datetime":"2002-01-01T13:12:33+0300",)"
+			u8R"("scrobble_end_datetime":"2003-02-03T12:10:04+0000",)"
+			u8R"("scrobble_duration":{"amount":1207,"unit":"ms"},)"
+			u8R"("track":{"title":"'39","artists":[{"name":"Queen"}],)"
+			u8R"("length":{"amount":207026,"unit":"ms"}}})"_s;
+
+	afc::Optional<ScrobbleInfo> scrobbleInfo = ScrobbleInfo::parse(input.begin(), input.end());
+	CPPUNIT_ASSERT(scrobbleInfo.hasValue());
+
+	afc::FastStringBuffer<char> buf;
+	appendAsBinary(scrobbleInfo.value(), buf);
+
+	ScrobbleInfo result;
+	CPPUNIT_ASSERT(ScrobbleInfo::parseBinary(buf.data(), buf.data() + buf.size(), result));
+
+	afc::FastStringBuffer<char, afc::AllocMode::accurate> serialisedScrobble = serialiseAsJson(result);
+
+	CPPUNIT_ASSERT_EQUAL(string(input.begin(), input.end()), string(serialisedScrobble.c_str()));
+}
+
+void ScrobbleInfoTest::testDeserialiseBinary_Truncated()
+{
+	afc::ConstStringRef input = u8R"({"scrobble_start_datetime":"2002-01-01T13:12:33+0300",)"
+			u8R"("scrobble_end_datetime":"2003-02-03T12:10:04+0000",)"
+			u8R"("scrobble_duration":{"amount":1207,"unit":"ms"},)"
+			u8R"("track":{"title":"'39","artists":[{"name":"Queen"}],)"
+			u8R"("length":{"amount":207026,"unit":"ms"}}})"_s;
+
+	afc::Optional<ScrobbleInfo> scrobbleInfo = ScrobbleInfo::parse(input.begin(), input.end());
+	CPPUNIT_ASSERT(scrobbleInfo.hasValue());
+
+	afc::FastStringBuffer<char> buf;
+	appendAsBinary(scrobbleInfo.value(), buf);
+
+	ScrobbleInfo result;
+	CPPUNIT_ASSERT(!ScrobbleInfo::parseBinary(buf.data(), buf.data() + buf.size() - 1, result));
+	CPPUNIT_ASSERT(!ScrobbleInfo::parseBinary(buf.data(), buf.data() + 10, result));
+}
+
+void ScrobbleInfoTest::testSerialiseAsCompactBinary_RoundTrip_WithAllFields()
+{
+	afc::ConstStringRef input = u8R"({"scrobble_start_datetime":"2002-01-01T23:12:33+0000",)"
+			u8R"("scrobble_end_datetime":"2003-02-03T13:40:04+0130",)"
+			u8R"("scrobble_duration":{"amount":1207,"unit":"ms"},)"
+			u8R"("track":{"title":"'39","artists":[{"name":"Queen"},{"name":"Scorpions"}],)"
+			u8R"("album":{"title":"A Night at the Opera","artists":[{"name":"ABBA"},{"name":"Scorpions"}]},)"
+			u8R"("length":{"amount":207026,"unit":"ms"}}})"_s;
+
+	afc::Optional<ScrobbleInfo> scrobbleInfo = ScrobbleInfo::parse(input.begin(), input.end());
+	CPPUNIT_ASSERT(scrobbleInfo.hasValue());
+
+	StringDictionary dictionary;
+	afc::FastStringBuffer<char> buf;
+	appendAsCompactBinary(scrobbleInfo.value(), dictionary, buf);
+
+	CPPUNIT_ASSERT_EQUAL(std::size_t(3), dictionary.size());
+
+	ScrobbleInfo result;
+	CPPUNIT_ASSERT(ScrobbleInfo::parseCompactBinary(buf.data(), buf.data() + buf.size(), dictionary, result));
+
+	afc::FastStringBuffer<char, afc::AllocMode::accurate> serialisedScrobble = serialiseAsJson(result);
+
+	CPPUNIT_ASSERT_EQUAL(string(input.begin(), input.end()), string(serialisedScrobble.c_str()));
+}
+
+void ScrobbleInfoTest::testSerialiseAsCompactBinary_RoundTrip_NoAlbum()
+{
+	afc::ConstStringRef input = u8R"({"scrobble_start_datetime":"2002-01-01T13:12:33+0300",)"
+			u8R"("scrobble_end_datetime":"2003-02-03T12:10:04+0000",)"
+			u8R"("scrobble_duration":{"amount":1207,"unit":"ms"},)"
+			u8R"("track":{"title":"'39","artists":[{"name":"Queen"}],)"
+			u8R"("length":{"amount":207026,"unit":"ms"}}})"_s;
+
+	afc::Optional<ScrobbleInfo> scrobbleInfo = ScrobbleInfo::parse(input.begin(), input.end());
+	CPPUNIT_ASSERT(scrobbleInfo.hasValue());
+
+	StringDictionary dictionary;
+	afc::FastStringBuffer<char> buf;
+	appendAsCompactBinary(scrobbleInfo.value(), dictionary, buf);
+
+	// The empty album title and album artists are not added to the dictionary.
+	CPPUNIT_ASSERT_EQUAL(std::size_t(1), dictionary.size());
+
+	ScrobbleInfo result;
+	CPPUNIT_ASSERT(ScrobbleInfo::parseCompactBinary(buf.data(), buf.data() + buf.size(), dictionary, result));
+
+	afc::FastStringBuffer<char, afc::AllocMode::accurate> serialisedScrobble = serialiseAsJson(result);
+
+	CPPUNIT_ASSERT_EQUAL(string(input.begin(), input.end()), string(serialisedScrobble.c_str()));
+}
+
+void ScrobbleInfoTest::testDeserialiseCompactBinary_UndefinedString()
+{
+	afc::ConstStringRef input = u8R"({"scrobble_start_datetime":"2002-01-01T13:12:33+0300",)"
+			u8R"("scrobble_end_datetime":"2003-02-03T12:10:04+0000",)"
+			u8R"("scrobble_duration":{"amount":1207,"unit":"ms"},)"
+			u8R"("track":{"title":"'39","artists":[{"name":"Queen"}],)"
+			u8R"("length":{"amount":207026,"unit":"ms"}}})"_s;
+
+	afc::Optional<ScrobbleInfo> scrobbleInfo = ScrobbleInfo::parse(input.begin(), input.end());
+	CPPUNIT_ASSERT(scrobbleInfo.hasValue());
+
+	StringDictionary dictionary;
+	afc::FastStringBuffer<char> buf;
+	appendAsCompactBinary(scrobbleInfo.value(), dictionary, buf);
+
+	ScrobbleInfo result;
+	CPPUNIT_ASSERT(!ScrobbleInfo::parseCompactBinary(buf.data(), buf.data() + buf.size() - 1, dictionary, result));
+	// The artists are not defined in an empty dictionary.
+	CPPUNIT_ASSERT(!ScrobbleInfo::parseCompactBinary(buf.data(), buf.data() + buf.size(), StringDictionary(), result));
+}
@@ -33,6 +33,13 @@ class ScrobbleInfoTest : public CppUnit::TestFixture
 	CPPUNIT_TEST(testDeserialiseScrobbleInfo_MalformedJson);
 
 	CPPUNIT_TEST(testSerialiseAsJson_ScrobbleInfoWithAllFields);
+
+	CPPUNIT_TEST(testSerialiseAsBinary_RoundTrip_WithAllFields);
+	CPPUNIT_TEST(testSerialiseAsBinary_RoundTrip_NoAlbum);
+	CPPUNIT_TEST(testDeserialiseBinary_Truncated);
+	CPPUNIT_TEST(testSerialiseAsCompactBinary_RoundTrip_WithAllFields);
+	CPPUNIT_TEST(testSerialiseAsCompactBinary_RoundTrip_NoAlbum);
+	CPPUNIT_TEST(testDeserialiseCompactBinary_UndefinedString);
 	CPPUNIT_TEST_SUITE_END();
 
 	std::unique_ptr<std::string> m_timeZoneBackup;
@@ -48,6 +55,13 @@ public:
 	void testDeserialiseScrobbleInfo_MalformedJson();
 
 	void testSerialiseAsJson_ScrobbleInfoWithAllFields();
+
+	void testSerialiseAsBinary_RoundTrip_WithAllFields();
+	void testSerialiseAsBinary_RoundTrip_NoAlbum();
+	void testDeserialiseBinary_Truncated();
+	void testSerialiseAsCompactBinary_RoundTrip_WithAllFields();
+	void testSerialiseAsCompactBinary_RoundTrip_NoAlbum();
+	void testDeserialiseCompactBinary_UndefinedString();
 };
 
 #endif /* SCROBBLEINFOTEST_HPP_ */
@@ -0,0 +1,392 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "ScrobbleJournalTest.hpp"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ScrobbleJournalTest);
+
+#include <cstdint>
+#include <string>
+
+#include <ScrobbleInfo.hpp>
+#include <ScrobbleJournal.hpp>
+#include <StringDictionary.hpp>
+#include <afc/FastStringBuffer.hpp>
+#include <afc/StringRef.hpp>
+#include <afc/utils.h>
+
+using afc::operator"" _s;
+using namespace std;
+
+namespace
+{
+	afc::ConstStringRef scrobbleJson = u8R"({"scrobble_start_datetime":"2002-01-01T23:12:33+0000",)"
+			u8R"("scrobble_end_datetime":"2003-02-03T13:40:04+0130",)"
+			u8R"("scrobble_duration":{"amount":1207,"unit":"ms"},)"
+			u8R"("track":{"title":"'39","artists":[{"name":"Queen"}],)"
+			u8R"("album":{"title":"A Night at the Opera","artists":[{"name":"Scorpions"}]},)"
+			u8R"("length":{"amount":207026,"unit":"ms"}}})"_s;
+
+	void appendTestRecord(afc::FastStringBuffer<char> &dest)
+	{
+		afc::Optional<ScrobbleInfo> scrobbleInfo = ScrobbleInfo::parse(scrobbleJson.begin(), scrobbleJson.end());
+		CPPUNIT_ASSERT(scrobbleInfo.hasValue());
+		appendJournalRecord(scrobbleInfo.value(), dest);
+	}
+
+	void appendCompactTestRecord(StringDictionary &dictionary, afc::FastStringBuffer<char> &dest)
+	{
+		afc::Optional<ScrobbleInfo> scrobbleInfo = ScrobbleInfo::parse(scrobbleJson.begin(), scrobbleJson.end());
+		CPPUNIT_ASSERT(scrobbleInfo.hasValue());
+		appendJournalRecord(scrobbleInfo.value(), dictionary, dest);
+	}
+
+	/* Reads the records between begin and end, defining the strings in a given dictionary
+	 * and checking that each scrobble is equal to the test one.
+	 *
+	 * @return the number of scrobbles read.
+	 */
+	std::size_t readCompactTestRecords(const char *p, const char * const end, StringDictionary &dictionary)
+	{
+		std::size_t count = 0;
+		JournalRecordType type;
+		const char *payloadBegin, *payloadEnd;
+		while (readJournalRecord(p, end, type, payloadBegin, payloadEnd) == JournalReadResult::ok) {
+			if (type == JournalRecordType::string) {
+				std::uint32_t id;
+				const char *stringBegin, *stringEnd;
+				CPPUNIT_ASSERT(readJournalString(payloadBegin, payloadEnd, id, stringBegin, stringEnd));
+				CPPUNIT_ASSERT(dictionary.define(id, stringBegin, stringEnd));
+				continue;
+			}
+			CPPUNIT_ASSERT(type == JournalRecordType::compactScrobble);
+
+			ScrobbleInfo result;
+			CPPUNIT_ASSERT(ScrobbleInfo::parseCompactBinary(payloadBegin, payloadEnd, dictionary, result));
+
+			afc::FastStringBuffer<char, afc::AllocMode::accurate> serialisedScrobble = serialiseAsJson(result);
+			CPPUNIT_ASSERT_EQUAL(string(scrobbleJson.begin(), scrobbleJson.end()),
+					string(serialisedScrobble.c_str()));
+			++count;
+		}
+		CPPUNIT_ASSERT(p == end);
+		return count;
+	}
+}
+
+void ScrobbleJournalTest::testCrc32()
+{
+	afc::ConstStringRef input = "123456789"_s;
+
+	CPPUNIT_ASSERT_EQUAL(std::uint32_t(0xcbf43926), crc32(input.begin(), input.end()));
+	CPPUNIT_ASSERT_EQUAL(std::uint32_t(0), crc32(input.begin(), input.begin()));
+}
+
+void ScrobbleJournalTest::testHeader_RoundTrip()
+{
+	afc::FastStringBuffer<char> buf;
+	appendJournalHeader(0x0123456789abcdefu, buf);
+
+	CPPUNIT_ASSERT_EQUAL(journalHeaderSize, buf.size());
+	CPPUNIT_ASSERT(hasJournalMagic(buf.data(), buf.data() + buf.size()));
+
+	std::uint64_t fileId;
+	CPPUNIT_ASSERT(readJournalHeader(buf.data(), buf.data() + buf.size(), fileId));
+	CPPUNIT_ASSERT_EQUAL(std::uint64_t(0x0123456789abcdefu), fileId);
+}
+
+void ScrobbleJournalTest::testHeader_UnsupportedVersion()
+{
+	afc::FastStringBuffer<char> buf;
+	appendJournalHeader(1, buf);
+	*(buf.begin() + 4) = static_cast<char>(journalFormatVersion + 1);
+
+	std::uint64_t fileId;
+	CPPUNIT_ASSERT(hasJournalMagic(buf.data(), buf.data() + buf.size()));
+	CPPUNIT_ASSERT(!readJournalHeader(buf.data(), buf.data() + buf.size(), fileId));
+}
+
+void ScrobbleJournalTest::testRecord_RoundTrip()
+{
+	afc::FastStringBuffer<char> buf;
+	appendTestRecord(buf);
+	appendTestRecord(buf);
+
+	const char *p = buf.data();
+	const char * const end = buf.data() + buf.size();
+	for (int i = 0; i < 2; ++i) {
+		JournalRecordType type;
+		const char *payloadBegin, *payloadEnd;
+		CPPUNIT_ASSERT(readJournalRecord(p, end, type, payloadBegin, payloadEnd) == JournalReadResult::ok);
+		CPPUNIT_ASSERT(type == JournalRecordType::scrobble);
+
+		ScrobbleInfo result;
+		CPPUNIT_ASSERT(ScrobbleInfo::parseBinary(payloadBegin, payloadEnd, result));
+
+		afc::FastStringBuffer<char, afc::AllocMode::accurate> serialisedScrobble = serialiseAsJson(result);
+		CPPUNIT_ASSERT_EQUAL(string(scrobbleJson.begin(), scrobbleJson.end()), string(serialisedScrobble.c_str()));
+	}
+
+	JournalRecordType type;
+	const char *payloadBegin, *payloadEnd;
+	CPPUNIT_ASSERT(readJournalRecord(p, end, type, payloadBegin, payloadEnd) == JournalReadResult::end);
+}
+
+void ScrobbleJournalTest::testRecord_Corrupted()
+{
+	afc::FastStringBuffer<char> buf;
+	appendTestRecord(buf);
+	const std::size_t firstRecordSize = buf.size();
+	appendTestRecord(buf);
+
+	// Damaging the payload of the first record.
+	*(buf.begin() + 10) ^= 0x20;
+
+	const char *p = buf.data();
+	const char * const end = buf.data() + buf.size();
+	JournalRecordType type;
+	const char *payloadBegin, *payloadEnd;
+	CPPUNIT_ASSERT(readJournalRecord(p, end, type, payloadBegin, payloadEnd) == JournalReadResult::corrupted);
+	// The corrupted record is skipped.
+	CPPUNIT_ASSERT(p == buf.data() + firstRecordSize);
+	CPPUNIT_ASSERT(readJournalRecord(p, end, type, payloadBegin, payloadEnd) == JournalReadResult::ok);
+}
+
+void ScrobbleJournalTest::testRecord_Truncated()
+{
+	afc::FastStringBuffer<char> buf;
+	appendTestRecord(buf);
+
+	const char *p = buf.data();
+	const char * const end = buf.data() + buf.size() - 1;
+	JournalRecordType type;
+	const char *payloadBegin, *payloadEnd;
+	CPPUNIT_ASSERT(readJournalRecord(p, end, type, payloadBegin, payloadEnd) == JournalReadResult::truncated);
+	// The position is not changed.
+	CPPUNIT_ASSERT(p == buf.data());
+}
+
+void ScrobbleJournalTest::testRecord_Skip()
+{
+	afc::FastStringBuffer<char> buf;
+	appendTestRecord(buf);
+	const std::size_t firstRecordSize = buf.size();
+	appendTestRecord(buf);
+
+	// Damaging the payload of the first record does not prevent it from being skipped.
+	*(buf.begin() + 10) ^= 0x20;
+
+	const char * const begin = buf.data();
+	const char * const end = buf.data() + buf.size();
+	const char * const second = skipJournalRecord(begin, end);
+	CPPUNIT_ASSERT(second == begin + firstRecordSize);
+	CPPUNIT_ASSERT(skipJournalRecord(second, end) == end);
+	CPPUNIT_ASSERT(skipJournalRecord(end, end) == nullptr);
+	CPPUNIT_ASSERT(skipJournalRecord(second, end - 1) == nullptr);
+}
+
+void ScrobbleJournalTest::testCompactRecord_RoundTrip()
+{
+	StringDictionary dictionary;
+	afc::FastStringBuffer<char> buf;
+	appendCompactTestRecord(dictionary, buf);
+	const std::size_t firstRecordsSize = buf.size();
+	appendCompactTestRecord(dictionary, buf);
+
+	// The strings are written with the first scrobble only.
+	CPPUNIT_ASSERT_EQUAL(std::size_t(3), dictionary.size());
+	CPPUNIT_ASSERT(buf.size() - firstRecordsSize < firstRecordsSize);
+	const char * const second = buf.data() + firstRecordsSize;
+	CPPUNIT_ASSERT(peekJournalRecordType(second) == JournalRecordType::compactScrobble);
+	CPPUNIT_ASSERT(skipJournalRecord(second, buf.data() + buf.size()) == buf.data() + buf.size());
+
+	StringDictionary readDictionary;
+	CPPUNIT_ASSERT_EQUAL(std::size_t(2), readCompactTestRecords(buf.data(), buf.data() + buf.size(), readDictionary));
+	CPPUNIT_ASSERT_EQUAL(std::size_t(3), readDictionary.size());
+}
+
+void ScrobbleJournalTest::testDictionary_RoundTrip()
+{
+	StringDictionary dictionary;
+	afc::FastStringBuffer<char> records;
+	appendCompactTestRecord(dictionary, records);
+	appendCompactTestRecord(dictionary, records);
+
+	// A journal that is re-written starts with the dictionary; the records that follow it refer to its strings.
+	afc::FastStringBuffer<char> buf;
+	appendJournalDictionary(dictionary, buf);
+	const std::size_t dictionarySize = buf.size();
+	appendCompactTestRecord(dictionary, buf);
+
+	CPPUNIT_ASSERT_EQUAL(std::size_t(3), dictionary.size());
+	CPPUNIT_ASSERT(peekJournalRecordType(buf.data()) == JournalRecordType::string);
+	CPPUNIT_ASSERT(peekJournalRecordType(buf.data() + dictionarySize) == JournalRecordType::compactScrobble);
+
+	StringDictionary readDictionary;
+	CPPUNIT_ASSERT_EQUAL(std::size_t(1), readCompactTestRecords(buf.data(), buf.data() + buf.size(), readDictionary));
+	CPPUNIT_ASSERT_EQUAL(std::size_t(3), readDictionary.size());
+}
+
+void ScrobbleJournalTest::testSharedRecord_RoundTrip()
+{
+	afc::Optional<ScrobbleInfo> scrobbleInfo = ScrobbleInfo::parse(scrobbleJson.begin(), scrobbleJson.end());
+	CPPUNIT_ASSERT(scrobbleInfo.hasValue());
+
+	StringDictionary dictionary;
+	afc::FastStringBuffer<char> buf;
+	appendJournalRecord(scrobbleInfo.value(), 0x5, dictionary, buf);
+
+	const char *p = buf.data();
+	const char * const end = buf.data() + buf.size();
+	StringDictionary readDictionary;
+	JournalRecordType type;
+	const char *payloadBegin, *payloadEnd;
+	for (;;) {
+		const char * const recordBegin = p;
+		CPPUNIT_ASSERT(readJournalRecord(p, end, type, payloadBegin, payloadEnd) == JournalReadResult::ok);
+		if (type == JournalRecordType::string) {
+			std::uint32_t id;
+			const char *stringBegin, *stringEnd;
+			CPPUNIT_ASSERT(readJournalString(payloadBegin, payloadEnd, id, stringBegin, stringEnd));
+			CPPUNIT_ASSERT(readDictionary.define(id, stringBegin, stringEnd));
+			CPPUNIT_ASSERT_EQUAL(0u, peekJournalRecordConsumers(recordBegin));
+			continue;
+		}
+		CPPUNIT_ASSERT(type == JournalRecordType::sharedScrobble);
+		CPPUNIT_ASSERT_EQUAL(0x5u, peekJournalRecordConsumers(recordBegin));
+		break;
+	}
+	CPPUNIT_ASSERT(p == end);
+	CPPUNIT_ASSERT_EQUAL(0x5u, journalRecordConsumers(type, payloadBegin, payloadEnd));
+
+	// The payload of a shared scrobble record is the consumer mask followed by a compact scrobble.
+	ScrobbleInfo result;
+	CPPUNIT_ASSERT(ScrobbleInfo::parseCompactBinary(payloadBegin + 1, payloadEnd, readDictionary, result));
+	afc::FastStringBuffer<char, afc::AllocMode::accurate> serialisedScrobble = serialiseAsJson(result);
+	CPPUNIT_ASSERT_EQUAL(string(scrobbleJson.begin(), scrobbleJson.end()), string(serialisedScrobble.c_str()));
+}
+
+void ScrobbleJournalTest::testSharedRecord_SetConsumers()
+{
+	afc::Optional<ScrobbleInfo> scrobbleInfo = ScrobbleInfo::parse(scrobbleJson.begin(), scrobbleJson.end());
+	CPPUNIT_ASSERT(scrobbleInfo.hasValue());
+
+	StringDictionary dictionary;
+	afc::FastStringBuffer<char> strings;
+	appendJournalRecord(scrobbleInfo.value(), 0x1, dictionary, strings);
+	afc::FastStringBuffer<char> buf;
+	appendJournalRecord(scrobbleInfo.value(), 0x1, dictionary, buf);
+
+	setJournalRecordConsumers(&*buf.begin(), buf.size(), 0x3);
+
+	const char *p = buf.data();
+	JournalRecordType type;
+	const char *payloadBegin, *payloadEnd;
+	CPPUNIT_ASSERT(readJournalRecord(p, buf.data() + buf.size(), type, payloadBegin, payloadEnd) ==
+			JournalReadResult::ok);
+	CPPUNIT_ASSERT(type == JournalRecordType::sharedScrobble);
+	CPPUNIT_ASSERT_EQUAL(0x3u, journalRecordConsumers(type, payloadBegin, payloadEnd));
+
+	// The scrobble and compact scrobble records are pending for all consumers.
+	afc::FastStringBuffer<char> compact;
+	appendCompactTestRecord(dictionary, compact);
+	CPPUNIT_ASSERT_EQUAL(allJournalConsumers, peekJournalRecordConsumers(compact.data()));
+}
+
+void ScrobbleJournalTest::testCursorsRecord_RoundTrip()
+{
+	JournalCursors offsets = {};
+	offsets[0] = 0x100000123u;
+	offsets[journalConsumerCount - 1] = journalHeaderSize;
+
+	afc::FastStringBuffer<char> buf;
+	appendJournalCursorsRecord(offsets, buf);
+	CPPUNIT_ASSERT_EQUAL(journalRecordOverhead + 8 * journalConsumerCount, buf.size());
+
+	const char *p = buf.data();
+	JournalRecordType type;
+	const char *payloadBegin, *payloadEnd;
+	CPPUNIT_ASSERT(readJournalRecord(p, buf.data() + buf.size(), type, payloadBegin, payloadEnd) ==
+			JournalReadResult::ok);
+	CPPUNIT_ASSERT(type == JournalRecordType::cursors);
+	CPPUNIT_ASSERT_EQUAL(0u, journalRecordConsumers(type, payloadBegin, payloadEnd));
+
+	JournalCursors result;
+	CPPUNIT_ASSERT(readJournalCursors(payloadBegin, payloadEnd, result));
+	CPPUNIT_ASSERT(offsets == result);
+	CPPUNIT_ASSERT(!readJournalCursors(payloadBegin, payloadEnd - 1, result));
+}
+
+void ScrobbleJournalTest::testCursor_RoundTrip()
+{
+	JournalCursors offsets = {};
+	offsets[0] = 0x100000123u;
+	offsets[1] = journalHeaderSize;
+
+	afc::FastStringBuffer<char> buf;
+	appendJournalCursor(0x0123456789abcdefu, offsets, buf);
+
+	CPPUNIT_ASSERT_EQUAL(journalCursorSize, buf.size());
+
+	std::uint64_t fileId;
+	JournalCursors result;
+	CPPUNIT_ASSERT(readJournalCursor(buf.data(), buf.data() + buf.size(), fileId, result));
+	CPPUNIT_ASSERT_EQUAL(std::uint64_t(0x0123456789abcdefu), fileId);
+	CPPUNIT_ASSERT(offsets == result);
+}
+
+void ScrobbleJournalTest::testCursor_Corrupted()
+{
+	JournalCursors offsets = {};
+	offsets[0] = journalHeaderSize;
+
+	afc::FastStringBuffer<char> buf;
+	appendJournalCursor(1, offsets, buf);
+
+	std::uint64_t fileId;
+	JournalCursors result;
+	CPPUNIT_ASSERT(!readJournalCursor(buf.data(), buf.data() + buf.size() - 1, fileId, result));
+
+	// Damaging the offset.
+	*(buf.begin() + 16) ^= 0x01;
+	CPPUNIT_ASSERT(!readJournalCursor(buf.data(), buf.data() + buf.size(), fileId, result));
+}
+
+void ScrobbleJournalTest::testCursor_Version1()
+{
+	// The cursor file of version 1 has a single offset.
+	const char header[] = {'D', 'B', 'S', 'C', 1, 0, 0, 0};
+	afc::FastStringBuffer<char> buf;
+	buf.reserve(legacyJournalCursorSize);
+	buf.append(header, sizeof(header));
+	for (const std::uint64_t value : {std::uint64_t(7), std::uint64_t(0x123)}) {
+		for (int i = 0; i < 8; ++i) {
+			buf.append(static_cast<char>(value >> (8 * i)));
+		}
+	}
+	const std::uint32_t crc = crc32(buf.data(), buf.data() + buf.size());
+	for (int i = 0; i < 4; ++i) {
+		buf.append(static_cast<char>(crc >> (8 * i)));
+	}
+
+	std::uint64_t fileId;
+	JournalCursors result;
+	CPPUNIT_ASSERT(readJournalCursor(buf.data(), buf.data() + buf.size(), fileId, result));
+	CPPUNIT_ASSERT_EQUAL(std::uint64_t(7), fileId);
+	// The offset applies to all consumers.
+	for (const std::uint64_t offset : result) {
+		CPPUNIT_ASSERT_EQUAL(std::uint64_t(0x123), offset);
+	}
+}
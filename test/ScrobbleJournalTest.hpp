@@ -0,0 +1,59 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef SCROBBLEJOURNALTEST_HPP_
+#define SCROBBLEJOURNALTEST_HPP_
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class ScrobbleJournalTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(ScrobbleJournalTest);
+	CPPUNIT_TEST(testCrc32);
+	CPPUNIT_TEST(testHeader_RoundTrip);
+	CPPUNIT_TEST(testHeader_UnsupportedVersion);
+	CPPUNIT_TEST(testRecord_RoundTrip);
+	CPPUNIT_TEST(testRecord_Corrupted);
+	CPPUNIT_TEST(testRecord_Truncated);
+	CPPUNIT_TEST(testRecord_Skip);
+	CPPUNIT_TEST(testCompactRecord_RoundTrip);
+	CPPUNIT_TEST(testDictionary_RoundTrip);
+	CPPUNIT_TEST(testSharedRecord_RoundTrip);
+	CPPUNIT_TEST(testSharedRecord_SetConsumers);
+	CPPUNIT_TEST(testCursorsRecord_RoundTrip);
+	CPPUNIT_TEST(testCursor_RoundTrip);
+	CPPUNIT_TEST(testCursor_Corrupted);
+	CPPUNIT_TEST(testCursor_Version1);
+	CPPUNIT_TEST_SUITE_END();
+public:
+	void testCrc32();
+	void testHeader_RoundTrip();
+	void testHeader_UnsupportedVersion();
+	void testRecord_RoundTrip();
+	void testRecord_Corrupted();
+	void testRecord_Truncated();
+	void testRecord_Skip();
+	void testCompactRecord_RoundTrip();
+	void testDictionary_RoundTrip();
+	void testSharedRecord_RoundTrip();
+	void testSharedRecord_SetConsumers();
+	void testCursorsRecord_RoundTrip();
+	void testCursor_RoundTrip();
+	void testCursor_Corrupted();
+	void testCursor_Version1();
+};
+
+#endif /* SCROBBLEJOURNALTEST_HPP_ */
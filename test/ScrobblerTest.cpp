@@ -0,0 +1,1317 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "ScrobblerTest.hpp"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ScrobblerTest);
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <HttpClient.hpp>
+#include <LastfmScrobbler.hpp>
+#include <Reactor.hpp>
+#include <Scrobbler.hpp>
+#include <ScrobbleInfo.hpp>
+#include <ScrobbleJournal.hpp>
+#include <SharedJournal.hpp>
+#include <afc/FastStringBuffer.hpp>
+#include <afc/SimpleString.hpp>
+#include <afc/StringRef.hpp>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using afc::operator"" _s;
+using namespace std;
+
+namespace
+{
+	afc::ConstStringRef scrobbleJson = u8R"({"scrobble_start_datetime":"2002-01-01T23:12:33+0000",)"
+			u8R"("scrobble_end_datetime":"2003-02-03T13:40:04+0130",)"
+			u8R"("scrobble_duration":{"amount":1207,"unit":"ms"},)"
+			u8R"("track":{"title":"'39","artists":[{"name":"Queen"}],)"
+			u8R"("album":{"title":"A Night at the Opera","artists":[{"name":"Scorpions"}]},)"
+			u8R"("length":{"amount":207026,"unit":"ms"}}})"_s;
+
+	/* Completes up to 20 leading pending scrobbles per request. The scrobbles are identified
+	 * by their duration which is expected to be increased by one for each subsequent scrobble.
+	 */
+	class TestScrobbler : public Scrobbler<std::deque<ScrobbleInfo>>
+	{
+	public:
+		explicit TestScrobbler(const string &dataFilePath)
+			: Scrobbler(20), m_completedCv(), m_completedCount(0), m_dataFilePath(), m_maxResidentCount(0), m_inOrder(true)
+		{
+			m_dataFilePath.assign(dataFilePath.data(), dataFilePath.size());
+		}
+
+		void enableScrobbling()
+		{ lock_guard<mutex> lock(m_mutex);
+			m_configured = true;
+			wake();
+		}
+
+		// Returns true if a given number of scrobbles are completed before the timeout expires.
+		bool waitForCompleted(const size_t count)
+		{ unique_lock<mutex> lock(m_mutex);
+			return m_completedCv.wait_for(lock, chrono::minutes(1),
+					[this, count]() { return m_completedCount >= count; });
+		}
+
+		size_t residentCount()
+		{ lock_guard<mutex> lock(m_mutex);
+			// The scrobbles that are not taken from the intake queue by the background thread yet are counted.
+			drainIntake();
+			m_maxResidentCount = max(m_maxResidentCount, m_pendingScrobbles.size());
+			return m_pendingScrobbles.size();
+		}
+
+		size_t maxResidentCount()
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_maxResidentCount;
+		}
+
+		bool inOrder()
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_inOrder;
+		}
+	protected:
+		virtual void startScrobbling() override { attemptFinished(completeLeading()); }
+
+		// Completes up to 20 leading pending scrobbles. Returns the number of scrobbles completed.
+		size_t completeLeading()
+		{
+			m_maxResidentCount = max(m_maxResidentCount, m_pendingScrobbles.size());
+
+			const size_t count = min<size_t>(m_pendingScrobbles.size(), 20);
+			auto end = m_pendingScrobbles.begin() + count;
+			for (auto it = m_pendingScrobbles.begin(); it != end; ++it) {
+				m_inOrder = m_inOrder && it->scrobbleDuration == long(m_completedCount);
+				++m_completedCount;
+			}
+			completeScrobbles(end);
+
+			m_completedCv.notify_all();
+			return count;
+		}
+
+		virtual const afc::String &getDataFilePath() const override { return m_dataFilePath; }
+
+		condition_variable m_completedCv;
+		size_t m_completedCount;
+	private:
+		afc::String m_dataFilePath;
+		size_t m_maxResidentCount;
+		bool m_inOrder;
+	};
+
+	/* An HTTP server on the loopback interface that responds to each request with a 200 response
+	 * once the number of milliseconds given by the first segment of the request path elapses.
+	 * The response body is empty unless another one is set. Connections are kept alive, and each one
+	 * is served by its own thread. The paths requested and responded to are recorded.
+	 */
+	class DelayingServer
+	{
+	public:
+		DelayingServer() : m_socket(-1), m_port(0), m_responseBody(), m_thread(), m_mutex(), m_logCv(),
+				m_requested(), m_responded(), m_connections(), m_connectionThreads() {}
+
+		~DelayingServer()
+		{
+			if (m_thread.joinable()) {
+				// Makes accept() and recv() return.
+				{ lock_guard<mutex> lock(m_mutex);
+					::shutdown(m_socket, SHUT_RDWR);
+					for (const int connection : m_connections) {
+						::shutdown(connection, SHUT_RDWR);
+					}
+				}
+				m_thread.join();
+				for (thread &connectionThread : m_connectionThreads) {
+					connectionThread.join();
+				}
+				for (const int connection : m_connections) {
+					::close(connection);
+				}
+			}
+			if (m_socket != -1) {
+				::close(m_socket);
+			}
+		}
+
+		bool start()
+		{
+			m_socket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+			sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			socklen_t addressSize = sizeof(address);
+			if (m_socket == -1 || ::bind(m_socket, reinterpret_cast<sockaddr *>(&address), addressSize) != 0 ||
+					::listen(m_socket, 16) != 0 ||
+					::getsockname(m_socket, reinterpret_cast<sockaddr *>(&address), &addressSize) != 0) {
+				return false;
+			}
+			m_port = ntohs(address.sin_port);
+			m_thread = thread([this]() { serve(); });
+			return true;
+		}
+
+		string url() const { return "http://127.0.0.1:" + to_string(m_port) + "/"; }
+
+		// It must be set before any request is sent.
+		void setResponseBody(string &&body) { m_responseBody = std::move(body); }
+
+		// Returns true if a request with a given path (without the query) arrives before the timeout expires.
+		bool waitForRequest(const string &path)
+		{ unique_lock<mutex> lock(m_mutex);
+			return m_logCv.wait_for(lock, chrono::seconds(10),
+					[&]() { return find(m_requested.begin(), m_requested.end(), path) != m_requested.end(); });
+		}
+
+		bool responded(const string &path)
+		{ lock_guard<mutex> lock(m_mutex);
+			return find(m_responded.begin(), m_responded.end(), path) != m_responded.end();
+		}
+	private:
+		void serve()
+		{
+			for (;;) {
+				const int connection = ::accept(m_socket, nullptr, nullptr);
+				if (connection == -1) {
+					return;
+				}
+				lock_guard<mutex> lock(m_mutex);
+				m_connections.push_back(connection);
+				m_connectionThreads.emplace_back([this, connection]() { serveConnection(connection); });
+			}
+		}
+
+		void serveConnection(const int connection)
+		{
+			const string response = "HTTP/1.1 200 OK\r\nContent-Length: " + to_string(m_responseBody.size()) +
+					"\r\n\r\n" + m_responseBody;
+
+			string request;
+			char buf[512];
+			ssize_t n;
+			while ((n = ::recv(connection, buf, sizeof(buf), 0)) > 0) {
+				request.append(buf, static_cast<size_t>(n));
+				for (size_t headersEnd; (headersEnd = request.find("\r\n\r\n")) != string::npos;) {
+					const size_t pathStart = request.find('/');
+					const string path = request.substr(pathStart, request.find_first_of("? ", pathStart) - pathStart);
+					const unsigned long delay = strtoul(request.c_str() + pathStart + 1, nullptr, 10);
+					// The body of a POST request is skipped.
+					const size_t lengthStart = request.find("Content-Length: ");
+					const size_t bodySize = lengthStart < headersEnd ?
+							strtoul(request.c_str() + lengthStart + 16, nullptr, 10) : 0;
+					while (request.size() < headersEnd + 4 + bodySize &&
+							(n = ::recv(connection, buf, sizeof(buf), 0)) > 0) {
+						request.append(buf, static_cast<size_t>(n));
+					}
+					request.erase(0, min(request.size(), headersEnd + 4 + bodySize));
+					log(m_requested, path);
+					this_thread::sleep_for(chrono::milliseconds(delay));
+					::send(connection, response.data(), response.size(), MSG_NOSIGNAL);
+					log(m_responded, path);
+				}
+			}
+			// The connection is closed once the server is stopped so that its descriptor is not re-used meanwhile.
+		}
+
+		void log(vector<string> &paths, const string &path)
+		{ lock_guard<mutex> lock(m_mutex);
+			paths.push_back(path);
+			m_logCv.notify_all();
+		}
+
+		int m_socket;
+		unsigned m_port;
+		string m_responseBody;
+		thread m_thread;
+		mutex m_mutex;
+		condition_variable m_logCv;
+		vector<string> m_requested;
+		vector<string> m_responded;
+		vector<int> m_connections;
+		vector<thread> m_connectionThreads;
+	};
+
+	/* Submits up to four batches of pending scrobbles at once, each one by an HTTP call to DelayingServer
+	 * performed by the reactor. The calls are responded to in the reverse order, and each scrobble
+	 * with an index that is divisible by three is rejected as recoverable at its first attempt.
+	 * Counts the attempts and completions per scrobble.
+	 */
+	class PipelinedScrobbler : public TestScrobbler
+	{
+	public:
+		PipelinedScrobbler(const string &dataFilePath, const size_t scrobbleCount, const string &url)
+			: TestScrobbler(dataFilePath), m_url(url), m_attempts(scrobbleCount), m_completions(scrobbleCount),
+			  m_maxBatches(0), m_calls(), m_callsInFlight(0)
+		{
+			setMaxBatchesInFlight(4);
+		}
+
+		vector<unsigned char> attempts()
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_attempts;
+		}
+
+		vector<unsigned char> completions()
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_completions;
+		}
+
+		size_t maxBatches()
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_maxBatches;
+		}
+	protected:
+		virtual void startScrobbling() override
+		{
+			vector<vector<const ScrobbleInfo *>> batches;
+			collectBatches(batches);
+			m_maxBatches = max(m_maxBatches, batches.size());
+
+			// The calls are prepared anew for each attempt, as GravifonScrobbler does.
+			for (size_t i = 0, n = batches.size(); i < n; ++i) {
+				// The later a batch follows, the sooner its call is responded to.
+				m_calls.emplace_back(new Call(*this, move(batches[i]), m_url + to_string(5 * (n - i))));
+			}
+			m_callsInFlight = m_calls.size();
+			for (const unique_ptr<Call> &call : m_calls) {
+				if (HttpClient().prepareGet(*call, call->url.c_str(), call->request, call->response, HttpTimeouts()) !=
+						HttpClient::StatusCode::SUCCESS || !perform(*call)) {
+					batchFinished(*call, false);
+				}
+			}
+		}
+	private:
+		struct NullAppender : HttpResponse::BodyAppender
+		{
+			virtual void operator()(const char *, size_t) override {}
+		};
+
+		struct Call : HttpCall
+		{
+			Call(PipelinedScrobbler &owner, vector<const ScrobbleInfo *> &&batch, string &&url)
+				: owner(owner), batch(move(batch)), url(move(url)), request(), response(appender), completedFlags()
+			{
+				request.setBody(nullptr, 0);
+			}
+
+			virtual void completed(const HttpClient::StatusCode status) override
+			{ lock_guard<mutex> lock(owner.m_mutex);
+				// The call can be destroyed by the owner once it is finished.
+				owner.batchFinished(*this, status == HttpClient::StatusCode::SUCCESS && response.statusCode == 200);
+			}
+
+			PipelinedScrobbler &owner;
+			const vector<const ScrobbleInfo *> batch;
+			const string url;
+			NullAppender appender;
+			HttpRequest request;
+			HttpResponse response;
+			// Indicates for each scrobble of the batch if it is completed.
+			vector<bool> completedFlags;
+		};
+
+		/* Records the outcome of a given call. Once all the calls of the attempt are finished
+		 * their outcome is applied by walking the pending scrobbles from the first one.
+		 */
+		void batchFinished(Call &call, const bool succeeded)
+		{
+			for (const ScrobbleInfo * const scrobbleInfo : call.batch) {
+				const size_t index = size_t(scrobbleInfo->scrobbleDuration);
+				++m_attempts[index];
+				call.completedFlags.push_back(succeeded && (index % 3 != 0 || m_attempts[index] > 1));
+			}
+			if (--m_callsInFlight != 0) {
+				return;
+			}
+
+			size_t count = 0;
+			auto it = m_pendingScrobbles.begin();
+			for (const unique_ptr<Call> &finishedCall : m_calls) {
+				for (const bool scrobbleCompleted : finishedCall->completedFlags) {
+					if (scrobbleCompleted) {
+						++m_completions[size_t(it->scrobbleDuration)];
+						it = completeScrobble(it);
+						++count;
+					} else {
+						++it;
+					}
+				}
+			}
+
+			m_calls.clear();
+			m_completedCount += count;
+			m_completedCv.notify_all();
+			attemptFinished(count);
+		}
+
+		const string m_url;
+		vector<unsigned char> m_attempts;
+		vector<unsigned char> m_completions;
+		size_t m_maxBatches;
+		vector<unique_ptr<Call>> m_calls;
+		size_t m_callsInFlight;
+	};
+
+	// Fails a given number of attempts to submit scrobbles before it completes them as TestScrobbler does.
+	class FlakyScrobbler : public TestScrobbler
+	{
+	public:
+		FlakyScrobbler(const string &dataFilePath, const size_t failureCount)
+			: TestScrobbler(dataFilePath), m_failureCount(failureCount), m_attemptCount(0) {}
+
+		size_t attemptCount()
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_attemptCount;
+		}
+	protected:
+		virtual void startScrobbling() override
+		{
+			attemptFinished(++m_attemptCount <= m_failureCount ? 0 : completeLeading());
+		}
+	private:
+		const size_t m_failureCount;
+		size_t m_attemptCount;
+	};
+
+	/* Submits pending scrobbles by a single HTTP call to a given URL which is expected to be never
+	 * responded to. The call is left in flight until this scrobbler is stopped.
+	 */
+	class HangingScrobbler : public TestScrobbler
+	{
+	public:
+		HangingScrobbler(const string &dataFilePath, const string &url)
+			: TestScrobbler(dataFilePath), m_url(url), m_call(*this), m_callStarted(false),
+			  m_callStatus(HttpClient::StatusCode::SUCCESS) {}
+
+		// Returns true if the call is started before the timeout expires.
+		bool waitForCall()
+		{ unique_lock<mutex> lock(m_mutex);
+			return m_completedCv.wait_for(lock, chrono::minutes(1), [this]() { return m_callStarted; });
+		}
+
+		HttpClient::StatusCode callStatus()
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_callStatus;
+		}
+	protected:
+		virtual void startScrobbling() override
+		{
+			m_request.setBody(nullptr, 0);
+			if (HttpClient().prepareGet(m_call, m_url.c_str(), m_request, m_response, HttpTimeouts()) !=
+					HttpClient::StatusCode::SUCCESS || !perform(m_call)) {
+				attemptFinished(0);
+				return;
+			}
+			m_callStarted = true;
+			m_completedCv.notify_all();
+		}
+	private:
+		struct NullAppender : HttpResponse::BodyAppender
+		{
+			virtual void operator()(const char *, size_t) override {}
+		};
+
+		struct Call : HttpCall
+		{
+			explicit Call(HangingScrobbler &owner) : owner(owner) {}
+
+			virtual void completed(const HttpClient::StatusCode status) override
+			{ lock_guard<mutex> lock(owner.m_mutex);
+				owner.m_callStatus = status;
+				owner.attemptFinished(0);
+			}
+
+			HangingScrobbler &owner;
+		};
+
+		const string m_url;
+		NullAppender m_appender;
+		HttpRequest m_request;
+		HttpResponse m_response{m_appender};
+		Call m_call;
+		bool m_callStarted;
+		HttpClient::StatusCode m_callStatus;
+	};
+
+	// Blocks the reactor thread from the time it is run until it is released.
+	class BlockingTask : public Reactor::Task
+	{
+	public:
+		BlockingTask() : m_mutex(), m_cv(), m_running(false), m_released(false) {}
+
+		// Returns true if the reactor thread is blocked before the timeout expires.
+		bool waitForRun()
+		{ unique_lock<mutex> lock(m_mutex);
+			return m_cv.wait_for(lock, chrono::minutes(1), [this]() { return m_running; });
+		}
+
+		void release()
+		{ lock_guard<mutex> lock(m_mutex);
+			m_released = true;
+			m_cv.notify_all();
+		}
+	protected:
+		virtual void run() override
+		{ unique_lock<mutex> lock(m_mutex);
+			m_running = true;
+			m_cv.notify_all();
+			m_cv.wait(lock, [this]() { return m_released; });
+		}
+	private:
+		mutex m_mutex;
+		condition_variable m_cv;
+		bool m_running;
+		bool m_released;
+	};
+
+	// The binary form of a scrobble is used as a prototype since scrobbles are not copyable.
+	afc::FastStringBuffer<char> prototypeScrobble()
+	{
+		afc::Optional<ScrobbleInfo> scrobbleInfo = ScrobbleInfo::parse(scrobbleJson.begin(), scrobbleJson.end());
+		CPPUNIT_ASSERT(scrobbleInfo.hasValue());
+		afc::FastStringBuffer<char> result;
+		appendAsBinary(scrobbleInfo.value(), result);
+		return result;
+	}
+
+	ScrobbleInfo testScrobble(const afc::FastStringBuffer<char> &prototype, const size_t index)
+	{
+		ScrobbleInfo result;
+		CPPUNIT_ASSERT(ScrobbleInfo::parseBinary(prototype.data(), prototype.data() + prototype.size(), result));
+		result.scrobbleDuration = long(index);
+		return result;
+	}
+
+	long fileSize(const string &path)
+	{
+		struct stat fileStatus;
+		return stat(path.c_str(), &fileStatus) == 0 ? long(fileStatus.st_size) : -1;
+	}
+
+	// Assigns a given IPv4 address to a given network interface.
+	bool addAddress(const char * const interface, const char * const address)
+	{
+		const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+		if (fd == -1) {
+			return false;
+		}
+		ifreq request = {};
+		strncpy(request.ifr_name, interface, IFNAMSIZ - 1);
+		sockaddr_in &interfaceAddress = reinterpret_cast<sockaddr_in &>(request.ifr_addr);
+		interfaceAddress.sin_family = AF_INET;
+		const bool result = inet_pton(AF_INET, address, &interfaceAddress.sin_addr) == 1 &&
+				ioctl(fd, SIOCSIFADDR, &request) == 0;
+		close(fd);
+		return result;
+	}
+
+	// The exit code of the child process that is unable to create a network namespace.
+	constexpr int namespaceUnavailable = 77;
+
+	/* Is executed by a child process in its own user and network namespaces so that it can change
+	 * the network without privileges and without affecting the host.
+	 *
+	 * @return zero if the backlog is drained once an address is assigned; the step that has failed otherwise.
+	 */
+	int drainOnNetworkChange(const string &dataFilePath, const afc::FastStringBuffer<char> &prototype)
+	{
+		constexpr size_t backlogSize = 30;
+
+		if (unshare(CLONE_NEWUSER | CLONE_NEWNET) != 0) {
+			return namespaceUnavailable;
+		}
+
+		// Without a network change the retry would be delayed for at least half an hour.
+		FlakyScrobbler scrobbler(dataFilePath, 1);
+		scrobbler.setRetryDelay(chrono::hours(1), chrono::hours(1));
+		scrobbler.setNetworkMonitoring(true);
+		if (!scrobbler.start() || !scrobbler.waitForLoad()) {
+			return 1;
+		}
+		for (size_t i = 0; i < backlogSize; ++i) {
+			scrobbler.scrobble(testScrobble(prototype, i));
+		}
+		scrobbler.enableScrobbling();
+
+		// Waiting for the failed attempt. The retry is scheduled within the same critical section.
+		int result = 0;
+		for (int i = 0; result == 0 && scrobbler.attemptCount() == 0; ++i) {
+			if (i == 10000) {
+				result = 2;
+			}
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+
+		if (result == 0 && !addAddress("lo", "10.11.12.13")) {
+			result = 3;
+		}
+		if (result == 0 && (!scrobbler.waitForCompleted(backlogSize) || !scrobbler.inOrder())) {
+			result = 4;
+		}
+		// The scrobbler must be stopped before it is destroyed.
+		if (!scrobbler.stop() && result == 0) {
+			result = 5;
+		}
+		return result;
+	}
+
+	/* Scrobbles failure-safe scrobbles before the backlog of a given size is loaded, and kills the process
+	 * once they are stored. It returns only if they are not stored before the load is finished.
+	 */
+	int killDuringLoad(const string &dataFilePath, const afc::FastStringBuffer<char> &prototype,
+			const size_t backlogSize, const size_t newCount)
+	{
+		const long backlogFileSize = fileSize(dataFilePath);
+
+		afc::String path;
+		path.assign(dataFilePath.data(), dataFilePath.size());
+		SharedJournal journal(path);
+
+		// The load is held while another thread keeps the journal locked so that the scrobbles precede it.
+		mutex holdMutex;
+		condition_variable holdCv;
+		bool held = false, released = false;
+		thread holder([&]()
+		{
+			const unique_lock<mutex> journalLock = journal.lock();
+			unique_lock<mutex> lock(holdMutex);
+			held = true;
+			holdCv.notify_all();
+			holdCv.wait(lock, [&released]() { return released; });
+		});
+		{ unique_lock<mutex> lock(holdMutex);
+			holdCv.wait(lock, [&held]() { return held; });
+		}
+
+		TestScrobbler scrobbler(dataFilePath + ".legacy");
+		scrobbler.setJournal(&journal, 0);
+		// The whole backlog is loaded into memory so that the load takes a while.
+		scrobbler.setResidentScrobbleLimit(backlogSize + newCount);
+		if (!scrobbler.start()) {
+			return 1;
+		}
+		atomic<bool> loaded(false);
+		thread loadWaiter([&]()
+		{
+			scrobbler.waitForLoad();
+			loaded.store(true);
+		});
+
+		// A single append is written at once so the process is not killed in the middle of it.
+		vector<ScrobbleInfo> batch;
+		for (size_t i = backlogSize; i < backlogSize + newCount; ++i) {
+			batch.emplace_back(testScrobble(prototype, i));
+		}
+		scrobbler.scrobble(batch.begin(), batch.end(), true);
+		{ lock_guard<mutex> lock(holdMutex);
+			released = true;
+			holdCv.notify_all();
+		}
+		holder.join();
+
+		while (fileSize(dataFilePath) == backlogFileSize && !loaded.load()) {
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		if (!loaded.load()) {
+			kill(getpid(), SIGKILL);
+		}
+
+		loadWaiter.join();
+		scrobbler.stop();
+		return 2;
+	}
+}
+
+void ScrobblerTest::setUp()
+{
+	char dirTemplate[] = "/tmp/scrobbler_test_XXXXXX";
+	CPPUNIT_ASSERT(mkdtemp(dirTemplate) != nullptr);
+	m_dir = dirTemplate;
+	m_dataFilePath = m_dir + "/data";
+}
+
+void ScrobblerTest::tearDown()
+{
+	remove(m_dataFilePath.c_str());
+	remove((m_dataFilePath + ".tmp").c_str());
+	remove((m_dataFilePath + ".cursor").c_str());
+	remove((m_dataFilePath + ".quarantine").c_str());
+	remove((m_dir + "/old").c_str());
+	remove((m_dir + "/old.cursor").c_str());
+	remove((m_dir + "/other").c_str());
+	remove((m_dir + "/other.cursor").c_str());
+	rmdir(m_dir.c_str());
+}
+
+void ScrobblerTest::testSpill_HugeBacklog()
+{
+	constexpr size_t backlogSize = 1000 * 1000;
+	constexpr size_t residentLimit = 100;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	TestScrobbler scrobbler(m_dataFilePath);
+	scrobbler.setResidentScrobbleLimit(residentLimit);
+	CPPUNIT_ASSERT(scrobbler.start());
+	CPPUNIT_ASSERT(scrobbler.waitForLoad());
+
+	// Scrobbles are not submitted until the backlog is accumulated.
+	for (size_t i = 0; i < backlogSize; ++i) {
+		scrobbler.scrobble(testScrobble(prototype, i));
+	}
+	CPPUNIT_ASSERT_EQUAL(residentLimit, scrobbler.residentCount());
+
+	scrobbler.enableScrobbling();
+	CPPUNIT_ASSERT(scrobbler.waitForCompleted(backlogSize));
+
+	CPPUNIT_ASSERT(scrobbler.inOrder());
+	CPPUNIT_ASSERT_EQUAL(residentLimit, scrobbler.maxResidentCount());
+	CPPUNIT_ASSERT_EQUAL(size_t(0), scrobbler.residentCount());
+
+	CPPUNIT_ASSERT(scrobbler.stop());
+	// All the records are acknowledged so the data file is compacted.
+	CPPUNIT_ASSERT_EQUAL(long(journalHeaderSize), fileSize(m_dataFilePath));
+}
+
+void ScrobblerTest::testSpill_Reload()
+{
+	constexpr size_t backlogSize = 1000;
+	constexpr size_t residentLimit = 100;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	{
+		TestScrobbler scrobbler(m_dataFilePath);
+		scrobbler.setResidentScrobbleLimit(residentLimit);
+		CPPUNIT_ASSERT(scrobbler.start());
+		for (size_t i = 0; i < backlogSize; ++i) {
+			scrobbler.scrobble(testScrobble(prototype, i));
+		}
+		CPPUNIT_ASSERT(scrobbler.stop());
+	}
+
+	// Only the leading pending scrobbles are loaded; the rest of them are loaded as they are needed.
+	TestScrobbler scrobbler(m_dataFilePath);
+	scrobbler.setResidentScrobbleLimit(residentLimit);
+	CPPUNIT_ASSERT(scrobbler.start());
+	CPPUNIT_ASSERT(scrobbler.waitForLoad());
+	CPPUNIT_ASSERT_EQUAL(residentLimit, scrobbler.residentCount());
+
+	scrobbler.enableScrobbling();
+	CPPUNIT_ASSERT(scrobbler.waitForCompleted(backlogSize));
+	CPPUNIT_ASSERT(scrobbler.inOrder());
+	CPPUNIT_ASSERT(scrobbler.stop());
+}
+
+void ScrobblerTest::testSharedJournal()
+{
+	constexpr size_t scrobbleCount = 100;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	afc::String dataFilePath;
+	dataFilePath.assign(m_dataFilePath.data(), m_dataFilePath.size());
+	SharedJournal journal(dataFilePath, chrono::milliseconds(20));
+
+	// The data files of the older versions do not exist.
+	TestScrobbler first(m_dir + "/first");
+	first.setJournal(&journal, 0);
+	CPPUNIT_ASSERT(first.start());
+	{
+		TestScrobbler second(m_dir + "/second");
+		second.setJournal(&journal, 1);
+		CPPUNIT_ASSERT(second.start());
+
+		for (size_t i = 0; i < scrobbleCount; ++i) {
+			first.scrobble(testScrobble(prototype, i), true);
+			second.scrobble(testScrobble(prototype, i), true);
+		}
+
+		// Only the first Scrobbler completes its scrobbles.
+		first.enableScrobbling();
+		CPPUNIT_ASSERT(first.waitForCompleted(scrobbleCount));
+		CPPUNIT_ASSERT(first.inOrder());
+		CPPUNIT_ASSERT(second.stop());
+	}
+	CPPUNIT_ASSERT(first.stop());
+
+	// The pending scrobbles of the second Scrobbler are kept.
+	TestScrobbler second(m_dir + "/second");
+	second.setJournal(&journal, 1);
+	CPPUNIT_ASSERT(second.start());
+	CPPUNIT_ASSERT(second.waitForLoad());
+	CPPUNIT_ASSERT_EQUAL(scrobbleCount, second.residentCount());
+
+	second.enableScrobbling();
+	CPPUNIT_ASSERT(second.waitForCompleted(scrobbleCount));
+	CPPUNIT_ASSERT(second.inOrder());
+	CPPUNIT_ASSERT(second.stop());
+
+	// All the records are acknowledged by both Scrobblers so the data file is compacted.
+	CPPUNIT_ASSERT_EQUAL(long(journalHeaderSize), fileSize(m_dataFilePath));
+}
+
+void ScrobblerTest::testSharedJournal_Migration()
+{
+	constexpr size_t scrobbleCount = 100;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+	const string oldDataFilePath = m_dir + "/old";
+
+	// The Scrobbler of an older version stores its pending scrobbles to its own journal.
+	{
+		TestScrobbler scrobbler(oldDataFilePath);
+		CPPUNIT_ASSERT(scrobbler.start());
+		for (size_t i = 0; i < scrobbleCount; ++i) {
+			scrobbler.scrobble(testScrobble(prototype, i));
+		}
+		CPPUNIT_ASSERT(scrobbler.stop());
+	}
+	CPPUNIT_ASSERT(fileSize(oldDataFilePath) > long(journalHeaderSize));
+
+	afc::String dataFilePath;
+	dataFilePath.assign(m_dataFilePath.data(), m_dataFilePath.size());
+	SharedJournal journal(dataFilePath);
+
+	// The pending scrobbles are moved to the shared journal.
+	TestScrobbler scrobbler(oldDataFilePath);
+	scrobbler.setJournal(&journal, 0);
+	CPPUNIT_ASSERT(scrobbler.start());
+	CPPUNIT_ASSERT(scrobbler.waitForLoad());
+	CPPUNIT_ASSERT_EQUAL(scrobbleCount, scrobbler.residentCount());
+	CPPUNIT_ASSERT_EQUAL(-1L, fileSize(oldDataFilePath));
+
+	scrobbler.enableScrobbling();
+	CPPUNIT_ASSERT(scrobbler.waitForCompleted(scrobbleCount));
+	CPPUNIT_ASSERT(scrobbler.inOrder());
+	CPPUNIT_ASSERT(scrobbler.stop());
+
+	CPPUNIT_ASSERT_EQUAL(long(journalHeaderSize), fileSize(m_dataFilePath));
+}
+
+void ScrobblerTest::testSharedReactor_SlowLoad()
+{
+	constexpr size_t scrobbleCount = 100;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	afc::String firstPath, secondPath;
+	firstPath.assign(m_dataFilePath.data(), m_dataFilePath.size());
+	const string secondDataFilePath = m_dir + "/other";
+	secondPath.assign(secondDataFilePath.data(), secondDataFilePath.size());
+	SharedJournal firstJournal(firstPath);
+	SharedJournal secondJournal(secondPath);
+	Reactor reactor;
+	CPPUNIT_ASSERT(reactor.start());
+
+	// The load of the first Scrobbler is held while another thread keeps its journal locked.
+	mutex holdMutex;
+	condition_variable holdCv;
+	bool held = false, released = false;
+	thread holder([&]()
+	{
+		const unique_lock<mutex> journalLock = firstJournal.lock();
+		unique_lock<mutex> lock(holdMutex);
+		held = true;
+		holdCv.notify_all();
+		holdCv.wait(lock, [&released]() { return released; });
+	});
+	{ unique_lock<mutex> lock(holdMutex);
+		holdCv.wait(lock, [&held]() { return held; });
+	}
+
+	TestScrobbler first(m_dir + "/first");
+	first.setJournal(&firstJournal, 0);
+	first.setReactor(&reactor);
+	CPPUNIT_ASSERT(first.start());
+	TestScrobbler second(m_dir + "/second");
+	second.setJournal(&secondJournal, 0);
+	second.setReactor(&reactor);
+	CPPUNIT_ASSERT(second.start());
+
+	for (size_t i = 0; i < scrobbleCount; ++i) {
+		first.scrobble(testScrobble(prototype, i), true);
+		second.scrobble(testScrobble(prototype, i), true);
+	}
+	first.enableScrobbling();
+	second.enableScrobbling();
+
+	// The second Scrobbler loads and drains its scrobbles while the load of the first one is held.
+	const bool drained = second.waitForCompleted(scrobbleCount);
+	{ lock_guard<mutex> lock(holdMutex);
+		released = true;
+		holdCv.notify_all();
+	}
+	holder.join();
+	CPPUNIT_ASSERT(drained);
+	CPPUNIT_ASSERT(second.inOrder());
+
+	CPPUNIT_ASSERT(first.waitForCompleted(scrobbleCount));
+	CPPUNIT_ASSERT(first.inOrder());
+	CPPUNIT_ASSERT(first.stop());
+	CPPUNIT_ASSERT(second.stop());
+	reactor.stop();
+
+	CPPUNIT_ASSERT_EQUAL(long(journalHeaderSize), fileSize(m_dataFilePath));
+	CPPUNIT_ASSERT_EQUAL(long(journalHeaderSize), fileSize(secondDataFilePath));
+}
+
+void ScrobblerTest::testStart_ScrobblesDuringLoad()
+{
+	constexpr size_t backlogSize = 100 * 1000;
+	constexpr size_t newCount = 1000;
+	constexpr size_t residentLimit = 100;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	{
+		TestScrobbler scrobbler(m_dataFilePath);
+		scrobbler.setResidentScrobbleLimit(residentLimit);
+		CPPUNIT_ASSERT(scrobbler.start());
+		for (size_t i = 0; i < backlogSize; ++i) {
+			scrobbler.scrobble(testScrobble(prototype, i));
+		}
+		CPPUNIT_ASSERT(scrobbler.stop());
+	}
+
+	// The scrobbles that arrive while the backlog is being loaded follow the backlog.
+	TestScrobbler scrobbler(m_dataFilePath);
+	scrobbler.setResidentScrobbleLimit(residentLimit);
+	CPPUNIT_ASSERT(scrobbler.start());
+	for (size_t i = backlogSize; i < backlogSize + newCount; ++i) {
+		scrobbler.scrobble(testScrobble(prototype, i), true);
+	}
+	CPPUNIT_ASSERT(scrobbler.waitForLoad());
+
+	scrobbler.enableScrobbling();
+	CPPUNIT_ASSERT(scrobbler.waitForCompleted(backlogSize + newCount));
+	CPPUNIT_ASSERT(scrobbler.inOrder());
+	CPPUNIT_ASSERT(scrobbler.stop());
+}
+
+void ScrobblerTest::testStart_LoadRetried()
+{
+	constexpr size_t scrobbleCount = 50;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	// The data file has a truncated header so it cannot be loaded.
+	FILE * const dataFile = fopen(m_dataFilePath.c_str(), "wb");
+	CPPUNIT_ASSERT(dataFile != nullptr);
+	CPPUNIT_ASSERT_EQUAL(size_t(4), fwrite("DBSJ", 1, 4, dataFile));
+	CPPUNIT_ASSERT_EQUAL(0, fclose(dataFile));
+
+	TestScrobbler scrobbler(m_dataFilePath);
+	scrobbler.setRetryDelay(chrono::milliseconds(10), chrono::milliseconds(40));
+	CPPUNIT_ASSERT(scrobbler.start());
+	CPPUNIT_ASSERT(!scrobbler.waitForLoad());
+
+	// The scrobbles are still accepted, and are kept until the load is retried successfully.
+	for (size_t i = 0; i < scrobbleCount; ++i) {
+		scrobbler.scrobble(testScrobble(prototype, i), i % 2 == 0);
+	}
+	scrobbler.enableScrobbling();
+	CPPUNIT_ASSERT_EQUAL(0, remove(m_dataFilePath.c_str()));
+
+	CPPUNIT_ASSERT(scrobbler.waitForCompleted(scrobbleCount));
+	CPPUNIT_ASSERT(scrobbler.inOrder());
+	CPPUNIT_ASSERT(scrobbler.waitForLoad());
+	CPPUNIT_ASSERT(scrobbler.stop());
+}
+
+void ScrobblerTest::testStart_KilledDuringLoad()
+{
+	constexpr size_t backlogSize = 100 * 1000;
+	constexpr size_t newCount = 50;
+	constexpr size_t residentLimit = 100;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+	afc::String path;
+	path.assign(m_dataFilePath.data(), m_dataFilePath.size());
+
+	{
+		SharedJournal journal(path);
+		TestScrobbler scrobbler(m_dataFilePath + ".legacy");
+		scrobbler.setJournal(&journal, 0);
+		scrobbler.setResidentScrobbleLimit(residentLimit);
+		CPPUNIT_ASSERT(scrobbler.start());
+		for (size_t i = 0; i < backlogSize; ++i) {
+			scrobbler.scrobble(testScrobble(prototype, i));
+		}
+		CPPUNIT_ASSERT(scrobbler.stop());
+	}
+
+	const pid_t pid = fork();
+	CPPUNIT_ASSERT(pid != -1);
+	if (pid == 0) {
+		// Failed assertions must not unwind into the test runner of the child process.
+		int result;
+		try {
+			result = killDuringLoad(m_dataFilePath, prototype, backlogSize, newCount);
+		} catch (...) {
+			result = 100;
+		}
+		_exit(result);
+	}
+
+	int status;
+	CPPUNIT_ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+	// The failure-safe scrobbles are stored while the backlog is being loaded.
+	CPPUNIT_ASSERT(WIFSIGNALED(status));
+	CPPUNIT_ASSERT_EQUAL(SIGKILL, WTERMSIG(status));
+
+	// They follow the backlog.
+	SharedJournal journal(path);
+	TestScrobbler scrobbler(m_dataFilePath + ".legacy");
+	scrobbler.setJournal(&journal, 0);
+	scrobbler.setResidentScrobbleLimit(residentLimit);
+	CPPUNIT_ASSERT(scrobbler.start());
+	CPPUNIT_ASSERT(scrobbler.waitForLoad());
+	scrobbler.enableScrobbling();
+	CPPUNIT_ASSERT(scrobbler.waitForCompleted(backlogSize + newCount));
+	CPPUNIT_ASSERT(scrobbler.inOrder());
+	CPPUNIT_ASSERT(scrobbler.stop());
+}
+
+void ScrobblerTest::testScrobble_Batch()
+{
+	constexpr size_t batchSize = 1000;
+	constexpr size_t residentLimit = 100;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	{
+		vector<ScrobbleInfo> batch;
+		for (size_t i = 0; i < batchSize; ++i) {
+			batch.emplace_back(testScrobble(prototype, i));
+		}
+
+		// The scrobbles that exceed the limit are stored to the data file directly.
+		TestScrobbler scrobbler(m_dataFilePath);
+		scrobbler.setResidentScrobbleLimit(residentLimit);
+		CPPUNIT_ASSERT(scrobbler.start());
+		CPPUNIT_ASSERT(scrobbler.waitForLoad());
+		scrobbler.scrobble(batch.begin(), batch.end(), true);
+		CPPUNIT_ASSERT_EQUAL(residentLimit, scrobbler.residentCount());
+		CPPUNIT_ASSERT(scrobbler.stop());
+	}
+
+	TestScrobbler scrobbler(m_dataFilePath);
+	scrobbler.setResidentScrobbleLimit(residentLimit);
+	CPPUNIT_ASSERT(scrobbler.start());
+	CPPUNIT_ASSERT(scrobbler.waitForLoad());
+
+	scrobbler.enableScrobbling();
+	CPPUNIT_ASSERT(scrobbler.waitForCompleted(batchSize));
+	CPPUNIT_ASSERT(scrobbler.inOrder());
+	CPPUNIT_ASSERT(scrobbler.stop());
+
+	CPPUNIT_ASSERT_EQUAL(long(journalHeaderSize), fileSize(m_dataFilePath));
+}
+
+void ScrobblerTest::testScrobbling_Pipelined()
+{
+	constexpr size_t backlogSize = 1000;
+	constexpr size_t residentLimit = 200;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	DelayingServer server;
+	CPPUNIT_ASSERT(server.start());
+
+	PipelinedScrobbler scrobbler(m_dataFilePath, backlogSize, server.url());
+	scrobbler.setResidentScrobbleLimit(residentLimit);
+	CPPUNIT_ASSERT(scrobbler.start());
+	CPPUNIT_ASSERT(scrobbler.waitForLoad());
+
+	for (size_t i = 0; i < backlogSize; ++i) {
+		scrobbler.scrobble(testScrobble(prototype, i), i % 2 == 0);
+	}
+
+	scrobbler.enableScrobbling();
+	CPPUNIT_ASSERT(scrobbler.waitForCompleted(backlogSize));
+	CPPUNIT_ASSERT_EQUAL(size_t(4), scrobbler.maxBatches());
+
+	// No scrobble is lost or completed twice whatever order the batches are completed in.
+	const vector<unsigned char> attempts = scrobbler.attempts();
+	const vector<unsigned char> completions = scrobbler.completions();
+	for (size_t i = 0; i < backlogSize; ++i) {
+		CPPUNIT_ASSERT_EQUAL(i % 3 == 0 ? 2 : 1, int(attempts[i]));
+		CPPUNIT_ASSERT_EQUAL(1, int(completions[i]));
+	}
+
+	CPPUNIT_ASSERT(scrobbler.stop());
+	// All the records are acknowledged so the data file is compacted.
+	CPPUNIT_ASSERT_EQUAL(long(journalHeaderSize), fileSize(m_dataFilePath));
+}
+
+void ScrobblerTest::testNowPlaying_DuringSubmission()
+{
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	DelayingServer server;
+	CPPUNIT_ASSERT(server.start());
+	// The handshake response. The other calls take "OK" from its first line as their status.
+	server.setResponseBody("OK\nsession\n" + server.url() + "0/nowPlaying\n" + server.url() + "2000/submission\n");
+
+	afc::String dataFilePath;
+	dataFilePath.assign(m_dataFilePath.data(), m_dataFilePath.size());
+	LastfmScrobbler scrobbler;
+	scrobbler.setDataFilePath(std::move(dataFilePath));
+	const string scrobblerUrl = server.url() + "0/handshake";
+	scrobbler.configure(scrobblerUrl.data(), scrobblerUrl.size(), "user", "password");
+	CPPUNIT_ASSERT(scrobbler.start());
+
+	scrobbler.scrobble(testScrobble(prototype, 0));
+	CPPUNIT_ASSERT(server.waitForRequest("/2000/submission"));
+
+	// The now-playing notification does not wait for the submission in progress.
+	scrobbler.playStarted(testScrobble(prototype, 1).track);
+	CPPUNIT_ASSERT(server.waitForRequest("/0/nowPlaying"));
+	CPPUNIT_ASSERT(!server.responded("/2000/submission"));
+
+	CPPUNIT_ASSERT(scrobbler.stop());
+}
+
+void ScrobblerTest::testRetry_NoNewScrobbles()
+{
+	constexpr size_t backlogSize = 50;
+	constexpr size_t failureCount = 4;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	FlakyScrobbler scrobbler(m_dataFilePath, failureCount);
+	scrobbler.setRetryDelay(chrono::milliseconds(10), chrono::milliseconds(40));
+	CPPUNIT_ASSERT(scrobbler.start());
+	CPPUNIT_ASSERT(scrobbler.waitForLoad());
+	for (size_t i = 0; i < backlogSize; ++i) {
+		scrobbler.scrobble(testScrobble(prototype, i));
+	}
+
+	// The backlog is drained once the failures are over even though no scrobbles follow them.
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	scrobbler.enableScrobbling();
+	CPPUNIT_ASSERT(scrobbler.waitForCompleted(backlogSize));
+	const chrono::steady_clock::duration elapsed = chrono::steady_clock::now() - start;
+
+	CPPUNIT_ASSERT(scrobbler.inOrder());
+	// Three requests of up to 20 scrobbles each follow the failed ones.
+	CPPUNIT_ASSERT_EQUAL(failureCount + 3, scrobbler.attemptCount());
+	// The retries are delayed by at least a half of 10, 20, 40 and 40 ms.
+	CPPUNIT_ASSERT(elapsed >= chrono::milliseconds(5 + 10 + 20 + 20));
+
+	CPPUNIT_ASSERT(scrobbler.stop());
+}
+
+void ScrobblerTest::testRetry_NetworkChange()
+{
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	const pid_t pid = fork();
+	CPPUNIT_ASSERT(pid != -1);
+	if (pid == 0) {
+		// Failed assertions must not unwind into the test runner of the child process.
+		int result;
+		try {
+			result = drainOnNetworkChange(m_dataFilePath, prototype);
+		} catch (...) {
+			result = 100;
+		}
+		_exit(result);
+	}
+
+	int status;
+	CPPUNIT_ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+	CPPUNIT_ASSERT(WIFEXITED(status));
+	if (WEXITSTATUS(status) == namespaceUnavailable) {
+		// Unprivileged user namespaces are disabled on this host.
+		return;
+	}
+	CPPUNIT_ASSERT_EQUAL(0, WEXITSTATUS(status));
+}
+
+void ScrobblerTest::testStop_BusyReactor()
+{
+	constexpr size_t scrobbleCount = 100;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	Reactor reactor;
+	CPPUNIT_ASSERT(reactor.start());
+	{
+		TestScrobbler scrobbler(m_dataFilePath);
+		scrobbler.setReactor(&reactor);
+		scrobbler.setStopTimeout(chrono::milliseconds(10));
+		CPPUNIT_ASSERT(scrobbler.start());
+		CPPUNIT_ASSERT(scrobbler.waitForLoad());
+
+		// The scrobbles stay in the intake queue since the reactor is busy.
+		BlockingTask task;
+		reactor.attach(task);
+		CPPUNIT_ASSERT(task.waitForRun());
+		for (size_t i = 0; i < scrobbleCount; ++i) {
+			scrobbler.scrobble(testScrobble(prototype, i));
+		}
+
+		bool stopped = false;
+		thread stopper([&scrobbler, &stopped]() { stopped = scrobbler.stop(); });
+
+		// The scrobbles are stored once the time to stop is over even though the reactor is still busy.
+		bool stored = false;
+		for (int i = 0; !stored && i < 10000; ++i) {
+			this_thread::sleep_for(chrono::milliseconds(1));
+			stored = fileSize(m_dataFilePath) > long(journalHeaderSize);
+		}
+		task.release();
+		stopper.join();
+		reactor.detach(task);
+		CPPUNIT_ASSERT(stored);
+		CPPUNIT_ASSERT(stopped);
+	}
+	reactor.stop();
+
+	TestScrobbler scrobbler(m_dataFilePath);
+	CPPUNIT_ASSERT(scrobbler.start());
+	CPPUNIT_ASSERT(scrobbler.waitForLoad());
+	CPPUNIT_ASSERT_EQUAL(scrobbleCount, scrobbler.residentCount());
+	scrobbler.enableScrobbling();
+	CPPUNIT_ASSERT(scrobbler.waitForCompleted(scrobbleCount));
+	CPPUNIT_ASSERT(scrobbler.inOrder());
+	CPPUNIT_ASSERT(scrobbler.stop());
+}
+
+void ScrobblerTest::testStop_UnfinishedLoad()
+{
+	constexpr size_t backlogSize = 1000;
+	constexpr size_t newCount = 50;
+	constexpr size_t residentLimit = 100;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	{
+		TestScrobbler scrobbler(m_dataFilePath);
+		CPPUNIT_ASSERT(scrobbler.start());
+		for (size_t i = 0; i < backlogSize; ++i) {
+			scrobbler.scrobble(testScrobble(prototype, i));
+		}
+		CPPUNIT_ASSERT(scrobbler.stop());
+	}
+
+	// The data file cannot be loaded while it is replaced with a directory.
+	const string backlogPath = m_dir + "/old";
+	CPPUNIT_ASSERT_EQUAL(0, rename(m_dataFilePath.c_str(), backlogPath.c_str()));
+	CPPUNIT_ASSERT_EQUAL(0, mkdir(m_dataFilePath.c_str(), 0700));
+	{
+		TestScrobbler scrobbler(m_dataFilePath);
+		scrobbler.setResidentScrobbleLimit(residentLimit);
+		scrobbler.setRetryDelay(chrono::hours(1), chrono::hours(1));
+		scrobbler.setStopTimeout(chrono::milliseconds(0));
+		CPPUNIT_ASSERT(scrobbler.start());
+		CPPUNIT_ASSERT(!scrobbler.waitForLoad());
+		for (size_t i = backlogSize; i < backlogSize + newCount; ++i) {
+			scrobbler.scrobble(testScrobble(prototype, i), i % 2 == 0);
+		}
+
+		// The load is not retried; the scrobbles accepted are stored after the backlog.
+		CPPUNIT_ASSERT_EQUAL(0, rmdir(m_dataFilePath.c_str()));
+		CPPUNIT_ASSERT_EQUAL(0, rename(backlogPath.c_str(), m_dataFilePath.c_str()));
+		CPPUNIT_ASSERT(scrobbler.stop());
+	}
+
+	TestScrobbler scrobbler(m_dataFilePath);
+	scrobbler.setResidentScrobbleLimit(residentLimit);
+	CPPUNIT_ASSERT(scrobbler.start());
+	CPPUNIT_ASSERT(scrobbler.waitForLoad());
+	CPPUNIT_ASSERT_EQUAL(residentLimit, scrobbler.residentCount());
+	scrobbler.enableScrobbling();
+	CPPUNIT_ASSERT(scrobbler.waitForCompleted(backlogSize + newCount));
+	CPPUNIT_ASSERT(scrobbler.inOrder());
+	CPPUNIT_ASSERT(scrobbler.stop());
+}
+
+void ScrobblerTest::testStop_AbortsCalls()
+{
+	constexpr size_t stopCount = 50;
+
+	const afc::FastStringBuffer<char> prototype = prototypeScrobble();
+
+	/* The server accepts connections into the backlog but never reads requests nor responds to them.
+	 * Once the backlog is full the calls that follow hang while they are connecting.
+	 */
+	const int server = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	CPPUNIT_ASSERT(server != -1);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressSize = sizeof(address);
+	CPPUNIT_ASSERT_EQUAL(0, ::bind(server, reinterpret_cast<sockaddr *>(&address), sizeof(address)));
+	CPPUNIT_ASSERT_EQUAL(0, listen(server, 8));
+	CPPUNIT_ASSERT_EQUAL(0, getsockname(server, reinterpret_cast<sockaddr *>(&address), &addressSize));
+	const string url = "http://127.0.0.1:" + to_string(ntohs(address.sin_port)) + "/";
+
+	vector<chrono::steady_clock::duration> stopTimes;
+	for (size_t i = 0; i < stopCount; ++i) {
+		HangingScrobbler scrobbler(m_dataFilePath, url);
+		CPPUNIT_ASSERT(scrobbler.start());
+		CPPUNIT_ASSERT(scrobbler.waitForLoad());
+		scrobbler.scrobble(testScrobble(prototype, i));
+		scrobbler.enableScrobbling();
+		CPPUNIT_ASSERT(scrobbler.waitForCall());
+
+		const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		CPPUNIT_ASSERT(scrobbler.stop());
+		stopTimes.push_back(chrono::steady_clock::now() - start);
+
+		CPPUNIT_ASSERT(scrobbler.callStatus() == HttpClient::StatusCode::ABORTED_BY_CLIENT);
+	}
+	close(server);
+
+	// The calls are aborted without waiting for any timeout, and the scrobbles are stored.
+	sort(stopTimes.begin(), stopTimes.end());
+	CPPUNIT_ASSERT(stopTimes[stopCount * 99 / 100] < chrono::milliseconds(100));
+
+	TestScrobbler scrobbler(m_dataFilePath);
+	CPPUNIT_ASSERT(scrobbler.start());
+	CPPUNIT_ASSERT(scrobbler.waitForLoad());
+	scrobbler.enableScrobbling();
+	CPPUNIT_ASSERT(scrobbler.waitForCompleted(stopCount));
+	CPPUNIT_ASSERT(scrobbler.inOrder());
+	CPPUNIT_ASSERT(scrobbler.stop());
+}
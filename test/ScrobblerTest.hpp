@@ -0,0 +1,68 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef SCROBBLERTEST_HPP_
+#define SCROBBLERTEST_HPP_
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+
+class ScrobblerTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(ScrobblerTest);
+	CPPUNIT_TEST(testSpill_HugeBacklog);
+	CPPUNIT_TEST(testSpill_Reload);
+	CPPUNIT_TEST(testSharedJournal);
+	CPPUNIT_TEST(testSharedJournal_Migration);
+	CPPUNIT_TEST(testSharedReactor_SlowLoad);
+	CPPUNIT_TEST(testStart_ScrobblesDuringLoad);
+	CPPUNIT_TEST(testStart_LoadRetried);
+	CPPUNIT_TEST(testStart_KilledDuringLoad);
+	CPPUNIT_TEST(testScrobble_Batch);
+	CPPUNIT_TEST(testScrobbling_Pipelined);
+	CPPUNIT_TEST(testNowPlaying_DuringSubmission);
+	CPPUNIT_TEST(testRetry_NoNewScrobbles);
+	CPPUNIT_TEST(testRetry_NetworkChange);
+	CPPUNIT_TEST(testStop_AbortsCalls);
+	CPPUNIT_TEST(testStop_BusyReactor);
+	CPPUNIT_TEST(testStop_UnfinishedLoad);
+	CPPUNIT_TEST_SUITE_END();
+public:
+	void setUp();
+	void tearDown();
+
+	void testSpill_HugeBacklog();
+	void testSpill_Reload();
+	void testSharedJournal();
+	void testSharedJournal_Migration();
+	void testSharedReactor_SlowLoad();
+	void testStart_ScrobblesDuringLoad();
+	void testStart_LoadRetried();
+	void testStart_KilledDuringLoad();
+	void testScrobble_Batch();
+	void testScrobbling_Pipelined();
+	void testNowPlaying_DuringSubmission();
+	void testRetry_NoNewScrobbles();
+	void testRetry_NetworkChange();
+	void testStop_AbortsCalls();
+	void testStop_BusyReactor();
+	void testStop_UnfinishedLoad();
+private:
+	std::string m_dir;
+	std::string m_dataFilePath;
+};
+
+#endif /* SCROBBLERTEST_HPP_ */
@@ -0,0 +1,473 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "SharedJournalTest.hpp"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SharedJournalTest);
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ScrobbleInfo.hpp>
+#include <ScrobbleJournal.hpp>
+#include <SharedJournal.hpp>
+#include <afc/FastStringBuffer.hpp>
+#include <afc/SimpleString.hpp>
+#include <afc/StringRef.hpp>
+#include <unistd.h>
+
+using afc::operator"" _s;
+using namespace std;
+
+namespace
+{
+	afc::ConstStringRef scrobbleJson = u8R"({"scrobble_start_datetime":"2002-01-01T23:12:33+0000",)"
+			u8R"("scrobble_end_datetime":"2003-02-03T13:40:04+0130",)"
+			u8R"("scrobble_duration":{"amount":1207,"unit":"ms"},)"
+			u8R"("track":{"title":"'39","artists":[{"name":"Queen"}],)"
+			u8R"("album":{"title":"A Night at the Opera","artists":[{"name":"Scorpions"}]},)"
+			u8R"("length":{"amount":207026,"unit":"ms"}}})"_s;
+
+	// The appends are delayed long enough to be amended within a test.
+	constexpr chrono::milliseconds longDelay(60 * 1000);
+
+	// The scrobbles are told apart by their duration.
+	ScrobbleInfo testScrobble(const long duration)
+	{
+		afc::Optional<ScrobbleInfo> scrobbleInfo = ScrobbleInfo::parse(scrobbleJson.begin(), scrobbleJson.end());
+		CPPUNIT_ASSERT(scrobbleInfo.hasValue());
+		scrobbleInfo.value().scrobbleDuration = duration;
+		return std::move(scrobbleInfo.value());
+	}
+
+	string readFile(const string &path)
+	{
+		ifstream in(path, ios::binary);
+		return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	}
+
+	afc::String toString(const string &s)
+	{
+		afc::String result;
+		result.assign(s.data(), s.size());
+		return result;
+	}
+
+	struct ScrobbleRecord
+	{
+		unsigned consumers;
+		uint64_t end;
+	};
+
+	// Returns the scrobble records of the data file in order.
+	vector<ScrobbleRecord> scrobbleRecords(const string &path)
+	{
+		const string content = readFile(path);
+		CPPUNIT_ASSERT(content.size() >= journalHeaderSize);
+
+		vector<ScrobbleRecord> result;
+		const char *p = content.data() + journalHeaderSize;
+		const char * const end = content.data() + content.size();
+		JournalRecordType type;
+		const char *payloadBegin, *payloadEnd;
+		while (readJournalRecord(p, end, type, payloadBegin, payloadEnd) == JournalReadResult::ok) {
+			const unsigned consumers = journalRecordConsumers(type, payloadBegin, payloadEnd);
+			if (consumers != 0) {
+				result.push_back({consumers, uint64_t(p - content.data())});
+			}
+		}
+		CPPUNIT_ASSERT(p == end);
+		return result;
+	}
+
+	vector<unsigned> recordConsumers(const string &path)
+	{
+		vector<unsigned> result;
+		for (const ScrobbleRecord &record : scrobbleRecords(path)) {
+			result.push_back(record.consumers);
+		}
+		return result;
+	}
+
+	void append(SharedJournal &journal, const unsigned consumer, const long duration)
+	{
+		const ScrobbleInfo scrobbleInfo = testScrobble(duration);
+		journal.append(consumer, &scrobbleInfo, &scrobbleInfo + 1, false, false);
+	}
+}
+
+void SharedJournalTest::setUp()
+{
+	char dirTemplate[] = "/tmp/shared_journal_test_XXXXXX";
+	CPPUNIT_ASSERT(mkdtemp(dirTemplate) != nullptr);
+	m_dir = dirTemplate;
+	m_dataFilePath = m_dir + "/data";
+}
+
+void SharedJournalTest::tearDown()
+{
+	remove(m_dataFilePath.c_str());
+	remove((m_dataFilePath + ".tmp").c_str());
+	remove((m_dataFilePath + ".cursor").c_str());
+	remove((m_dataFilePath + ".quarantine").c_str());
+	rmdir(m_dir.c_str());
+}
+
+void SharedJournalTest::testAppend_SameScrobble()
+{
+	SharedJournal journal(toString(m_dataFilePath), longDelay);
+	{ auto lock = journal.lock();
+		CPPUNIT_ASSERT(journal.attach(0));
+		CPPUNIT_ASSERT(journal.attach(1));
+
+		append(journal, 0, 1);
+		// The record of the first consumer is amended instead of storing the scrobble twice.
+		append(journal, 1, 1);
+		CPPUNIT_ASSERT_EQUAL(size_t(1), journal.storedCount(0));
+		CPPUNIT_ASSERT_EQUAL(size_t(1), journal.storedCount(1));
+	}
+	journal.flush();
+
+	CPPUNIT_ASSERT(recordConsumers(m_dataFilePath) == vector<unsigned>({0x3}));
+
+	auto lock = journal.lock();
+	CPPUNIT_ASSERT(journal.detach(0));
+	CPPUNIT_ASSERT(journal.detach(1));
+}
+
+void SharedJournalTest::testAppend_DifferentScrobbles()
+{
+	SharedJournal journal(toString(m_dataFilePath), longDelay);
+	auto lock = journal.lock();
+	CPPUNIT_ASSERT(journal.attach(0));
+	CPPUNIT_ASSERT(journal.attach(1));
+
+	append(journal, 0, 1);
+	append(journal, 1, 2);
+	// The record of the same consumer is not amended.
+	append(journal, 1, 2);
+
+	CPPUNIT_ASSERT(journal.detach(0));
+	CPPUNIT_ASSERT(journal.detach(1));
+
+	CPPUNIT_ASSERT(recordConsumers(m_dataFilePath) == vector<unsigned>({0x1, 0x2, 0x2}));
+}
+
+void SharedJournalTest::testAppend_NoDelay()
+{
+	SharedJournal journal(toString(m_dataFilePath));
+	auto lock = journal.lock();
+	CPPUNIT_ASSERT(journal.attach(0));
+	CPPUNIT_ASSERT(journal.attach(1));
+
+	// The records are written right away so they cannot be amended.
+	append(journal, 0, 1);
+	append(journal, 1, 1);
+
+	CPPUNIT_ASSERT(journal.detach(0));
+	CPPUNIT_ASSERT(journal.detach(1));
+
+	CPPUNIT_ASSERT(recordConsumers(m_dataFilePath) == vector<unsigned>({0x1, 0x2}));
+}
+
+void SharedJournalTest::testAppend_Many()
+{
+	constexpr size_t scrobbleCount = 50 * 1000;
+
+	{
+		SharedJournal journal(toString(m_dataFilePath));
+		auto lock = journal.lock();
+		CPPUNIT_ASSERT(journal.attach(0));
+
+		// Enough records to be encoded by several threads if there are several processors.
+		deque<ScrobbleInfo> scrobbles;
+		for (size_t i = 0; i < scrobbleCount; ++i) {
+			scrobbles.emplace_back(testScrobble(long(i)));
+		}
+		journal.append(0, scrobbles.cbegin(), scrobbles.cend(), true, false);
+		CPPUNIT_ASSERT_EQUAL(scrobbleCount, journal.storedCount(0));
+		CPPUNIT_ASSERT(journal.detach(0));
+	}
+
+	const vector<ScrobbleRecord> records = scrobbleRecords(m_dataFilePath);
+	CPPUNIT_ASSERT_EQUAL(scrobbleCount, records.size());
+	for (const ScrobbleRecord &record : records) {
+		CPPUNIT_ASSERT_EQUAL(0x1u, record.consumers);
+	}
+
+	SharedJournal journal(toString(m_dataFilePath));
+	auto lock = journal.lock();
+	CPPUNIT_ASSERT(journal.attach(0));
+	SharedJournal::SpillRange range;
+	CPPUNIT_ASSERT(journal.spillRange(0, range));
+	CPPUNIT_ASSERT_EQUAL(records.back().end, range.end);
+	CPPUNIT_ASSERT(journal.detach(0));
+}
+
+void SharedJournalTest::testAppend_ManyConcurrently()
+{
+	constexpr size_t batchSize = 10 * 1000;
+	constexpr size_t singleCount = 100;
+	constexpr size_t scrobbleCount = 2 * batchSize + singleCount;
+
+	SharedJournal journal(toString(m_dataFilePath));
+	{ auto lock = journal.lock();
+		CPPUNIT_ASSERT(journal.attach(0));
+		CPPUNIT_ASSERT(journal.attach(1));
+	}
+
+	/* Each consumer appends two batches that are large enough to be encoded outside the lock,
+	 * and single scrobbles between them, while the other consumer does the same.
+	 */
+	vector<thread> consumers;
+	for (unsigned consumer = 0; consumer < 2; ++consumer) {
+		consumers.emplace_back([&journal, consumer]()
+		{
+			deque<ScrobbleInfo> batch;
+			for (size_t i = 0; i < batchSize; ++i) {
+				batch.emplace_back(testScrobble(long(i)));
+			}
+			{ auto lock = journal.lock();
+				journal.append(consumer, batch.cbegin(), batch.cend(), false, false);
+			}
+			for (size_t i = 0; i < singleCount; ++i) {
+				auto lock = journal.lock();
+				append(journal, consumer, long(i));
+			}
+			{ auto lock = journal.lock();
+				journal.append(consumer, batch.cbegin(), batch.cend(), true, false);
+			}
+		});
+	}
+	for (thread &consumer : consumers) {
+		consumer.join();
+	}
+
+	{ auto lock = journal.lock();
+		CPPUNIT_ASSERT_EQUAL(scrobbleCount, journal.storedCount(0));
+		CPPUNIT_ASSERT_EQUAL(scrobbleCount, journal.storedCount(1));
+		CPPUNIT_ASSERT(journal.detach(0, true));
+		CPPUNIT_ASSERT(journal.detach(1, true));
+	}
+
+	size_t counts[2] = {};
+	for (const ScrobbleRecord &record : scrobbleRecords(m_dataFilePath)) {
+		CPPUNIT_ASSERT(record.consumers == 0x1 || record.consumers == 0x2);
+		++counts[record.consumers - 1];
+	}
+	CPPUNIT_ASSERT_EQUAL(scrobbleCount, counts[0]);
+	CPPUNIT_ASSERT_EQUAL(scrobbleCount, counts[1]);
+}
+
+void SharedJournalTest::testAcknowledge_PerConsumer()
+{
+	const afc::String dataFilePath = toString(m_dataFilePath);
+	{
+		SharedJournal journal(dataFilePath);
+		auto lock = journal.lock();
+		CPPUNIT_ASSERT(journal.attach(0));
+		CPPUNIT_ASSERT(journal.attach(1));
+
+		append(journal, 0, 1);
+		append(journal, 1, 1);
+		append(journal, 0, 2);
+		journal.acknowledge(0, 2);
+
+		CPPUNIT_ASSERT(journal.detach(0));
+		CPPUNIT_ASSERT(journal.detach(1));
+	}
+
+	// The records of the second consumer are kept while the ones of the first consumer are acknowledged.
+	const vector<ScrobbleRecord> records = scrobbleRecords(m_dataFilePath);
+	CPPUNIT_ASSERT_EQUAL(size_t(3), records.size());
+
+	SharedJournal journal(dataFilePath);
+	auto lock = journal.lock();
+	CPPUNIT_ASSERT(journal.attach(0));
+	CPPUNIT_ASSERT(journal.attach(1));
+	CPPUNIT_ASSERT(!journal.hasSpill(0));
+	CPPUNIT_ASSERT(journal.hasSpill(1));
+
+	SharedJournal::SpillRange range;
+	CPPUNIT_ASSERT(journal.spillRange(1, range));
+	CPPUNIT_ASSERT(journal.isCurrent(range));
+	CPPUNIT_ASSERT_EQUAL(uint64_t(journalHeaderSize), range.begin);
+	journal.loadSpill(1, range, range.end, deque<uint64_t>({records[1].end}));
+	CPPUNIT_ASSERT(!journal.hasSpill(1));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), journal.storedCount(1));
+	journal.acknowledge(1, 1);
+
+	CPPUNIT_ASSERT(journal.detach(0));
+	CPPUNIT_ASSERT(journal.detach(1));
+
+	// All the records are acknowledged so the data file is compacted.
+	CPPUNIT_ASSERT_EQUAL(size_t(journalHeaderSize), readFile(m_dataFilePath).size());
+}
+
+void SharedJournalTest::testAcknowledgeAt_Compaction()
+{
+	const afc::String dataFilePath = toString(m_dataFilePath);
+	{
+		SharedJournal journal(dataFilePath, longDelay);
+		auto lock = journal.lock();
+		CPPUNIT_ASSERT(journal.attach(0));
+		CPPUNIT_ASSERT(journal.attach(1));
+
+		append(journal, 0, 1);
+		append(journal, 1, 1);
+		append(journal, 0, 2);
+		append(journal, 1, 2);
+
+		// The second scrobble is completed by both consumers; the first one is pending for the first consumer.
+		journal.acknowledgeAt(0, 1);
+		journal.acknowledge(1, 2);
+
+		CPPUNIT_ASSERT(journal.detach(1));
+		// The record acknowledged out of order is swept out.
+		CPPUNIT_ASSERT(journal.detach(0));
+	}
+
+	CPPUNIT_ASSERT(recordConsumers(m_dataFilePath) == vector<unsigned>({0x3}));
+
+	SharedJournal journal(dataFilePath);
+	auto lock = journal.lock();
+	CPPUNIT_ASSERT(journal.attach(0));
+	CPPUNIT_ASSERT(journal.attach(1));
+	CPPUNIT_ASSERT(journal.hasSpill(0));
+	CPPUNIT_ASSERT(!journal.hasSpill(1));
+	CPPUNIT_ASSERT(journal.detach(0));
+	CPPUNIT_ASSERT(journal.detach(1));
+}
+
+void SharedJournalTest::testAcknowledgeAt_ConsumerMask()
+{
+	SharedJournal journal(toString(m_dataFilePath), longDelay);
+	auto lock = journal.lock();
+	CPPUNIT_ASSERT(journal.attach(0));
+	CPPUNIT_ASSERT(journal.attach(1));
+
+	append(journal, 0, 1);
+	append(journal, 1, 1);
+	append(journal, 0, 2);
+	append(journal, 1, 2);
+
+	// The second record is still pending for the second consumer.
+	journal.acknowledgeAt(0, 1);
+
+	CPPUNIT_ASSERT(journal.detach(1));
+	CPPUNIT_ASSERT(journal.detach(0));
+
+	CPPUNIT_ASSERT(recordConsumers(m_dataFilePath) == vector<unsigned>({0x3, 0x2}));
+}
+
+void SharedJournalTest::testCheckpoint_AcknowledgedDuringCompaction()
+{
+	// Enough dead records for the data file to be compacted.
+	constexpr size_t deadCount = 200 * 1000;
+	constexpr size_t keptCount = 100 * 1000;
+
+	const afc::String dataFilePath = toString(m_dataFilePath);
+	SharedJournal journal(dataFilePath);
+	auto lock = journal.lock();
+	CPPUNIT_ASSERT(journal.attach(0));
+
+	deque<ScrobbleInfo> scrobbles;
+	for (size_t i = 0; i < deadCount + keptCount; ++i) {
+		scrobbles.emplace_back(testScrobble(long(i)));
+	}
+	journal.append(0, scrobbles.cbegin(), scrobbles.cend(), false, false);
+	journal.acknowledge(0, deadCount);
+	CPPUNIT_ASSERT(journal.sync());
+	const size_t size = readFile(m_dataFilePath).size();
+
+	// The records kept by the compaction are acknowledged before the compaction is finished.
+	journal.checkpoint();
+	journal.acknowledge(0, keptCount);
+	CPPUNIT_ASSERT(journal.sync());
+	CPPUNIT_ASSERT(readFile(m_dataFilePath).size() < size / 2);
+	CPPUNIT_ASSERT_EQUAL(size_t(0), journal.storedCount(0));
+
+	// Nothing is pending so the data file is compacted once again.
+	CPPUNIT_ASSERT(journal.detach(0));
+	CPPUNIT_ASSERT_EQUAL(size_t(journalHeaderSize), readFile(m_dataFilePath).size());
+}
+
+void SharedJournalTest::testCheckpoint_AppendsDuringCompaction()
+{
+	// Enough dead records for the data file to be compacted.
+	constexpr size_t deadCount = 50 * 1000;
+
+	const afc::String dataFilePath = toString(m_dataFilePath);
+	size_t deadSize;
+	{
+		SharedJournal journal(dataFilePath);
+		auto lock = journal.lock();
+		CPPUNIT_ASSERT(journal.attach(0));
+		CPPUNIT_ASSERT(journal.attach(1));
+
+		deque<ScrobbleInfo> scrobbles;
+		for (size_t i = 0; i < deadCount; ++i) {
+			scrobbles.emplace_back(testScrobble(long(i)));
+		}
+		journal.append(0, scrobbles.cbegin(), scrobbles.cend(), false, false);
+		append(journal, 1, 1);
+		append(journal, 1, 2);
+		append(journal, 0, 3);
+		journal.acknowledge(0, deadCount);
+		CPPUNIT_ASSERT(journal.sync());
+		deadSize = readFile(m_dataFilePath).size();
+
+		// The data file is compacted in the background while the consumers go on.
+		journal.checkpoint();
+		append(journal, 1, 4);
+		append(journal, 0, 5);
+		append(journal, 1, 6);
+		journal.acknowledge(1, 1);
+
+		// The records appended meanwhile follow the new journal.
+		CPPUNIT_ASSERT(journal.sync());
+		CPPUNIT_ASSERT_EQUAL(size_t(2), journal.storedCount(0));
+		CPPUNIT_ASSERT_EQUAL(size_t(3), journal.storedCount(1));
+		append(journal, 1, 7);
+		CPPUNIT_ASSERT(journal.sync());
+
+		CPPUNIT_ASSERT(journal.detach(0, true));
+		CPPUNIT_ASSERT(journal.detach(1, true));
+	}
+
+	CPPUNIT_ASSERT(readFile(m_dataFilePath).size() < deadSize / 100);
+	const vector<ScrobbleRecord> records = scrobbleRecords(m_dataFilePath);
+	CPPUNIT_ASSERT(recordConsumers(m_dataFilePath) == vector<unsigned>({0x2, 0x2, 0x1, 0x2, 0x1, 0x2, 0x2}));
+
+	// The cursor of the second consumer is moved past its first record.
+	SharedJournal journal(dataFilePath);
+	auto lock = journal.lock();
+	CPPUNIT_ASSERT(journal.attach(0));
+	CPPUNIT_ASSERT(journal.attach(1));
+	SharedJournal::SpillRange range;
+	CPPUNIT_ASSERT(journal.spillRange(1, range));
+	CPPUNIT_ASSERT_EQUAL(records[0].end, range.begin);
+	CPPUNIT_ASSERT_EQUAL(records.back().end, range.end);
+	CPPUNIT_ASSERT(journal.detach(0));
+	CPPUNIT_ASSERT(journal.detach(1));
+}
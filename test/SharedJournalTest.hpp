@@ -0,0 +1,56 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef SHAREDJOURNALTEST_HPP_
+#define SHAREDJOURNALTEST_HPP_
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+
+class SharedJournalTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(SharedJournalTest);
+	CPPUNIT_TEST(testAppend_SameScrobble);
+	CPPUNIT_TEST(testAppend_DifferentScrobbles);
+	CPPUNIT_TEST(testAppend_NoDelay);
+	CPPUNIT_TEST(testAppend_Many);
+	CPPUNIT_TEST(testAppend_ManyConcurrently);
+	CPPUNIT_TEST(testAcknowledge_PerConsumer);
+	CPPUNIT_TEST(testAcknowledgeAt_Compaction);
+	CPPUNIT_TEST(testAcknowledgeAt_ConsumerMask);
+	CPPUNIT_TEST(testCheckpoint_AcknowledgedDuringCompaction);
+	CPPUNIT_TEST(testCheckpoint_AppendsDuringCompaction);
+	CPPUNIT_TEST_SUITE_END();
+public:
+	void setUp();
+	void tearDown();
+
+	void testAppend_SameScrobble();
+	void testAppend_DifferentScrobbles();
+	void testAppend_NoDelay();
+	void testAppend_Many();
+	void testAppend_ManyConcurrently();
+	void testAcknowledge_PerConsumer();
+	void testAcknowledgeAt_Compaction();
+	void testAcknowledgeAt_ConsumerMask();
+	void testCheckpoint_AcknowledgedDuringCompaction();
+	void testCheckpoint_AppendsDuringCompaction();
+private:
+	std::string m_dir;
+	std::string m_dataFilePath;
+};
+
+#endif /* SHAREDJOURNALTEST_HPP_ */
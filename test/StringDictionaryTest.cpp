@@ -0,0 +1,159 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "StringDictionaryTest.hpp"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(StringDictionaryTest);
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <StringDictionary.hpp>
+#include <afc/StringRef.hpp>
+
+using afc::operator"" _s;
+using namespace std;
+
+namespace
+{
+	string lookup(const StringDictionary &dictionary, const std::uint32_t id)
+	{
+		const char *begin, *end;
+		CPPUNIT_ASSERT(dictionary.lookup(id, begin, end));
+		return string(begin, end);
+	}
+}
+
+void StringDictionaryTest::testAdd()
+{
+	StringDictionary dictionary;
+	afc::ConstStringRef queen = "Queen"_s;
+	afc::ConstStringRef abba = "ABBA"_s;
+	bool isNew;
+
+	const std::uint32_t queenId = dictionary.add(queen.begin(), queen.end(), isNew);
+	CPPUNIT_ASSERT(isNew);
+	CPPUNIT_ASSERT(queenId != StringDictionary::emptyStringId);
+
+	const std::uint32_t abbaId = dictionary.add(abba.begin(), abba.end(), isNew);
+	CPPUNIT_ASSERT(isNew);
+	CPPUNIT_ASSERT(abbaId != queenId);
+
+	// A string that is equal to an existing one gets the same identifier.
+	const string queenCopy(queen.begin(), queen.end());
+	CPPUNIT_ASSERT_EQUAL(queenId, dictionary.add(queenCopy.data(), queenCopy.data() + queenCopy.size(), isNew));
+	CPPUNIT_ASSERT(!isNew);
+
+	CPPUNIT_ASSERT_EQUAL(std::size_t(2), dictionary.size());
+	CPPUNIT_ASSERT_EQUAL(string("Queen"), lookup(dictionary, queenId));
+	CPPUNIT_ASSERT_EQUAL(string("ABBA"), lookup(dictionary, abbaId));
+}
+
+void StringDictionaryTest::testDefine()
+{
+	StringDictionary dictionary;
+	afc::ConstStringRef queen = "Queen"_s;
+	afc::ConstStringRef abba = "ABBA"_s;
+
+	CPPUNIT_ASSERT(dictionary.define(5, queen.begin(), queen.end()));
+	// Re-defining a string with the same value is allowed.
+	CPPUNIT_ASSERT(dictionary.define(5, queen.begin(), queen.end()));
+	CPPUNIT_ASSERT_EQUAL(std::size_t(1), dictionary.size());
+	CPPUNIT_ASSERT_EQUAL(string("Queen"), lookup(dictionary, 5));
+
+	bool isNew;
+	CPPUNIT_ASSERT_EQUAL(std::uint32_t(5), dictionary.add(queen.begin(), queen.end(), isNew));
+	CPPUNIT_ASSERT(!isNew);
+
+	// New strings get identifiers that follow the defined ones.
+	const std::uint32_t abbaId = dictionary.add(abba.begin(), abba.end(), isNew);
+	CPPUNIT_ASSERT(isNew);
+	CPPUNIT_ASSERT(abbaId > 5);
+}
+
+void StringDictionaryTest::testDefine_Conflict()
+{
+	StringDictionary dictionary;
+	afc::ConstStringRef queen = "Queen"_s;
+	afc::ConstStringRef abba = "ABBA"_s;
+
+	CPPUNIT_ASSERT(dictionary.define(1, queen.begin(), queen.end()));
+	CPPUNIT_ASSERT(!dictionary.define(1, abba.begin(), abba.end()));
+	CPPUNIT_ASSERT(!dictionary.define(StringDictionary::emptyStringId, abba.begin(), abba.end()));
+	CPPUNIT_ASSERT(!dictionary.define(0xffffffffu, abba.begin(), abba.end()));
+
+	CPPUNIT_ASSERT_EQUAL(std::size_t(1), dictionary.size());
+	CPPUNIT_ASSERT_EQUAL(string("Queen"), lookup(dictionary, 1));
+}
+
+void StringDictionaryTest::testLookup_Undefined()
+{
+	StringDictionary dictionary;
+	const char *begin, *end;
+
+	CPPUNIT_ASSERT(!dictionary.lookup(StringDictionary::emptyStringId, begin, end));
+	CPPUNIT_ASSERT(!dictionary.lookup(1, begin, end));
+}
+
+void StringDictionaryTest::testFind()
+{
+	StringDictionary dictionary;
+	afc::ConstStringRef queen = "Queen"_s;
+	afc::ConstStringRef abba = "ABBA"_s;
+	bool isNew;
+
+	const std::uint32_t queenId = dictionary.add(queen.begin(), queen.end(), isNew);
+	CPPUNIT_ASSERT_EQUAL(queenId, dictionary.find(queen.begin(), queen.end()));
+	CPPUNIT_ASSERT_EQUAL(StringDictionary::emptyStringId, dictionary.find(abba.begin(), abba.end()));
+	// find() does not add strings.
+	CPPUNIT_ASSERT_EQUAL(std::size_t(1), dictionary.size());
+}
+
+void StringDictionaryTest::testForEach()
+{
+	StringDictionary dictionary;
+	afc::ConstStringRef queen = "Queen"_s;
+	afc::ConstStringRef abba = "ABBA"_s;
+	bool isNew;
+	const std::uint32_t queenId = dictionary.add(queen.begin(), queen.end(), isNew);
+	const std::uint32_t abbaId = dictionary.add(abba.begin(), abba.end(), isNew);
+
+	map<std::uint32_t, string> strings;
+	dictionary.forEach([&strings](const std::uint32_t id, const char * const begin, const char * const end)
+	{
+		strings.emplace(id, string(begin, end));
+	});
+
+	CPPUNIT_ASSERT_EQUAL(std::size_t(2), strings.size());
+	CPPUNIT_ASSERT_EQUAL(string("Queen"), strings[queenId]);
+	CPPUNIT_ASSERT_EQUAL(string("ABBA"), strings[abbaId]);
+}
+
+void StringDictionaryTest::testClear()
+{
+	StringDictionary dictionary;
+	afc::ConstStringRef queen = "Queen"_s;
+	bool isNew;
+	const std::uint32_t queenId = dictionary.add(queen.begin(), queen.end(), isNew);
+
+	dictionary.clear();
+
+	const char *begin, *end;
+	CPPUNIT_ASSERT_EQUAL(std::size_t(0), dictionary.size());
+	CPPUNIT_ASSERT(!dictionary.lookup(queenId, begin, end));
+	dictionary.add(queen.begin(), queen.end(), isNew);
+	CPPUNIT_ASSERT(isNew);
+}
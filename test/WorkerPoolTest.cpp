@@ -0,0 +1,87 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "WorkerPoolTest.hpp"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(WorkerPoolTest);
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include <WorkerPool.hpp>
+
+using namespace std;
+
+void WorkerPoolTest::testRun_AllParts()
+{
+	constexpr size_t partCount = 16;
+
+	WorkerPool pool(3);
+	CPPUNIT_ASSERT_EQUAL(size_t(3), pool.threadCount());
+
+	// The same threads run the jobs one after another; each part is run exactly once.
+	for (int job = 0; job < 100; ++job) {
+		vector<atomic<int>> runs(partCount);
+		pool.run(partCount, [&runs](const size_t i) { ++runs[i]; });
+		for (size_t i = 0; i < partCount; ++i) {
+			CPPUNIT_ASSERT_EQUAL(1, runs[i].load());
+		}
+	}
+
+	pool.run(0, [](size_t) { CPPUNIT_FAIL("No part is expected to be run."); });
+}
+
+void WorkerPoolTest::testRun_NoThreads()
+{
+	WorkerPool pool(0);
+
+	const thread::id caller = this_thread::get_id();
+	vector<thread::id> runners(4);
+	pool.run(runners.size(), [&runners](const size_t i) { runners[i] = this_thread::get_id(); });
+	for (const thread::id runner : runners) {
+		CPPUNIT_ASSERT(runner == caller);
+	}
+}
+
+void WorkerPoolTest::testRun_ConcurrentJobs()
+{
+	constexpr int submitterCount = 4;
+	constexpr int jobCount = 1000;
+	constexpr size_t partCount = 8;
+
+	// The jobs that are submitted while another one is in progress are run by their submitters.
+	WorkerPool pool(2);
+	atomic<long> sum(0);
+	vector<thread> submitters;
+	for (int submitter = 0; submitter < submitterCount; ++submitter) {
+		submitters.emplace_back([&pool, &sum]()
+		{
+			for (int job = 0; job < jobCount; ++job) {
+				vector<int> results(partCount);
+				pool.run(partCount, [&results](const size_t i) { results[i] = int(i) + 1; });
+				for (const int result : results) {
+					sum += result;
+				}
+			}
+		});
+	}
+	for (thread &submitter : submitters) {
+		submitter.join();
+	}
+
+	CPPUNIT_ASSERT_EQUAL(long(submitterCount) * jobCount * (partCount * (partCount + 1) / 2), sum.load());
+}
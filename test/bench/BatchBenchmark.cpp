@@ -0,0 +1,118 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "BenchScrobbler.hpp"
+#include "Benchmark.hpp"
+
+using namespace std;
+
+/* Compares importing a listening history by the batch scrobble() (a range of scrobbles per call)
+ * against a scrobble() call per scrobble, with and without failure-safe scrobbling. The time is
+ * that of the scrobble() calls; all the scrobbles are kept in memory.
+ */
+namespace
+{
+	struct Case
+	{
+		const char *name;
+		// The number of scrobbles per scrobble() call; zero if all of them are passed by a single call.
+		size_t batchSize;
+	};
+
+	const Case cases[] = {
+		{"single calls", 1},
+		{"batches of 100", 100},
+		{"one batch", 0}
+	};
+
+	bool measure(const string &path, const size_t count, const size_t batchSize, const bool safeScrobbling,
+			double &time)
+	{
+		::unlink(path.c_str());
+		::unlink((path + ".cursor").c_str());
+
+		vector<ScrobbleInfo> scrobbles;
+		scrobbles.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			scrobbles.push_back(benchScrobble(i));
+		}
+
+		BenchScrobbler scrobbler(path);
+		scrobbler.setResidentScrobbleLimit(count);
+		if (!scrobbler.start() || !scrobbler.waitForLoad()) {
+			fprintf(stderr, "Unable to start the scrobbler.\n");
+			return false;
+		}
+		const BenchClock::time_point start = BenchClock::now();
+		if (batchSize == 1) {
+			for (ScrobbleInfo &scrobbleInfo : scrobbles) {
+				scrobbler.scrobble(move(scrobbleInfo), safeScrobbling);
+			}
+		} else {
+			const size_t step = batchSize == 0 ? count : batchSize;
+			for (auto it = scrobbles.begin(); it != scrobbles.end();) {
+				const auto batchEnd = next(it, min(step, size_t(scrobbles.end() - it)));
+				scrobbler.scrobble(it, batchEnd, safeScrobbling);
+				it = batchEnd;
+			}
+		}
+		time = millisSince(start);
+		const size_t residentCount = scrobbler.residentCount();
+		scrobbler.stop();
+
+		if (residentCount != count) {
+			printf("  %zu scrobbles are resident, %zu expected\n", residentCount, count);
+			return false;
+		}
+		return true;
+	}
+
+	int run(const BenchmarkOptions &options)
+	{
+		const size_t count = options.countOr(200000);
+		const string path = options.dir + "/data";
+
+		printf("%zu scrobbles, best of %u runs\n", count, options.runs);
+		printf("%-16s %10s %12s %10s %12s\n", "scrobble()", "time, ms", "k/s", "safe, ms", "safe, k/s");
+		int status = 0;
+		for (const Case &c : cases) {
+			double times[2] = {0, 0};
+			for (const bool safeScrobbling : {false, true}) {
+				for (unsigned i = 0; i < options.runs; ++i) {
+					double runTime;
+					if (!measure(path, count, c.batchSize, safeScrobbling, runTime)) {
+						status = 1;
+					}
+					times[safeScrobbling] = i == 0 ? runTime : min(times[safeScrobbling], runTime);
+				}
+			}
+			printf("%-16s %10.1f %12.0f %10.1f %12.0f\n", c.name, times[0], count / times[0], times[1],
+					count / times[1]);
+			fflush(stdout);
+		}
+		return status;
+	}
+
+	const Benchmark benchmark("batch", "importing scrobbles by the batch scrobble() against a call per scrobble",
+			&run);
+}
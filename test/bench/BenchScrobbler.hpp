@@ -0,0 +1,75 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef BENCHSCROBBLER_HPP_
+#define BENCHSCROBBLER_HPP_
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <afc/SimpleString.hpp>
+#include <Scrobbler.hpp>
+#include <ScrobbleInfo.hpp>
+
+/* A Scrobbler that never submits its pending scrobbles. It is used to measure loading and storing them.
+ * Subclasses that complete pending scrobbles in startScrobbling() call enableScrobbling() once started.
+ */
+class BenchScrobbler : public Scrobbler<std::deque<ScrobbleInfo>>
+{
+public:
+	using Scrobbler::defaultResidentScrobbleLimit;
+
+	explicit BenchScrobbler(const std::string &dataFilePath) : Scrobbler(20), m_dataFilePath()
+	{
+		m_dataFilePath.assign(dataFilePath.data(), dataFilePath.size());
+	}
+
+	// Makes startScrobbling() be invoked until this Scrobbler is stopped.
+	void enableScrobbling()
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		m_configured = true;
+		wake();
+	}
+
+	// The number of pending scrobbles in memory, including the ones accepted but not taken yet.
+	std::size_t residentCount()
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		drainIntake();
+		return m_pendingScrobbles.size();
+	}
+
+	// The indices (see benchScrobble()) of the pending scrobbles in memory, in order.
+	std::vector<std::size_t> residentIndices()
+	{ std::lock_guard<std::mutex> lock(m_mutex);
+		drainIntake();
+		std::vector<std::size_t> result;
+		result.reserve(m_pendingScrobbles.size());
+		for (const ScrobbleInfo &scrobbleInfo : m_pendingScrobbles) {
+			result.push_back(std::size_t(scrobbleInfo.scrobbleDuration));
+		}
+		return result;
+	}
+protected:
+	virtual void startScrobbling() override { attemptFinished(0); }
+
+	virtual const afc::String &getDataFilePath() const override { return m_dataFilePath; }
+private:
+	afc::String m_dataFilePath;
+};
+
+#endif /* BENCHSCROBBLER_HPP_ */
@@ -0,0 +1,156 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ftw.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include <afc/FastStringBuffer.hpp>
+#include <fileutil.hpp>
+#include <ScrobbleInfo.hpp>
+#include <ScrobbleJournal.hpp>
+#include <StringDictionary.hpp>
+
+using namespace std;
+
+namespace
+{
+	vector<const Benchmark *> &registry()
+	{
+		static vector<const Benchmark *> benchmarks;
+		return benchmarks;
+	}
+
+	// Scrobbles are written in blocks so that large data files are not built in memory as a whole.
+	constexpr size_t writeBlockSize = 10000;
+
+	template<typename AppendRecord>
+	bool writeBlocks(const string &path, const size_t count, afc::FastStringBuffer<char> &&head,
+			AppendRecord appendRecord)
+	{
+		const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0664);
+		if (fd == -1) {
+			return false;
+		}
+		bool written = writeFully(fd, head.data(), head.size());
+		afc::FastStringBuffer<char> block;
+		for (size_t i = 0; written && i < count; i += writeBlockSize) {
+			block.clear();
+			for (size_t j = i, n = min(count, i + writeBlockSize); j < n; ++j) {
+				appendRecord(benchScrobble(j), block);
+			}
+			written = writeFully(fd, block.data(), block.size());
+		}
+		return ::close(fd) == 0 && written;
+	}
+}
+
+Benchmark::Benchmark(const char * const name, const char * const summary, const Function function)
+	: name(name), summary(summary), function(function)
+{
+	registry().push_back(this);
+}
+
+vector<const Benchmark *> Benchmark::all()
+{
+	vector<const Benchmark *> result(registry());
+	sort(result.begin(), result.end(),
+			[](const Benchmark * const a, const Benchmark * const b) { return strcmp(a->name, b->name) < 0; });
+	return result;
+}
+
+ScrobbleInfo benchScrobble(const size_t index)
+{
+	char title[64], artist[64], album[64];
+	snprintf(title, sizeof(title), "Track title %zu", index);
+	snprintf(artist, sizeof(artist), "Some Artist Name %zu", index % 200);
+	snprintf(album, sizeof(album), "An Album Title of Moderate Length %zu", index % 500);
+
+	ScrobbleInfo scrobbleInfo;
+	scrobbleInfo.scrobbleStartTimestamp = time_t(1400000000 + 240 * index);
+	scrobbleInfo.scrobbleEndTimestamp = time_t(1400000000 + 240 * index + 200);
+	scrobbleInfo.scrobbleDuration = long(index);
+
+	TrackInfoBuilder builder(scrobbleInfo.track);
+	builder.setTitle(title);
+	const size_t artistSize = strlen(artist);
+	builder.getBuf().reserve(builder.getBuf().size() + artistSize);
+	builder.getBuf().append(artist, artistSize);
+	builder.artistsProcessed();
+	builder.setAlbumTitle(album);
+	builder.getBuf().reserve(builder.getBuf().size() + artistSize);
+	builder.getBuf().append(artist, artistSize);
+	builder.albumArtistsProcessed();
+	builder.setDurationMillis(200000);
+	builder.build();
+	return scrobbleInfo;
+}
+
+bool writeBenchJournal(const string &path, const size_t count, const size_t damagePeriod)
+{
+	afc::FastStringBuffer<char> header;
+	appendJournalHeader(newJournalFileId(), header);
+	StringDictionary dictionary;
+	size_t index = 0;
+	return writeBlocks(path, count, move(header), [&](const ScrobbleInfo &scrobbleInfo,
+			afc::FastStringBuffer<char> &dest)
+	{
+		appendJournalRecord(scrobbleInfo, dictionary, dest);
+		// The scrobble record is the last one appended; its CRC is made invalid.
+		if (damagePeriod != 0 && ++index % damagePeriod == 0) {
+			dest.begin()[dest.size() - 1] ^= 0xff;
+		}
+	});
+}
+
+bool writeBenchJsonLines(const string &path, const size_t count)
+{
+	return writeBlocks(path, count, afc::FastStringBuffer<char>(),
+			[](const ScrobbleInfo &scrobbleInfo, afc::FastStringBuffer<char> &dest)
+	{
+		appendAsJson(scrobbleInfo, dest);
+		dest.reserve(dest.size() + 1);
+		dest.append(u8"\n"[0]);
+	});
+}
+
+bool writeBenchFile(const string &path, const char * const data, const size_t size)
+{
+	const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0664);
+	if (fd == -1) {
+		return false;
+	}
+	const bool written = writeFully(fd, data, size);
+	return ::close(fd) == 0 && written;
+}
+
+size_t benchFileSize(const string &path)
+{
+	struct stat fileStatus;
+	return ::stat(path.c_str(), &fileStatus) == 0 ? size_t(fileStatus.st_size) : 0;
+}
+
+void removeBenchDir(const string &path)
+{
+	::nftw(path.c_str(), [](const char * const file, const struct stat *, int, FTW *) { return ::remove(file); },
+			16, FTW_DEPTH | FTW_PHYS);
+}
@@ -0,0 +1,120 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef BENCHMARK_HPP_
+#define BENCHMARK_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <afc/SimpleString.hpp>
+#include <ScrobbleInfo.hpp>
+
+// The settings of a benchmark run that are given on the command line (see run_benchmarks.cpp).
+struct BenchmarkOptions
+{
+	// The number of scrobbles a benchmark works with; zero if the benchmark is to use its own default.
+	std::size_t count;
+	// The number of times each measurement is repeated.
+	unsigned runs;
+	// The directory the data files are created in. It is removed once the benchmark is finished.
+	std::string dir;
+
+	std::size_t countOr(const std::size_t defaultCount) const noexcept { return count == 0 ? defaultCount : count; }
+};
+
+/* A benchmark that is run by name by the benchmarks binary. Each benchmark is defined as a static
+ * instance of this class in its own file. The benchmarks report their results to stdout and return
+ * the exit status: zero if the measurements are taken and the checks they make are passed.
+ */
+class Benchmark
+{
+public:
+	typedef int (*Function)(const BenchmarkOptions &options);
+
+	Benchmark(const char *name, const char *summary, Function function);
+
+	// All the benchmarks registered, ordered by their names.
+	static std::vector<const Benchmark *> all();
+
+	const char * const name;
+	const char * const summary;
+	const Function function;
+};
+
+typedef std::chrono::steady_clock BenchClock;
+
+inline double millisSince(const BenchClock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+}
+
+// The durations measured by a benchmark, in milliseconds.
+class Samples
+{
+public:
+	void add(const double value) { m_values.push_back(value); }
+
+	bool empty() const noexcept { return m_values.empty(); }
+
+	double min() const { return *std::min_element(m_values.begin(), m_values.end()); }
+
+	// Returns the value below which a given fraction of the samples falls (the nearest-rank method).
+	double percentile(const double fraction) const
+	{
+		std::vector<double> sorted(m_values);
+		std::sort(sorted.begin(), sorted.end());
+		const std::size_t rank = std::size_t(fraction * (sorted.size() - 1) + 0.5);
+		return sorted[rank];
+	}
+private:
+	std::vector<double> m_values;
+};
+
+inline afc::String toString(const std::string &s)
+{
+	afc::String result;
+	result.assign(s.data(), s.size());
+	return result;
+}
+
+/* Returns the scrobble with a given index. The index is stored as the scrobble duration so that
+ * the order of the scrobbles can be checked. The strings repeat across scrobbles as they do
+ * in a real listening history: 200 artists, 500 albums.
+ */
+ScrobbleInfo benchScrobble(std::size_t index);
+
+/* Writes a data file that holds the records of the scrobbles from zero to count - 1 pending
+ * for all consumers, as they are stored by the current version of the plugin. If damagePeriod
+ * is not zero then the CRC of each damagePeriod-th scrobble record is made invalid.
+ */
+bool writeBenchJournal(const std::string &path, std::size_t count, std::size_t damagePeriod = 0);
+
+/* Writes a data file of the older versions of the plugin (JSON lines) that holds the scrobbles
+ * from zero to count - 1.
+ */
+bool writeBenchJsonLines(const std::string &path, std::size_t count);
+
+bool writeBenchFile(const std::string &path, const char *data, std::size_t size);
+
+std::size_t benchFileSize(const std::string &path);
+
+// Removes a given directory with all its contents.
+void removeBenchDir(const std::string &path);
+
+#endif /* BENCHMARK_HPP_ */
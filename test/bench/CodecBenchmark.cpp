@@ -0,0 +1,171 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <afc/FastStringBuffer.hpp>
+#include <fileutil.hpp>
+#include <ScrobbleInfo.hpp>
+#include <ScrobbleJournal.hpp>
+#include <StringDictionary.hpp>
+
+#include "Benchmark.hpp"
+
+using namespace std;
+
+/* Compares the store and load throughput of the formats of the data file: the JSON lines of
+ * the older versions, the journal of scrobble records and the journal of compact scrobble records
+ * (with the strings in the dictionary). Storing is encoding the scrobbles and writing them to the file
+ * without syncing; loading is mapping the file and parsing the scrobbles, as the loader does.
+ */
+namespace
+{
+	enum Format {F_JSON, F_JOURNAL, F_COMPACT_JOURNAL};
+
+	const char * const formatNames[] = {"JSON lines", "journal", "compact journal"};
+
+	void encode(const Format format, const vector<ScrobbleInfo> &scrobbles, afc::FastStringBuffer<char> &dest)
+	{
+		StringDictionary dictionary;
+		if (format != F_JSON) {
+			appendJournalHeader(newJournalFileId(), dest);
+		}
+		for (const ScrobbleInfo &scrobbleInfo : scrobbles) {
+			switch (format) {
+			case F_JSON:
+				appendAsJson(scrobbleInfo, dest);
+				dest.reserve(dest.size() + 1);
+				dest.append(u8"\n"[0]);
+				break;
+			case F_JOURNAL:
+				appendJournalRecord(scrobbleInfo, dest);
+				break;
+			case F_COMPACT_JOURNAL:
+				appendJournalRecord(scrobbleInfo, dictionary, dest);
+				break;
+			}
+		}
+	}
+
+	// Returns the number of scrobbles parsed.
+	size_t parse(const Format format, const char *begin, const char * const end, vector<ScrobbleInfo> &dest)
+	{
+		if (format == F_JSON) {
+			while (begin != end) {
+				const char *lineEnd = static_cast<const char *>(memchr(begin, u8"\n"[0], end - begin));
+				if (lineEnd == nullptr) {
+					lineEnd = end;
+				}
+				dest.emplace_back();
+				if (!ScrobbleInfo::parse(begin, lineEnd, dest.back())) {
+					dest.pop_back();
+				}
+				begin = lineEnd == end ? end : lineEnd + 1;
+			}
+			return dest.size();
+		}
+
+		uint64_t fileId;
+		if (!readJournalHeader(begin, end, fileId)) {
+			return 0;
+		}
+		begin += journalHeaderSize;
+		StringDictionary dictionary;
+		JournalRecordType type;
+		const char *payloadBegin, *payloadEnd;
+		while (readJournalRecord(begin, end, type, payloadBegin, payloadEnd) == JournalReadResult::ok) {
+			if (type == JournalRecordType::string) {
+				uint32_t id;
+				const char *stringBegin, *stringEnd;
+				if (readJournalString(payloadBegin, payloadEnd, id, stringBegin, stringEnd)) {
+					dictionary.define(id, stringBegin, stringEnd);
+				}
+				continue;
+			}
+			dest.emplace_back();
+			const bool parsed = type == JournalRecordType::scrobble ?
+					ScrobbleInfo::parseBinary(payloadBegin, payloadEnd, dest.back()) :
+					ScrobbleInfo::parseCompactBinary(payloadBegin, payloadEnd, dictionary, dest.back());
+			if (!parsed) {
+				dest.pop_back();
+			}
+		}
+		return dest.size();
+	}
+
+	int run(const BenchmarkOptions &options)
+	{
+		const size_t count = options.countOr(200000);
+		vector<ScrobbleInfo> scrobbles;
+		scrobbles.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			scrobbles.push_back(benchScrobble(i));
+		}
+
+		printf("%zu scrobbles, best of %u runs\n", count, options.runs);
+		printf("%-16s %10s %10s %12s %10s %12s\n", "format", "size, MiB", "store, ms", "store, k/s",
+				"load, ms", "load, k/s");
+		int status = 0;
+		for (const Format format : {F_JSON, F_JOURNAL, F_COMPACT_JOURNAL}) {
+			const string path = options.dir + "/data";
+			double storeTime = 0, loadTime = 0;
+			size_t size = 0, parsedCount = 0;
+			for (unsigned i = 0; i < options.runs; ++i) {
+				BenchClock::time_point start = BenchClock::now();
+				{
+					afc::FastStringBuffer<char> data;
+					encode(format, scrobbles, data);
+					if (!writeBenchFile(path, data.data(), data.size())) {
+						fprintf(stderr, "Unable to write the file %s.\n", path.c_str());
+						return 1;
+					}
+					size = data.size();
+				}
+				const double storeRunTime = millisSince(start);
+
+				start = BenchClock::now();
+				{
+					MappedFile file;
+					vector<ScrobbleInfo> loaded;
+					loaded.reserve(count);
+					if (file.map(path.c_str()) != MappedFile::M_MAPPED) {
+						fprintf(stderr, "Unable to map the file %s.\n", path.c_str());
+						return 1;
+					}
+					parsedCount = parse(format, file.begin(), file.end(), loaded);
+				}
+				const double loadRunTime = millisSince(start);
+
+				storeTime = i == 0 ? storeRunTime : min(storeTime, storeRunTime);
+				loadTime = i == 0 ? loadRunTime : min(loadTime, loadRunTime);
+			}
+
+			printf("%-16s %10.1f %10.1f %12.0f %10.1f %12.0f\n", formatNames[format], size / 1048576.0,
+					storeTime, count / storeTime, loadTime, count / loadTime);
+			if (parsedCount != count) {
+				printf("  only %zu scrobbles of %zu are parsed\n", parsedCount, count);
+				status = 1;
+			}
+		}
+		return status;
+	}
+
+	const Benchmark benchmark("codec", "store and load throughput of the data file formats", &run);
+}
@@ -0,0 +1,224 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <afc/FastStringBuffer.hpp>
+#include <JournalWriter.hpp>
+#include <ScrobbleJournal.hpp>
+#include <fileutil.hpp>
+
+#include "BenchScrobbler.hpp"
+#include "Benchmark.hpp"
+
+using namespace std;
+
+/* Measures the persistence path of failure-safe scrobbling:
+ * - the time Scrobbler::scrobble() blocks its caller, with and without syncing, against opening,
+ *   appending to and closing the data file for each scrobble as the older versions did, and the time
+ *   until all the scrobbles are stored;
+ * - the throughput of synced appends submitted by several threads at once, which the journal writer
+ *   commits as a group, against each thread calling write() and fdatasync() itself.
+ */
+namespace
+{
+	constexpr unsigned maxSubmitterCount = 16;
+
+	void printLatency(const char * const name, const Samples &samples, const double storeTime)
+	{
+		printf("%-32s %10.4f %10.4f %10.4f %10.1f\n", name, samples.percentile(0.5), samples.percentile(0.99),
+				samples.percentile(1), storeTime);
+	}
+
+	bool scrobbleLatency(const string &path, const size_t count, const bool sync, Samples &samples,
+			double &storeTime)
+	{
+		::unlink(path.c_str());
+		::unlink((path + ".cursor").c_str());
+		BenchScrobbler scrobbler(path);
+		scrobbler.setResidentScrobbleLimit(count);
+		if (!scrobbler.start() || !scrobbler.waitForLoad()) {
+			return false;
+		}
+		const BenchClock::time_point start = BenchClock::now();
+		for (size_t i = 0; i < count; ++i) {
+			ScrobbleInfo scrobbleInfo = benchScrobble(i);
+			const BenchClock::time_point scrobbleStart = BenchClock::now();
+			scrobbler.scrobble(move(scrobbleInfo), true, sync);
+			samples.add(millisSince(scrobbleStart));
+		}
+		const size_t residentCount = scrobbler.residentCount();
+		// stop() returns once all the scrobbles are written.
+		scrobbler.stop();
+		storeTime = millisSince(start);
+		return residentCount == count;
+	}
+
+	// The baseline: the data file is opened, appended to (and synced) and closed for each scrobble.
+	bool reopeningLatency(const string &path, const size_t count, const bool sync, Samples &samples,
+			double &storeTime)
+	{
+		::unlink(path.c_str());
+		const BenchClock::time_point storeStart = BenchClock::now();
+		for (size_t i = 0; i < count; ++i) {
+			afc::FastStringBuffer<char> record;
+			appendJournalRecord(benchScrobble(i), record);
+
+			const BenchClock::time_point start = BenchClock::now();
+			const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0664);
+			if (fd == -1) {
+				return false;
+			}
+			bool written = writeFully(fd, record.c_str(), record.size()) && (!sync || ::fdatasync(fd) == 0);
+			written = ::close(fd) == 0 && written;
+			samples.add(millisSince(start));
+			if (!written) {
+				return false;
+			}
+		}
+		storeTime = millisSince(storeStart);
+		return true;
+	}
+
+	/* Each submitter appends its share of count records with syncing and waits until each of them
+	 * is written. Returns the number of records per second, or zero on failure.
+	 */
+	double groupCommitThroughput(const string &path, const size_t count, const unsigned submitterCount)
+	{
+		afc::FastStringBuffer<char> header;
+		appendJournalHeader(newJournalFileId(), header);
+		if (!writeBenchFile(path, header.c_str(), header.size())) {
+			return 0;
+		}
+		JournalWriter writer;
+		writer.start(toString(path));
+
+		// The appends must be submitted in the order of their offsets.
+		mutex offsetMutex;
+		uint64_t offset = header.size();
+		const size_t share = count / submitterCount;
+
+		const BenchClock::time_point start = BenchClock::now();
+		vector<thread> submitters;
+		for (unsigned i = 0; i < submitterCount; ++i) {
+			submitters.emplace_back([&, i]()
+			{
+				for (size_t j = 0; j < share; ++j) {
+					afc::FastStringBuffer<char> record;
+					appendJournalRecord(benchScrobble(i * share + j), record);
+					{ lock_guard<mutex> lock(offsetMutex);
+						const size_t size = record.size();
+						writer.append(move(record), offset, true);
+						offset += size;
+					}
+					writer.flush();
+				}
+			});
+		}
+		for (thread &submitter : submitters) {
+			submitter.join();
+		}
+		const double time = millisSince(start);
+		writer.stop();
+		return writer.takeFailure() || benchFileSize(path) != offset ? 0 : share * submitterCount / time * 1000;
+	}
+
+	// The baseline: each submitter calls write() and fdatasync() for each record on a shared descriptor.
+	double directSyncThroughput(const string &path, const size_t count, const unsigned submitterCount)
+	{
+		const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0664);
+		if (fd == -1) {
+			return 0;
+		}
+		const size_t share = count / submitterCount;
+		vector<char> failed(submitterCount, false);
+
+		const BenchClock::time_point start = BenchClock::now();
+		vector<thread> submitters;
+		for (unsigned i = 0; i < submitterCount; ++i) {
+			submitters.emplace_back([&, i]()
+			{
+				for (size_t j = 0; j < share && !failed[i]; ++j) {
+					afc::FastStringBuffer<char> record;
+					appendJournalRecord(benchScrobble(i * share + j), record);
+					failed[i] = !writeFully(fd, record.c_str(), record.size()) || ::fdatasync(fd) != 0;
+				}
+			});
+		}
+		for (thread &submitter : submitters) {
+			submitter.join();
+		}
+		const double time = millisSince(start);
+		bool succeeded = ::close(fd) == 0;
+		for (const char f : failed) {
+			succeeded = succeeded && !f;
+		}
+		return succeeded ? share * submitterCount / time * 1000 : 0;
+	}
+
+	int run(const BenchmarkOptions &options)
+	{
+		const size_t count = options.countOr(10000);
+		const string path = options.dir + "/data";
+
+		printf("%zu failure-safe scrobbles\n", count);
+		printf("%-32s %10s %10s %10s %10s\n", "storing", "p50, ms", "p99, ms", "max, ms", "all, ms");
+		for (const bool sync : {false, true}) {
+			Samples scrobbler, reopening;
+			double scrobblerTime = 0, reopeningTime = 0;
+			if (!scrobbleLatency(path, count, sync, scrobbler, scrobblerTime) ||
+					!reopeningLatency(path, count, sync, reopening, reopeningTime)) {
+				fprintf(stderr, "Unable to store scrobbles to the file %s.\n", path.c_str());
+				return 1;
+			}
+			printLatency(sync ? "scrobble(), sync" : "scrobble(), no sync", scrobbler, scrobblerTime);
+			printLatency(sync ? "open + write + fdatasync + close" : "open + write + close", reopening,
+					reopeningTime);
+		}
+
+		printf("\n%zu synced appends, best of %u runs\n", count, options.runs);
+		printf("%-12s %18s %24s %8s\n", "submitters", "group commit, k/s", "write + fdatasync, k/s", "ratio");
+		for (unsigned submitterCount = 1; submitterCount <= maxSubmitterCount; submitterCount *= 2) {
+			double groupCommit = 0, direct = 0;
+			for (unsigned i = 0; i < options.runs; ++i) {
+				const double groupCommitRun = groupCommitThroughput(path, count, submitterCount);
+				const double directRun = directSyncThroughput(path, count, submitterCount);
+				if (groupCommitRun == 0 || directRun == 0) {
+					fprintf(stderr, "Unable to append to the file %s.\n", path.c_str());
+					return 1;
+				}
+				groupCommit = max(groupCommit, groupCommitRun);
+				direct = max(direct, directRun);
+			}
+			printf("%-12u %18.1f %24.1f %8.2f\n", submitterCount, groupCommit / 1000, direct / 1000,
+					groupCommit / direct);
+		}
+		return 0;
+	}
+
+	const Benchmark benchmark("commit", "blocking of failure-safe scrobbling and group commit of synced appends",
+			&run);
+}
@@ -0,0 +1,142 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "BenchScrobbler.hpp"
+#include "Benchmark.hpp"
+
+using namespace std;
+
+/* Measures how long scrobble() blocks the producer (the message thread of DeaDBeeF) while the reactor
+ * thread is busy within the lock of the Scrobbler, as it is when it builds request bodies and processes
+ * responses. The producer scrobbles every 200 us; each attempt to submit holds the lock for 2 ms and
+ * completes up to 50 scrobbles. The scrobbles that are not failure-safe are pushed to the intake queue;
+ * the failure-safe ones take the lock to be handed to the journal writer before scrobble() returns.
+ */
+namespace
+{
+	constexpr chrono::microseconds scrobbleInterval(200);
+	constexpr size_t scrobblesPerAttempt = 50;
+
+	struct Case
+	{
+		const char *name;
+		// The time for which an attempt to submit holds the lock.
+		chrono::microseconds holdTime;
+		bool safeScrobbling;
+	};
+
+	const Case cases[] = {
+		{"idle worker", chrono::microseconds(0), false},
+		{"busy worker", chrono::microseconds(2000), false},
+		{"busy worker, safe", chrono::microseconds(2000), true}
+	};
+
+	class BusyScrobbler : public BenchScrobbler
+	{
+	public:
+		BusyScrobbler(const string &dataFilePath, const chrono::microseconds holdTime)
+			: BenchScrobbler(dataFilePath), m_holdTime(holdTime), m_completedCount(0) {}
+
+		size_t completedCount()
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_completedCount;
+		}
+	protected:
+		virtual void startScrobbling() override
+		{
+			// Stands for encoding a request body and parsing the response.
+			const BenchClock::time_point until = BenchClock::now() + m_holdTime;
+			while (BenchClock::now() < until) {
+				// Busy waiting.
+			}
+			const size_t count = min(m_pendingScrobbles.size(), scrobblesPerAttempt);
+			completeScrobbles(count);
+			m_completedCount += count;
+			attemptFinished(count);
+		}
+	private:
+		const chrono::microseconds m_holdTime;
+		size_t m_completedCount;
+	};
+
+	bool measure(const string &path, const Case &c, const size_t count, Samples &samples)
+	{
+		::unlink(path.c_str());
+		::unlink((path + ".cursor").c_str());
+
+		BusyScrobbler scrobbler(path, c.holdTime);
+		if (!scrobbler.start() || !scrobbler.waitForLoad()) {
+			fprintf(stderr, "Unable to start the scrobbler.\n");
+			return false;
+		}
+		scrobbler.enableScrobbling();
+		for (size_t i = 0; i < count; ++i) {
+			ScrobbleInfo scrobbleInfo = benchScrobble(i);
+			const BenchClock::time_point start = BenchClock::now();
+			scrobbler.scrobble(move(scrobbleInfo), c.safeScrobbling);
+			samples.add(millisSince(start));
+			this_thread::sleep_for(scrobbleInterval);
+		}
+
+		const BenchClock::time_point deadline = BenchClock::now() + chrono::seconds(10);
+		while (scrobbler.residentCount() != 0 && BenchClock::now() < deadline) {
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		const size_t completedCount = scrobbler.completedCount();
+		scrobbler.stop();
+
+		if (completedCount != count) {
+			printf("  %s: %zu scrobbles completed, %zu expected\n", c.name, completedCount, count);
+			return false;
+		}
+		return true;
+	}
+
+	int run(const BenchmarkOptions &options)
+	{
+		const size_t count = options.countOr(4000);
+		const string path = options.dir + "/data";
+
+		printf("%zu scrobbles, one per %lld us; %u hardware threads\n", count,
+				static_cast<long long>(scrobbleInterval.count()), thread::hardware_concurrency());
+		printf("%-20s %10s %10s %10s %10s %10s\n", "scrobble()", "p50, us", "p90, us", "p99, us", "p99.9, us",
+				"max, us");
+		int status = 0;
+		for (const Case &c : cases) {
+			Samples samples;
+			if (!measure(path, c, count, samples)) {
+				status = 1;
+				continue;
+			}
+			printf("%-20s %10.1f %10.1f %10.1f %10.1f %10.1f\n", c.name, samples.percentile(0.5) * 1000,
+					samples.percentile(0.9) * 1000, samples.percentile(0.99) * 1000,
+					samples.percentile(0.999) * 1000, samples.percentile(1) * 1000);
+			fflush(stdout);
+		}
+		return status;
+	}
+
+	const Benchmark benchmark("contention", "latency of scrobble() while the reactor thread holds the lock",
+			&run);
+}
@@ -0,0 +1,217 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fileutil.hpp>
+
+#include "BenchScrobbler.hpp"
+#include "Benchmark.hpp"
+
+using namespace std;
+
+/* Kills a process that scrobbles in the failure-safe mode with syncing enabled at random moments,
+ * including while the data file is appended to or re-written, and checks that the data file
+ * it leaves is loaded without losing or reordering the scrobbles stored.
+ *
+ * The child process scrobbles the scrobbles benchScrobble(i) with increasing i, keeps completing
+ * the oldest pending scrobbles as long as more than keptCount are pending, and restarts its Scrobbler
+ * every cycleScrobbleCount scrobbles. Once stop() returns everything is stored, so the child reports
+ * the number of scrobbles scrobbled and completed so far to the parent. After the child is killed,
+ * the parent loads the data file and checks that:
+ * - the pending scrobbles are [c, s) in order, i.e. nothing between the first one and the last one is lost;
+ * - no scrobble reported as scrobbled is lost and no scrobble reported as completed is resubmitted;
+ * - no record is malformed, i.e. nothing is quarantined.
+ * The next child continues with the data file the previous one has left.
+ *
+ * SIGKILL does not discard the data written to the page cache, so this checks the recovery from
+ * a crash of the player, not from a power loss.
+ */
+namespace
+{
+	constexpr size_t keptCount = 100;
+	constexpr size_t cycleScrobbleCount = 50;
+	constexpr unsigned maxKillDelayMillis = 200;
+
+	class DrainingScrobbler : public BenchScrobbler
+	{
+	public:
+		explicit DrainingScrobbler(const string &dataFilePath) : BenchScrobbler(dataFilePath) {}
+	protected:
+		virtual void startScrobbling() override
+		{
+			const size_t size = m_pendingScrobbles.size();
+			const size_t count = size > keptCount ? size - keptCount : 0;
+			completeScrobbles(count);
+			attemptFinished(count);
+		}
+	};
+
+	struct Report
+	{
+		uint64_t scrobbled;
+		uint64_t completed;
+	};
+
+	[[noreturn]] void runChild(const string &path, Report state, const int reportFd)
+	{
+		DrainingScrobbler scrobbler(path);
+		scrobbler.setRetryDelay(chrono::hours(1), chrono::hours(1));
+		for (;;) {
+			if (!scrobbler.start() || !scrobbler.waitForLoad()) {
+				::_exit(2);
+			}
+			scrobbler.enableScrobbling();
+			for (size_t i = 0; i < cycleScrobbleCount; ++i) {
+				scrobbler.scrobble(benchScrobble(state.scrobbled++), true, true);
+			}
+			scrobbler.stop();
+			state.completed += scrobbler.completedCount();
+			// Reports are written atomically since they are shorter than PIPE_BUF.
+			if (!writeFully(reportFd, reinterpret_cast<const char *>(&state), sizeof(state))) {
+				::_exit(2);
+			}
+		}
+	}
+
+	// Returns the last report written to a given pipe, or initial if there is none.
+	Report readLastReport(const int fd, const Report initial, size_t &reportCount)
+	{
+		Report last = initial, report;
+		ssize_t n;
+		while ((n = ::read(fd, &report, sizeof(report))) == ssize_t(sizeof(report))) {
+			last = report;
+			++reportCount;
+		}
+		return last;
+	}
+
+	/* Loads the data file left by a killed child and checks it against the last report of the child.
+	 * Updates state to the scrobbles the data file holds.
+	 */
+	bool verify(const string &path, const Report reported, Report &state)
+	{
+		BenchScrobbler scrobbler(path);
+		scrobbler.setResidentScrobbleLimit(1000000);
+		if (!scrobbler.start() || !scrobbler.waitForLoad()) {
+			printf("  the data file is not loaded\n");
+			return false;
+		}
+		const vector<size_t> indices = scrobbler.residentIndices();
+		scrobbler.stop();
+
+		if (indices.empty()) {
+			if (reported.scrobbled != reported.completed) {
+				printf("  no pending scrobble is loaded, %zu expected at least\n",
+						size_t(reported.scrobbled - reported.completed));
+				return false;
+			}
+			state = reported;
+			return true;
+		}
+		bool valid = true;
+		for (size_t i = 1; i < indices.size(); ++i) {
+			if (indices[i] != indices[i - 1] + 1) {
+				printf("  scrobble %zu is followed by %zu\n", indices[i - 1], indices[i]);
+				valid = false;
+				break;
+			}
+		}
+		const size_t begin = indices.front(), end = indices.back() + 1;
+		if (begin < reported.completed) {
+			printf("  scrobbles from %zu to %zu are completed but loaded\n", begin, size_t(reported.completed));
+			valid = false;
+		}
+		if (end < reported.scrobbled) {
+			printf("  scrobbles from %zu to %zu are lost\n", end, size_t(reported.scrobbled));
+			valid = false;
+		}
+		if (end > reported.scrobbled + cycleScrobbleCount) {
+			printf("  scrobble %zu is loaded but never scrobbled\n", end - 1);
+			valid = false;
+		}
+		if (benchFileSize(path + ".quarantine") != 0) {
+			printf("  malformed records are quarantined\n");
+			valid = false;
+		}
+		state = Report{end, begin};
+		return valid;
+	}
+
+	int run(const BenchmarkOptions &options)
+	{
+		const size_t killCount = options.countOr(100);
+		const string path = options.dir + "/data";
+		const unsigned seed = random_device()();
+		mt19937 random(seed);
+		uniform_int_distribution<unsigned> killDelay(0, maxKillDelayMillis);
+
+		printf("%zu kills within %u ms after start, seed %u\n", killCount, maxKillDelayMillis, seed);
+		Report state{0, 0};
+		size_t reportCount = 0, failureCount = 0;
+		for (size_t i = 0; i < killCount; ++i) {
+			int reportPipe[2];
+			if (::pipe(reportPipe) != 0) {
+				perror("pipe");
+				return 1;
+			}
+			fflush(stdout);
+			const pid_t child = ::fork();
+			if (child == -1) {
+				perror("fork");
+				return 1;
+			}
+			if (child == 0) {
+				::close(reportPipe[0]);
+				runChild(path, state, reportPipe[1]);
+			}
+			::close(reportPipe[1]);
+
+			this_thread::sleep_for(chrono::milliseconds(killDelay(random)));
+			::kill(child, SIGKILL);
+			int status;
+			::waitpid(child, &status, 0);
+			const Report reported = readLastReport(reportPipe[0], state, reportCount);
+			::close(reportPipe[0]);
+
+			if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGKILL) {
+				printf("kill %zu: the child process has failed\n", i);
+				return 1;
+			}
+			if (!verify(path, reported, state)) {
+				printf("kill %zu: the data file is inconsistent\n", i);
+				++failureCount;
+			}
+		}
+
+		printf("%zu restarts reported, %zu scrobbled, %zu pending at the end, %zu inconsistent data files\n",
+				reportCount, size_t(state.scrobbled), size_t(state.scrobbled - state.completed), failureCount);
+		return failureCount == 0 ? 0 : 1;
+	}
+
+	const Benchmark benchmark("crash", "durability of the data file when the process is killed while writing it",
+			&run);
+}
@@ -0,0 +1,178 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <HttpClient.hpp>
+#include <Reactor.hpp>
+
+#include "Benchmark.hpp"
+#include "HttpStub.hpp"
+
+using namespace std;
+
+/* Measures the throughput of the HTTP calls performed by the reactor depending on the number of calls
+ * in flight, against a local stand-in server that responds at once and with a delay that stands for
+ * the round trip to a scrobbling service. A task keeps a given number of POST calls in flight and
+ * starts a new call each time one is completed, until all the requests are sent.
+ */
+namespace
+{
+	constexpr unsigned concurrencyLevels[] = {1, 2, 4, 8, 16};
+	constexpr unsigned latencyMillis[] = {0, 5};
+	const char requestBody[] = u8"[{\"track\":{\"title\":\"Title\"}}]";
+
+	class LoadTask;
+
+	class Call : public HttpCall, public HttpResponse::BodyAppender
+	{
+	public:
+		explicit Call(LoadTask &task) : request(), response(*this), m_task(task)
+		{
+			request.setBody(requestBody, sizeof requestBody - 1);
+		}
+
+		virtual void operator()(const char *, size_t) override { /* The response body is ignored. */ }
+
+		virtual void completed(HttpClient::StatusCode status) override;
+
+		HttpRequest request;
+		HttpResponse response;
+	private:
+		LoadTask &m_task;
+	};
+
+	class LoadTask : public Reactor::Task
+	{
+	public:
+		LoadTask(Reactor &reactor, const string &url, const size_t count, const unsigned concurrency)
+			: m_reactor(reactor), m_url(url), m_concurrency(concurrency), m_calls(), m_mutex(), m_cv(),
+			  m_startedCount(0), m_inFlightCount(0), m_finishedCount(0), m_succeededCount(0)
+		{
+			m_calls.reserve(count);
+			for (size_t i = 0; i < count; ++i) {
+				m_calls.emplace_back(new Call(*this));
+			}
+		}
+
+		void callCompleted(const bool succeeded)
+		{
+			{ lock_guard<mutex> lock(m_mutex);
+				--m_inFlightCount;
+				++m_finishedCount;
+				if (succeeded) {
+					++m_succeededCount;
+				}
+			}
+			m_cv.notify_all();
+			wake();
+		}
+
+		// Returns the number of calls that succeeded, once all of them are finished or the time is over.
+		size_t await(const chrono::steady_clock::time_point deadline)
+		{ unique_lock<mutex> lock(m_mutex);
+			m_cv.wait_until(lock, deadline, [&]() { return m_finishedCount == m_calls.size(); });
+			return m_succeededCount;
+		}
+	protected:
+		virtual void run() override
+		{
+			unique_lock<mutex> lock(m_mutex);
+			while (m_inFlightCount < m_concurrency && m_startedCount < m_calls.size()) {
+				Call &call = *m_calls[m_startedCount++];
+				if (HttpClient().preparePost(call, m_url.c_str(), call.request, call.response, HttpTimeouts()) ==
+						HttpClient::StatusCode::SUCCESS && m_reactor.perform(*this, call)) {
+					++m_inFlightCount;
+				} else {
+					++m_finishedCount;
+				}
+			}
+			lock.unlock();
+			m_cv.notify_all();
+		}
+	private:
+		Reactor &m_reactor;
+		const string m_url;
+		const unsigned m_concurrency;
+		vector<unique_ptr<Call>> m_calls;
+		mutex m_mutex;
+		condition_variable m_cv;
+		size_t m_startedCount;
+		unsigned m_inFlightCount;
+		size_t m_finishedCount;
+		size_t m_succeededCount;
+	};
+
+	void Call::completed(const HttpClient::StatusCode status)
+	{
+		m_task.callCompleted(status == HttpClient::StatusCode::SUCCESS && response.statusCode == 200);
+	}
+
+	int run(const BenchmarkOptions &options)
+	{
+		const size_t count = options.countOr(1000);
+
+		Reactor reactor;
+		if (!reactor.start()) {
+			fprintf(stderr, "Unable to start the reactor.\n");
+			return 1;
+		}
+
+		printf("%zu requests, best of %u runs\n", count, options.runs);
+		printf("%-12s %12s %10s %14s\n", "latency, ms", "in flight", "time, ms", "requests/s");
+		int status = 0;
+		for (const unsigned latency : latencyMillis) {
+			HttpStub stub([](const string &, const string &) { return string("{}"); }, chrono::milliseconds(latency));
+			if (!stub.start()) {
+				fprintf(stderr, "Unable to start the stand-in server.\n");
+				return 1;
+			}
+
+			for (const unsigned concurrency : concurrencyLevels) {
+				double time = 0;
+				for (unsigned i = 0; i < options.runs; ++i) {
+					LoadTask task(reactor, stub.url(), count, concurrency);
+					const BenchClock::time_point start = BenchClock::now();
+					reactor.attach(task);
+					const size_t succeededCount = task.await(start + chrono::minutes(1));
+					const double runTime = millisSince(start);
+					reactor.detach(task);
+
+					if (succeededCount != count) {
+						printf("  %u in flight: %zu requests succeeded, %zu expected\n", concurrency,
+								succeededCount, count);
+						status = 1;
+					}
+					time = i == 0 ? runTime : min(time, runTime);
+				}
+				printf("%-12u %12u %10.1f %14.0f\n", latency, concurrency, time, count / time * 1000);
+				fflush(stdout);
+			}
+		}
+		reactor.stop();
+		return status;
+	}
+
+	const Benchmark benchmark("http", "requests/s of the reactor with 1-16 calls in flight against a local server",
+			&run);
+}
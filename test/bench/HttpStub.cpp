@@ -0,0 +1,140 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "HttpStub.hpp"
+
+#include <cstdlib>
+#include <strings.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+	// Returns the value of the Content-Length header of given request headers, or zero if there is none.
+	size_t contentLength(const string &headers)
+	{
+		static const char name[] = "\r\ncontent-length:";
+		constexpr size_t nameSize = sizeof(name) - 1;
+		for (size_t pos = headers.find("\r\n"); pos != string::npos; pos = headers.find("\r\n", pos + 2)) {
+			if (::strncasecmp(headers.c_str() + pos, name, nameSize) == 0) {
+				return strtoul(headers.c_str() + pos + nameSize, nullptr, 10);
+			}
+		}
+		return 0;
+	}
+
+	// Unlike write(), send() does not raise SIGPIPE if the client has closed the connection.
+	bool sendFully(const int connection, const string &data)
+	{
+		for (size_t sent = 0; sent < data.size();) {
+			const ssize_t n = ::send(connection, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+			if (n < 0) {
+				return false;
+			}
+			sent += size_t(n);
+		}
+		return true;
+	}
+}
+
+HttpStub::~HttpStub()
+{
+	if (m_thread.joinable()) {
+		// Makes accept() and recv() return.
+		{ lock_guard<mutex> lock(m_mutex);
+			::shutdown(m_socket, SHUT_RDWR);
+			for (const int connection : m_connections) {
+				::shutdown(connection, SHUT_RDWR);
+			}
+		}
+		m_thread.join();
+		for (thread &connectionThread : m_connectionThreads) {
+			connectionThread.join();
+		}
+		for (const int connection : m_connections) {
+			::close(connection);
+		}
+	}
+	if (m_socket != -1) {
+		::close(m_socket);
+	}
+}
+
+bool HttpStub::start()
+{
+	m_socket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressSize = sizeof(address);
+	if (m_socket == -1 || ::bind(m_socket, reinterpret_cast<sockaddr *>(&address), addressSize) != 0 ||
+			::listen(m_socket, 64) != 0 ||
+			::getsockname(m_socket, reinterpret_cast<sockaddr *>(&address), &addressSize) != 0) {
+		return false;
+	}
+	m_port = ntohs(address.sin_port);
+	m_thread = thread([this]() { serve(); });
+	return true;
+}
+
+void HttpStub::serve()
+{
+	for (;;) {
+		const int connection = ::accept4(m_socket, nullptr, nullptr, SOCK_CLOEXEC);
+		if (connection == -1) {
+			return;
+		}
+		lock_guard<mutex> lock(m_mutex);
+		m_connections.push_back(connection);
+		m_connectionThreads.emplace_back([this, connection]() { serveConnection(connection); });
+	}
+}
+
+void HttpStub::serveConnection(const int connection)
+{
+	string input;
+	char buf[4096];
+	ssize_t n;
+	while ((n = ::recv(connection, buf, sizeof(buf), 0)) > 0) {
+		input.append(buf, size_t(n));
+		for (;;) {
+			const size_t headersEnd = input.find("\r\n\r\n");
+			if (headersEnd == string::npos) {
+				break;
+			}
+			const size_t bodySize = contentLength(input.substr(0, headersEnd + 2));
+			if (input.size() < headersEnd + 4 + bodySize) {
+				break;
+			}
+			const string requestLine = input.substr(0, input.find("\r\n"));
+			const string body = m_handler(requestLine, input.substr(headersEnd + 4, bodySize));
+			input.erase(0, headersEnd + 4 + bodySize);
+
+			this_thread::sleep_for(m_delay);
+			const string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " +
+					to_string(body.size()) + "\r\n\r\n" + body;
+			m_requestCount.fetch_add(1, memory_order_relaxed);
+			if (!sendFully(connection, response)) {
+				return;
+			}
+		}
+	}
+	// The connection is closed once the server is stopped so that its descriptor is not re-used meanwhile.
+}
@@ -0,0 +1,71 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef HTTPSTUB_HPP_
+#define HTTPSTUB_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* An HTTP server on the loopback interface that stands in for a scrobbling service. It responds
+ * to each request with a 200 response which body is returned by a given handler, once a given delay
+ * elapses. Connections are kept alive, and each one is served by its own thread so that the delays
+ * of concurrent requests overlap as they would with a remote server.
+ */
+class HttpStub
+{
+	HttpStub(const HttpStub &) = delete;
+	HttpStub &operator=(const HttpStub &) = delete;
+public:
+	/* Returns the body of the response to a request with a given request line (e.g. "GET /path HTTP/1.1")
+	 * and a given body. It is invoked by the connection threads concurrently.
+	 */
+	typedef std::function<std::string(const std::string &requestLine, const std::string &body)> Handler;
+
+	explicit HttpStub(Handler handler, std::chrono::milliseconds delay = std::chrono::milliseconds(0))
+		: m_handler(std::move(handler)), m_delay(delay), m_socket(-1), m_port(0), m_requestCount(0), m_thread(),
+		  m_mutex(), m_connections(), m_connectionThreads() {}
+
+	// Stops serving and closes all connections.
+	~HttpStub();
+
+	bool start();
+
+	// The URL of the root of this server, with the trailing slash.
+	std::string url() const { return "http://127.0.0.1:" + std::to_string(m_port) + "/"; }
+
+	std::size_t requestCount() const noexcept { return m_requestCount.load(std::memory_order_relaxed); }
+private:
+	void serve();
+	void serveConnection(int connection);
+
+	const Handler m_handler;
+	const std::chrono::milliseconds m_delay;
+	int m_socket;
+	unsigned m_port;
+	std::atomic<std::size_t> m_requestCount;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::vector<int> m_connections;
+	std::vector<std::thread> m_connectionThreads;
+};
+
+#endif /* HTTPSTUB_HPP_ */
@@ -0,0 +1,116 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+#include <unistd.h>
+
+#include "BenchScrobbler.hpp"
+#include "Benchmark.hpp"
+
+using namespace std;
+
+/* Measures the time from Scrobbler::start() until the pending scrobbles are loaded from the data file,
+ * i.e. mapping the file and parsing its records. The data file is written anew before each run.
+ */
+namespace
+{
+	enum DataFile {D_JOURNAL, D_DAMAGED_JOURNAL, D_JSON};
+
+	struct Case
+	{
+		const char *name;
+		DataFile dataFile;
+		// Whether all the pending scrobbles are kept in memory or the default limit applies.
+		bool allResident;
+	};
+
+	const Case cases[] = {
+		{"journal", D_JOURNAL, true},
+		{"journal, window", D_JOURNAL, false},
+		{"journal, 1% damaged", D_DAMAGED_JOURNAL, true},
+		{"JSON lines", D_JSON, true}
+	};
+
+	constexpr size_t damagePeriod = 100;
+
+	bool writeDataFile(const string &path, const DataFile dataFile, const size_t count)
+	{
+		::unlink((path + ".cursor").c_str());
+		::unlink((path + ".quarantine").c_str());
+		switch (dataFile) {
+		case D_JOURNAL:
+			return writeBenchJournal(path, count);
+		case D_DAMAGED_JOURNAL:
+			return writeBenchJournal(path, count, damagePeriod);
+		default:
+			return writeBenchJsonLines(path, count);
+		}
+	}
+
+	int run(const BenchmarkOptions &options)
+	{
+		const size_t count = options.countOr(200000);
+		const string path = options.dir + "/data";
+
+		printf("%zu scrobbles, best of %u runs\n", count, options.runs);
+		printf("%-20s %10s %10s %10s %10s\n", "data file", "size, MiB", "load, ms", "MiB/s", "resident");
+		int status = 0;
+		for (const Case &c : cases) {
+			double loadTime = 0;
+			size_t size = 0, residentCount = 0;
+			for (unsigned i = 0; i < options.runs; ++i) {
+				if (!writeDataFile(path, c.dataFile, count)) {
+					fprintf(stderr, "Unable to write the file %s.\n", path.c_str());
+					return 1;
+				}
+				size = benchFileSize(path);
+
+				BenchScrobbler scrobbler(path);
+				if (c.allResident) {
+					scrobbler.setResidentScrobbleLimit(count);
+				}
+				const BenchClock::time_point start = BenchClock::now();
+				const bool loaded = scrobbler.start() && scrobbler.waitForLoad();
+				const double runTime = millisSince(start);
+				residentCount = loaded ? scrobbler.residentCount() : 0;
+				scrobbler.stop();
+
+				loadTime = i == 0 ? runTime : min(loadTime, runTime);
+			}
+
+			printf("%-20s %10.1f %10.1f %10.1f %10zu\n", c.name, size / 1048576.0, loadTime,
+					size / 1048576.0 / loadTime * 1000, residentCount);
+
+			size_t expectedCount = c.dataFile == D_DAMAGED_JOURNAL ? count - count / damagePeriod : count;
+			if (!c.allResident) {
+				expectedCount = min(expectedCount, BenchScrobbler::defaultResidentScrobbleLimit);
+			}
+			if (residentCount != expectedCount) {
+				printf("  %zu scrobbles are expected to be resident\n", expectedCount);
+				status = 1;
+			}
+			if (c.dataFile == D_DAMAGED_JOURNAL && benchFileSize(path + ".quarantine") == 0) {
+				printf("  the damaged records are not quarantined\n");
+				status = 1;
+			}
+		}
+		return status;
+	}
+
+	const Benchmark benchmark("load", "loading pending scrobbles from the data file", &run);
+}
@@ -0,0 +1,258 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include <afc/FastStringBuffer.hpp>
+#include <afc/SimpleString.hpp>
+#include <ChunkedRing.hpp>
+#include <HttpClient.hpp>
+#include <Scrobbler.hpp>
+#include <ScrobbleInfo.hpp>
+#include <deadbeef_util.hpp>
+
+#include "Benchmark.hpp"
+#include "HttpStub.hpp"
+
+using namespace std;
+
+/* Measures how long draining a backlog of pending scrobbles takes depending on the max number
+ * of batches in flight (see Scrobbler::setMaxBatchesInFlight()), against a local stand-in server
+ * that delays each response as a remote scrobbling service would.
+ *
+ * The scrobbles are submitted as GravifonScrobbler submits them: each batch of up to 20 leading
+ * pending scrobbles is encoded as a JSON array and POSTed by the reactor, and the next round
+ * starts once all the calls of the round are finished. A batch is completed if its call is
+ * responded to with 200, whatever the response body is.
+ */
+namespace
+{
+	constexpr size_t batchSize = 20;
+	constexpr unsigned maxBatchesInFlight[] = {1, 2, 4, 8, 16};
+	constexpr unsigned latencyMillis = 50;
+
+	class BatchScrobbler : public Scrobbler<ChunkedRing<ScrobbleInfo>>
+	{
+	public:
+		BatchScrobbler(const string &dataFilePath, const string &url)
+			: Scrobbler(batchSize), m_dataFilePath(toString(dataFilePath)), m_url(url), m_calls(),
+			  m_callsInProgress(0), m_maxCallsInProgress(0) {}
+
+		~BatchScrobbler()
+		{
+			// Synchronising memory before destructing the member fields of this BatchScrobbler.
+			lock_guard<mutex> lock(m_mutex);
+		}
+
+		void enableScrobbling()
+		{ lock_guard<mutex> lock(m_mutex);
+			m_configured = true;
+			wake();
+		}
+
+		size_t maxCallsInProgress()
+		{ lock_guard<mutex> lock(m_mutex);
+			return m_maxCallsInProgress;
+		}
+	protected:
+		virtual void startScrobbling() override
+		{
+			vector<vector<const ScrobbleInfo *>> batches;
+			collectBatches(batches);
+
+			for (vector<const ScrobbleInfo *> &batch : batches) {
+				m_calls.emplace_back(new Call(*this, move(batch)));
+			}
+			m_callsInProgress = 0;
+			for (const unique_ptr<Call> &call : m_calls) {
+				if (HttpClient().preparePost(*call, m_url.c_str(), call->request, call->response, HttpTimeouts()) ==
+						HttpClient::StatusCode::SUCCESS && perform(*call)) {
+					++m_callsInProgress;
+				}
+			}
+			m_maxCallsInProgress = max(m_maxCallsInProgress, m_callsInProgress);
+			if (m_callsInProgress == 0) {
+				finishScrobbling();
+			}
+		}
+
+		virtual const afc::String &getDataFilePath() const override { return m_dataFilePath; }
+	private:
+		class Call : public HttpCall
+		{
+		public:
+			Call(BatchScrobbler &owner, vector<const ScrobbleInfo *> &&batch)
+				: batch(move(batch)), succeeded(false), request(), response(m_responseAppender), m_owner(owner),
+				  m_body(this->batch), m_responseBody(), m_responseAppender(m_responseBody)
+			{
+				request.setBody(m_body);
+				request.headers.push_back("Content-Type: application/json; charset=utf-8");
+			}
+
+			virtual void completed(const HttpClient::StatusCode status) override
+			{
+				succeeded = status == HttpClient::StatusCode::SUCCESS && response.statusCode == 200;
+
+				lock_guard<mutex> lock(m_owner.m_mutex);
+				assert(m_owner.m_callsInProgress != 0);
+				if (--m_owner.m_callsInProgress == 0) {
+					m_owner.finishScrobbling();
+				}
+			}
+
+			const vector<const ScrobbleInfo *> batch;
+			bool succeeded;
+			HttpRequest request;
+			HttpResponse response;
+		private:
+			// Encodes the batch as a JSON array, a scrobble at a time, as GravifonScrobbler does.
+			class Body final : public PieceBodyProducer
+			{
+			public:
+				explicit Body(const vector<const ScrobbleInfo *> &batch) : m_batch(batch) {}
+			protected:
+				virtual bool encodePiece(const size_t index, afc::FastStringBuffer<char> &dest) override
+				{
+					if (index == m_batch.size()) {
+						return false;
+					}
+					dest.reserveForOne();
+					dest.append(index == 0 ? '[' : ',');
+					appendAsJson(*m_batch[index], dest);
+					if (index + 1 == m_batch.size()) {
+						dest.reserveForOne();
+						dest.append(']');
+					}
+					return true;
+				}
+			private:
+				const vector<const ScrobbleInfo *> &m_batch;
+			};
+
+			BatchScrobbler &m_owner;
+			Body m_body;
+			afc::FastStringBuffer<char> m_responseBody;
+			FastStringBufferAppender m_responseAppender;
+		};
+
+		// The batches follow each other in the list of pending scrobbles whatever order they are responded to in.
+		void finishScrobbling()
+		{
+			size_t completedCount = 0;
+			auto it = m_pendingScrobbles.begin();
+			for (const unique_ptr<Call> &call : m_calls) {
+				if (call->succeeded) {
+					for (size_t i = 0; i < call->batch.size(); ++i) {
+						it = completeScrobble(it);
+					}
+					completedCount += call->batch.size();
+				} else {
+					it = next(it, call->batch.size());
+				}
+			}
+			m_calls.clear();
+			attemptFinished(completedCount);
+		}
+
+		const afc::String m_dataFilePath;
+		const string m_url;
+		vector<unique_ptr<Call>> m_calls;
+		size_t m_callsInProgress;
+		size_t m_maxCallsInProgress;
+	};
+
+	bool drain(const string &path, const string &url, const size_t count, const unsigned batchesInFlight,
+			double &drainTime, size_t &maxCallsInProgress)
+	{
+		::unlink((path + ".cursor").c_str());
+		if (!writeBenchJournal(path, count)) {
+			fprintf(stderr, "Unable to write the file %s.\n", path.c_str());
+			return false;
+		}
+		BatchScrobbler scrobbler(path, url);
+		scrobbler.setMaxBatchesInFlight(batchesInFlight);
+		if (!scrobbler.start() || !scrobbler.waitForLoad()) {
+			fprintf(stderr, "Unable to load the scrobbles of the data file %s.\n", path.c_str());
+			scrobbler.stop();
+			return false;
+		}
+
+		const BenchClock::time_point start = BenchClock::now();
+		const BenchClock::time_point deadline = start + chrono::minutes(5);
+		scrobbler.enableScrobbling();
+		while (!scrobbler.drained() && BenchClock::now() < deadline) {
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		drainTime = millisSince(start);
+		const size_t completedCount = scrobbler.completedCount();
+		maxCallsInProgress = scrobbler.maxCallsInProgress();
+		scrobbler.stop();
+
+		if (completedCount != count) {
+			printf("  %zu scrobbles completed, %zu expected\n", completedCount, count);
+			return false;
+		}
+		return true;
+	}
+
+	int run(const BenchmarkOptions &options)
+	{
+		const size_t count = options.countOr(2000);
+		const string path = options.dir + "/data";
+
+		HttpStub stub([](const string &, const string &) { return string("{}"); }, chrono::milliseconds(latencyMillis));
+		if (!stub.start()) {
+			fprintf(stderr, "Unable to start the stand-in server.\n");
+			return 1;
+		}
+
+		printf("%zu pending scrobbles in batches of %zu, %u ms per response, best of %u runs\n", count, batchSize,
+				latencyMillis, options.runs);
+		printf("%-10s %12s %10s %10s\n", "in flight", "drain, ms", "speedup", "max calls");
+		double baseTime = 0;
+		for (const unsigned batchesInFlight : maxBatchesInFlight) {
+			double drainTime = 0;
+			size_t maxCallsInProgress = 0;
+			for (unsigned i = 0; i < options.runs; ++i) {
+				double runTime;
+				if (!drain(path, stub.url(), count, batchesInFlight, runTime, maxCallsInProgress)) {
+					return 1;
+				}
+				drainTime = i == 0 ? runTime : min(drainTime, runTime);
+			}
+			if (baseTime == 0) {
+				baseTime = drainTime;
+			}
+			printf("%-10u %12.1f %10.2f %10zu\n", batchesInFlight, drainTime, baseTime / drainTime,
+					maxCallsInProgress);
+		}
+		return 0;
+	}
+
+	const Benchmark benchmark("pipeline", "draining a backlog with 1-16 batches in flight against a slow server",
+			&run);
+}
@@ -0,0 +1,146 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <iterator>
+#include <list>
+#include <vector>
+
+#include <afc/FastStringBuffer.hpp>
+#include <ChunkedRing.hpp>
+#include <ScrobbleInfo.hpp>
+#include <ScrobbleJournal.hpp>
+#include <StringDictionary.hpp>
+
+#include "Benchmark.hpp"
+
+using namespace std;
+
+/* Compares the containers of pending scrobbles: ChunkedRing (used by GravifonScrobbler), std::list and
+ * std::deque. Enqueueing is appending all the scrobbles; batch iteration is walking the queue in batches
+ * of 20 scrobbles, as the batches to submit are collected; partial erase is completing 15 of the leading
+ * 20 scrobbles one by one (the rest of them are rejected and left to be submitted again), with the leading
+ * batch dropped as a whole every 4th round; storing is encoding all the scrobbles as journal records.
+ */
+namespace
+{
+	constexpr size_t batchSize = 20;
+	constexpr size_t partialEraseRounds = 5000;
+
+	struct Times
+	{
+		double enqueue, iterate, erase, store;
+	};
+
+	template<typename Queue>
+	Times measure(const size_t count, size_t &checksum)
+	{
+		vector<ScrobbleInfo> scrobbles;
+		scrobbles.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			scrobbles.push_back(benchScrobble(i));
+		}
+		Times times;
+		Queue queue;
+
+		BenchClock::time_point start = BenchClock::now();
+		for (ScrobbleInfo &scrobbleInfo : scrobbles) {
+			queue.emplace_back(move(scrobbleInfo));
+		}
+		times.enqueue = millisSince(start);
+
+		start = BenchClock::now();
+		{
+			vector<const ScrobbleInfo *> batch;
+			batch.reserve(batchSize);
+			for (auto it = queue.begin(), end = queue.end(); it != end; ++it) {
+				batch.push_back(&*it);
+				if (batch.size() == batchSize) {
+					checksum += batch.front()->scrobbleDuration;
+					batch.clear();
+				}
+			}
+		}
+		times.iterate = millisSince(start);
+
+		start = BenchClock::now();
+		for (size_t round = 0; round < partialEraseRounds && queue.size() >= batchSize; ++round) {
+			auto it = queue.begin();
+			for (size_t i = 0; i < batchSize; ++i) {
+				if (i % 4 != 3) {
+					it = queue.erase(it);
+				} else {
+					++it;
+				}
+			}
+			if (round % 4 == 3) {
+				queue.erase(queue.begin(), next(queue.begin(), batchSize));
+			}
+		}
+		times.erase = millisSince(start);
+
+		start = BenchClock::now();
+		{
+			StringDictionary dictionary;
+			afc::FastStringBuffer<char> records;
+			for (const ScrobbleInfo &scrobbleInfo : queue) {
+				appendJournalRecord(scrobbleInfo, dictionary, records);
+			}
+			checksum += records.size();
+		}
+		times.store = millisSince(start);
+
+		return times;
+	}
+
+	template<typename Queue>
+	void run(const char * const name, const size_t count, const unsigned runs, size_t &checksum)
+	{
+		Times best = {0, 0, 0, 0};
+		for (unsigned i = 0; i < runs; ++i) {
+			const Times times = measure<Queue>(count, checksum);
+			if (i == 0) {
+				best = times;
+			} else {
+				best.enqueue = min(best.enqueue, times.enqueue);
+				best.iterate = min(best.iterate, times.iterate);
+				best.erase = min(best.erase, times.erase);
+				best.store = min(best.store, times.store);
+			}
+		}
+		printf("%-14s %12.1f %12.1f %12.1f %12.1f\n", name, best.enqueue, best.iterate, best.erase, best.store);
+		fflush(stdout);
+	}
+
+	int run(const BenchmarkOptions &options)
+	{
+		const size_t count = options.countOr(200000);
+
+		printf("%zu scrobbles, %zu rounds of partial erase, best of %u runs\n", count, partialEraseRounds,
+				options.runs);
+		printf("%-14s %12s %12s %12s %12s\n", "container", "enqueue, ms", "iterate, ms", "erase, ms", "store, ms");
+		size_t checksum = 0;
+		run<ChunkedRing<ScrobbleInfo>>("ChunkedRing", count, options.runs, checksum);
+		run<list<ScrobbleInfo>>("std::list", count, options.runs, checksum);
+		run<deque<ScrobbleInfo>>("std::deque", count, options.runs, checksum);
+		// The checksum keeps the work from being optimised out.
+		return checksum == 0 ? 1 : 0;
+	}
+
+	const Benchmark benchmark("queue", "ChunkedRing against std::list and std::deque as the queue of pending scrobbles",
+			&run);
+}
@@ -0,0 +1,221 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fileutil.hpp>
+
+#include "BenchScrobbler.hpp"
+#include "Benchmark.hpp"
+
+using namespace std;
+
+/* Measures the memory a Scrobbler takes for a large backlog of pending scrobbles, with the default
+ * limit of resident scrobbles and with all of them resident. Each case is run in its own process
+ * which loads the backlog, reports its memory usage, completes a part of the backlog in batches
+ * of 20 scrobbles as GravifonScrobbler does, and reports its memory usage again.
+ *
+ * RssAnon (the heap) is what the limit bounds. RssFile includes the pages of the mapped data file,
+ * which the kernel can drop at any time; they are included in the peak RSS as well.
+ */
+namespace
+{
+	constexpr size_t batchSize = 20;
+	// The growth of RssAnon allowed for a backlog of any size with the default limit.
+	constexpr long maxWindowGrowthKb = 8 * 1024;
+
+	class DrainingScrobbler : public BenchScrobbler
+	{
+	public:
+		DrainingScrobbler(const string &dataFilePath, const size_t quota)
+			: BenchScrobbler(dataFilePath), m_quota(quota) {}
+	protected:
+		virtual void startScrobbling() override
+		{
+			const size_t count = min({m_pendingScrobbles.size(), batchSize, m_quota});
+			m_quota -= count;
+			completeScrobbles(count);
+			attemptFinished(count);
+		}
+	private:
+		size_t m_quota;
+	};
+
+	struct Usage
+	{
+		long anonKb;
+		long fileKb;
+		long maxRssKb;
+		size_t residentCount;
+	};
+
+	struct Report
+	{
+		long initialAnonKb;
+		Usage loaded;
+		Usage drained;
+		bool succeeded;
+	};
+
+	// Returns the value of a given field of /proc/self/status in kB, or -1 if it is not available.
+	long statusKb(const char * const field)
+	{
+		FILE * const f = fopen("/proc/self/status", "r");
+		if (f == nullptr) {
+			return -1;
+		}
+		const size_t fieldSize = strlen(field);
+		char line[256];
+		long value = -1;
+		while (fgets(line, sizeof(line), f) != nullptr) {
+			if (strncmp(line, field, fieldSize) == 0 && line[fieldSize] == ':') {
+				value = strtol(line + fieldSize + 1, nullptr, 10);
+				break;
+			}
+		}
+		fclose(f);
+		return value;
+	}
+
+	Usage usage(const size_t residentCount)
+	{
+		struct rusage resourceUsage;
+		::getrusage(RUSAGE_SELF, &resourceUsage);
+		return Usage{statusKb("RssAnon"), statusKb("RssFile"), resourceUsage.ru_maxrss, residentCount};
+	}
+
+	bool waitForCompleted(DrainingScrobbler &scrobbler, const size_t count)
+	{
+		const BenchClock::time_point deadline = BenchClock::now() + chrono::minutes(10);
+		while (scrobbler.completedCount() < count) {
+			if (BenchClock::now() >= deadline) {
+				return false;
+			}
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+	Report measure(const string &path, const size_t count, const size_t drainCount, const bool allResident)
+	{
+		Report report = Report();
+		report.initialAnonKb = statusKb("RssAnon");
+
+		DrainingScrobbler scrobbler(path, drainCount);
+		scrobbler.setRetryDelay(chrono::hours(1), chrono::hours(1));
+		if (allResident) {
+			scrobbler.setResidentScrobbleLimit(count);
+		}
+		if (!scrobbler.start() || !scrobbler.waitForLoad()) {
+			return report;
+		}
+		report.loaded = usage(scrobbler.residentCount());
+
+		scrobbler.enableScrobbling();
+		const bool drained = waitForCompleted(scrobbler, drainCount);
+		report.drained = usage(scrobbler.residentCount());
+		scrobbler.stop();
+		report.succeeded = drained;
+		return report;
+	}
+
+	/* Runs a given function in a child process so that the memory it takes is not accounted to
+	 * this process nor to the other cases. The function writes its result to a given descriptor.
+	 */
+	template<typename Function>
+	bool runInChild(const Function function, const int resultFd)
+	{
+		fflush(stdout);
+		const pid_t child = ::fork();
+		if (child == -1) {
+			return false;
+		}
+		if (child == 0) {
+			::_exit(function(resultFd) ? 0 : 1);
+		}
+		int status;
+		return ::waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+
+	void printUsage(const char * const name, const char * const phase, const long initialAnonKb, const Usage &usage)
+	{
+		printf("%-16s %-10s %10zu %12.1f %12.1f %12.1f\n", name, phase, usage.residentCount,
+				(usage.anonKb - initialAnonKb) / 1024.0, usage.fileKb / 1024.0, usage.maxRssKb / 1024.0);
+	}
+
+	int run(const BenchmarkOptions &options)
+	{
+		const size_t count = options.countOr(1000000);
+		const size_t drainCount = count / 10;
+		const string path = options.dir + "/data";
+
+		int resultPipe[2];
+		if (::pipe(resultPipe) != 0) {
+			perror("pipe");
+			return 1;
+		}
+		// The data file is written by a child process so that this process stays small for the cases to fork.
+		if (!runInChild([&](int) { return writeBenchJournal(path, count); }, resultPipe[1])) {
+			fprintf(stderr, "Unable to write the file %s.\n", path.c_str());
+			return 1;
+		}
+
+		printf("%zu pending scrobbles (%.1f MiB), %zu completed after loading\n", count,
+				benchFileSize(path) / 1048576.0, drainCount);
+		printf("%-16s %-10s %10s %12s %12s %12s\n", "limit", "", "resident", "+anon, MiB", "file, MiB",
+				"peak, MiB");
+		int status = 0;
+		for (const bool allResident : {false, true}) {
+			::unlink((path + ".cursor").c_str());
+			Report report;
+			const bool measured = runInChild([&](const int resultFd)
+			{
+				const Report report = measure(path, count, drainCount, allResident);
+				return writeFully(resultFd, reinterpret_cast<const char *>(&report), sizeof(report)) &&
+						report.succeeded;
+			}, resultPipe[1]) && ::read(resultPipe[0], &report, sizeof(report)) == ssize_t(sizeof(report));
+			if (!measured) {
+				fprintf(stderr, "Unable to load and complete the pending scrobbles.\n");
+				return 1;
+			}
+
+			const char * const name = allResident ? "all resident" : "default";
+			printUsage(name, "loaded", report.initialAnonKb, report.loaded);
+			printUsage(name, "completed", report.initialAnonKb, report.drained);
+
+			const long growthKb = max(report.loaded.anonKb, report.drained.anonKb) - report.initialAnonKb;
+			if (!allResident && growthKb > maxWindowGrowthKb) {
+				printf("  the heap grows by more than %ld MiB with the default limit\n", maxWindowGrowthKb / 1024);
+				status = 1;
+			}
+		}
+		::close(resultPipe[0]);
+		::close(resultPipe[1]);
+		return status;
+	}
+
+	const Benchmark benchmark("rss", "memory taken by a large backlog with and without the limit of resident scrobbles",
+			&run);
+}
@@ -0,0 +1,108 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <SharedJournal.hpp>
+
+#include "BenchScrobbler.hpp"
+#include "Benchmark.hpp"
+
+using namespace std;
+
+/* Measures how converting a large data file of an older version to the shared journal at start
+ * scales with the number of parse threads. This is the path on which the data file is parsed in chunks
+ * in parallel. The time is from Scrobbler::start() until the pending scrobbles are loaded; it includes
+ * storing the scrobbles converted to the shared journal.
+ */
+namespace
+{
+	struct Format
+	{
+		const char *name;
+		bool (*write)(const string &path, size_t count);
+	};
+
+	bool writeJournal(const string &path, const size_t count) { return writeBenchJournal(path, count); }
+
+	const Format formats[] = {{"journal", &writeJournal}, {"JSON lines", &writeBenchJsonLines}};
+
+	int run(const BenchmarkOptions &options)
+	{
+		const vector<size_t> counts = options.count == 0 ? vector<size_t>{100000, 1000000} :
+				vector<size_t>{options.count};
+		vector<unsigned> threadCounts = {1, 2, 4};
+		for (unsigned n = 8; n <= thread::hardware_concurrency(); n *= 2) {
+			threadCounts.push_back(n);
+		}
+		const string legacyPath = options.dir + "/legacy";
+		const string sharedPath = options.dir + "/shared";
+
+		printf("%u hardware threads, best of %u runs\n", thread::hardware_concurrency(), options.runs);
+		printf("%-12s %10s %10s %8s %12s %8s\n", "data file", "scrobbles", "size, MiB", "threads", "convert, ms",
+				"speedup");
+		int status = 0;
+		for (const Format &format : formats) {
+			for (const size_t count : counts) {
+				double baseTime = 0;
+				for (const unsigned threadCount : threadCounts) {
+					double convertTime = 0;
+					size_t size = 0;
+					for (unsigned i = 0; i < options.runs; ++i) {
+						::unlink(sharedPath.c_str());
+						::unlink((sharedPath + ".cursor").c_str());
+						if (!format.write(legacyPath, count)) {
+							fprintf(stderr, "Unable to write the file %s.\n", legacyPath.c_str());
+							return 1;
+						}
+						size = benchFileSize(legacyPath);
+
+						SharedJournal journal(toString(sharedPath));
+						BenchScrobbler scrobbler(legacyPath);
+						scrobbler.setJournal(&journal, 0);
+						scrobbler.setMaxParseThreads(threadCount);
+						const BenchClock::time_point start = BenchClock::now();
+						const bool loaded = scrobbler.start() && scrobbler.waitForLoad();
+						const double runTime = millisSince(start);
+						const size_t residentCount = loaded ? scrobbler.residentCount() : 0;
+						scrobbler.stop();
+
+						if (residentCount != min(count, BenchScrobbler::defaultResidentScrobbleLimit)) {
+							printf("  %s: %zu scrobbles are resident after the conversion\n", format.name,
+									residentCount);
+							status = 1;
+						}
+						convertTime = i == 0 ? runTime : min(convertTime, runTime);
+					}
+					if (threadCount == 1) {
+						baseTime = convertTime;
+					}
+					printf("%-12s %10zu %10.1f %8u %12.1f %8.2f\n", format.name, count, size / 1048576.0,
+							threadCount, convertTime, baseTime / convertTime);
+					fflush(stdout);
+				}
+			}
+		}
+		return status;
+	}
+
+	const Benchmark benchmark("scaling", "parsing a large data file of an older version by 1-N threads", &run);
+}
@@ -0,0 +1,108 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <SharedJournal.hpp>
+
+#include "BenchScrobbler.hpp"
+#include "Benchmark.hpp"
+
+using namespace std;
+
+/* Measures storing a backlog of unstored scrobbles at once, as Scrobbler::stop() does, and loading
+ * it back at start. Encoding is SharedJournal::append() of all the scrobbles, which encodes large appends
+ * on the pool of the journal; storing is that and SharedJournal::sync(), i.e. until the records are written
+ * with writev() and synced. The journal writer may start writing before append() returns. Loading is
+ * the time from Scrobbler::start() until the pending scrobbles are loaded, with all of them resident.
+ */
+namespace
+{
+	int run(const BenchmarkOptions &options)
+	{
+		const vector<size_t> counts = options.count == 0 ? vector<size_t>{10000, 100000, 1000000} :
+				vector<size_t>{options.count};
+		const string path = options.dir + "/data";
+
+		printf("%u hardware threads, best of %u runs\n", thread::hardware_concurrency(), options.runs);
+		printf("%10s %10s %10s %10s %12s %10s %12s\n", "scrobbles", "size, MiB", "encode, ms", "store, ms",
+				"store, k/s", "load, ms", "load, k/s");
+		int status = 0;
+		for (const size_t count : counts) {
+			deque<ScrobbleInfo> scrobbles;
+			for (size_t i = 0; i < count; ++i) {
+				scrobbles.push_back(benchScrobble(i));
+			}
+
+			double encodeTime = 0, storeTime = 0, loadTime = 0;
+			size_t size = 0, residentCount = 0;
+			for (unsigned i = 0; i < options.runs; ++i) {
+				::unlink(path.c_str());
+				::unlink((path + ".cursor").c_str());
+
+				{
+					SharedJournal journal(toString(path));
+					unique_lock<mutex> lock = journal.lock();
+					if (!journal.attach(0)) {
+						fprintf(stderr, "Unable to open the file %s.\n", path.c_str());
+						return 1;
+					}
+					const BenchClock::time_point start = BenchClock::now();
+					journal.append(0, scrobbles.cbegin(), scrobbles.cend(), true, false);
+					const double encodeRunTime = millisSince(start);
+					const bool written = journal.sync();
+					const double storeRunTime = millisSince(start);
+					journal.detach(0);
+					if (!written) {
+						fprintf(stderr, "Unable to write the file %s.\n", path.c_str());
+						return 1;
+					}
+
+					encodeTime = i == 0 ? encodeRunTime : min(encodeTime, encodeRunTime);
+					storeTime = i == 0 ? storeRunTime : min(storeTime, storeRunTime);
+				}
+				size = benchFileSize(path);
+
+				BenchScrobbler scrobbler(path);
+				scrobbler.setResidentScrobbleLimit(count);
+				const BenchClock::time_point start = BenchClock::now();
+				const bool loaded = scrobbler.start() && scrobbler.waitForLoad();
+				const double loadRunTime = millisSince(start);
+				residentCount = loaded ? scrobbler.residentCount() : 0;
+				scrobbler.stop();
+
+				loadTime = i == 0 ? loadRunTime : min(loadTime, loadRunTime);
+			}
+
+			printf("%10zu %10.1f %10.1f %10.1f %12.0f %10.1f %12.0f\n", count, size / 1048576.0, encodeTime,
+					storeTime, count / storeTime, loadTime, count / loadTime);
+			fflush(stdout);
+			if (residentCount != count) {
+				printf("  only %zu scrobbles of %zu are loaded\n", residentCount, count);
+				status = 1;
+			}
+		}
+		return status;
+	}
+
+	const Benchmark benchmark("store", "storing a backlog of 10k-1M scrobbles at once and loading it back", &run);
+}
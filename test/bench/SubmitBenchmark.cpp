@@ -0,0 +1,130 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include <LastfmScrobbler.hpp>
+#include <SharedJournal.hpp>
+#include <scrobbler_plugin.hpp>
+
+#include "Benchmark.hpp"
+#include "HttpStub.hpp"
+
+using namespace std;
+
+/* Measures how fast a backlog of pending scrobbles is submitted to a local stand-in for the Last.fm
+ * submission service (the Audioscrobbler protocol 1.2), as `scrobblectl submit --backend lastfm` does,
+ * with the stand-in responding at once and with a delay that stands for the round trip to the service.
+ *
+ * The Gravifon backend is not measured: GravifonScrobbler does not complete scrobbles with any
+ * response at the moment.
+ */
+namespace
+{
+	constexpr unsigned latenciesMillis[] = {0, 20};
+
+	// Counts the scrobbles submitted. Each one starts with the parameter a[<index>] in the form.
+	size_t scrobbleCount(const string &body)
+	{
+		size_t count = 0;
+		for (size_t pos = body.find("&a%5b"); pos != string::npos; pos = body.find("&a%5b", pos + 1)) {
+			++count;
+		}
+		return count;
+	}
+
+	bool submit(const string &path, const size_t count, const unsigned latencyMillis, double &submitTime,
+			size_t &requestCount)
+	{
+		atomic<size_t> receivedCount(0);
+		string url;
+		HttpStub stub([&](const string &requestLine, const string &body) -> string
+		{
+			if (requestLine.compare(0, 4, "GET ") == 0) {
+				return "OK\nbench-session\n" + url + "np\n" + url + "submission\n";
+			}
+			receivedCount.fetch_add(scrobbleCount(body), memory_order_relaxed);
+			return "OK\n";
+		}, chrono::milliseconds(latencyMillis));
+		if (!stub.start()) {
+			fprintf(stderr, "Unable to start the stand-in server.\n");
+			return false;
+		}
+		url = stub.url();
+
+		::unlink((path + ".cursor").c_str());
+		if (!writeBenchJournal(path, count)) {
+			fprintf(stderr, "Unable to write the file %s.\n", path.c_str());
+			return false;
+		}
+		SharedJournal journal(toString(path));
+		LastfmScrobbler client;
+		client.configure(url.data(), url.size(), "bench", "bench");
+		client.setJournal(&journal, lastfmJournalConsumer);
+		if (!client.start() || !client.waitForLoad()) {
+			fprintf(stderr, "Unable to load the scrobbles of the data file %s.\n", path.c_str());
+			client.stop();
+			return false;
+		}
+
+		const BenchClock::time_point start = BenchClock::now();
+		const BenchClock::time_point deadline = start + chrono::minutes(5);
+		while (!client.drained() && BenchClock::now() < deadline) {
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		submitTime = millisSince(start);
+		const size_t completedCount = client.completedCount();
+		client.stop();
+		requestCount = stub.requestCount();
+
+		if (completedCount != count || receivedCount.load() != count) {
+			printf("  %zu scrobbles completed, %zu received, %zu expected\n", completedCount, receivedCount.load(),
+					count);
+			return false;
+		}
+		return true;
+	}
+
+	int run(const BenchmarkOptions &options)
+	{
+		const size_t count = options.countOr(10000);
+		const string path = options.dir + "/data";
+
+		printf("%zu pending scrobbles, Last.fm, best of %u runs\n", count, options.runs);
+		printf("%-12s %10s %12s %12s\n", "latency, ms", "requests", "submit, ms", "records/s");
+		for (const unsigned latency : latenciesMillis) {
+			double submitTime = 0;
+			size_t requestCount = 0;
+			for (unsigned i = 0; i < options.runs; ++i) {
+				double runTime;
+				if (!submit(path, count, latency, runTime, requestCount)) {
+					return 1;
+				}
+				submitTime = i == 0 ? runTime : min(submitTime, runTime);
+			}
+			printf("%-12u %10zu %12.1f %12.0f\n", latency, requestCount, submitTime, count / submitTime * 1000);
+		}
+		return 0;
+	}
+
+	const Benchmark benchmark("submit", "submitting a backlog to a local stand-in for Last.fm", &run);
+}
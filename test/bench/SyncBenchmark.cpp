@@ -0,0 +1,174 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <afc/FastStringBuffer.hpp>
+#include <JournalWriter.hpp>
+#include <ScrobbleJournal.hpp>
+#include <fileutil.hpp>
+
+#include "Benchmark.hpp"
+
+using namespace std;
+
+/* Measures the cost of syncing the data file to the storage device: the latency of appending
+ * a single scrobble record until it is written (and synced if requested), and the latency of
+ * re-writing the data file atomically (a temporary file, fdatasync, rename, directory fsync)
+ * against truncating and writing it in place without syncing, as the older versions did.
+ */
+namespace
+{
+	void appendRecord(const size_t index, afc::FastStringBuffer<char> &dest)
+	{
+		appendJournalRecord(benchScrobble(index), dest);
+	}
+
+	bool appendLatency(const string &path, const size_t count, const bool sync, Samples &samples)
+	{
+		afc::FastStringBuffer<char> header;
+		appendJournalHeader(newJournalFileId(), header);
+		if (!writeBenchFile(path, header.c_str(), header.size())) {
+			return false;
+		}
+		uint64_t offset = header.size();
+
+		JournalWriter writer;
+		writer.start(toString(path));
+		for (size_t i = 0; i < count; ++i) {
+			afc::FastStringBuffer<char> record;
+			appendRecord(i, record);
+			const size_t size = record.size();
+
+			const BenchClock::time_point start = BenchClock::now();
+			writer.append(move(record), offset, sync);
+			writer.flush();
+			samples.add(millisSince(start));
+
+			offset += size;
+		}
+		writer.stop();
+		return !writer.takeFailure() && benchFileSize(path) == offset;
+	}
+
+	// The baseline for a synced append: write() and fdatasync() called directly.
+	bool directAppendLatency(const string &path, const size_t count, Samples &samples)
+	{
+		const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0664);
+		if (fd == -1) {
+			return false;
+		}
+		bool written = true;
+		for (size_t i = 0; i < count && written; ++i) {
+			afc::FastStringBuffer<char> record;
+			appendRecord(i, record);
+
+			const BenchClock::time_point start = BenchClock::now();
+			written = writeFully(fd, record.c_str(), record.size()) && ::fdatasync(fd) == 0;
+			samples.add(millisSince(start));
+		}
+		return ::close(fd) == 0 && written;
+	}
+
+	void buildJournal(const size_t count, afc::FastStringBuffer<char> &dest)
+	{
+		appendJournalHeader(newJournalFileId(), dest);
+		for (size_t i = 0; i < count; ++i) {
+			appendRecord(i, dest);
+		}
+	}
+
+	bool rewriteLatency(const string &path, const size_t count, const unsigned runs, Samples &samples)
+	{
+		JournalWriter writer;
+		writer.start(toString(path));
+		size_t size = 0;
+		for (unsigned i = 0; i < runs; ++i) {
+			afc::FastStringBuffer<char> journal;
+			buildJournal(count, journal);
+			size = journal.size();
+
+			const BenchClock::time_point start = BenchClock::now();
+			writer.rewrite(move(journal));
+			writer.flush();
+			samples.add(millisSince(start));
+		}
+		writer.stop();
+		return !writer.takeFailure() && benchFileSize(path) == size;
+	}
+
+	bool inPlaceWriteLatency(const string &path, const size_t count, const unsigned runs, Samples &samples)
+	{
+		for (unsigned i = 0; i < runs; ++i) {
+			afc::FastStringBuffer<char> journal;
+			buildJournal(count, journal);
+
+			const BenchClock::time_point start = BenchClock::now();
+			const bool written = writeBenchFile(path, journal.c_str(), journal.size());
+			samples.add(millisSince(start));
+			if (!written) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void printSamples(const char * const name, const Samples &samples)
+	{
+		printf("%-28s %10.3f %10.3f %10.3f\n", name, samples.percentile(0.5), samples.percentile(0.99),
+				samples.percentile(1));
+	}
+
+	int run(const BenchmarkOptions &options)
+	{
+		const size_t appendCount = options.countOr(1000);
+		const string path = options.dir + "/data";
+
+		printf("appending %zu scrobbles one by one\n", appendCount);
+		printf("%-28s %10s %10s %10s\n", "append", "p50, ms", "p99, ms", "max, ms");
+		Samples unsynced, synced, direct;
+		if (!appendLatency(path, appendCount, false, unsynced) || !appendLatency(path, appendCount, true, synced) ||
+				!directAppendLatency(path, appendCount, direct)) {
+			fprintf(stderr, "Unable to append to the file %s.\n", path.c_str());
+			return 1;
+		}
+		printSamples("journal writer, no sync", unsynced);
+		printSamples("journal writer, sync", synced);
+		printSamples("write + fdatasync", direct);
+
+		printf("\nre-writing the data file, %u runs\n", options.runs);
+		printf("%-28s %10s %12s %10s\n", "scrobbles", "atomic, ms", "in place, ms", "ratio");
+		for (const size_t count : {size_t(1000), size_t(10000), size_t(100000)}) {
+			Samples atomic, inPlace;
+			if (!rewriteLatency(path, count, options.runs, atomic) ||
+					!inPlaceWriteLatency(path, count, options.runs, inPlace)) {
+				fprintf(stderr, "Unable to re-write the file %s.\n", path.c_str());
+				return 1;
+			}
+			printf("%-28zu %10.2f %12.2f %10.1f\n", count, atomic.percentile(0.5), inPlace.percentile(0.5),
+					atomic.percentile(0.5) / inPlace.percentile(0.5));
+		}
+		return 0;
+	}
+
+	const Benchmark benchmark("sync", "syncing appends and atomic re-writes of the data file", &run);
+}
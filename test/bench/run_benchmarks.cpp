@@ -0,0 +1,135 @@
+/* gravifon_scrobbler - an audio track scrobbler to Gravifon plugin to the audio player DeaDBeeF.
+Copyright (C) 2026 Dźmitry Laŭčuk
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Benchmark.hpp"
+
+using namespace std;
+
+namespace
+{
+	const char usage[] =
+		"Usage: benchmarks [options] <benchmark>... | all | list\n"
+		"Options:\n"
+		"  --count <n>  the number of scrobbles each benchmark works with instead of its default\n"
+		"  --runs <n>   the number of times each measurement is repeated (3 by default)\n"
+		"  --dir <dir>  the directory the temporary data files are created in (the current one\n"
+		"               by default). The syncing benchmarks are meaningless on tmpfs.\n";
+
+	bool parseArguments(const int argc, char ** const argv, BenchmarkOptions &options, vector<const char *> &names)
+	{
+		options.count = 0;
+		options.runs = 3;
+		options.dir = ".";
+		for (int i = 1; i < argc; ++i) {
+			const char * const arg = argv[i];
+			if (strncmp(arg, "--", 2) != 0) {
+				names.push_back(arg);
+				continue;
+			}
+			if (i + 1 == argc) {
+				return false;
+			}
+			const char * const value = argv[++i];
+			if (strcmp(arg, "--count") == 0) {
+				options.count = strtoull(value, nullptr, 10);
+			} else if (strcmp(arg, "--runs") == 0) {
+				options.runs = unsigned(strtoul(value, nullptr, 10));
+			} else if (strcmp(arg, "--dir") == 0) {
+				options.dir = value;
+			} else {
+				return false;
+			}
+		}
+		return !names.empty() && options.runs != 0;
+	}
+
+	const Benchmark *findBenchmark(const char * const name)
+	{
+		for (const Benchmark * const benchmark : Benchmark::all()) {
+			if (strcmp(benchmark->name, name) == 0) {
+				return benchmark;
+			}
+		}
+		return nullptr;
+	}
+
+	// Runs a given benchmark in a directory of its own which is removed afterwards.
+	int run(const Benchmark &benchmark, const BenchmarkOptions &options)
+	{
+		string dir = options.dir + "/bench-" + benchmark.name + "-XXXXXX";
+		if (::mkdtemp(&dir[0]) == nullptr) {
+			fprintf(stderr, "Unable to create a directory in %s.\n", options.dir.c_str());
+			return 1;
+		}
+		BenchmarkOptions benchmarkOptions(options);
+		benchmarkOptions.dir = dir;
+
+		printf("== %s: %s\n", benchmark.name, benchmark.summary);
+		fflush(stdout);
+		const int status = benchmark.function(benchmarkOptions);
+		removeBenchDir(dir);
+		if (status != 0) {
+			printf("%s FAILED\n", benchmark.name);
+		}
+		printf("\n");
+		fflush(stdout);
+		return status;
+	}
+}
+
+int main(const int argc, char ** const argv)
+{
+	BenchmarkOptions options;
+	vector<const char *> names;
+	if (!parseArguments(argc, argv, options, names)) {
+		fputs(usage, stderr);
+		return 2;
+	}
+
+	if (names.size() == 1 && strcmp(names[0], "list") == 0) {
+		for (const Benchmark * const benchmark : Benchmark::all()) {
+			printf("%-16s %s\n", benchmark->name, benchmark->summary);
+		}
+		return 0;
+	}
+
+	vector<const Benchmark *> benchmarks;
+	if (names.size() == 1 && strcmp(names[0], "all") == 0) {
+		benchmarks = Benchmark::all();
+	} else {
+		for (const char * const name : names) {
+			const Benchmark * const benchmark = findBenchmark(name);
+			if (benchmark == nullptr) {
+				fprintf(stderr, "Unknown benchmark: %s.\n", name);
+				return 2;
+			}
+			benchmarks.push_back(benchmark);
+		}
+	}
+
+	int status = 0;
+	for (const Benchmark * const benchmark : benchmarks) {
+		if (run(*benchmark, options) != 0) {
+			status = 1;
+		}
+	}
+	return status;
+}